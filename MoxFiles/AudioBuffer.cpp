@@ -10,6 +10,7 @@
 #include <MoxFiles/AudioBuffer.h>
 
 #include <MoxFiles/Thread.h>
+#include <MoxFiles/BufferPool.h>
 
 #include <MoxMxf/Exception.h>
 
@@ -755,7 +756,7 @@ MakeAudioBufferType(const AudioBuffer &buffer, SampleType type)
 		const ptrdiff_t stride = SampleSize(type);
 		const size_t channel_data_size = stride * length;
 
-		DataChunkPtr chan_data = new DataChunk(channel_data_size);
+		DataChunkPtr chan_data = new PooledDataChunk(channel_data_size);
 		
 		dest_buf->insert(name.text(), AudioSlice(type, (char *)chan_data->Data, stride));
 		
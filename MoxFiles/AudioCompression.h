@@ -15,6 +15,7 @@ namespace MoxFiles
 	enum AudioCompression
 	{
 		PCM = 0,	// uncompressed audio
+		FLAC,		// lossless, each frame's audio on its own
 		
 
 		NUM_AUDIO_COMPRESSION_METHODS	// number of different compression methods
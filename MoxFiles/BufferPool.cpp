@@ -0,0 +1,278 @@
+/*
+ *  BufferPool.cpp
+ *  MoxFiles
+ *
+ *  Created by agent on 10/18/26.
+ *  Copyright 2026 fnord. All rights reserved.
+ *
+ */
+
+#include <MoxFiles/BufferPool.h>
+
+#include <MoxMxf/Exception.h>
+
+#include <algorithm>
+#include <new>
+
+#include <assert.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+namespace MoxFiles
+{
+
+static const size_t HugePageSize = (2 * 1024 * 1024);
+
+
+BufferPool::BufferPool(size_t alignment, size_t maxCached) :
+	_alignment(alignment),
+	_max_cached(maxCached),
+	_huge_pages(false)
+{
+	if(alignment < sizeof(void *) || (alignment & (alignment - 1)) != 0)
+		throw MoxMxf::ArgExc("BufferPool alignment must be a power of 2");
+}
+
+
+BufferPool::~BufferPool()
+{
+	assert(_in_use.empty()); // somebody is still holding on to a block
+
+	trimLocked(0);
+}
+
+
+void *
+BufferPool::allocate(size_t size)
+{
+	const size_t block_size = sizeClass(size);
+
+	void *block = NULL;
+
+	{
+		Lock lock(_mutex);
+
+		_stats.allocations++;
+
+		FreeList::iterator list = _free.find(block_size);
+
+		if(list != _free.end() && !list->second.empty())
+		{
+			block = list->second.back();
+
+			list->second.pop_back();
+
+			_stats.reused++;
+			_stats.bytesCached -= block_size;
+			_stats.bytesInUse += block_size;
+
+			_in_use[block] = block_size;
+
+			return block;
+		}
+	}
+
+	block = systemAllocate(block_size);
+
+	{
+		Lock lock(_mutex);
+
+		_stats.systemAllocations++;
+		_stats.bytesInUse += block_size;
+		_stats.peakBytes = std::max(_stats.peakBytes, _stats.bytesInUse + _stats.bytesCached);
+
+		_in_use[block] = block_size;
+	}
+
+	return block;
+}
+
+
+void
+BufferPool::release(void *block)
+{
+	if(block == NULL)
+		return;
+
+	{
+		Lock lock(_mutex);
+
+		std::map<void *, size_t>::iterator found = _in_use.find(block);
+
+		if(found == _in_use.end())
+		{
+			assert(false); // not one of ours, and we may be in a destructor so don't throw
+			
+			return;
+		}
+
+		const size_t block_size = found->second;
+
+		_in_use.erase(found);
+
+		_stats.bytesInUse -= block_size;
+
+		if(_stats.bytesCached + block_size <= _max_cached)
+		{
+			_free[block_size].push_back(block);
+
+			_stats.bytesCached += block_size;
+
+			return;
+		}
+	}
+
+	systemFree(block);
+}
+
+
+void
+BufferPool::trim(size_t maxCached)
+{
+	Lock lock(_mutex);
+
+	trimLocked(maxCached);
+}
+
+
+void
+BufferPool::setMaxCached(size_t maxCached)
+{
+	Lock lock(_mutex);
+
+	_max_cached = maxCached;
+
+	trimLocked(maxCached);
+}
+
+
+BufferPool::Statistics
+BufferPool::statistics() const
+{
+	Lock lock(_mutex);
+
+	return _stats;
+}
+
+
+BufferPool &
+BufferPool::global()
+{
+	// never deleted, so buffers that outlive main() can still come back
+	static BufferPool *pool = new BufferPool;
+
+	return *pool;
+}
+
+
+size_t
+BufferPool::sizeClass(size_t size)
+{
+	// Small blocks go up in cache lines.  After that each power of 2 is
+	// split into 8 classes, so we never waste more than 12.5%.
+	if(size <= 4096)
+		return std::max<size_t>((size + 63) & ~(size_t)63, 64);
+
+	int high_bit = 0;
+
+	while((size >> (high_bit + 1)) != 0)
+		high_bit++;
+
+	const size_t step = ((size_t)1 << (high_bit - 3));
+
+	return ((size + step - 1) & ~(step - 1));
+}
+
+
+void *
+BufferPool::systemAllocate(size_t size) const
+{
+	size_t alignment = _alignment;
+
+#ifdef __linux__
+	if(_huge_pages && size >= HugePageSize)
+		alignment = std::max(alignment, HugePageSize);
+#endif
+
+	void *block = NULL;
+
+#ifdef _WIN32
+	block = _aligned_malloc(size, alignment);
+#else
+	if(posix_memalign(&block, alignment, size) != 0)
+		block = NULL;
+#endif
+
+	if(block == NULL)
+		throw std::bad_alloc();
+
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+	if(_huge_pages && size >= HugePageSize)
+		madvise(block, size, MADV_HUGEPAGE);
+#endif
+
+	return block;
+}
+
+
+void
+BufferPool::systemFree(void *block)
+{
+#ifdef _WIN32
+	_aligned_free(block);
+#else
+	free(block);
+#endif
+}
+
+
+void
+BufferPool::trimLocked(size_t maxCached)
+{
+	// biggest blocks go first
+	for(FreeList::reverse_iterator list = _free.rbegin(); list != _free.rend() && _stats.bytesCached > maxCached; ++list)
+	{
+		std::vector<void *> &blocks = list->second;
+
+		while(!blocks.empty() && _stats.bytesCached > maxCached)
+		{
+			systemFree(blocks.back());
+
+			blocks.pop_back();
+
+			_stats.bytesCached -= list->first;
+		}
+	}
+}
+
+
+PooledDataChunk::PooledDataChunk(size_t size, BufferPool &pool) :
+	DataChunk(),
+	_pool(pool),
+	_block(pool.allocate(size)),
+	_capacity(BufferPool::sizeClass(size))
+{
+	Data = (UInt8 *)_block;
+	Size = size;
+}
+
+
+PooledDataChunk::~PooledDataChunk()
+{
+	assert(Data == _block); // was resized
+
+	// keep DataChunk from delete[]ing it
+	Data = NULL;
+	Size = 0;
+
+	_pool.release(_block);
+}
+
+} // namespace
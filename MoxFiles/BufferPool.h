@@ -0,0 +1,109 @@
+/*
+ *  BufferPool.h
+ *  MoxFiles
+ *
+ *  Created by agent on 10/18/26.
+ *  Copyright 2026 fnord. All rights reserved.
+ *
+ */
+
+#ifndef MOXFILES_BUFFERPOOL_H
+#define MOXFILES_BUFFERPOOL_H
+
+#include <MoxFiles/Types.h>
+#include <MoxFiles/Thread.h>
+
+#include <map>
+#include <vector>
+
+namespace MoxFiles
+{
+	// Recycles frame-sized blocks of memory.
+	//
+	// Every frame we read or write needs a few buffers that are exactly the
+	// same size as the ones for the last frame.  Rather than going back to
+	// malloc every time, freed blocks are kept around by size class and handed
+	// out again.  Blocks are aligned for SIMD (64 bytes by default), and big
+	// ones can be put on huge pages where the OS lets us.
+
+	class BufferPool
+	{
+	  public:
+		BufferPool(size_t alignment = 64, size_t maxCached = (512 * 1024 * 1024));
+		~BufferPool();
+
+		void * allocate(size_t size);
+		void release(void *block);
+
+		// Returns cached blocks to the system until no more than maxCached bytes are left.
+		void trim(size_t maxCached = 0);
+
+		// Freed blocks beyond this are returned to the system right away.
+		void setMaxCached(size_t maxCached);
+
+		// Align blocks of 2 MB or more to 2 MB and ask for transparent huge pages.
+		// Only does anything on Linux.
+		void setHugePages(bool hugePages) { _huge_pages = hugePages; }
+
+		struct Statistics
+		{
+			UInt64 allocations;		// calls to allocate()
+			UInt64 reused;			// ...that were served from the cache
+			UInt64 systemAllocations; // ...that had to go to the system
+			size_t bytesInUse;
+			size_t bytesCached;
+			size_t peakBytes;		// in use + cached
+
+			Statistics() : allocations(0), reused(0), systemAllocations(0), bytesInUse(0), bytesCached(0), peakBytes(0) {}
+		};
+
+		Statistics statistics() const;
+
+		// The pool everything in MoxFiles draws from.
+		static BufferPool & global();
+
+		// Size blocks are actually allocated at.
+		static size_t sizeClass(size_t size);
+
+	  private:
+		const size_t _alignment;
+		size_t _max_cached;
+		bool _huge_pages;
+
+		mutable Mutex _mutex;
+
+		typedef std::map<size_t, std::vector<void *> > FreeList;
+		FreeList _free;
+
+		std::map<void *, size_t> _in_use;
+
+		Statistics _stats;
+
+		void * systemAllocate(size_t size) const;
+		static void systemFree(void *block);
+
+		void trimLocked(size_t maxCached);
+	};
+
+
+	// A DataChunk whose memory comes from (and goes back to) the pool.
+	// Don't Resize() it, because mxflib would try to delete[] our block.
+	// Setting Size to anything up to capacity() is fine.
+
+	class PooledDataChunk : public DataChunk
+	{
+	  public:
+		PooledDataChunk(size_t size, BufferPool &pool = BufferPool::global());
+		virtual ~PooledDataChunk();
+
+		size_t capacity() const { return _capacity; }
+
+	  private:
+		BufferPool &_pool;
+		void * const _block;
+		const size_t _capacity;
+	};
+
+} // namespace
+
+#endif // MOXFILES_BUFFERPOOL_H
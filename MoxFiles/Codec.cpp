@@ -19,8 +19,11 @@
 #include <MoxFiles/OpenEXRCodec.h>
 #include <MoxFiles/DiracCodec.h>
 #include <MoxFiles/MPEGCodec.h>
+#include <MoxFiles/UncompressedCDCICodec.h>
+#include <MoxFiles/PlanarCodec.h>
 
 #include <MoxFiles/UncompressedPCMCodec.h>
+#include <MoxFiles/FLACCodec.h>
 
 
 namespace MoxFiles
@@ -110,6 +113,15 @@ VideoCodec::sampledWindow() const
 
 DataChunkPtr
 VideoCodec::getNextData()
+{
+	int keyOffset = 0, temporalOffset = 0, flags = -1;
+	
+	return getNextData(keyOffset, temporalOffset, flags);
+}
+
+
+DataChunkPtr
+VideoCodec::getNextData(int &keyOffset, int &temporalOffset, int &flags)
 {
 	DataChunkPtr dat;
 	
@@ -117,7 +129,14 @@ VideoCodec::getNextData()
 	{
 		dat = _data_queue.front();
 		
+		const IndexEntry &entry = _index_queue.front();
+		
+		keyOffset = entry.keyOffset;
+		temporalOffset = entry.temporalOffset;
+		flags = entry.flags;
+		
 		_data_queue.pop();
+		_index_queue.pop();
 	}
 	
 	return dat;
@@ -140,10 +159,77 @@ VideoCodec::getNextFrame()
 }
 
 
+bool
+VideoCodec::decompressInto(const DataChunk &data, FrameBuffer &frameBuffer)
+{
+	decompress(data);
+	
+	FrameBufferPtr decompressed_frame = getNextFrame();
+	
+	if(decompressed_frame)
+	{
+		frameBuffer.copyFromFrame(*decompressed_frame);
+		
+		return true;
+	}
+	
+	return false;
+}
+
+
+bool
+VideoCodec::decompressReduced(const DataChunk &data, FrameBuffer &frameBuffer, int resolutionFactor)
+{
+	if(resolutionFactor == 1)
+		return decompressInto(data, frameBuffer);
+	
+	decompress(data);
+	
+	FrameBufferPtr decompressed_frame = getNextFrame();
+	
+	if(decompressed_frame)
+	{
+		frameBuffer.reduceFromFrame(*decompressed_frame, resolutionFactor);
+		
+		return true;
+	}
+	
+	return false;
+}
+
+
+bool
+VideoCodec::decompressRegion(const DataChunk &data, FrameBuffer &frameBuffer, const Box2i &region)
+{
+	decompress(data);
+	
+	FrameBufferPtr decompressed_frame = getNextFrame();
+	
+	if(decompressed_frame)
+	{
+		FrameBuffer region_view(frameBuffer, region);
+		
+		region_view.copyFromFrame(*decompressed_frame);
+		
+		return true;
+	}
+	
+	return false;
+}
+
+
 void
 VideoCodec::storeData(DataChunkPtr dat)
+{
+	storeData(dat, 0, 0, -1);
+}
+
+
+void
+VideoCodec::storeData(DataChunkPtr dat, int keyOffset, int temporalOffset, int flags)
 {
 	_data_queue.push(dat);
+	_index_queue.push( IndexEntry(keyOffset, temporalOffset, flags) );
 }
 
 
@@ -367,6 +453,128 @@ VideoCodecListStorage::~VideoCodecListStorage()
 }
 
 
+bool
+VideoCodec::canFillFrame(const FrameBuffer &frameBuffer, const ChannelList &channels, int resolutionFactor) const
+{
+	if(frameBuffer.dataWindow() != ReducedWindow(dataWindow(), resolutionFactor))
+		return false;
+	
+	return matchesChannels(frameBuffer, channels);
+}
+
+
+bool
+VideoCodec::matchesChannels(const FrameBuffer &frameBuffer, const ChannelList &channels) const
+{
+	return (subsetOfChannels(frameBuffer, channels) && frameBuffer.size() == channels.size());
+}
+
+
+bool
+VideoCodec::subsetOfChannels(const FrameBuffer &frameBuffer, const ChannelList &channels) const
+{
+	for(FrameBuffer::ConstIterator i = frameBuffer.begin(); i != frameBuffer.end(); ++i)
+	{
+		const Channel *chan = channels.findChannel(i.name());
+		const Slice &slice = i.slice();
+		
+		if(chan == NULL || chan->type != slice.type || slice.xSampling != 1 || slice.ySampling != 1)
+			return false;
+	}
+	
+	return true;
+}
+
+
+static bool
+IsColorChannel(const std::string &name)
+{
+	return (name == "R" || name == "G" || name == "B" || name == "Y" || name == "Cb" || name == "Cr");
+}
+
+
+bool
+VideoCodec::channelWanted(const FrameBuffer &frameBuffer, const std::string &name)
+{
+	if(frameBuffer.findSlice(name) != NULL)
+		return true;
+	
+	// copyFromFrame() may need it to convert between RGB and Y'CbCr
+	if( IsColorChannel(name) )
+	{
+		for(FrameBuffer::ConstIterator i = frameBuffer.begin(); i != frameBuffer.end(); ++i)
+		{
+			if( IsColorChannel(i.name()) )
+				return true;
+		}
+	}
+	
+	return false;
+}
+
+
+ChannelList
+VideoCodec::wantedChannels(const FrameBuffer &frameBuffer, const ChannelList &channels)
+{
+	ChannelList wanted;
+	
+	for(ChannelList::ConstIterator i = channels.begin(); i != channels.end(); ++i)
+	{
+		if( channelWanted(frameBuffer, i.name()) )
+			wanted.insert(i.name(), i.channel());
+	}
+	
+	return wanted;
+}
+
+
+char *
+VideoCodec::interleavedRows(const FrameBuffer &frameBuffer, const std::vector<std::string> &channels, PixelType type, ptrdiff_t &rowbytes, int resolutionFactor) const
+{
+	ChannelList chans;
+	
+	for(std::vector<std::string>::const_iterator i = channels.begin(); i != channels.end(); ++i)
+		chans.insert(*i, Channel(type));
+	
+	if(channels.empty() || !canFillFrame(frameBuffer, chans, resolutionFactor))
+		return NULL;
+	
+	const ptrdiff_t sample_size = PixelSize(type);
+	const ptrdiff_t pixel_size = sample_size * channels.size();
+	
+	const Slice &first = frameBuffer[channels[0]];
+	
+	for(int i = 0; i < channels.size(); i++)
+	{
+		const Slice &slice = frameBuffer[channels[i]];
+		
+		if(slice.xStride != pixel_size || slice.yStride != first.yStride || slice.base != first.base + (i * sample_size))
+			return NULL;
+	}
+	
+	const Box2i dw = frameBuffer.dataWindow();
+	
+	rowbytes = first.yStride;
+	
+	return (first.base + (dw.min.y * first.yStride) + (dw.min.x * first.xStride));
+}
+
+
+char *
+VideoCodec::stagingBuffer(size_t size, unsigned int index)
+{
+	if(index >= _staging.size())
+		_staging.resize(index + 1);
+	
+	DataChunkPtr &chunk = _staging[index];
+	
+	if(!chunk || chunk->Size < size)
+		chunk = new PooledDataChunk(size);
+	
+	return (char *)chunk->Data;
+}
+
+
 const VideoCodecInfo &
 getVideoCodecInfo(VideoCompression videoCompression)
 {
@@ -386,6 +594,8 @@ getVideoCodecInfo(VideoCompression videoCompression)
 		codecList[OPENEXR] = new OpenEXRCodecInfo;
 		codecList[DIRAC] = new DiracCodecInfo;
 		codecList[MPEG] = new MPEGCodecInfo;
+		codecList[UNCOMPRESSED_CDCI] = new UncompressedCDCICodecInfo;
+		codecList[PLANAR] = new PlanarCodecInfo;
 	}
 	
 	if(codecList.find(videoCompression) == codecList.end())
@@ -438,6 +648,14 @@ getVideoCodecInfo(MoxMxf::VideoDescriptor::VideoCodec codec)
 	{
 		return getVideoCodecInfo(MPEG);
 	}
+	else if(codec == MoxMxf::VideoDescriptor::VideoCodecUncompressedCDCI)
+	{
+		return getVideoCodecInfo(UNCOMPRESSED_CDCI);
+	}
+	else if(codec == MoxMxf::VideoDescriptor::VideoCodecPlanar)
+	{
+		return getVideoCodecInfo(PLANAR);
+	}
 	
 	throw MoxMxf::InputExc("Unknown video codec");
 }
@@ -475,6 +693,27 @@ AudioCodec::getNextBuffer()
 }
 
 
+bool
+AudioCodec::decompressInto(const DataChunk &data, AudioBuffer &audioBuffer, UInt64 start, UInt64 samples)
+{
+	decompress(data);
+	
+	AudioBufferPtr decompressed_audio = getNextBuffer();
+	
+	if(decompressed_audio)
+	{
+		if(start > 0)
+			decompressed_audio->fastForward(start);
+		
+		audioBuffer.copyFromBuffer(*decompressed_audio, samples);
+		
+		return true;
+	}
+	
+	return false;
+}
+
+
 void
 AudioCodec::storeData(DataChunkPtr dat)
 {
@@ -577,6 +816,7 @@ getAudioCodecInfo(AudioCompression audioCompression)
 	if( codecList.empty() )
 	{
 		codecList[PCM] = new UncompressedPCMCodecInfo;
+		codecList[FLAC] = new FLACCodecInfo;
 	}
 	
 	if(codecList.find(audioCompression) == codecList.end())
@@ -594,8 +834,34 @@ getAudioCodecInfo(MoxMxf::AudioDescriptor::AudioCodec codec)
 	{
 		return getAudioCodecInfo(PCM);
 	}
+	else if(codec == MoxMxf::AudioDescriptor::AudioCodecFLAC)
+	{
+		return getAudioCodecInfo(FLAC);
+	}
 	
-	throw MoxMxf::InputExc("Unknown video codec");
+	throw MoxMxf::InputExc("Unknown audio codec");
+}
+
+
+UInt64
+AudioSamplesInFrame(const Rational &frameRate, const Rational &sampleRate, UInt64 frame)
+{
+	const bool uniform_audio_frames = (sampleRate.Numerator * frameRate.Denominator) % (sampleRate.Denominator * frameRate.Numerator) == 0;
+	
+	if(uniform_audio_frames)
+	{
+		return (sampleRate.Numerator * frameRate.Denominator) / (sampleRate.Denominator * frameRate.Numerator);
+	}
+	else
+	{
+		const double samples_per_frame = (double)(sampleRate.Numerator * frameRate.Denominator) / (double)(sampleRate.Denominator * frameRate.Numerator);
+		
+		const UInt64 samples_so_far = ((double)frame * samples_per_frame) + 0.5;
+		
+		const UInt64 samples_post_frame = ((double)(frame + 1) * samples_per_frame) + 0.5;
+		
+		return (samples_post_frame - samples_so_far);
+	}
 }
 
 
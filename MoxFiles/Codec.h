@@ -14,10 +14,12 @@
 //#include <MoxFiles/Types.h>
 #include <MoxFiles/FrameBuffer.h>
 #include <MoxFiles/AudioBuffer.h>
+#include <MoxFiles/BufferPool.h>
 
 #include <MoxMxf/Descriptor.h>
 
 #include <queue>
+#include <vector>
 
 namespace MoxFiles
 {
@@ -49,10 +51,44 @@ namespace MoxFiles
 		virtual void compress(const FrameBuffer &frame) = 0;
 		virtual DataChunkPtr getNextData();
 		
+		// Same, plus what goes in the MXF index for it.  Inter-frame codecs give the
+		// (negative) offset back to the key frame it needs, the offset from display
+		// to stored order, and the index entry flags.  Otherwise it's 0, 0, -1.
+		DataChunkPtr getNextData(int &keyOffset, int &temporalOffset, int &flags);
+		
+		// True if compress() will take slices of any type and stride, filling in
+		// missing channels, because it converts while staging the frame anyway.
+		// Otherwise the caller must hand it exactly the channels and types it asked for.
+		virtual bool convertsInput() const { return false; }
+		
 		virtual void decompress(const DataChunk &data) = 0;
 		virtual FrameBufferPtr getNextFrame();
 		
+		// Decompress right into the caller's FrameBuffer, skipping the extra frame copy
+		// when the codec can write its slices directly.  The default calls decompress()
+		// and copies.  Returns false if no frame came out (codecs with a delay).
+		virtual bool decompressInto(const DataChunk &data, FrameBuffer &frameBuffer);
+		
+		// Same, but for a proxy 1/resolutionFactor the size (2, 4, 8), so the FrameBuffer
+		// should have ReducedWindow(dataWindow(), resolutionFactor).  The default decodes
+		// the full frame and box filters it, codecs that can decode smaller should.
+		virtual bool decompressReduced(const DataChunk &data, FrameBuffer &frameBuffer, int resolutionFactor);
+		
+		// Decompress only the pixels inside region (which is inside our data window and
+		// the FrameBuffer's), leaving the rest of the FrameBuffer alone.  The default
+		// decodes the whole frame and copies the region out of it.
+		virtual bool decompressRegion(const DataChunk &data, FrameBuffer &frameBuffer, const Box2i &region);
+		
 		virtual void end_of_stream() {}  // i.e. no more pixels/data
+		
+		// Codecs whose frames are stored out of display order (MPEG-2 B pictures).
+		// InputFile calls startStream() with the stored position of a key frame,
+		// then hands over the frames after it in stored order.  Frames come back
+		// out of getNextFrame() in display order, and lastFrameNumber() says
+		// which display frame the last one was.
+		virtual bool reordersFrames() const { return false; }
+		virtual void startStream(int storedFrame) {}
+		virtual int lastFrameNumber() const { return -1; }
 
 	  public:
 		static bool isLossless(const Header &header);
@@ -65,13 +101,52 @@ namespace MoxFiles
 				
 	  protected:		
 		virtual void storeData(DataChunkPtr dat);
+		void storeData(DataChunkPtr dat, int keyOffset, int temporalOffset, int flags);
 		virtual void storeFrame(FrameBufferPtr frm);
 		
 		static void setWindows(MoxMxf::VideoDescriptor &descriptor, const Header &header);
 		
+		// For decompressInto(): does the FrameBuffer have exactly these channels, with the
+		// same types, unsampled, covering our (possibly reduced) data window?
+		bool canFillFrame(const FrameBuffer &frameBuffer, const ChannelList &channels, int resolutionFactor = 1) const;
+		
+		// Just the channel part of that, for when the FrameBuffer only gets a region.
+		bool matchesChannels(const FrameBuffer &frameBuffer, const ChannelList &channels) const;
+		
+		// Same, but the FrameBuffer may leave some of the channels out.
+		bool subsetOfChannels(const FrameBuffer &frameBuffer, const ChannelList &channels) const;
+		
+		// Callers often only want some of the channels (just "A", a few AOVs), so
+		// codecs that can skip the rest should.  A channel is wanted if there's a slice
+		// for it, or copyFromFrame() might use it for an RGB <-> Y'CbCr conversion.
+		static bool channelWanted(const FrameBuffer &frameBuffer, const std::string &name);
+		static ChannelList wantedChannels(const FrameBuffer &frameBuffer, const ChannelList &channels);
+		
+		// Same, plus the slices are interleaved in this order, so a library can write
+		// whole rows.  Returns the address of the first row, or NULL.
+		char * interleavedRows(const FrameBuffer &frameBuffer, const std::vector<std::string> &channels, PixelType type, ptrdiff_t &rowbytes, int resolutionFactor = 1) const;
+		
+		// Scratch memory for staging frames in compress().  It's kept between
+		// frames so we aren't allocating a whole image every time.  Anything
+		// still pointing into the last buffer at that index becomes invalid.
+		char * stagingBuffer(size_t size, unsigned int index = 0);
+		
 	  private:
 		std::queue<DataChunkPtr> _data_queue;
 		std::queue<FrameBufferPtr> _frame_queue;
+		
+		typedef struct IndexEntry
+		{
+			int keyOffset;
+			int temporalOffset;
+			int flags;
+			
+			IndexEntry(int k=0, int t=0, int f=-1) : keyOffset(k), temporalOffset(t), flags(f) {}
+		} IndexEntry;
+		
+		std::queue<IndexEntry> _index_queue; // goes along with _data_queue
+		
+		std::vector<DataChunkPtr> _staging;
 	};
 	
 
@@ -84,8 +159,9 @@ namespace MoxFiles
 		Channels_YA		= 1L << 3,
 		Channels_A		= 1L << 4,
 		Channels_Any	= 1L << 5, // i.e. a channel with some random name like
+		Channels_YCbCr	= 1L << 6, // "Y", "Cb", "Cr"
 		
-		Channels_All	= Channels_RGB | Channels_RGBA | Channels_Y | Channels_YA | Channels_A | Channels_Any
+		Channels_All	= Channels_RGB | Channels_RGBA | Channels_Y | Channels_YA | Channels_A | Channels_Any | Channels_YCbCr
 	};
 	
 	typedef UInt32 ChannelCapabilities;
@@ -124,10 +200,18 @@ namespace MoxFiles
 		virtual void compress(const AudioBuffer &audio) = 0;
 		virtual DataChunkPtr getNextData();
 		
-		virtual UInt64 samplesInFrame(size_t frame_size) = 0;
+		// Has to work without the data, so the sample index can be built
+		// when the file is opened.
+		virtual UInt64 samplesInFrame(UInt64 frame, size_t frame_size) = 0;
 		virtual void decompress(const DataChunk &data) = 0;
 		virtual AudioBufferPtr getNextBuffer();
 		
+		// Decompress samples start to start + samples of the frame right into the
+		// caller's AudioBuffer at its playheads, moving them ahead, skipping the
+		// extra buffer when the codec can.  The default calls decompress() and
+		// copies.  Returns false if no audio came out.
+		virtual bool decompressInto(const DataChunk &data, AudioBuffer &audioBuffer, UInt64 start, UInt64 samples);
+		
 		virtual void end_of_stream() {}
 		
 	  protected:		
@@ -172,6 +256,9 @@ namespace MoxFiles
 	
 	const AudioCodecInfo & getAudioCodecInfo(AudioCompression audioCompression);
 	const AudioCodecInfo & getAudioCodecInfo(MoxMxf::AudioDescriptor::AudioCodec audioCodec);
+	
+	// How OutputFile divides audio among the frames.
+	UInt64 AudioSamplesInFrame(const Rational &frameRate, const Rational &sampleRate, UInt64 frame);
 }
 
 #endif // MOXFILES_CODEC_H
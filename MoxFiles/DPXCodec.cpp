@@ -10,9 +10,15 @@
 #include <MoxFiles/DPXCodec.h>
 
 #include <MoxFiles/MemoryFile.h>
+#include <MoxFiles/Thread.h>
+#include <MoxFiles/SIMD.h>
 
 #include "DPX.h"
 
+#include <algorithm>
+
+#include <string.h>
+
 namespace MoxFiles
 {
 
@@ -159,38 +165,488 @@ DPXCodec_OutStream::Seek(long offset, Origin origin)
 }
 
 
+// Element data in filled method A, the way DPXCodec writes 10 and 12-bit frames:
+//
+//	10-bit	three samples to a 32-bit word, first one in bits 31-22, then 21-12
+//			and 11-2, carrying on from pixel to pixel, rows starting on a word
+//	12-bit	one sample to a 16-bit word, in bits 15-4
+//
+// Words are in the byte order of whoever wrote the file, which the magic number
+// tells us.  Frames come and go as interleaved 16-bit samples, either with the
+// actual 10 or 12-bit values or scaled to the full 16-bit range.
+
+static inline UInt32
+ByteSwap32(UInt32 v)
+{
+	return ((v >> 24) | ((v >> 8) & 0xff00) | ((v << 8) & 0xff0000) | (v << 24));
+}
+
+static inline UInt16
+ByteSwap16(UInt16 v)
+{
+	return ((v >> 8) | (v << 8));
+}
+
+#ifdef MOXFILES_SSE2
+static inline __m128i
+Swap32(__m128i v)
+{
+	v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1));
+	
+	return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
+
+static inline __m128i
+Swap16(__m128i v)
+{
+	return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
+#endif
+
+
+static inline UInt16
+Expand10(UInt32 v)
+{
+	return ((v << 6) | (v >> 4));
+}
+
+static inline UInt16
+Expand12(UInt32 v)
+{
+	return ((v << 4) | (v >> 8));
+}
+
+
+// count samples starting with sample number first in the row
+static void
+Unpack10Row(UInt16 *out, const UInt8 *row, size_t first, size_t count, bool swap, bool expand)
+{
+	const UInt8 *words = row + (4 * (first / 3));
+	
+	size_t i = (first % 3); // sample within the words
+	
+	const size_t end = i + count;
+
+#ifdef MOXFILES_SSE2
+	// whole words from here, four at a time
+	while(i % 3 != 0 && i < end)
+	{
+		UInt32 word;
+		
+		memcpy(&word, words + (4 * (i / 3)), 4);
+		
+		if(swap)
+			word = ByteSwap32(word);
+		
+		const UInt32 v = (word >> (22 - (10 * (i % 3)))) & 0x3ff;
+		
+		*out++ = (expand ? Expand10(v) : v);
+		
+		i++;
+	}
+	
+	const __m128i mask10 = _mm_set1_epi32(0x3ff);
+	
+	// Each word is stored as four samples, the last of which the next word
+	// overwrites, so this stops while there's still a sample after.
+	for(; i + 12 < end; i += 12)
+	{
+		__m128i w = _mm_loadu_si128((const __m128i *)(words + (4 * (i / 3))));
+		
+		if(swap)
+			w = Swap32(w);
+		
+		__m128i s0 = _mm_and_si128(_mm_srli_epi32(w, 22), mask10);
+		__m128i s1 = _mm_and_si128(_mm_srli_epi32(w, 12), mask10);
+		__m128i s2 = _mm_and_si128(_mm_srli_epi32(w, 2), mask10);
+		
+		if(expand)
+		{
+			s0 = _mm_or_si128(_mm_slli_epi32(s0, 6), _mm_srli_epi32(s0, 4));
+			s1 = _mm_or_si128(_mm_slli_epi32(s1, 6), _mm_srli_epi32(s1, 4));
+			s2 = _mm_or_si128(_mm_slli_epi32(s2, 6), _mm_srli_epi32(s2, 4));
+		}
+		
+		const __m128i pairs = _mm_or_si128(s0, _mm_slli_epi32(s1, 16));
+		
+		const __m128i lo = _mm_unpacklo_epi32(pairs, s2);
+		const __m128i hi = _mm_unpackhi_epi32(pairs, s2);
+		
+		_mm_storel_epi64((__m128i *)(out + 0), lo);
+		_mm_storel_epi64((__m128i *)(out + 3), _mm_unpackhi_epi64(lo, lo));
+		_mm_storel_epi64((__m128i *)(out + 6), hi);
+		_mm_storel_epi64((__m128i *)(out + 9), _mm_unpackhi_epi64(hi, hi));
+		
+		out += 12;
+	}
+#endif
+
+	for(; i < end; i++)
+	{
+		UInt32 word;
+		
+		memcpy(&word, words + (4 * (i / 3)), 4);
+		
+		if(swap)
+			word = ByteSwap32(word);
+		
+		const UInt32 v = (word >> (22 - (10 * (i % 3)))) & 0x3ff;
+		
+		*out++ = (expand ? Expand10(v) : v);
+	}
+}
+
+
+// whole rows, written in our own byte order
+static void
+Pack10Row(UInt8 *row, const UInt16 *in, size_t samples, bool reduce)
+{
+	const int shift = (reduce ? 6 : 0);
+	
+	size_t i = 0;
+
+#ifdef MOXFILES_SSE2
+	const __m128i mask10 = _mm_set1_epi32(0x3ff);
+	const __m128i lo16 = _mm_set1_epi32(0xffff);
+	
+	// Each word is loaded as four samples, so this also leaves one after.
+	for(; i + 12 < samples; i += 12)
+	{
+		const __m128i w01 = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)(in + i + 0)), _mm_loadl_epi64((const __m128i *)(in + i + 3)));
+		const __m128i w23 = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)(in + i + 6)), _mm_loadl_epi64((const __m128i *)(in + i + 9)));
+		
+		// first and second samples of each word, then the third
+		const __m128i pairs = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(w01), _mm_castsi128_ps(w23), _MM_SHUFFLE(2, 0, 2, 0)));
+		const __m128i thirds = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(w01), _mm_castsi128_ps(w23), _MM_SHUFFLE(3, 1, 3, 1)));
+		
+		const __m128i s0 = _mm_and_si128(_mm_srli_epi32(_mm_and_si128(pairs, lo16), shift), mask10);
+		const __m128i s1 = _mm_and_si128(_mm_srli_epi32(pairs, 16 + shift), mask10);
+		const __m128i s2 = _mm_and_si128(_mm_srli_epi32(_mm_and_si128(thirds, lo16), shift), mask10);
+		
+		const __m128i w = _mm_or_si128(_mm_slli_epi32(s0, 22), _mm_or_si128(_mm_slli_epi32(s1, 12), _mm_slli_epi32(s2, 2)));
+		
+		_mm_storeu_si128((__m128i *)(row + (4 * (i / 3))), w);
+	}
+#endif
+
+	for(; i < samples; i += 3)
+	{
+		UInt32 word = 0;
+		
+		for(int j = 0; j < 3 && i + j < samples; j++)
+			word |= ((UInt32)(in[i + j] >> shift) & 0x3ff) << (22 - (10 * j));
+		
+		memcpy(row + (4 * (i / 3)), &word, 4);
+	}
+}
+
+
+static void
+Unpack12Row(UInt16 *out, const UInt8 *row, size_t first, size_t count, bool swap, bool expand)
+{
+	const UInt16 *in = (const UInt16 *)row + first;
+	
+	size_t i = 0;
+
+#ifdef MOXFILES_SSE2
+	const __m128i mask = _mm_set1_epi16((short)0xfff0);
+	
+	for(; i + 8 <= count; i += 8)
+	{
+		__m128i w = _mm_loadu_si128((const __m128i *)(in + i));
+		
+		if(swap)
+			w = Swap16(w);
+		
+		const __m128i v = (expand ? _mm_or_si128(_mm_and_si128(w, mask), _mm_srli_epi16(w, 12)) : _mm_srli_epi16(w, 4));
+		
+		_mm_storeu_si128((__m128i *)(out + i), v);
+	}
+#endif
+
+	for(; i < count; i++)
+	{
+		const UInt16 w = (swap ? ByteSwap16(in[i]) : in[i]);
+		
+		out[i] = (expand ? Expand12(w >> 4) : (w >> 4));
+	}
+}
+
+
+static void
+Pack12Row(UInt8 *row, const UInt16 *in, size_t samples, bool reduce)
+{
+	UInt16 *out = (UInt16 *)row;
+	
+	size_t i = 0;
+
+#ifdef MOXFILES_SSE2
+	const __m128i mask = _mm_set1_epi16((short)0xfff0);
+	
+	for(; i + 8 <= samples; i += 8)
+	{
+		const __m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+		
+		_mm_storeu_si128((__m128i *)(out + i), (reduce ? _mm_and_si128(v, mask) : _mm_and_si128(_mm_slli_epi16(v, 4), mask)));
+	}
+#endif
+
+	for(; i < samples; i++)
+		out[i] = (reduce ? (in[i] & 0xfff0) : ((in[i] << 4) & 0xfff0));
+}
+
+
+// Where the 10 or 12-bit image is in a DPX frame we can unpack ourselves
+struct DPXImage
+{
+	const UInt8 *data;
+	size_t rowBytes;
+	int bitDepth;
+	bool swap;
+};
+
+
+static size_t
+PackedRowBytes(size_t samples, int bit_depth)
+{
+	return (bit_depth == 10 ? (4 * ((samples + 2) / 3)) : (2 * samples));
+}
+
+
+// Rows are split into a couple of stripes per thread.
+static int
+RowsPerTask(int height)
+{
+	const int threads = std::max(1, ThreadPool::globalThreadPool().numThreads());
+	
+	return std::max(16, (height + (2 * threads) - 1) / (2 * threads));
+}
+
+
+class DPXPackTask : public Task
+{
+  public:
+	DPXPackTask(TaskGroup *group, UInt8 *out, size_t out_rowbytes, const char *in, ptrdiff_t in_rowbytes, size_t samples, int rows, int bit_depth, bool reduce);
+	virtual ~DPXPackTask() {}
+	
+	virtual void execute();
+
+  private:
+	UInt8 * const _out;
+	const size_t _out_rowbytes;
+	const char * const _in;
+	const ptrdiff_t _in_rowbytes;
+	const size_t _samples;
+	const int _rows;
+	const int _bit_depth;
+	const bool _reduce;
+};
+
+
+DPXPackTask::DPXPackTask(TaskGroup *group, UInt8 *out, size_t out_rowbytes, const char *in, ptrdiff_t in_rowbytes, size_t samples, int rows, int bit_depth, bool reduce) :
+	Task(group),
+	_out(out),
+	_out_rowbytes(out_rowbytes),
+	_in(in),
+	_in_rowbytes(in_rowbytes),
+	_samples(samples),
+	_rows(rows),
+	_bit_depth(bit_depth),
+	_reduce(reduce)
+{
+
+}
+
+
 void
-DPXCodec::compress(const FrameBuffer &frame)
+DPXPackTask::execute()
 {
-	const PixelType pixel_type = (_depth == DPX_8 ? MoxFiles::UINT8 : MoxFiles::UINT16);
-	const size_t bytes_per_subpixel = PixelSize(pixel_type);
-	const int num_channels = (_channels == DPX_RGBA ? 4 : 3);
+	for(int y = 0; y < _rows; y++)
+	{
+		UInt8 *row = _out + (y * _out_rowbytes);
+		const UInt16 *in = (const UInt16 *)(_in + (y * _in_rowbytes));
+		
+		if(_bit_depth == 10)
+			Pack10Row(row, in, _samples, _reduce);
+		else
+			Pack12Row(row, in, _samples, _reduce);
+	}
+}
+
+
+class DPXUnpackTask : public Task
+{
+  public:
+	DPXUnpackTask(TaskGroup *group, const DPXImage &image, int first_row, int rows, size_t first, size_t count, char *out, ptrdiff_t out_rowbytes, bool expand);
+	virtual ~DPXUnpackTask() {}
+	
+	virtual void execute();
+
+  private:
+	const DPXImage &_image;
+	const int _first_row;
+	const int _rows;
+	const size_t _first;
+	const size_t _count;
+	char * const _out;
+	const ptrdiff_t _out_rowbytes;
+	const bool _expand;
+};
+
+
+DPXUnpackTask::DPXUnpackTask(TaskGroup *group, const DPXImage &image, int first_row, int rows, size_t first, size_t count, char *out, ptrdiff_t out_rowbytes, bool expand) :
+	Task(group),
+	_image(image),
+	_first_row(first_row),
+	_rows(rows),
+	_first(first),
+	_count(count),
+	_out(out),
+	_out_rowbytes(out_rowbytes),
+	_expand(expand)
+{
+
+}
+
+
+void
+DPXUnpackTask::execute()
+{
+	for(int y = 0; y < _rows; y++)
+	{
+		UInt16 *out = (UInt16 *)(_out + (y * _out_rowbytes));
+		const UInt8 *row = _image.data + ((_first_row + y) * _image.rowBytes);
+		
+		if(_image.bitDepth == 10)
+			Unpack10Row(out, row, _first, _count, _image.swap, _expand);
+		else
+			Unpack12Row(out, row, _first, _count, _image.swap, _expand);
+	}
+}
+
+
+std::vector<std::string>
+DPXCodec::channelNames() const
+{
+	std::vector<std::string> names;
+	
+	names.push_back("R");
+	names.push_back("G");
+	names.push_back("B");
+	
+	if(_channels == DPX_RGBA)
+		names.push_back("A");
+	
+	return names;
+}
+
+
+DataChunkPtr
+DPXCodec::packImage(const DataChunk &header, const FrameBuffer &frame)
+{
+	const PixelType pixel_type = (_depth == DPX_10 ? MoxFiles::UINT10 : MoxFiles::UINT12);
+	const int bit_depth = (_depth == DPX_10 ? 10 : 12);
+	
+	const std::vector<std::string> names = channelNames();
 	
 	const Box2i dataW = dataWindow();
 	
 	const int width = (dataW.max.x - dataW.min.x + 1);
 	const int height = (dataW.max.y - dataW.min.y + 1);
 	
-	const size_t bytes_per_pixel = bytes_per_subpixel * num_channels;
-	const size_t rowbytes = bytes_per_pixel * width;
-	const size_t buffer_size = rowbytes * height;
+	const size_t samples = width * names.size();
 	
 	
-	DataChunk data(buffer_size);
+	// Straight from the caller's rows if we can, with the actual 10 or 12-bit
+	// values or full range 16-bit, otherwise staged.
+	bool reduce = false;
 	
-	FrameBuffer frame_buffer(dataW);
+	ptrdiff_t in_rowbytes = 0;
+	
+	const char *in = interleavedRows(frame, names, pixel_type, in_rowbytes);
+	
+	if(in == NULL)
+	{
+		in = interleavedRows(frame, names, MoxFiles::UINT16, in_rowbytes);
 		
-	char *origin = (char *)data.Data;
+		reduce = (in != NULL);
+	}
 	
-	frame_buffer.insert("R", Slice(pixel_type, origin + (bytes_per_subpixel * 0), bytes_per_pixel, rowbytes));
-	frame_buffer.insert("G", Slice(pixel_type, origin + (bytes_per_subpixel * 1), bytes_per_pixel, rowbytes));
-	frame_buffer.insert("B", Slice(pixel_type, origin + (bytes_per_subpixel * 2), bytes_per_pixel, rowbytes));
+	if(in == NULL)
+	{
+		const size_t bytes_per_subpixel = PixelSize(pixel_type);
+		const size_t bytes_per_pixel = bytes_per_subpixel * names.size();
+		
+		in_rowbytes = bytes_per_pixel * width;
+		
+		char *origin = stagingBuffer(in_rowbytes * height);
+		
+		FrameBuffer frame_buffer(dataW);
+		
+		for(int i = 0; i < names.size(); i++)
+			frame_buffer.insert(names[i], Slice(pixel_type, origin + (bytes_per_subpixel * i), bytes_per_pixel, in_rowbytes));
+		
+		frame_buffer.copyFromFrame(frame);
+		
+		in = origin;
+	}
 	
-	if(_channels == DPX_RGBA)
-		frame_buffer.insert("A", Slice(pixel_type, origin + (bytes_per_subpixel * 3), bytes_per_pixel, rowbytes));
 	
+	const size_t header_size = header.Size;
+	const size_t rowbytes = PackedRowBytes(samples, bit_depth);
+	const size_t file_size = header_size + (rowbytes * height);
 	
-	frame_buffer.copyFromFrame(frame);
+	PooledDataChunk *chunk = new PooledDataChunk(file_size);
+	
+	DataChunkPtr data = chunk;
+	
+	memcpy(chunk->Data, header.Data, header_size);
+	
+	// What WriteElement() and Finish() would have filled in: image offset, file
+	// size, and the element's offset and padding.  We asked libdpx for our own
+	// byte order.
+	const UInt32 offset = header_size;
+	const UInt32 size = file_size;
+	const UInt32 no_padding = 0;
+	
+	memcpy(chunk->Data + 4, &offset, 4);
+	memcpy(chunk->Data + 16, &size, 4);
+	memcpy(chunk->Data + 808, &offset, 4);
+	memcpy(chunk->Data + 812, &no_padding, 4);
+	memcpy(chunk->Data + 816, &no_padding, 4);
+	
+	{
+		TaskGroup taskGroup;
+		
+		const int rows_per_task = RowsPerTask(height);
+		
+		for(int y = 0; y < height; y += rows_per_task)
+		{
+			ThreadPool::addGlobalTask(new DPXPackTask(&taskGroup, chunk->Data + header_size + (y * rowbytes), rowbytes,
+														in + (y * in_rowbytes), in_rowbytes, samples,
+														std::min(rows_per_task, height - y), bit_depth, reduce));
+		}
+	}
+	
+	return data;
+}
+
+
+void
+DPXCodec::compress(const FrameBuffer &frame)
+{
+	const PixelType pixel_type = (_depth == DPX_8 ? MoxFiles::UINT8 : MoxFiles::UINT16);
+	const size_t bytes_per_subpixel = PixelSize(pixel_type);
+	const int num_channels = (_channels == DPX_RGBA ? 4 : 3);
+	
+	const Box2i dataW = dataWindow();
+	
+	const int width = (dataW.max.x - dataW.min.x + 1);
+	const int height = (dataW.max.y - dataW.min.y + 1);
+	
+	const size_t bytes_per_pixel = bytes_per_subpixel * num_channels;
+	const size_t rowbytes = bytes_per_pixel * width;
+	const size_t buffer_size = rowbytes * height;
 	
 	
 	MemoryFile file(buffer_size);
@@ -238,10 +694,35 @@ DPXCodec::compress(const FrameBuffer &frame)
 	if(!wrote_header)
 		throw MoxMxf::ArgExc("Error writing header");
 	
+	
+	// 12-bit rows that don't end on a 32-bit word are left to libdpx, which
+	// is what reads them back too (see findImage)
+	if(packing == dpx::kFilledMethodA && PackedRowBytes(width * num_channels, bit_depth) % 4 == 0)
+	{
+		storeData( packImage(*file.getDataChunk(), frame) );
+		
+		return;
+	}
+	
+	
+	char *origin = stagingBuffer(buffer_size);
+	
+	FrameBuffer frame_buffer(dataW);
+	
+	frame_buffer.insert("R", Slice(pixel_type, origin + (bytes_per_subpixel * 0), bytes_per_pixel, rowbytes));
+	frame_buffer.insert("G", Slice(pixel_type, origin + (bytes_per_subpixel * 1), bytes_per_pixel, rowbytes));
+	frame_buffer.insert("B", Slice(pixel_type, origin + (bytes_per_subpixel * 2), bytes_per_pixel, rowbytes));
+	
+	if(_channels == DPX_RGBA)
+		frame_buffer.insert("A", Slice(pixel_type, origin + (bytes_per_subpixel * 3), bytes_per_pixel, rowbytes));
+	
+	
+	frame_buffer.copyFromFrame(frame);
+	
 
 	const dpx::DataSize size = (pixel_type == MoxFiles::UINT16 ? dpx::kWord : dpx::kByte);
 	
-	const bool wrote_element = dpx.WriteElement(0, data.Data, size);
+	const bool wrote_element = dpx.WriteElement(0, origin, size);
 	
 	if(!wrote_element)
 		throw MoxMxf::ArgExc("Error writing image");
@@ -323,8 +804,260 @@ DPXCodec_InStream::Seek(long offset, Origin origin)
 		return false;
 }
 
+static inline UInt32
+ReadUInt32(const UInt8 *bytes, bool swap)
+{
+	UInt32 v;
+	
+	memcpy(&v, bytes, 4);
+	
+	return (swap ? ByteSwap32(v) : v);
+}
+
+
+static inline UInt16
+ReadUInt16(const UInt8 *bytes, bool swap)
+{
+	UInt16 v;
+	
+	memcpy(&v, bytes, 2);
+	
+	return (swap ? ByteSwap16(v) : v);
+}
+
+
+bool
+DPXCodec::findImage(const DataChunk &data, DPXImage &image) const
+{
+	if(_depth != DPX_10 && _depth != DPX_12)
+		return false;
+	
+	// the generic and industry headers
+	if(data.Size < 2048)
+		return false;
+	
+	const UInt8 *header = data.Data;
+	
+	const UInt32 magic = ReadUInt32(header, false);
+	
+	if(magic != 0x53445058 && magic != 0x58504453) // "SDPX" either way around
+		return false;
+	
+	const bool swap = (magic == 0x58504453);
+	
+	const UInt16 elements = ReadUInt16(header + 770, swap);
+	const UInt32 width = ReadUInt32(header + 772, swap);
+	const UInt32 height = ReadUInt32(header + 776, swap);
+	
+	// first image element
+	const UInt8 descriptor = header[800];
+	const UInt8 bit_depth = header[803];
+	const UInt16 packing = ReadUInt16(header + 804, swap);
+	const UInt16 encoding = ReadUInt16(header + 806, swap);
+	const UInt32 offset = ReadUInt32(header + 808, swap);
+	const UInt32 eol_padding = ReadUInt32(header + 812, swap);
+	
+	const int channels = (_channels == DPX_RGBA ? 4 : 3);
+	
+	if(elements < 1 || descriptor != (channels == 4 ? dpx::kRGBA : dpx::kRGB) ||
+		bit_depth != (_depth == DPX_10 ? 10 : 12) || packing != dpx::kFilledMethodA || encoding != dpx::kNone)
+	{
+		return false;
+	}
+	
+	
+	const Box2i dataW = dataWindow();
+	
+	if(width != (dataW.max.x - dataW.min.x + 1))
+		throw MoxMxf::InputExc("Stored data is wrong width");
+	
+	if(height != (dataW.max.y - dataW.min.y + 1))
+		throw MoxMxf::InputExc("Stored data is wrong height");
+	
+	
+	size_t rowbytes = PackedRowBytes(width * channels, bit_depth);
+	
+	// 12-bit rows that don't end on a 32-bit word could go either way
+	if(rowbytes % 4 != 0)
+		return false;
+	
+	if(eol_padding != 0xffffffff)
+		rowbytes += eol_padding;
+	
+	if(offset > data.Size || ((data.Size - offset) / rowbytes) < height)
+		throw MoxMxf::InputExc("DPX image data is too short");
+	
+	image.data = data.Data + offset;
+	image.rowBytes = rowbytes;
+	image.bitDepth = bit_depth;
+	image.swap = swap;
+	
+	return true;
+}
+
+
+void
+DPXCodec::unpackRows(const DPXImage &image, char *origin, ptrdiff_t rowbytes, const Box2i &region, bool expand) const
+{
+	const Box2i dataW = dataWindow();
+	
+	const int channels = (_channels == DPX_RGBA ? 4 : 3);
+	
+	const size_t first = (region.min.x - dataW.min.x) * channels;
+	const size_t count = (region.max.x - region.min.x + 1) * channels;
+	
+	const int first_row = (region.min.y - dataW.min.y);
+	const int height = (region.max.y - region.min.y + 1);
+	
+	const int rows_per_task = RowsPerTask(height);
+	
+	TaskGroup taskGroup;
+	
+	for(int y = 0; y < height; y += rows_per_task)
+	{
+		ThreadPool::addGlobalTask(new DPXUnpackTask(&taskGroup, image, first_row + y, std::min(rows_per_task, height - y),
+														first, count, origin + (y * rowbytes), rowbytes, expand));
+	}
+}
+
+
 void
 DPXCodec::decompress(const DataChunk &data)
+{
+	DPXImage image;
+	
+	if(findImage(data, image))
+	{
+		const Box2i dataW = dataWindow();
+		
+		const int width = (dataW.max.x - dataW.min.x + 1);
+		const int height = (dataW.max.y - dataW.min.y + 1);
+		
+		const PixelType pixel_type = (_depth == DPX_10 ? MoxFiles::UINT10 : MoxFiles::UINT12);
+		
+		const std::vector<std::string> names = channelNames();
+		
+		const size_t bytes_per_subpixel = PixelSize(pixel_type);
+		const size_t bytes_per_pixel = bytes_per_subpixel * names.size();
+		const size_t rowbytes = bytes_per_pixel * width;
+		
+		DataChunkPtr frame_data = new PooledDataChunk(rowbytes * height);
+		
+		char *buffer = (char *)frame_data->Data;
+		
+		char *origin = buffer - (dataW.min.x * bytes_per_pixel) - (dataW.min.y * rowbytes);
+		
+		FrameBufferPtr frame_buffer = new FrameBuffer(dataW);
+		
+		for(int i = 0; i < names.size(); i++)
+			frame_buffer->insert(names[i], Slice(pixel_type, origin + (bytes_per_subpixel * i), bytes_per_pixel, rowbytes));
+		
+		frame_buffer->attachData(frame_data);
+		
+		unpackRows(image, buffer, rowbytes, dataW, false);
+		
+		storeFrame(frame_buffer);
+		
+		return;
+	}
+	
+	FrameBufferPtr frame_buffer = readRegion(data, dataWindow());
+	
+	if(frame_buffer)
+		storeFrame(frame_buffer);
+}
+
+
+bool
+DPXCodec::decompressInto(const DataChunk &data, FrameBuffer &frameBuffer)
+{
+	DPXImage image;
+	
+	if(findImage(data, image))
+	{
+		const PixelType pixel_type = (_depth == DPX_10 ? MoxFiles::UINT10 : MoxFiles::UINT12);
+		
+		const std::vector<std::string> names = channelNames();
+		
+		ptrdiff_t rowbytes = 0;
+		
+		char *origin = interleavedRows(frameBuffer, names, pixel_type, rowbytes);
+		
+		bool expand = false;
+		
+		if(origin == NULL)
+		{
+			origin = interleavedRows(frameBuffer, names, MoxFiles::UINT16, rowbytes);
+			
+			expand = (origin != NULL);
+		}
+		
+		if(origin != NULL)
+		{
+			unpackRows(image, origin, rowbytes, dataWindow(), expand);
+			
+			return true;
+		}
+	}
+	
+	return VideoCodec::decompressInto(data, frameBuffer);
+}
+
+
+bool
+DPXCodec::decompressRegion(const DataChunk &data, FrameBuffer &frameBuffer, const Box2i &region)
+{
+	DPXImage image;
+	
+	if(findImage(data, image))
+	{
+		// just the region's rows and samples, into a staging buffer
+		const int width = (region.max.x - region.min.x + 1);
+		const int height = (region.max.y - region.min.y + 1);
+		
+		const PixelType pixel_type = (_depth == DPX_10 ? MoxFiles::UINT10 : MoxFiles::UINT12);
+		
+		const std::vector<std::string> names = channelNames();
+		
+		const size_t bytes_per_subpixel = PixelSize(pixel_type);
+		const size_t bytes_per_pixel = bytes_per_subpixel * names.size();
+		const size_t rowbytes = bytes_per_pixel * width;
+		
+		char *buffer = stagingBuffer(rowbytes * height);
+		
+		char *origin = buffer - (region.min.x * bytes_per_pixel) - (region.min.y * rowbytes);
+		
+		FrameBuffer region_frame(region);
+		
+		for(int i = 0; i < names.size(); i++)
+			region_frame.insert(names[i], Slice(pixel_type, origin + (bytes_per_subpixel * i), bytes_per_pixel, rowbytes));
+		
+		unpackRows(image, buffer, rowbytes, region, false);
+		
+		FrameBuffer region_view(frameBuffer, region);
+		
+		region_view.copyFromFrame(region_frame);
+		
+		return true;
+	}
+	
+	FrameBufferPtr region_frame = readRegion(data, region);
+	
+	if(region_frame)
+	{
+		FrameBuffer region_view(frameBuffer, region);
+		
+		region_view.copyFromFrame(*region_frame);
+		
+		return true;
+	}
+	
+	return false;
+}
+
+
+FrameBufferPtr
+DPXCodec::readRegion(const DataChunk &data, const Box2i &region)
 {
 	MemoryFile file(data);
 	
@@ -355,20 +1088,29 @@ DPXCodec::decompress(const DataChunk &data)
 		if(dpx_height != (dataW.max.y - dataW.min.y + 1))
 			throw MoxMxf::InputExc("Stored data is wrong height");
 		
+		assert(region.min.x >= dataW.min.x && region.max.x <= dataW.max.x);
+		assert(region.min.y >= dataW.min.y && region.max.y <= dataW.max.y);
+		
+		
+		// only the region gets allocated and read
+		const int width = (region.max.x - region.min.x + 1);
+		const int height = (region.max.y - region.min.y + 1);
 		
 		const size_t pixsize = (_depth == DPX_8 ? sizeof(unsigned char) : sizeof(unsigned short));
-		const size_t rowbytes = dpx_width * pixsize * dpx_channels;
-		const size_t buffer_size = rowbytes * dpx_height;
+		const size_t rowbytes = width * pixsize * dpx_channels;
+		const size_t buffer_size = rowbytes * height;
 		
-		DataChunkPtr frame_data = new DataChunk(buffer_size);
+		DataChunkPtr frame_data = new PooledDataChunk(buffer_size);
 		
-		char *origin = (char *)frame_data->Data;
+		char *buffer = (char *)frame_data->Data;
 		
-		FrameBufferPtr frame_buffer = new FrameBuffer(dataW);
+		FrameBufferPtr frame_buffer = new FrameBuffer(region);
 		
 		const PixelType pixel_type = (_depth == DPX_8 ? MoxFiles::UINT8 : MoxFiles::UINT16);
 		const size_t bytes_per_subpixel = PixelSize(pixel_type);
 		const size_t bytes_per_pixel = bytes_per_subpixel * dpx_channels;
+		
+		char *origin = buffer - (region.min.x * bytes_per_pixel) - (region.min.y * rowbytes);
 	
 		frame_buffer->insert("R", Slice(pixel_type, origin + (bytes_per_subpixel * 0), bytes_per_pixel, rowbytes));
 		frame_buffer->insert("G", Slice(pixel_type, origin + (bytes_per_subpixel * 1), bytes_per_pixel, rowbytes));
@@ -380,22 +1122,25 @@ DPXCodec::decompress(const DataChunk &data)
 		frame_buffer->attachData(frame_data);
 		
 		
-		dpx::Block block(0, 0, dpx_width - 1, dpx_height - 1);
+		dpx::Block block(region.min.x - dataW.min.x, region.min.y - dataW.min.y,
+							region.max.x - dataW.min.x, region.max.y - dataW.min.y);
 		
 		const dpx::Descriptor dpx_desc = dpx.header.ImageDescriptor(0);
 		const dpx::DataSize dpx_size = (_depth == DPX_8 ? dpx::kByte : dpx::kWord);
 		
-		const bool image_read = dpx.ReadBlock((void *)origin, dpx_size, block, dpx_desc);
+		const bool image_read = dpx.ReadBlock((void *)buffer, dpx_size, block, dpx_desc);
 		
 		if(image_read)
 		{
-			storeFrame(frame_buffer);
+			return frame_buffer;
 		}
 		else
 			assert(false);
 	}
 	else
 		assert(false);
+	
+	return FrameBufferPtr();
 }
 
 
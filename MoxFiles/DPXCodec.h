@@ -14,6 +14,13 @@
 
 namespace MoxFiles
 {
+	struct DPXImage;
+	
+	// DPX through libdpx, except for 10 and 12-bit frames in filled method A
+	// (which is how we write those), where the image is packed and unpacked
+	// here, straight between the essence and the caller's rows if they are
+	// interleaved 16-bit RGB(A).
+	
 	class DPXCodec : public VideoCodec
 	{
 	  public:
@@ -24,11 +31,21 @@ namespace MoxFiles
 		virtual const MoxMxf::VideoDescriptor * getDescriptor() const { return &_descriptor; }
 		
 		virtual void compress(const FrameBuffer &frame);
+		virtual bool convertsInput() const { return true; }
 		virtual void decompress(const DataChunk &data);
+		virtual bool decompressInto(const DataChunk &data, FrameBuffer &frameBuffer);
+		virtual bool decompressRegion(const DataChunk &data, FrameBuffer &frameBuffer, const Box2i &region);
 	
 	  private:
 		MoxMxf::RGBADescriptor _descriptor;
 		
+		FrameBufferPtr readRegion(const DataChunk &data, const Box2i &region);
+		
+		std::vector<std::string> channelNames() const;
+		DataChunkPtr packImage(const DataChunk &header, const FrameBuffer &frame);
+		bool findImage(const DataChunk &data, DPXImage &image) const;
+		void unpackRows(const DPXImage &image, char *origin, ptrdiff_t rowbytes, const Box2i &region, bool expand) const;
+		
 		enum DPX_Channels {
 			DPX_RGB,
 			DPX_RGBA
@@ -11,9 +11,85 @@
 
 #include <MoxFiles/Thread.h>
 
+#include <algorithm>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
 namespace MoxFiles
 {
 
+int
+DiracCodec::getGOPLength(const Header &header)
+{
+	const IntAttribute *gopAttr = header.findTypedAttribute<IntAttribute>("diracGOPLength");
+	
+	return (gopAttr != NULL ? gopAttr->value() : 1);
+}
+
+
+void
+DiracCodec::setGOPLength(Header &header, int length)
+{
+	// the index only has a signed byte for the key frame offset
+	if(length < 1 || length > 128)
+		throw MoxMxf::ArgExc("Dirac GOP length must be 1-128");
+	
+	header.insert("diracGOPLength", IntAttribute(length));
+}
+
+
+static CodecThreads gDiracThreads("Dirac");
+
+
+int
+DiracCodec::threadCount()
+{
+	return gDiracThreads.count();
+}
+
+
+void
+DiracCodec::setThreadCount(int count)
+{
+	gDiracThreads.setCount(count);
+}
+
+
+static Mutex gSchroThreadsMutex;
+static bool gSchroThreadsSet = false;
+
+
+static void
+SetSchroThreads()
+{
+	// Schroedinger only takes its thread count from the environment, when it
+	// starts an encoder or decoder.  The environment isn't safe to change while
+	// other threads might be reading it, so that happens once, and never over
+	// a SCHRO_THREADS the user already set.
+	Lock lock(gSchroThreadsMutex);
+	
+	if(gSchroThreadsSet)
+		return;
+	
+	gSchroThreadsSet = true;
+	
+	if(getenv("SCHRO_THREADS") != NULL)
+		return;
+	
+	char count[16];
+	
+	snprintf(count, sizeof(count), "%d", std::max(DiracCodec::threadCount(), 1));
+
+#ifdef _WIN32
+	_putenv_s("SCHRO_THREADS", count);
+#else
+	setenv("SCHRO_THREADS", count, 0);
+#endif
+}
+
+
 static unsigned int
 PixelLayoutDepth(PixelType type)
 {
@@ -100,11 +176,19 @@ DiracCodec::DiracCodec(const Header &header, const ChannelList &channels) :
 	VideoCodec(header, channels),
 	_descriptor(NULL),
 	_encoder(NULL),
-	_decoder(NULL)
+	_decoder(NULL),
+	_gopLength(1),
+	_picturesCoded(0),
+	_lastKeyFrame(0),
+	_frameFormat(SCHRO_FRAME_FORMAT_U8_444),
+	_decoderRunning(false),
+	_nextPicture(0)
 {	
 	
 	schro_init();
 	
+	SetSchroThreads();
+	
 	_encoder = schro_encoder_new();
 	
 	if(_encoder == NULL)
@@ -112,7 +196,18 @@ DiracCodec::DiracCodec(const Header &header, const ChannelList &channels) :
 	
 	
 	// see struct SchroEncoderSettings in schroencoder.c
-	schro_encoder_setting_set_double(_encoder, "gop_structure", SCHRO_ENCODER_GOP_INTRA_ONLY);
+	_gopLength = getGOPLength(header);
+	
+	if(_gopLength > 1)
+	{
+		// Only I and P pictures, each access unit (sequence header and intra
+		// picture) starting a GOP.  There's no reordering, so pictures are
+		// stored in display order and the decoder never has to look ahead.
+		schro_encoder_setting_set_double(_encoder, "gop_structure", SCHRO_ENCODER_GOP_BACKREF);
+		schro_encoder_setting_set_double(_encoder, "au_distance", _gopLength);
+	}
+	else
+		schro_encoder_setting_set_double(_encoder, "gop_structure", SCHRO_ENCODER_GOP_INTRA_ONLY);
 	
 	if( isLossless(header) )
 	{
@@ -228,7 +323,13 @@ DiracCodec::DiracCodec(const MoxMxf::VideoDescriptor &descriptor, Header &header
 	VideoCodec(descriptor, header, channels),
 	_descriptor(NULL),
 	_encoder(NULL),
-	_decoder(NULL)
+	_decoder(NULL),
+	_gopLength(1),
+	_picturesCoded(0),
+	_lastKeyFrame(0),
+	_frameFormat(SCHRO_FRAME_FORMAT_U8_444),
+	_decoderRunning(false),
+	_nextPicture(0)
 {
 	if(descriptor.getVideoCodec() == MoxMxf::VideoDescriptor::VideoCodecDiracRGB)
 	{
@@ -253,6 +354,12 @@ DiracCodec::DiracCodec(const MoxMxf::VideoDescriptor &descriptor, Header &header
 		}
 		
 		_descriptor = new MoxMxf::RGBADescriptor(rgb_descriptor);
+		
+		for(int i = 0; i < num_channels; i++)
+		{
+			if(pixelLayout[i].code != 'F' && pixelLayout[i].depth > 8)
+				_frameFormat = SCHRO_FRAME_FORMAT_S16_444;
+		}
 	}
 	else if(descriptor.getVideoCodec() == MoxMxf::VideoDescriptor::VideoCodecDiracCDCI)
 	{
@@ -267,12 +374,16 @@ DiracCodec::DiracCodec(const MoxMxf::VideoDescriptor &descriptor, Header &header
 
 	schro_init();
 	
+	SetSchroThreads();
+	
 	_decoder = schro_decoder_new();
 	
 	if(_decoder == NULL)
 		throw MoxMxf::NullExc("Error creating decoder"); 
 	
 	//schro_decoder_set_skip_ratio(_decoder, 1.0);
+	
+	resetDecoder();
 }
 
 
@@ -284,6 +395,9 @@ DiracCodec::~DiracCodec()
 	if(_decoder != NULL)
 		schro_decoder_free(_decoder);
 	
+	for(std::vector<SchroFrame *>::iterator i = _framePool.begin(); i != _framePool.end(); ++i)
+		schro_frame_unref(*i);
+	
 	delete _descriptor;
 }
 
@@ -462,34 +576,135 @@ DiracCodec::compress(const FrameBuffer &frame)
 }
 
 
+static UInt32
+ReadUInt32(const unsigned char *buf)
+{
+	return ((UInt32)buf[0] << 24) | ((UInt32)buf[1] << 16) | ((UInt32)buf[2] << 8) | (UInt32)buf[3];
+}
+
+
+static const unsigned char *
+NextParseUnit(const unsigned char *buf, const unsigned char *end, UInt32 &length)
+{
+	// returns the parse unit at buf and its length, or NULL at the end
+	if((end - buf) < SCHRO_PARSE_HEADER_SIZE || buf[0] != 'B' || buf[1] != 'B' || buf[2] != 'C' || buf[3] != 'D')
+		return NULL;
+	
+	length = ReadUInt32(&buf[5]);
+	
+	if(length < SCHRO_PARSE_HEADER_SIZE || length > (size_t)(end - buf))
+		return NULL;
+	
+	return buf;
+}
+
+
+static bool
+FirstPictureNumber(const DataChunk &data, UInt32 &picture_number)
+{
+	const unsigned char *end = data.Data + data.Size;
+	
+	UInt32 length = 0;
+	
+	for(const unsigned char *buf = NextParseUnit(data.Data, end, length); buf != NULL; buf = NextParseUnit(buf + length, end, length))
+	{
+		if(SCHRO_PARSE_CODE_IS_PICTURE(buf[4]) && length >= SCHRO_PARSE_HEADER_SIZE + 4)
+		{
+			picture_number = ReadUInt32(&buf[SCHRO_PARSE_HEADER_SIZE]);
+			
+			return true;
+		}
+	}
+	
+	return false;
+}
+
+
 void
-DiracCodec::decompress(const DataChunk &data)
+DiracCodec::resetDecoder()
 {
 	schro_decoder_reset(_decoder);
+	
+	// Our streams only have I and P pictures, so coded order is display
+	// order and pictures can come out as soon as they're decoded.
+	schro_decoder_set_picture_order(_decoder, SCHRO_DECODER_PICTURE_ORDER_CODED);
+	
+	_decoderRunning = false;
+}
+
 
-	unsigned char *buf = data.Data;
-	ptrdiff_t buf_pos = 0;
+void
+DiracCodec::decoder_push(const DataChunk &data)
+{
+	// Sequential frames go right into the running decoder.  Anything else
+	// is a random access, so start over.
+	UInt32 picture_number = 0;
 	
-	while(buf_pos <= (data.Size - SCHRO_PARSE_HEADER_SIZE) && buf[0] == 'B' && buf[1] == 'B' && buf[2] == 'C' && buf[3] == 'D')
+	if( FirstPictureNumber(data, picture_number) )
 	{
-		unsigned int parse_code = buf[4];
+		if(_decoderRunning && picture_number != _nextPicture)
+			resetDecoder();
 		
-		const int buf_len = (buf[5] << 24) + (buf[6] << 16) + (buf[7] << 8) + buf[8];
+		_nextPicture = picture_number + 1;
+	}
+	
+	const unsigned char *end = data.Data + data.Size;
+	
+	UInt32 length = 0;
+	
+	for(const unsigned char *buf = NextParseUnit(data.Data, end, length); buf != NULL; buf = NextParseUnit(buf + length, end, length))
+	{
+		const unsigned int parse_code = buf[4];
 		
-		if(buf_len < SCHRO_PARSE_HEADER_SIZE)
-			break;
+		if( SCHRO_PARSE_CODE_IS_SEQ_HEADER(parse_code) )
+		{
+			_sequenceHeader.assign(buf, buf + length);
+			
+			if(_decoderRunning)
+				continue; // already has it
+		}
+		else if(!_decoderRunning)
+		{
+			// Frames after the first don't have to repeat the sequence
+			// header, so use the last one we saw.
+			if( _sequenceHeader.empty() )
+				throw MoxMxf::InputExc("Dirac stream starts without a sequence header");
+			
+			SchroBuffer *seq_buf = schro_buffer_new_and_alloc(_sequenceHeader.size());
+			
+			memcpy(seq_buf->data, &_sequenceHeader[0], _sequenceHeader.size());
+			
+			schro_decoder_push(_decoder, seq_buf);
+		}
 		
-		SchroBuffer *schro_buf = schro_buffer_new_with_data(buf, buf_len);
+		// Copied, because the decoder may hang on to a buffer past this frame
+		// and the DataChunk won't be around that long.
+		SchroBuffer *schro_buf = schro_buffer_new_and_alloc(length);
+		
+		memcpy(schro_buf->data, buf, length);
 		
 		schro_decoder_push(_decoder, schro_buf);
 		
-		buf += buf_len;
-		buf_pos += buf_len;
+		_decoderRunning = true;
 	}
+}
+
+
+void
+DiracCodec::decompress(const DataChunk &data)
+{
+	decoder_push(data);
 	
-	schro_decoder_push_end_of_stream(_decoder);
+	decoder_pull(NULL);
+}
+
+
+bool
+DiracCodec::decompressInto(const DataChunk &data, FrameBuffer &frameBuffer)
+{
+	decoder_push(data);
 	
-	decoder_pull();
+	return decoder_pull(&frameBuffer);
 }
 
 
@@ -504,9 +719,14 @@ DiracCodec::end_of_stream()
 	}
 	else if(_decoder != NULL)
 	{
-		schro_decoder_push_end_of_stream(_decoder);
-		
-		decoder_pull();
+		if(_decoderRunning)
+		{
+			schro_decoder_push_end_of_stream(_decoder);
+			
+			decoder_pull(NULL);
+			
+			resetDecoder();
+		}
 	}
 	else
 		assert(false); // huh?
@@ -519,6 +739,10 @@ DiracCodec::encoder_pull()
 	if(_encoder != NULL)
 	{
 		DataChunkPtr data;
+		
+		bool picture = false;
+		bool intra = false;
+		bool sequence_header = false;
 	
 		bool go = true;
 		
@@ -553,8 +777,16 @@ DiracCodec::encoder_pull()
 							data->Append(buffer->length, buffer->data);
 						}
 						
+						if( SCHRO_PARSE_CODE_IS_SEQ_HEADER(parse_code) )
+							sequence_header = true;
+						
 						if(SCHRO_PARSE_CODE_IS_PICTURE(parse_code))
+						{
+							picture = true;
+							intra = SCHRO_PARSE_CODE_IS_INTRA(parse_code);
+							
 							go = false; // end this data packet after we get a picture
+						}
 					}
 					else
 						assert(!SCHRO_PARSE_CODE_IS_END_OF_SEQUENCE(parse_code) &&
@@ -579,7 +811,32 @@ DiracCodec::encoder_pull()
 		
 		
 		if(data)
-			storeData(data);
+		{
+			if(_gopLength > 1 && picture)
+			{
+				// Pictures come out in display order, so the key frame offset is
+				// just a count back to the last access unit.
+				const bool key_frame = (intra && sequence_header);
+				
+				if(key_frame)
+					_lastKeyFrame = _picturesCoded;
+				
+				const int keyOffset = _lastKeyFrame - _picturesCoded;
+				
+				if(keyOffset < -128)
+					throw MoxMxf::LogicExc("Dirac key frames too far apart for the index");
+				
+				// SMPTE 377M index flags: random access and sequence header, or forward prediction
+				const int flags = (key_frame ? 0xc0 : intra ? 0x00 : 0x20);
+				
+				storeData(data, keyOffset, 0, flags);
+			}
+			else
+				storeData(data);
+			
+			if(picture)
+				_picturesCoded++;
+		}
 	}
 	else
 		assert(false); // only call on encoder
@@ -682,9 +939,11 @@ ConvertToUnsigned(const FrameBuffer &frameBuffer)
 }
 
 
-void
-DiracCodec::decoder_pull()
+bool
+DiracCodec::decoder_pull(FrameBuffer *frameBuffer)
 {
+	bool got_frame = false;
+	
 	bool go = true;
 	
 	while(go)
@@ -716,34 +975,16 @@ DiracCodec::decoder_pull()
 		}
 		else if(state == SCHRO_DECODER_NEED_FRAME)
 		{
-			SchroFrameFormat frame_format = SCHRO_FRAME_FORMAT_U8_444;
+			SchroFrame *schro_frame = NULL;
 			
-			if(MoxMxf::RGBADescriptor *rgb_descriptor = dynamic_cast<MoxMxf::RGBADescriptor *>(_descriptor))
+			if( !_framePool.empty() )
 			{
-				const MoxMxf::RGBADescriptor::RGBALayout &pixelLayout = rgb_descriptor->getPixelLayout();
+				schro_frame = _framePool.back();
 				
-				assert(pixelLayout.size() == 3);
-				
-				for(int i = 0; i < pixelLayout.size(); i++)
-				{
-					if(pixelLayout[i].code != 'F')
-					{
-						if(pixelLayout[i].depth > 8)
-						{
-							frame_format = SCHRO_FRAME_FORMAT_S16_444;
-							break;
-						}
-					}
-				}
-			}
-			else if(MoxMxf::CDCIDescriptor *cdci_descriptor = dynamic_cast<MoxMxf::CDCIDescriptor *>(_descriptor))
-			{
-				assert(false); // getting bit depth yet
+				_framePool.pop_back();
 			}
 			else
-				assert(false);
-				
-			SchroFrame *schro_frame = schro_frame_new_and_alloc(NULL, frame_format, width, height);
+				schro_frame = schro_frame_new_and_alloc(NULL, _frameFormat, width, height);
 			
 			schro_decoder_add_output_picture(_decoder, schro_frame);
 		}
@@ -762,8 +1003,12 @@ DiracCodec::decoder_pull()
 											8);
 			
 				FrameBuffer schro_frameBuffer(width, height);
-							
-				FrameBufferPtr frame_buffer = new FrameBuffer(width, height);
+				
+				// only need our own frame when there's no caller's to fill
+				FrameBufferPtr frame_buffer;
+				
+				if(frameBuffer == NULL)
+					frame_buffer = new FrameBuffer(width, height);
 			
 				if(MoxMxf::RGBADescriptor *rgb_descriptor = dynamic_cast<MoxMxf::RGBADescriptor *>(_descriptor))
 				{
@@ -785,13 +1030,15 @@ DiracCodec::decoder_pull()
 							
 							schro_frameBuffer.insert(chan_name, Slice(pixelType, (char *)schro_frame->components[i].data, schro_xStride, schro_frame->components[i].stride));
 							
+							if(!frame_buffer)
+								continue;
 							
 							const size_t xStride = (pixelLayout[i].depth > 8 ? sizeof(unsigned short) : sizeof(unsigned char));
 							
 							const size_t rowbytes = width * xStride;
 							const size_t mem_size = height * rowbytes;
 							
-							DataChunkPtr chan_data = new DataChunk(mem_size);
+							DataChunkPtr chan_data = new PooledDataChunk(mem_size);
 							
 							frame_buffer->insert(chan_name, Slice(pixelType, (char *)chan_data->Data, xStride, rowbytes));
 							
@@ -811,10 +1058,13 @@ DiracCodec::decoder_pull()
 						
 						schro_frameBuffer.insert(chans[i], Slice(MoxFiles::UINT8, (char *)schro_frame->components[i].data, xStride, schro_frame->components[i].stride));
 						
+						if(!frame_buffer)
+							continue;
+						
 						const size_t rowbytes = width * xStride;
 						const size_t mem_size = height * rowbytes;
 						
-						DataChunkPtr chan_data = new DataChunk(mem_size);
+						DataChunkPtr chan_data = new PooledDataChunk(mem_size);
 						
 						frame_buffer->insert(chans[i], Slice(MoxFiles::UINT8, (char *)chan_data->Data, xStride, rowbytes));
 						
@@ -825,11 +1075,20 @@ DiracCodec::decoder_pull()
 				//if(frame_depth > 8)
 				//	ConvertToUnsigned(schro_frameBuffer);
 				
-				frame_buffer->copyFromFrame(schro_frameBuffer);
+				if(frameBuffer != NULL)
+				{
+					frameBuffer->copyFromFrame(schro_frameBuffer);
+				}
+				else
+				{
+					frame_buffer->copyFromFrame(schro_frameBuffer);
+					
+					storeFrame(frame_buffer);
+				}
 				
-				storeFrame(frame_buffer);
+				_framePool.push_back(schro_frame); // handed back for the next picture
 				
-				schro_frame_unref(schro_frame);
+				got_frame = true;
 			
 				go = false;
 			}
@@ -838,15 +1097,17 @@ DiracCodec::decoder_pull()
 		}
 		else if(state == SCHRO_DECODER_EOS)
 		{
-			assert(false);
+			go = false; // after end_of_stream()
 		}
 		else if(state == SCHRO_DECODER_ERROR)
 		{
-			assert(false);
+			resetDecoder();
 			
-			go = false;
+			throw MoxMxf::InputExc("Error decoding Dirac frame");
 		}
 	}
+	
+	return got_frame;
 }
 
 
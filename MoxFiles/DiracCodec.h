@@ -26,18 +26,52 @@ namespace MoxFiles
 		virtual const MoxMxf::VideoDescriptor * getDescriptor() const { return _descriptor; }
 		
 		virtual void compress(const FrameBuffer &frame);
+		virtual bool convertsInput() const { return true; }
 		virtual void decompress(const DataChunk &data);
+		virtual bool decompressInto(const DataChunk &data, FrameBuffer &frameBuffer);
 		
 		virtual void end_of_stream();
 		
+	  public:
+		// Encoder setting for the Header: frames per GOP.  1 (the default) is
+		// intra-only, which is how Dirac frames were always stored.  Longer GOPs
+		// start with a key frame and predict the rest from the frames before
+		// them, making files several times smaller, but then reading a frame
+		// means decoding from the key frame the index points back to.  Up to 128.
+		static int getGOPLength(const Header &header);
+		static void setGOPLength(Header &header, int length);
+		
+		// Worker threads Schroedinger starts for each encoder and decoder, see
+		// CodecThreads in Thread.h (0 is the same as 1 here).  It goes into the
+		// SCHRO_THREADS environment variable when the first Dirac codec is
+		// created, unless that's already set, and can't change after that.
+		static int threadCount();
+		static void setThreadCount(int count);
+		
 	  private:
 		MoxMxf::VideoDescriptor *_descriptor;
 		
 		SchroEncoder *_encoder;
 		SchroDecoder *_decoder;
 		
+		// for the index entries when encoding GOPs
+		int _gopLength;
+		int _picturesCoded;
+		int _lastKeyFrame;
+		
+		// The decoder keeps running from frame to frame and is only reset when
+		// the picture numbers jump, i.e. a random access.  The last sequence
+		// header is kept to start it up again, and output pictures are reused.
+		SchroFrameFormat _frameFormat;
+		bool _decoderRunning;
+		UInt32 _nextPicture;
+		std::vector<unsigned char> _sequenceHeader;
+		std::vector<SchroFrame *> _framePool;
+		
 		void encoder_pull();
-		void decoder_pull();
+		void resetDecoder();
+		void decoder_push(const DataChunk &data);
+		bool decoder_pull(FrameBuffer *frameBuffer);
 	};
 	
 	
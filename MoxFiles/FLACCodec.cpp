@@ -0,0 +1,637 @@
+/*
+ *  FLACCodec.cpp
+ *  MoxFiles
+ *
+ *  Created by agent on 10/18/26.
+ *  Copyright 2026 fnord. All rights reserved.
+ *
+ */
+
+#include <MoxFiles/FLACCodec.h>
+
+#include <MoxFiles/MemoryFile.h>
+#include <MoxFiles/Thread.h>
+
+#include "FLAC/stream_encoder.h"
+#include "FLAC/stream_decoder.h"
+
+#include <algorithm>
+
+#include <string.h>
+
+namespace MoxFiles
+{
+
+// Every frame is, all little-endian:
+//
+//   "MXFL", sample count, channel count (UInt32s),
+//   each channel's size (UInt32)
+//
+// followed by the channels, each a complete mono FLAC stream, in the order
+// of StandardAudioChannelList().
+
+static const unsigned char FLACMagic[4] = { 'M', 'X', 'F', 'L' };
+static const size_t FLACHeaderSize = 12;
+
+
+static inline void
+PutUInt32(unsigned char *p, UInt32 value)
+{
+	p[0] = (value & 0xff);
+	p[1] = ((value >> 8) & 0xff);
+	p[2] = ((value >> 16) & 0xff);
+	p[3] = ((value >> 24) & 0xff);
+}
+
+
+static inline UInt32
+GetUInt32(const unsigned char *p)
+{
+	return (p[0] | (p[1] << 8) | (p[2] << 16) | ((UInt32)p[3] << 24));
+}
+
+
+FLACCodec::FLACCodec(const Header &header, const AudioChannelList &channels) :
+	AudioCodec(header, channels),
+	_descriptor(header.frameRate(), header.sampleRate(), channels.size(), SampleBits(channels.type()), MoxMxf::AudioDescriptor::AudioCodecFLAC),
+	_compressionLevel(getCompressionLevel(header))
+{
+	const Rational &sample_rate = header.sampleRate();
+	
+	if(sample_rate.Denominator == 0 || (sample_rate.Numerator % sample_rate.Denominator) != 0 ||
+		!FLAC__format_sample_rate_is_valid(sample_rate.Numerator / sample_rate.Denominator))
+	{
+		throw MoxMxf::ArgExc("FLAC needs a whole number sample rate");
+	}
+	
+	const SampleType type = channels.type();
+	
+	if(type != UNSIGNED8 && type != SIGNED16 && type != SIGNED24)
+		throw MoxMxf::ArgExc("FLAC can only take 8, 16 and 24-bit audio");
+}
+
+
+FLACCodec::FLACCodec(const MoxMxf::AudioDescriptor &descriptor, Header &header, AudioChannelList &channels) :
+	AudioCodec(descriptor, header, channels),
+	_descriptor(dynamic_cast<const MoxMxf::WaveAudioDescriptor &>(descriptor)),
+	_compressionLevel(5)
+{
+	assert(header.sampleRate() == _descriptor.getAudioSamplingRate());
+	
+	const UInt32 bit_depth = _descriptor.getBitDepth();
+	
+	if(bit_depth != 8 && bit_depth != 16 && bit_depth != 24)
+		throw MoxMxf::InputExc("Not handling the provided bit depth");
+	
+	const SampleType sample_type = sampleType();
+	
+	std::vector<Name> channel_list = StandardAudioChannelList(_descriptor.getChannelCount());
+	
+	for(int i = 0; i < channel_list.size(); i++)
+	{
+		channels.insert(channel_list[i].text(), AudioChannel(sample_type));
+	}
+}
+
+
+FLACCodec::~FLACCodec()
+{
+	for(int i = 0; i < _encoders.size(); i++)
+		FLAC__stream_encoder_delete(_encoders[i]);
+	
+	for(int i = 0; i < _decoders.size(); i++)
+		FLAC__stream_decoder_delete(_decoders[i]);
+}
+
+
+int
+FLACCodec::getCompressionLevel(const Header &header)
+{
+	const IntAttribute *levelAttr = header.findTypedAttribute<IntAttribute>("flacCompressionLevel");
+	
+	return (levelAttr != NULL ? levelAttr->value() : 5);
+}
+
+
+void
+FLACCodec::setCompressionLevel(Header &header, int level)
+{
+	if(level < 0 || level > 8)
+		throw MoxMxf::ArgExc("FLAC compression level must be 0-8");
+	
+	header.insert("flacCompressionLevel", IntAttribute(level));
+}
+
+
+static CodecThreads gFLACThreads("FLAC");
+
+
+int
+FLACCodec::threadCount()
+{
+	return gFLACThreads.count();
+}
+
+
+void
+FLACCodec::setThreadCount(int count)
+{
+	gFLACThreads.setCount(count);
+}
+
+
+SampleType
+FLACCodec::sampleType() const
+{
+	const UInt32 bit_depth = _descriptor.getBitDepth();
+	
+	return (bit_depth == 8 ? UNSIGNED8 :
+			bit_depth == 16 ? SIGNED16 :
+			SIGNED24);
+}
+
+
+// FLAC samples are signed 32-bit, whatever the depth.  Our 8-bit is unsigned.
+template <typename T>
+static void
+ReadSamples(FLAC__int32 *out, const char *in, ptrdiff_t stride, UInt64 length, FLAC__int32 offset)
+{
+	for(UInt64 i = 0; i < length; i++)
+	{
+		*out++ = (FLAC__int32)*(const T *)in - offset;
+		
+		in += stride;
+	}
+}
+
+
+template <typename T>
+static void
+WriteSamples(char *out, ptrdiff_t stride, const FLAC__int32 *in, UInt64 length, FLAC__int32 offset)
+{
+	for(UInt64 i = 0; i < length; i++)
+	{
+		*(T *)out = (T)(*in++ + offset);
+		
+		out += stride;
+	}
+}
+
+
+namespace
+{
+
+static FLAC__StreamEncoderWriteStatus
+EncoderWrite(const FLAC__StreamEncoder *encoder, const FLAC__byte buffer[], size_t bytes, unsigned samples, unsigned current_frame, void *client_data)
+{
+	MemoryFile *file = (MemoryFile *)client_data;
+	
+	return (file->FileWrite(buffer, bytes) == bytes ? FLAC__STREAM_ENCODER_WRITE_STATUS_OK : FLAC__STREAM_ENCODER_WRITE_STATUS_FATAL_ERROR);
+}
+
+
+class FLACEncodeTask : public Task
+{
+  public:
+	FLACEncodeTask(TaskGroup *group, FLAC__StreamEncoder *encoder, const AudioSlice &slice, UInt64 length,
+					unsigned int bitDepth, unsigned int sampleRate, int level, DataChunkPtr &stream);
+	~FLACEncodeTask() {}
+	
+	virtual void execute();
+
+  private:
+	FLAC__StreamEncoder * const _encoder;
+	const AudioSlice &_slice;
+	const UInt64 _length;
+	const unsigned int _bitDepth;
+	const unsigned int _sampleRate;
+	const int _level;
+	DataChunkPtr &_stream;
+};
+
+
+FLACEncodeTask::FLACEncodeTask(TaskGroup *group, FLAC__StreamEncoder *encoder, const AudioSlice &slice, UInt64 length,
+								unsigned int bitDepth, unsigned int sampleRate, int level, DataChunkPtr &stream) :
+	Task(group),
+	_encoder(encoder),
+	_slice(slice),
+	_length(length),
+	_bitDepth(bitDepth),
+	_sampleRate(sampleRate),
+	_level(level),
+	_stream(stream)
+{
+
+}
+
+
+void
+FLACEncodeTask::execute()
+{
+	std::vector<FLAC__int32> samples(std::max<UInt64>(_length, 1));
+	
+	if(_slice.type == UNSIGNED8)
+		ReadSamples<UInt8>(&samples[0], _slice.base, _slice.stride, _length, 128);
+	else if(_slice.type == SIGNED16)
+		ReadSamples<Int16>(&samples[0], _slice.base, _slice.stride, _length, 0);
+	else if(_slice.type == SIGNED24)
+		ReadSamples<Int32>(&samples[0], _slice.base, _slice.stride, _length, 0);
+	else
+		return;
+	
+	// The frame's audio in one block if it fits, although that's not subset
+	// FLAC past 4608 samples (16384 above 48 kHz).  The encoder goes back to
+	// its defaults after every stream, so this is all set every time.
+	const unsigned int blocksize = std::max<UInt64>(FLAC__MIN_BLOCK_SIZE, std::min<UInt64>(_length, FLAC__MAX_BLOCK_SIZE));
+	const unsigned int subset_blocksize = (_sampleRate <= 48000 ? 4608 : 16384);
+	
+	FLAC__stream_encoder_set_channels(_encoder, 1);
+	FLAC__stream_encoder_set_bits_per_sample(_encoder, _bitDepth);
+	FLAC__stream_encoder_set_sample_rate(_encoder, _sampleRate);
+	FLAC__stream_encoder_set_compression_level(_encoder, _level);
+	FLAC__stream_encoder_set_blocksize(_encoder, blocksize);
+	FLAC__stream_encoder_set_streamable_subset(_encoder, blocksize <= subset_blocksize);
+	FLAC__stream_encoder_set_do_md5(_encoder, false);
+	FLAC__stream_encoder_set_total_samples_estimate(_encoder, _length);
+	
+	MemoryFile file((_length * ((_bitDepth + 7) / 8)) + 1024);
+	
+	if(FLAC__stream_encoder_init_stream(_encoder, EncoderWrite, NULL, NULL, NULL, &file) != FLAC__STREAM_ENCODER_INIT_STATUS_OK)
+		return;
+	
+	const FLAC__int32 * const buffers[1] = { &samples[0] };
+	
+	const bool processed = (_length == 0 || FLAC__stream_encoder_process(_encoder, buffers, _length));
+	
+	const bool finished = FLAC__stream_encoder_finish(_encoder);
+	
+	if(processed && finished)
+		_stream = file.getDataChunk();
+}
+
+
+// one channel's stream, and where its samples go
+struct FLACSource
+{
+	const unsigned char *buf;
+	size_t size;
+	
+	char *out;
+	ptrdiff_t stride;
+	SampleType type;
+	unsigned int bitDepth;
+	UInt64 length;
+	UInt64 written;
+	
+	bool error;
+	bool success;
+	
+	FLACSource() : buf(NULL), size(0), out(NULL), stride(0), type(SIGNED24), bitDepth(24), length(0), written(0), error(false), success(false) {}
+};
+
+
+static FLAC__StreamDecoderReadStatus
+DecoderRead(const FLAC__StreamDecoder *decoder, FLAC__byte buffer[], size_t *bytes, void *client_data)
+{
+	FLACSource *source = (FLACSource *)client_data;
+	
+	const size_t n = std::min(*bytes, source->size);
+	
+	*bytes = n;
+	
+	if(n == 0)
+		return FLAC__STREAM_DECODER_READ_STATUS_END_OF_STREAM;
+	
+	memcpy(buffer, source->buf, n);
+	
+	source->buf += n;
+	source->size -= n;
+	
+	return FLAC__STREAM_DECODER_READ_STATUS_CONTINUE;
+}
+
+
+static FLAC__StreamDecoderWriteStatus
+DecoderWrite(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const buffer[], void *client_data)
+{
+	FLACSource *source = (FLACSource *)client_data;
+	
+	const unsigned int samples = frame->header.blocksize;
+	
+	if(frame->header.channels != 1 || frame->header.bits_per_sample != source->bitDepth ||
+		source->written + samples > source->length)
+	{
+		source->error = true;
+		
+		return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+	}
+	
+	char *out = source->out + (source->written * source->stride);
+	
+	if(source->type == UNSIGNED8)
+		WriteSamples<UInt8>(out, source->stride, buffer[0], samples, 128);
+	else if(source->type == SIGNED16)
+		WriteSamples<Int16>(out, source->stride, buffer[0], samples, 0);
+	else
+		WriteSamples<Int32>(out, source->stride, buffer[0], samples, 0);
+	
+	source->written += samples;
+	
+	return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+}
+
+
+static void
+DecoderError(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus status, void *client_data)
+{
+	FLACSource *source = (FLACSource *)client_data;
+	
+	source->error = true;
+}
+
+
+class FLACDecodeTask : public Task
+{
+  public:
+	FLACDecodeTask(TaskGroup *group, FLAC__StreamDecoder *decoder, FLACSource &source);
+	~FLACDecodeTask() {}
+	
+	virtual void execute();
+
+  private:
+	FLAC__StreamDecoder * const _decoder;
+	FLACSource &_source;
+};
+
+
+FLACDecodeTask::FLACDecodeTask(TaskGroup *group, FLAC__StreamDecoder *decoder, FLACSource &source) :
+	Task(group),
+	_decoder(decoder),
+	_source(source)
+{
+
+}
+
+
+void
+FLACDecodeTask::execute()
+{
+	if(FLAC__stream_decoder_init_stream(_decoder, DecoderRead, NULL, NULL, NULL, NULL,
+										DecoderWrite, NULL, DecoderError, &_source) != FLAC__STREAM_DECODER_INIT_STATUS_OK)
+	{
+		return;
+	}
+	
+	const bool processed = FLAC__stream_decoder_process_until_end_of_stream(_decoder);
+	
+	FLAC__stream_decoder_finish(_decoder);
+	
+	_source.success = (processed && !_source.error && _source.written == _source.length);
+}
+
+} // namespace
+
+
+void
+FLACCodec::compress(const AudioBuffer &audio)
+{
+	const SampleType sample_type = sampleType();
+	
+	bool input_matches = true;
+	
+	for(AudioBuffer::ConstIterator i = audio.begin(); i != audio.end(); ++i)
+	{
+		const AudioSlice &slice = i.slice();
+		
+		if(slice.type != sample_type)
+			input_matches = false;
+	}
+	
+	AudioBufferPtr converted_audio;
+	
+	if(!input_matches)
+	{
+		converted_audio = MakeAudioBufferType(audio, sample_type);
+	}
+	
+	const AudioBuffer &audio_buf = (input_matches ? audio : *converted_audio);
+	
+	
+	const UInt32 channels = _descriptor.getChannelCount();
+	
+	assert(channels == audio_buf.size());
+	
+	const UInt64 length = audio_buf.length();
+	
+	const Rational &audio_sampling_rate = _descriptor.getAudioSamplingRate();
+	
+	const unsigned int sample_rate = (audio_sampling_rate.Numerator / audio_sampling_rate.Denominator);
+	
+	
+	std::vector<Name> channel_list = StandardAudioChannelList(channels);
+	
+	std::vector<const AudioSlice *> slices;
+	
+	for(int i = 0; i < channel_list.size(); i++)
+	{
+		const AudioSlice *slice = audio_buf.findSlice(channel_list[i].text());
+		
+		if(slice == NULL)
+			throw MoxMxf::ArgExc("Missing audio channel");
+		
+		slices.push_back(slice);
+	}
+	
+	while(_encoders.size() < channels)
+	{
+		FLAC__StreamEncoder *encoder = FLAC__stream_encoder_new();
+		
+		if(encoder == NULL)
+			throw MoxMxf::NullExc("Error creating FLAC encoder");
+		
+		_encoders.push_back(encoder);
+	}
+	
+	std::vector<DataChunkPtr> streams(channels);
+	
+	const bool threaded = (threadCount() != 0 && channels > 1);
+	
+	{
+		TaskGroup taskGroup;
+		
+		for(int i = 0; i < channels; i++)
+		{
+			runTask(new FLACEncodeTask(&taskGroup, _encoders[i], *slices[i], length, _descriptor.getBitDepth(), sample_rate, _compressionLevel, streams[i]), threaded);
+		}
+	}
+	
+	size_t data_size = FLACHeaderSize + (4 * channels);
+	
+	for(int i = 0; i < channels; i++)
+	{
+		if(!streams[i])
+			throw MoxMxf::IoExc("Problem encoding FLAC channel");
+		
+		data_size += streams[i]->Size;
+	}
+	
+	
+	DataChunkPtr data = new PooledDataChunk(data_size);
+	
+	unsigned char *p = data->Data;
+	
+	memcpy(p, FLACMagic, 4);
+	
+	PutUInt32(p + 4, length);
+	PutUInt32(p + 8, channels);
+	
+	p += FLACHeaderSize;
+	
+	for(int i = 0; i < channels; i++)
+	{
+		PutUInt32(p, streams[i]->Size);
+		
+		p += 4;
+	}
+	
+	for(int i = 0; i < channels; i++)
+	{
+		memcpy(p, streams[i]->Data, streams[i]->Size);
+		
+		p += streams[i]->Size;
+	}
+	
+	assert(p == data->Data + data_size);
+	
+	storeData(data);
+}
+
+
+UInt64
+FLACCodec::samplesInFrame(UInt64 frame, size_t frame_size)
+{
+	// OutputFile gives every frame the same share of samples, so this
+	// doesn't need to look inside
+	return AudioSamplesInFrame(_descriptor.getSampleRate(), _descriptor.getAudioSamplingRate(), frame);
+}
+
+
+void
+FLACCodec::decompress(const DataChunk &data)
+{
+	const UInt32 channels = _descriptor.getChannelCount();
+	
+	const unsigned char *p = data.Data;
+	
+	if(data.Size < FLACHeaderSize || memcmp(p, FLACMagic, 4) != 0)
+		throw MoxMxf::InputExc("Not a FLAC frame");
+	
+	const UInt32 length = GetUInt32(p + 4);
+	const UInt32 channel_count = GetUInt32(p + 8);
+	
+	if(channel_count != channels || data.Size < FLACHeaderSize + (4 * (size_t)channel_count))
+		throw MoxMxf::InputExc("FLAC frame doesn't match the descriptor");
+	
+	
+	const SampleType sample_type = sampleType();
+	
+	const size_t decoded_sample_size = SampleSize(sample_type);
+	
+	const ptrdiff_t stride = channels * decoded_sample_size;
+	
+	DataChunkPtr buf_data = new PooledDataChunk(std::max<size_t>(stride * length, 1));
+	
+	char *buf_origin = (char *)buf_data->Data;
+	
+	
+	AudioBufferPtr buf = new AudioBuffer(length);
+	
+	std::vector<Name> channel_list = StandardAudioChannelList(channels);
+	
+	for(int i = 0; i < channel_list.size(); i++)
+	{
+		buf->insert(channel_list[i].text(), AudioSlice(sample_type, buf_origin + (decoded_sample_size * i), stride));
+	}
+	
+	buf->attachData(buf_data);
+	
+	
+	std::vector<FLACSource> sources(channels);
+	
+	const unsigned char *stream_sizes = p + FLACHeaderSize;
+	const unsigned char *stream = stream_sizes + (4 * channels);
+	
+	for(int i = 0; i < channels; i++)
+	{
+		FLACSource &source = sources[i];
+		
+		source.buf = stream;
+		source.size = GetUInt32(stream_sizes + (4 * i));
+		source.out = buf_origin + (decoded_sample_size * i);
+		source.stride = stride;
+		source.type = sample_type;
+		source.bitDepth = _descriptor.getBitDepth();
+		source.length = length;
+		
+		if(source.size > (size_t)((data.Data + data.Size) - stream))
+			throw MoxMxf::InputExc("FLAC frame is cut short");
+		
+		stream += source.size;
+	}
+	
+	while(_decoders.size() < channels)
+	{
+		FLAC__StreamDecoder *decoder = FLAC__stream_decoder_new();
+		
+		if(decoder == NULL)
+			throw MoxMxf::NullExc("Error creating FLAC decoder");
+		
+		_decoders.push_back(decoder);
+	}
+	
+	const bool threaded = (threadCount() != 0 && channels > 1);
+	
+	{
+		TaskGroup taskGroup;
+		
+		for(int i = 0; i < channels; i++)
+		{
+			runTask(new FLACDecodeTask(&taskGroup, _decoders[i], sources[i]), threaded);
+		}
+	}
+	
+	for(int i = 0; i < channels; i++)
+	{
+		if(!sources[i].success)
+			throw MoxMxf::InputExc("Problem decoding FLAC channel");
+	}
+	
+	storeBuffer(buf);
+}
+
+
+bool
+FLACCodecInfo::canCompressType(SampleType sampleType) const
+{
+	return (sampleType == UNSIGNED8 || sampleType == SIGNED16 || sampleType == SIGNED24);
+}
+
+AudioChannelCapabilities
+FLACCodecInfo::getChannelCapabilites() const
+{
+	return AudioChannels_All;
+}
+
+AudioCodec *
+FLACCodecInfo::createCodec(const Header &header, const AudioChannelList &channels) const
+{
+	return new FLACCodec(header, channels);
+}
+
+AudioCodec *
+FLACCodecInfo::createCodec(const MoxMxf::AudioDescriptor &descriptor, Header &header, AudioChannelList &channels) const
+{
+	return new FLACCodec(descriptor, header, channels);
+}
+
+} // namespace
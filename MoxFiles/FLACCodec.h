@@ -0,0 +1,79 @@
+/*
+ *  FLACCodec.h
+ *  MoxFiles
+ *
+ *  Created by agent on 10/18/26.
+ *  Copyright 2026 fnord. All rights reserved.
+ *
+ */
+
+#ifndef MOXFILES_FLACCODEC_H
+#define MOXFILES_FLACCODEC_H
+
+#include <MoxFiles/Codec.h>
+
+struct FLAC__StreamEncoder;
+struct FLAC__StreamDecoder;
+
+namespace MoxFiles
+{
+	// Lossless audio.  Every frame's audio is compressed on its own, so any
+	// frame can be read without the ones before it, and every channel is its
+	// own little FLAC stream, so the channels are encoded and decoded at the
+	// same time on the global thread pool.  8, 16 and 24-bit.
+	class FLACCodec : public AudioCodec
+	{
+	  public:
+		FLACCodec(const Header &header, const AudioChannelList &channels);
+		FLACCodec(const MoxMxf::AudioDescriptor &descriptor, Header &header, AudioChannelList &channels);
+		virtual ~FLACCodec();
+		
+		virtual const MoxMxf::AudioDescriptor * getDescriptor() const { return &_descriptor; }
+		
+		virtual void compress(const AudioBuffer &audio);
+		
+		virtual UInt64 samplesInFrame(UInt64 frame, size_t frame_size);
+		virtual void decompress(const DataChunk &data);
+	
+	  public:
+		// libFLAC's 0-8, default 5
+		static int getCompressionLevel(const Header &header);
+		static void setCompressionLevel(Header &header, int level);
+		
+		// Whether the channels go on the global pool, see CodecThreads in Thread.h.
+		static int threadCount();
+		static void setThreadCount(int count);
+	
+	  private:
+		MoxMxf::WaveAudioDescriptor _descriptor;
+		
+		int _compressionLevel;
+		
+		SampleType sampleType() const;
+		
+		// kept from frame to frame, one for each channel
+		std::vector<struct FLAC__StreamEncoder *> _encoders;
+		std::vector<struct FLAC__StreamDecoder *> _decoders;
+	};
+	
+	
+	// Takes 8, 16 and 24-bit audio.  Anything deeper, SIGNED32 or AFLOAT, is
+	// converted to 24-bit on the way in (see compressedType()), so the extra
+	// bits are lost and it's no longer lossless.
+	class FLACCodecInfo : public AudioCodecInfo
+	{
+	  public:
+		FLACCodecInfo() {}
+		virtual ~FLACCodecInfo() {}
+		
+		virtual bool canCompressType(SampleType sampleType) const;
+		
+		virtual AudioChannelCapabilities getChannelCapabilites() const;
+		
+		virtual AudioCodec * createCodec(const Header &header, const AudioChannelList &channels) const; // compression
+		virtual AudioCodec * createCodec(const MoxMxf::AudioDescriptor &descriptor, Header &header, AudioChannelList &channels) const; // decompression
+	};
+
+} // namespace
+
+#endif // MOXFILES_FLACCODEC_H
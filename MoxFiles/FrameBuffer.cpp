@@ -10,6 +10,8 @@
 #include <MoxFiles/FrameBuffer.h>
 
 #include <MoxFiles/Thread.h>
+#include <MoxFiles/BufferPool.h>
+#include <MoxFiles/SIMD.h>
 
 #include <MoxMxf/Exception.h>
 
@@ -18,6 +20,8 @@
 #include <algorithm>
 #include <cmath>
 
+#include <string.h>
+
 using std::min;
 using std::max;
 using std::string;
@@ -67,6 +71,21 @@ FrameBuffer::FrameBuffer(int width, int height) :
 }
 
 
+FrameBuffer::FrameBuffer(const FrameBuffer &other, const Box2i &dataWindow) :
+	_map(other._map),
+	_dataWindow(dataWindow),
+	_data(other._data),
+	_coefficients(other._coefficients)
+{
+	if( _dataWindow.isEmpty() )
+		throw MoxMxf::ArgExc("Invalid dimensions for FrameBuffer");
+	
+	if(_dataWindow.min.x < other._dataWindow.min.x || _dataWindow.max.x > other._dataWindow.max.x ||
+		_dataWindow.min.y < other._dataWindow.min.y || _dataWindow.max.y > other._dataWindow.max.y)
+		throw MoxMxf::ArgExc("FrameBuffer view is outside the frame");
+}
+
+
 class FillTask : public Task
 {
   public:
@@ -573,6 +592,69 @@ copySlice(TaskGroup &taskGroup,
 }
 
 
+// Each sample of a subsampled slice fills its xSampling by ySampling block
+// of a full resolution one, same type.
+class UpsampleTask : public Task
+{
+  public:
+	UpsampleTask(TaskGroup *group, const Slice &destination_slice, const Slice &source_slice, const Box2i &dw, int y);
+	virtual ~UpsampleTask() {}
+	
+	virtual void execute();
+
+  private:
+	const Slice &_destination_slice;
+	const Slice &_source_slice;
+	const Box2i &_dw;
+	const int _y;
+};
+
+
+UpsampleTask::UpsampleTask(TaskGroup *group, const Slice &destination_slice, const Slice &source_slice, const Box2i &dw, int y) :
+	Task(group),
+	_destination_slice(destination_slice),
+	_source_slice(source_slice),
+	_dw(dw),
+	_y(y)
+{
+
+}
+
+
+void
+UpsampleTask::execute()
+{
+	const size_t pix_size = PixelSize(_source_slice.type);
+	
+	char *dest = _destination_slice.base + (_y * _destination_slice.yStride) + (_dw.min.x * _destination_slice.xStride);
+	
+	const char *source_row = _source_slice.base + ((_y / _source_slice.ySampling) * _source_slice.yStride);
+	
+	for(int x = _dw.min.x; x <= _dw.max.x; x++)
+	{
+		memcpy(dest, source_row + ((x / _source_slice.xSampling) * _source_slice.xStride), pix_size);
+		
+		dest += _destination_slice.xStride;
+	}
+}
+
+
+static void
+upsampleSlice(TaskGroup &taskGroup,
+		const Slice &destination_slice,
+		const Slice &source_slice,
+		const Box2i &dw)
+{
+	assert(destination_slice.type == source_slice.type);
+	assert(destination_slice.xSampling == 1 && destination_slice.ySampling == 1);
+	
+	for(int y = dw.min.y; y <= dw.max.y; y++)
+	{
+		ThreadPool::addGlobalTask(new UpsampleTask(&taskGroup, destination_slice, source_slice, dw, y));
+	}
+}
+
+
 typedef struct RGBtoYCbCr_Coefficients
 {
 	double Yr;
@@ -1019,9 +1101,305 @@ copySlices_YCbCrtoRGB(TaskGroup &taskGroup,
 }
 
 
+class ReduceTask : public Task
+{
+  public:
+	ReduceTask(TaskGroup *group, const Slice &destination_slice, const Slice &source_slice,
+				const Box2i &dest_box, const Box2i &source_dw, int factor, int y);
+	virtual ~ReduceTask() {}
+	
+	virtual void execute();
+	
+  private:
+	template <typename T, typename SUM>
+	void ReduceRow(char *dest_origin, const char *source_origin, int rows, int width, int last_columns, int x);
+	
+	template <typename T, typename SUM>
+	static T Average(const SUM &sum, int count);
+	
+  private:
+	const Slice &_destination_slice;
+	const Slice &_source_slice;
+	const Box2i &_dest_box;
+	const Box2i &_source_dw;
+	const int _factor;
+	const int _y;
+};
+
+ReduceTask::ReduceTask(TaskGroup *group, const Slice &destination_slice, const Slice &source_slice,
+						const Box2i &dest_box, const Box2i &source_dw, int factor, int y) :
+	Task(group),
+	_destination_slice(destination_slice),
+	_source_slice(source_slice),
+	_dest_box(dest_box),
+	_source_dw(source_dw),
+	_factor(factor),
+	_y(y)
+{
+
+}
+
+#ifdef MOXFILES_SSE2
+// 2x2 boxes of planar pixels, returns how many output pixels were done
+static int
+Reduce2x2Row(unsigned char *out, const unsigned char *in0, const unsigned char *in1, int width)
+{
+	const __m128i mask = _mm_set1_epi16(0x00ff);
+	const __m128i round = _mm_set1_epi16(2);
+	
+	int x = 0;
+	
+	for(; x + 8 <= width; x += 8)
+	{
+		const __m128i a = _mm_loadu_si128((const __m128i *)(in0 + (2 * x)));
+		const __m128i b = _mm_loadu_si128((const __m128i *)(in1 + (2 * x)));
+		
+		const __m128i sum = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(a, mask), _mm_srli_epi16(a, 8)),
+											_mm_add_epi16(_mm_and_si128(b, mask), _mm_srli_epi16(b, 8)));
+		
+		const __m128i avg = _mm_srli_epi16(_mm_add_epi16(sum, round), 2);
+		
+		_mm_storel_epi64((__m128i *)(out + x), _mm_packus_epi16(avg, avg));
+	}
+	
+	return x;
+}
+
+static int
+Reduce2x2Row(unsigned short *out, const unsigned short *in0, const unsigned short *in1, int width)
+{
+	const __m128i mask = _mm_set1_epi32(0x0000ffff);
+	const __m128i round = _mm_set1_epi32(2);
+	const __m128i bias32 = _mm_set1_epi32(0x8000);
+	const __m128i bias16 = _mm_set1_epi16((short)0x8000);
+	
+	int x = 0;
+	
+	for(; x + 8 <= width; x += 8)
+	{
+		const __m128i a0 = _mm_loadu_si128((const __m128i *)(in0 + (2 * x)));
+		const __m128i a1 = _mm_loadu_si128((const __m128i *)(in0 + (2 * x) + 8));
+		const __m128i b0 = _mm_loadu_si128((const __m128i *)(in1 + (2 * x)));
+		const __m128i b1 = _mm_loadu_si128((const __m128i *)(in1 + (2 * x) + 8));
+		
+		const __m128i sum0 = _mm_add_epi32(_mm_add_epi32(_mm_and_si128(a0, mask), _mm_srli_epi32(a0, 16)),
+											_mm_add_epi32(_mm_and_si128(b0, mask), _mm_srli_epi32(b0, 16)));
+		const __m128i sum1 = _mm_add_epi32(_mm_add_epi32(_mm_and_si128(a1, mask), _mm_srli_epi32(a1, 16)),
+											_mm_add_epi32(_mm_and_si128(b1, mask), _mm_srli_epi32(b1, 16)));
+		
+		// SSE2 only has a signed 32->16 pack, so shift the range down and back
+		const __m128i avg0 = _mm_sub_epi32(_mm_srli_epi32(_mm_add_epi32(sum0, round), 2), bias32);
+		const __m128i avg1 = _mm_sub_epi32(_mm_srli_epi32(_mm_add_epi32(sum1, round), 2), bias32);
+		
+		_mm_storeu_si128((__m128i *)(out + x), _mm_xor_si128(_mm_packs_epi32(avg0, avg1), bias16));
+	}
+	
+	return x;
+}
+#endif // MOXFILES_SSE2
+
+void
+ReduceTask::execute()
+{
+	const int source_y = (_y * _factor);
+	const int rows = min(_factor, _source_dw.max.y - source_y + 1);
+	
+	const int width = (_dest_box.max.x - _dest_box.min.x + 1);
+	
+	// the last box might hang off the edge of the source
+	const int last_columns = min(_factor, _source_dw.max.x - (_dest_box.max.x * _factor) + 1);
+	
+	char *dest_origin = _destination_slice.base + (_y * _destination_slice.yStride) + (_dest_box.min.x * _destination_slice.xStride);
+	const char *source_origin = _source_slice.base + (source_y * _source_slice.yStride) + (_dest_box.min.x * _factor * _source_slice.xStride);
+	
+	int x = 0;
+	
+#ifdef MOXFILES_SSE2
+	if(_factor == 2 && rows == 2)
+	{
+		const int full_width = (last_columns == 2 ? width : width - 1);
+	
+		if(_source_slice.type == UINT8 && _source_slice.xStride == 1 && _destination_slice.xStride == 1)
+		{
+			x = Reduce2x2Row((unsigned char *)dest_origin, (const unsigned char *)source_origin,
+								(const unsigned char *)(source_origin + _source_slice.yStride), full_width);
+		}
+		else if(_source_slice.type != UINT8 && PixelSize(_source_slice.type) == 2 && _source_slice.type != HALF &&
+				_source_slice.xStride == 2 && _destination_slice.xStride == 2)
+		{
+			x = Reduce2x2Row((unsigned short *)dest_origin, (const unsigned short *)source_origin,
+								(const unsigned short *)(source_origin + _source_slice.yStride), full_width);
+		}
+	}
+#endif
+
+	switch(_source_slice.type)
+	{
+		case UINT8:
+			ReduceRow<unsigned char, unsigned int>(dest_origin, source_origin, rows, width, last_columns, x);
+		break;
+		
+		case UINT10:
+		case UINT12:
+		case UINT16:
+		case UINT16A:
+			ReduceRow<unsigned short, unsigned int>(dest_origin, source_origin, rows, width, last_columns, x);
+		break;
+		
+		case UINT32:
+			ReduceRow<unsigned int, UInt64>(dest_origin, source_origin, rows, width, last_columns, x);
+		break;
+		
+		case HALF:
+			ReduceRow<half, float>(dest_origin, source_origin, rows, width, last_columns, x);
+		break;
+		
+		case FLOAT:
+			ReduceRow<float, float>(dest_origin, source_origin, rows, width, last_columns, x);
+		break;
+	}
+}
+
+template <typename T, typename SUM>
+void
+ReduceTask::ReduceRow(char *dest_origin, const char *source_origin, int rows, int width, int last_columns, int x)
+{
+	const ptrdiff_t dest_xStride = _destination_slice.xStride;
+	const ptrdiff_t source_xStride = _source_slice.xStride;
+	const ptrdiff_t source_yStride = _source_slice.yStride;
+	
+	for(; x < width; x++)
+	{
+		const int columns = (x == width - 1 ? last_columns : _factor);
+		
+		const char *box = source_origin + (x * _factor * source_xStride);
+		
+		SUM sum = 0;
+		
+		for(int r = 0; r < rows; r++)
+		{
+			const char *pix = box + (r * source_yStride);
+			
+			for(int c = 0; c < columns; c++)
+			{
+				sum += *(const T *)pix;
+				
+				pix += source_xStride;
+			}
+		}
+		
+		*(T *)(dest_origin + (x * dest_xStride)) = Average<T, SUM>(sum, rows * columns);
+	}
+}
+
+template <typename T, typename SUM>
+T
+ReduceTask::Average(const SUM &sum, int count)
+{
+	return (sum + (count / 2)) / count;
+}
+
+template <>
+half
+ReduceTask::Average<half, float>(const float &sum, int count)
+{
+	return (sum / count);
+}
+
+template <>
+float
+ReduceTask::Average<float, float>(const float &sum, int count)
+{
+	return (sum / count);
+}
+
+static void
+reduceSlice(TaskGroup &taskGroup,
+			const Slice &destination_slice,
+			const Slice &source_slice,
+			const Box2i &dest_box,
+			const Box2i &source_dw,
+			int factor)
+{
+	assert(destination_slice.type == source_slice.type);
+	assert(destination_slice.xSampling == 1 && destination_slice.ySampling == 1);
+
+	for(int y = dest_box.min.y; y <= dest_box.max.y; y++)
+	{
+		ThreadPool::addGlobalTask(new ReduceTask(&taskGroup, destination_slice, source_slice, dest_box, source_dw, factor, y));
+	}
+}
+
+
+static bool
+Subsampled(const FrameBuffer &frame)
+{
+	for(FrameBuffer::ConstIterator i = frame.begin(); i != frame.end(); ++i)
+	{
+		if(i.slice().xSampling != 1 || i.slice().ySampling != 1)
+			return true;
+	}
+	
+	return false;
+}
+
+
+// The copies and reductions only work on full resolution slices, so frames
+// with subsampled ones, like 4:2:0 MPEG-2 or an OpenEXR file's, get those
+// upsampled into full first.  The rest are used as they are.
+static void
+UpsampleFrame(FrameBuffer &full, const FrameBuffer &frame)
+{
+	const Box2i &dataW = frame.dataWindow();
+	
+	const int width = frame.width();
+	const int height = frame.height();
+	
+	full.coefficients() = frame.coefficients();
+	
+	TaskGroup taskGroup;
+	
+	for(FrameBuffer::ConstIterator i = frame.begin(); i != frame.end(); ++i)
+	{
+		const Slice &slice = i.slice();
+		
+		if(slice.xSampling == 1 && slice.ySampling == 1)
+		{
+			full.insert(i.name(), slice);
+		}
+		else
+		{
+			const size_t pix_size = PixelSize(slice.type);
+			const size_t rowbytes = pix_size * width;
+			
+			DataChunkPtr data = new PooledDataChunk(rowbytes * height);
+			
+			char *origin = (char *)data->Data - (dataW.min.x * pix_size) - (dataW.min.y * rowbytes);
+			
+			full.insert(i.name(), Slice(slice.type, origin, pix_size, rowbytes, 1, 1, slice.fillValue));
+			
+			full.attachData(data);
+			
+			upsampleSlice(taskGroup, full[i.name()], slice, dataW);
+		}
+	}
+}
+
+
 void
 FrameBuffer::copyFromFrame(const FrameBuffer &other, bool fillMissing)
 {
+	if( Subsampled(other) )
+	{
+		FrameBuffer full(other._dataWindow);
+		
+		UpsampleFrame(full, other);
+		
+		copyFromFrame(full, fillMissing);
+		
+		return;
+	}
+	
 	if(_dataWindow.min.x < other._dataWindow.min.x ||
 		_dataWindow.min.y < other._dataWindow.min.y ||
 		_dataWindow.max.x > other._dataWindow.max.x ||
@@ -1285,6 +1663,115 @@ FrameBuffer::copyFromFrame(const FrameBuffer &other, bool fillMissing)
 }
 
 
+void
+FrameBuffer::reduceFromFrame(const FrameBuffer &other, int factor, bool fillMissing)
+{
+	if(factor < 1)
+		throw MoxMxf::ArgExc("Invalid reduction factor");
+	
+	if(factor == 1)
+	{
+		copyFromFrame(other, fillMissing);
+		
+		return;
+	}
+	
+	if( Subsampled(other) )
+	{
+		FrameBuffer full(other._dataWindow);
+		
+		UpsampleFrame(full, other);
+		
+		reduceFromFrame(full, factor, fillMissing);
+		
+		return;
+	}
+	
+	const Box2i reducedWindow = ReducedWindow(other._dataWindow, factor);
+	
+	// If we have all the same slices as the other frame,
+	// we can filter right into them.
+	bool direct = true;
+	
+	for(ConstIterator i = begin(); i != end() && direct; ++i)
+	{
+		const Slice *other_slice = other.findSlice(i.name());
+		
+		if(other_slice == NULL || other_slice->type != i.slice().type)
+			direct = false;
+	}
+	
+	if(direct)
+	{
+		if(_dataWindow.min.x < reducedWindow.min.x ||
+			_dataWindow.min.y < reducedWindow.min.y ||
+			_dataWindow.max.x > reducedWindow.max.x ||
+			_dataWindow.max.y > reducedWindow.max.y)
+		{
+			TaskGroup taskGroup;
+			
+			for(ConstIterator i = begin(); i != end(); ++i)
+			{
+				fillSlice(taskGroup, i.slice(), _dataWindow);
+			}
+		}
+		
+		const Box2i reduceBox(V2i(max(_dataWindow.min.x, reducedWindow.min.x),
+									max(_dataWindow.min.y, reducedWindow.min.y)),
+								V2i(min(_dataWindow.max.x, reducedWindow.max.x),
+									min(_dataWindow.max.y, reducedWindow.max.y)));
+		
+		if( !reduceBox.isEmpty() )
+		{
+			TaskGroup taskGroup;
+			
+			for(ConstIterator i = begin(); i != end(); ++i)
+			{
+				reduceSlice(taskGroup, i.slice(), other[i.name()], reduceBox, other._dataWindow, factor);
+			}
+		}
+	}
+	else
+	{
+		// Reduce into a frame just like the other one, then let
+		// copyFromFrame() deal with types and color spaces.
+		FrameBuffer reduced(reducedWindow);
+		
+		reduced._coefficients = other._coefficients;
+		
+		const int width = reduced.width();
+		const int height = reduced.height();
+		
+		for(ConstIterator i = other.begin(); i != other.end(); ++i)
+		{
+			const Slice &other_slice = i.slice();
+			
+			const size_t pix_size = PixelSize(other_slice.type);
+			const size_t rowbytes = pix_size * width;
+			
+			DataChunkPtr data = new PooledDataChunk(rowbytes * height);
+			
+			char *origin = (char *)data->Data - (reducedWindow.min.x * pix_size) - (reducedWindow.min.y * rowbytes);
+			
+			reduced.insert(i.name(), Slice(other_slice.type, origin, pix_size, rowbytes, 1, 1, other_slice.fillValue));
+			
+			reduced.attachData(data);
+		}
+		
+		{
+			TaskGroup taskGroup;
+			
+			for(ConstIterator i = reduced.begin(); i != reduced.end(); ++i)
+			{
+				reduceSlice(taskGroup, i.slice(), other[i.name()], reducedWindow, other._dataWindow, factor);
+			}
+		}
+		
+		copyFromFrame(reduced, fillMissing);
+	}
+}
+
+
 void
 FrameBuffer::insert (const char name[], const Slice &slice)
 {
@@ -1444,6 +1931,21 @@ FrameBuffer::isYCbCr() const
 	return (NULL != findSlice("Y") && NULL != findSlice("Cb") && NULL != findSlice("Cr"));
 }
 
+
+static inline int
+CeilDivide(int num, int den)
+{
+	return (num >= 0 ? (num + den - 1) / den : -(-num / den));
+}
+
+Box2i
+ReducedWindow(const Box2i &window, int factor)
+{
+	// Same rounding as JPEG 2000 resolution levels and libjpeg scaling
+	return Box2i(V2i(CeilDivide(window.min.x, factor), CeilDivide(window.min.y, factor)),
+					V2i(CeilDivide(window.max.x + 1, factor) - 1, CeilDivide(window.max.y + 1, factor) - 1));
+}
+
 } // namespace
 
 
@@ -121,11 +121,22 @@ class FrameBuffer : public RefCount<FrameBuffer>
   public:
 	FrameBuffer(const Box2i &dataWindow);
 	FrameBuffer(int width, int height);
+	
+	// A view of part of another frame: the same slices (so the same memory),
+	// with a smaller data window that must be inside the other one.
+	FrameBuffer(const FrameBuffer &other, const Box2i &dataWindow);
 	~FrameBuffer() {}
 	
+	// Subsampled slices in the other frame are upsampled, each sample filling
+	// its block.  Ours have to be full resolution.
 	void copyFromFrame(const FrameBuffer &other, bool fillMissing = true);
 	void copyFromFrame(const FrameBuffer *other, bool fillMissing = true) { copyFromFrame(*other, fillMissing); }
 	
+	// Box filter the other frame down by factor (2, 4, 8...).  Our data window should
+	// be in reduced coordinates, i.e. ReducedWindow(other.dataWindow(), factor).
+	// Subsampled slices are upsampled first, like copyFromFrame().
+	void reduceFromFrame(const FrameBuffer &other, int factor, bool fillMissing = true);
+	
 	void attachData(DataChunkPtr dat) { _data.push_back(dat);  }
 	
 	
@@ -220,6 +231,10 @@ class FrameBuffer : public RefCount<FrameBuffer>
 typedef SmartPtr<FrameBuffer> FrameBufferPtr;
 
 
+// The data window of a frame reduced by factor, rounding up like JPEG 2000 does.
+Box2i ReducedWindow(const Box2i &window, int factor);
+
+
 //----------
 // Iterators
 //----------
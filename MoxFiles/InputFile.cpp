@@ -19,7 +19,9 @@ namespace MoxFiles
 InputFile::InputFile(MoxMxf::IOStream &infile) :
 	_mxf_file(infile),
 	_bodySID(0),
-	_indexSID(0)
+	_indexSID(0),
+	_next_video_frame(-1),
+	_stream_start(-1)
 {
 	_header.duration() = _mxf_file.getDuration();
 	_header.frameRate() = _mxf_file.getEditRate();
@@ -267,7 +269,7 @@ InputFile::InputFile(MoxMxf::IOStream &infile) :
 					unit.sampleIndex.push_back(0);
 				}
 				
-				unit.sampleIndex.push_back(unit.sampleIndex[f] + unit.codec->samplesInFrame( part->getDataSize() ));
+				unit.sampleIndex.push_back(unit.sampleIndex[f] + unit.codec->samplesInFrame( f, part->getDataSize() ));
 			}
 			else
 				assert(false);
@@ -295,17 +297,86 @@ InputFile::~InputFile()
 
 
 void
-InputFile::getFrame(int frameNumber, FrameBuffer &frameBuffer)
+InputFile::getFrame(int frameNumber, FrameBuffer &frameBuffer, int resolutionFactor)
 {
+	if(resolutionFactor != 1 && resolutionFactor != 2 && resolutionFactor != 4 && resolutionFactor != 8)
+		throw MoxMxf::ArgExc("Resolution factor must be 1, 2, 4, or 8");
+	
+	readFrame(frameNumber, frameBuffer, resolutionFactor, NULL);
+}
+
+
+void
+InputFile::getFrame(int frameNumber, FrameBuffer &frameBuffer, const Box2i &region)
+{
+	const Box2i &dataW = _header.dataWindow();
+	const Box2i &frameW = frameBuffer.dataWindow();
+	
+	const Box2i clipped_region(V2i(std::max(region.min.x, std::max(dataW.min.x, frameW.min.x)),
+									std::max(region.min.y, std::max(dataW.min.y, frameW.min.y))),
+								V2i(std::min(region.max.x, std::min(dataW.max.x, frameW.max.x)),
+									std::min(region.max.y, std::min(dataW.max.y, frameW.max.y))));
+	
+	if( clipped_region.isEmpty() )
+		throw MoxMxf::ArgExc("Region does not overlap the frame");
+	
+	if(clipped_region == dataW)
+		readFrame(frameNumber, frameBuffer, 1, NULL);
+	else
+		readFrame(frameNumber, frameBuffer, 1, &clipped_region);
+}
+
+
+void
+InputFile::readFrame(int frameNumber, FrameBuffer &frameBuffer, int resolutionFactor, const Box2i *region)
+{
+	if(!_video_codec_units.empty() && _video_codec_units.front().codec->reordersFrames())
+	{
+		readReorderedFrame(frameNumber, frameBuffer, resolutionFactor, region);
+		
+		return;
+	}
+	
+	const int nextFrame = _next_video_frame;
+	
+	_next_video_frame = -1; // unless we get all the way through
+	
+	MoxMxf::FramePtr mxf_frame;
+	
+	if(frameNumber < _header.duration())
+	{
+		mxf_frame = _mxf_file.getFrame(frameNumber, _bodySID, _indexSID);
+		
+		if(!mxf_frame)
+			throw MoxMxf::NullExc("NULL frame");
+		
+		// An inter-frame codec needs every frame from the key frame on.  The
+		// decoders hang on to their references, so if they're already partway
+		// there (playing forward) pick up where they left off.
+		const int keyFrame = frameNumber + mxf_frame->getKeyOffset();
+		
+		if(keyFrame < frameNumber)
+		{
+			const int startFrame = (nextFrame > keyFrame && nextFrame <= frameNumber ? nextFrame : keyFrame);
+			
+			for(int f = startFrame; f < frameNumber; f++)
+				skipFrame(f);
+		}
+	}
+	
+	
 	bool got_frame = false;
 	
 	int frameToRequest = frameNumber;
 	
+	bool ended = false;
+	
 	while(!got_frame)
 	{
 		if(frameToRequest < _header.duration())
 		{
-			MoxMxf::FramePtr mxf_frame = _mxf_file.getFrame(frameToRequest, _bodySID, _indexSID);
+			if(frameToRequest != frameNumber)
+				mxf_frame = _mxf_file.getFrame(frameToRequest, _bodySID, _indexSID);
 			
 			if(!mxf_frame)
 				throw MoxMxf::NullExc("NULL frame");
@@ -325,14 +396,12 @@ InputFile::getFrame(int frameNumber, FrameBuffer &frameBuffer)
 					
 					mxflib::DataChunk &data = part->getData();
 					
-					unit.codec->decompress(data);
-					
-					FrameBufferPtr decompressed_frame = unit.codec->getNextFrame();
+					const bool decompressed = (region != NULL ?
+												unit.codec->decompressRegion(data, frameBuffer, *region) :
+												unit.codec->decompressReduced(data, frameBuffer, resolutionFactor));
 					
-					if(decompressed_frame)
+					if(decompressed)
 					{
-						frameBuffer.copyFromFrame(*decompressed_frame);
-						
 						got_frame = true;
 					}
 				}
@@ -344,6 +413,8 @@ InputFile::getFrame(int frameNumber, FrameBuffer &frameBuffer)
 		}
 		else
 		{
+			ended = true;
+			
 			for(std::list<VideoCodecUnit>::iterator u = _video_codec_units.begin(); u != _video_codec_units.end(); ++u)
 			{
 				VideoCodecUnit &unit = *u;
@@ -354,7 +425,14 @@ InputFile::getFrame(int frameNumber, FrameBuffer &frameBuffer)
 				
 				if(decompressed_frame)
 				{
-					frameBuffer.copyFromFrame(*decompressed_frame);
+					if(region != NULL)
+					{
+						FrameBuffer region_view(frameBuffer, *region);
+						
+						region_view.copyFromFrame(*decompressed_frame);
+					}
+					else
+						frameBuffer.reduceFromFrame(*decompressed_frame, resolutionFactor);
 					
 					got_frame = true;
 				}
@@ -363,6 +441,206 @@ InputFile::getFrame(int frameNumber, FrameBuffer &frameBuffer)
 			}
 		}
 	}
+	
+	if(!ended)
+		_next_video_frame = frameToRequest;
+}
+
+
+void
+InputFile::readReorderedFrame(int frameNumber, FrameBuffer &frameBuffer, int resolutionFactor, const Box2i *region)
+{
+	if(frameNumber < 0 || frameNumber >= _header.duration())
+		throw MoxMxf::ArgExc("Frame number out of range");
+	
+	MoxMxf::FramePtr mxf_frame = _mxf_file.getFrame(frameNumber, _bodySID, _indexSID);
+	
+	if(!mxf_frame)
+		throw MoxMxf::NullExc("NULL frame");
+	
+	// where the frame is stored, and the key frame decoding has to start from
+	const int storedFrame = frameNumber + mxf_frame->getTemporalOffset();
+	const int keyFrame = storedFrame + mxf_frame->getKeyOffset();
+	
+	const int nextFrame = _next_video_frame;
+	
+	_next_video_frame = -1; // unless we get all the way through
+	
+	// Keep going with the decoders if they started at or before that key
+	// frame, are past it, and haven't already put out this frame and moved on.
+	bool carry_on = (nextFrame > keyFrame && _stream_start <= keyFrame);
+	
+	for(std::list<VideoCodecUnit>::iterator u = _video_codec_units.begin(); u != _video_codec_units.end(); ++u)
+	{
+		VideoCodecUnit &unit = *u;
+		
+		if(unit.last_output >= frameNumber && unit.reordered.find(frameNumber) == unit.reordered.end())
+			carry_on = false;
+	}
+	
+	int position = nextFrame;
+	
+	if(!carry_on)
+	{
+		for(std::list<VideoCodecUnit>::iterator u = _video_codec_units.begin(); u != _video_codec_units.end(); ++u)
+		{
+			VideoCodecUnit &unit = *u;
+			
+			unit.codec->startStream(keyFrame);
+			
+			unit.reordered.clear();
+			unit.last_output = -1;
+		}
+		
+		_stream_start = keyFrame;
+		
+		position = keyFrame;
+	}
+	
+	
+	bool ended = false;
+	
+	while(true)
+	{
+		bool have_frame = true;
+		
+		for(std::list<VideoCodecUnit>::iterator u = _video_codec_units.begin(); u != _video_codec_units.end(); ++u)
+		{
+			VideoCodecUnit &unit = *u;
+			
+			if(unit.reordered.find(frameNumber) == unit.reordered.end())
+				have_frame = false;
+		}
+		
+		if(have_frame)
+			break;
+		
+		if(position < _header.duration())
+		{
+			MoxMxf::FramePtr stored_frame = _mxf_file.getFrame(position, _bodySID, _indexSID, false);
+			
+			if(!stored_frame)
+				throw MoxMxf::NullExc("NULL frame");
+			
+			MoxMxf::Frame::FrameParts &frameParts = stored_frame->getFrameParts();
+			
+			for(std::list<VideoCodecUnit>::iterator u = _video_codec_units.begin(); u != _video_codec_units.end(); ++u)
+			{
+				VideoCodecUnit &unit = *u;
+				
+				if(frameParts.find(unit.trackNumber) != frameParts.end())
+				{
+					MoxMxf::FramePartPtr part = frameParts[unit.trackNumber];
+					
+					if(!part)
+						throw MoxMxf::NullExc("Null part?!?");
+					
+					unit.codec->decompress( part->getData() );
+					
+					collectFrames(unit, frameNumber);
+				}
+				else
+					assert(false);
+			}
+			
+			position++;
+		}
+		else if(!ended)
+		{
+			for(std::list<VideoCodecUnit>::iterator u = _video_codec_units.begin(); u != _video_codec_units.end(); ++u)
+			{
+				VideoCodecUnit &unit = *u;
+				
+				unit.codec->end_of_stream();
+				
+				collectFrames(unit, frameNumber);
+			}
+			
+			ended = true;
+		}
+		else
+			throw MoxMxf::InputExc("Can't get requested frame");
+	}
+	
+	
+	for(std::list<VideoCodecUnit>::iterator u = _video_codec_units.begin(); u != _video_codec_units.end(); ++u)
+	{
+		VideoCodecUnit &unit = *u;
+		
+		std::map<int, FrameBufferPtr>::iterator f = unit.reordered.find(frameNumber);
+		
+		const FrameBuffer &decompressed_frame = *f->second;
+		
+		if(region != NULL)
+		{
+			FrameBuffer region_view(frameBuffer, *region);
+			
+			region_view.copyFromFrame(decompressed_frame);
+		}
+		else
+			frameBuffer.reduceFromFrame(decompressed_frame, resolutionFactor);
+		
+		unit.reordered.erase(unit.reordered.begin(), ++f);
+	}
+	
+	if(!ended)
+		_next_video_frame = position;
+}
+
+
+void
+InputFile::collectFrames(VideoCodecUnit &unit, int frameNumber)
+{
+	// Frames come out in display order.  Keep the one we want and any after
+	// it, which we'll probably be asked for next.
+	FrameBufferPtr decompressed_frame = unit.codec->getNextFrame();
+	
+	while(decompressed_frame)
+	{
+		const int displayFrame = unit.codec->lastFrameNumber();
+		
+		if(displayFrame >= frameNumber)
+			unit.reordered[displayFrame] = decompressed_frame;
+		
+		unit.last_output = displayFrame;
+		
+		decompressed_frame = unit.codec->getNextFrame();
+	}
+}
+
+
+void
+InputFile::skipFrame(int frameNumber)
+{
+	// decode a frame only so the codecs have it as a reference
+	MoxMxf::FramePtr mxf_frame = _mxf_file.getFrame(frameNumber, _bodySID, _indexSID);
+	
+	if(!mxf_frame)
+		throw MoxMxf::NullExc("NULL frame");
+	
+	MoxMxf::Frame::FrameParts &frameParts = mxf_frame->getFrameParts();
+	
+	for(std::list<VideoCodecUnit>::iterator u = _video_codec_units.begin(); u != _video_codec_units.end(); ++u)
+	{
+		VideoCodecUnit &unit = *u;
+		
+		if(frameParts.find(unit.trackNumber) != frameParts.end())
+		{
+			MoxMxf::FramePartPtr part = frameParts[unit.trackNumber];
+			
+			if(!part)
+				throw MoxMxf::NullExc("Null part?!?");
+			
+			unit.codec->decompress( part->getData() );
+			
+			FrameBufferPtr decompressed_frame = unit.codec->getNextFrame();
+			
+			while(decompressed_frame)
+				decompressed_frame = unit.codec->getNextFrame();
+		}
+		else
+			assert(false);
+	}
 }
 
 
@@ -499,20 +777,9 @@ InputFile::readAudio(UInt64 samples, AudioBuffer &buffer)
 				
 				mxflib::DataChunk &data = frameParts[unit.trackNumber]->getData();
 				
-				unit.codec->decompress(data);
-				
-				AudioBufferPtr codec_buffer = unit.codec->getNextBuffer();
+				AudioBufferPtr track_buffer = trackBuffers[unit.trackNumber];
 				
-				if(codec_buffer)
-				{
-					if(start_sample > 0)
-						codec_buffer->fastForward(start_sample);
-				
-					AudioBufferPtr track_buffer = trackBuffers[unit.trackNumber];
-					
-					track_buffer->copyFromBuffer(*codec_buffer, samples_to_read);
-				}
-				else
+				if(!unit.codec->decompressInto(data, *track_buffer, start_sample, samples_to_read))
 					throw MoxMxf::LogicExc("Not currently dealing with codecs that don't return audio every time.");
 			}
 			
@@ -27,11 +27,23 @@ namespace MoxFiles
 		
 		const Header & header() const { return _header; }
 		
-		void getFrame(int frameNumber, FrameBuffer &frameBuffer);
+		// For a proxy, pass a resolutionFactor of 2, 4 or 8 and a FrameBuffer
+		// with ReducedWindow(header().dataWindow(), resolutionFactor).
+		void getFrame(int frameNumber, FrameBuffer &frameBuffer, int resolutionFactor = 1);
+		
+		// Only decode the pixels in region (data window coordinates, full resolution).
+		// The rest of the FrameBuffer is left alone, and codecs that can will skip
+		// decoding it altogether.
+		void getFrame(int frameNumber, FrameBuffer &frameBuffer, const Box2i &region);
 		
 		void seekAudio(UInt64 sampleNum) { _sample_num = sampleNum; }
 		void readAudio(UInt64 samples, AudioBuffer &buffer);
 		
+	  private:
+		void readFrame(int frameNumber, FrameBuffer &frameBuffer, int resolutionFactor, const Box2i *region);
+		void readReorderedFrame(int frameNumber, FrameBuffer &frameBuffer, int resolutionFactor, const Box2i *region);
+		void skipFrame(int frameNumber);
+		
 	  private:
 		MoxMxf::InputFile _mxf_file;
 		MoxMxf::SID _bodySID;
@@ -45,12 +57,21 @@ namespace MoxFiles
 			VideoCodec *codec;
 			MoxMxf::TrackNum trackNumber;
 			
-			VideoCodecUnit() : codec(NULL) {}
-			VideoCodecUnit(ChannelList ch, VideoCodec *co, MoxMxf::TrackNum tr) : channelList(ch), codec(co), trackNumber(tr) {}
+			// for codecs that reorder frames: ones decoded ahead of the one asked for
+			std::map<int, FrameBufferPtr> reordered;
+			int last_output;
+			
+			VideoCodecUnit() : codec(NULL), last_output(-1) {}
+			VideoCodecUnit(ChannelList ch, VideoCodec *co, MoxMxf::TrackNum tr) : channelList(ch), codec(co), trackNumber(tr), last_output(-1) {}
 		} VideoCodecUnit;
 		
 		std::list<VideoCodecUnit> _video_codec_units;
 		
+		int _next_video_frame; // the stored frame the video codecs would see next, or -1
+		int _stream_start; // the key frame they started from
+		
+		void collectFrames(VideoCodecUnit &unit, int frameNumber);
+		
 		
 		typedef struct AudioCodecUnit
 		{
@@ -14,7 +14,33 @@
 
 #include "openjpeg.h"
 
+#ifdef MOXFILES_USE_OPENJPH
+#include <openjph/ojph_arch.h>
+#include <openjph/ojph_mem.h>
+#include <openjph/ojph_file.h>
+#include <openjph/ojph_params.h>
+#include <openjph/ojph_codestream.h>
+#endif
+
+#include <stdexcept>
+#include <vector>
+
 #include <assert.h>
+#include <math.h>
+#include <string.h>
+
+// opj_set_decoded_components() showed up in OpenJPEG 2.4
+#if defined(OPJ_VERSION_MAJOR) && (OPJ_VERSION_MAJOR > 2 || (OPJ_VERSION_MAJOR == 2 && OPJ_VERSION_MINOR >= 4))
+#define MOXFILES_OPJ_DECODED_COMPONENTS 1
+#endif
+
+// and it could decode HTJ2K as of 2.5
+#if defined(OPJ_VERSION_MAJOR) && (OPJ_VERSION_MAJOR > 2 || (OPJ_VERSION_MAJOR == 2 && OPJ_VERSION_MINOR >= 5))
+#define MOXFILES_OPJ_HTJ2K 1
+#endif
+
+// Rsiz bit that says the codestream uses Part 15 (HT) block coding
+static const unsigned int RsizHighThroughput = (1 << 14);
 //#include <algorithm>
 
 namespace MoxFiles
@@ -73,6 +99,20 @@ JPEG2000Codec::JPEG2000Codec(const Header &header, const ChannelList &channels)
 	
 	_lossless = isLossless(header);
 	_quality = (_lossless ? 100 : getQuality(header));
+	
+	_tileSize = getTileSize(header);
+	_codeBlockSize = getCodeBlockSize(header);
+	
+	_highThroughput = getHighThroughput(header);
+	
+	if(_highThroughput)
+	{
+#ifdef MOXFILES_USE_OPENJPH
+		_descriptor.setRsiz(RsizHighThroughput);
+#else
+		throw MoxMxf::NoImplExc("Writing HTJ2K needs OpenJPH");
+#endif
+	}
 }
 
 
@@ -80,7 +120,12 @@ JPEG2000Codec::JPEG2000Codec(const MoxMxf::VideoDescriptor &descriptor, Header &
 	VideoCodec(descriptor, header, channels),
 	_descriptor(dynamic_cast<const MoxMxf::RGBADescriptor &>(descriptor)),
 	_depth(JP2_10),
-	_channels(JP2_RGB)
+	_channels(JP2_RGB),
+	_lossless(true),
+	_quality(100),
+	_tileSize(0),
+	_codeBlockSize(64),
+	_highThroughput(false)
 {
 	assert(_descriptor.getVideoCodec() == MoxMxf::VideoDescriptor::VideoCodecJPEG2000);
 
@@ -119,6 +164,15 @@ JPEG2000Codec::JPEG2000Codec(const MoxMxf::VideoDescriptor &descriptor, Header &
 	
 	if(_channels == JP2_RGBA)
 		channels.insert("A", Channel(pixel_type));
+	
+	
+	// the descriptor has a copy of the codestream's Rsiz
+	if(_descriptor.getRsiz() & RsizHighThroughput)
+	{
+		_highThroughput = true;
+		
+		setHighThroughput(header, true);
+	}
 }
 
 
@@ -128,6 +182,60 @@ JPEG2000Codec::~JPEG2000Codec()
 }
 
 
+bool
+JPEG2000Codec::getHighThroughput(const Header &header)
+{
+	const IntAttribute *highThroughputAttr = header.findTypedAttribute<IntAttribute>("jpeg2000HighThroughput");
+	
+	return (highThroughputAttr != NULL && highThroughputAttr->value() != 0);
+}
+
+
+void
+JPEG2000Codec::setHighThroughput(Header &header, bool highThroughput)
+{
+	header.insert("jpeg2000HighThroughput", IntAttribute(highThroughput ? 1 : 0));
+}
+
+
+int
+JPEG2000Codec::getTileSize(const Header &header)
+{
+	const IntAttribute *tileSizeAttr = header.findTypedAttribute<IntAttribute>("jpeg2000TileSize");
+	
+	return (tileSizeAttr != NULL ? tileSizeAttr->value() : 0);
+}
+
+
+void
+JPEG2000Codec::setTileSize(Header &header, int tileSize)
+{
+	if(tileSize < 0 || (tileSize & (tileSize - 1)) != 0)
+		throw MoxMxf::ArgExc("JPEG 2000 tile size must be a power of 2");
+	
+	header.insert("jpeg2000TileSize", IntAttribute(tileSize));
+}
+
+
+int
+JPEG2000Codec::getCodeBlockSize(const Header &header)
+{
+	const IntAttribute *codeBlockSizeAttr = header.findTypedAttribute<IntAttribute>("jpeg2000CodeBlockSize");
+	
+	return (codeBlockSizeAttr != NULL ? codeBlockSizeAttr->value() : 64);
+}
+
+
+void
+JPEG2000Codec::setCodeBlockSize(Header &header, int codeBlockSize)
+{
+	if(codeBlockSize < 4 || codeBlockSize > 64 || (codeBlockSize & (codeBlockSize - 1)) != 0)
+		throw MoxMxf::ArgExc("JPEG 2000 code-block size must be a power of 2 from 4 to 64");
+	
+	header.insert("jpeg2000CodeBlockSize", IntAttribute(codeBlockSize));
+}
+
+
 static void
 ErrorHandler(const char *msg, void *client_data)
 {
@@ -209,7 +317,7 @@ OutputStreamSeek(OPJ_OFF_T p_nb_bytes, void * p_user_data)
 class CopyToJP2Buffer : public Task
 {
   public:
-	CopyToJP2Buffer(TaskGroup *group, const opj_image_comp_t &component, const Slice &slice, int y);
+	CopyToJP2Buffer(TaskGroup *group, const opj_image_comp_t &component, const Slice &slice, const Box2i &dw, int y);
 	~CopyToJP2Buffer() {}
 	
 	virtual void execute();
@@ -217,16 +325,18 @@ class CopyToJP2Buffer : public Task
   private:
 	const opj_image_comp_t &_comp;
 	const Slice &_slice;
+	const Box2i &_dw;
 	const int _y;
 	
 	template <typename PIXTYPE>
-	void CopyRow(OPJ_INT32 *out, const PIXTYPE *in, int inStep, int len);
+	void CopyRow(OPJ_INT32 *out, const char *in, ptrdiff_t inStride, int len);
 };
 
-CopyToJP2Buffer::CopyToJP2Buffer(TaskGroup *group, const opj_image_comp_t &component, const Slice &slice, int y) :
+CopyToJP2Buffer::CopyToJP2Buffer(TaskGroup *group, const opj_image_comp_t &component, const Slice &slice, const Box2i &dw, int y) :
 	Task(group),
 	_comp(component),
 	_slice(slice),
+	_dw(dw),
 	_y(y)
 {
 
@@ -235,11 +345,12 @@ CopyToJP2Buffer::CopyToJP2Buffer(TaskGroup *group, const opj_image_comp_t &compo
 void
 CopyToJP2Buffer::execute()
 {
-	OPJ_INT32 *outRow = (_comp.data + (_y * _comp.w));
+	// _y is in data window coordinates, the component starts at 0
+	OPJ_INT32 *outRow = (_comp.data + ((_y - _dw.min.y) * _comp.w));
 	const int outDepth = _comp.prec;
 	
-	const char *inRow = (_slice.base + (_y * _slice.yStride));
-	const int inStep = (_slice.xStride / PixelSize(_slice.type));
+	const char *inRow = (_slice.base + (_y * _slice.yStride) + (_dw.min.x * _slice.xStride));
+	const ptrdiff_t inStride = _slice.xStride;
 	const int inDepth = PixelBits(_slice.type);
 	
 	assert(outDepth == inDepth);
@@ -247,11 +358,11 @@ CopyToJP2Buffer::execute()
 	
 	if(_slice.type == UINT8)
 	{
-		CopyRow<unsigned char>(outRow, (unsigned char *)inRow, inStep, _comp.w);
+		CopyRow<unsigned char>(outRow, inRow, inStride, _comp.w);
 	}
 	else if(_slice.type == UINT10 || _slice.type == UINT12 || _slice.type == UINT16)
 	{
-		CopyRow<unsigned short>(outRow, (unsigned short *)inRow, inStep, _comp.w);
+		CopyRow<unsigned short>(outRow, inRow, inStride, _comp.w);
 	}
 	else
 		assert(false);
@@ -259,21 +370,94 @@ CopyToJP2Buffer::execute()
 
 template <typename PIXTYPE>
 void
-CopyToJP2Buffer::CopyRow(OPJ_INT32 *out, const PIXTYPE *in, int inStep, int len)
+CopyToJP2Buffer::CopyRow(OPJ_INT32 *out, const char *in, ptrdiff_t inStride, int len)
 {
 	for(int x=0; x < len; x++)
 	{
-		*out = *in;
+		*out = *(const PIXTYPE *)in;
 		
 		out++;
-		in += inStep;
+		in += inStride;
 	}
 }
 
 
+const FrameBuffer &
+JPEG2000Codec::nativeInput(const FrameBuffer &frame, FrameBuffer &tempBuffer)
+{
+	const PixelType pixelType = nativeType();
+	
+	const ChannelList channels = nativeChannels();
+	
+	// If the caller's slices are already what we're writing, use them.
+	// Otherwise convert into our staging buffer first.
+	bool input_matches = (frame.dataWindow() == dataWindow());
+	
+	for(ChannelList::ConstIterator i = channels.begin(); i != channels.end(); ++i)
+	{
+		const Slice *slice = frame.findSlice(i.name());
+		
+		if(slice == NULL || slice->type != pixelType || slice->xSampling != 1 || slice->ySampling != 1)
+			input_matches = false;
+	}
+	
+	if(input_matches)
+		return frame;
+	
+	
+	const Box2i &dataW = tempBuffer.dataWindow();
+	
+	assert(dataW == dataWindow());
+	
+	const size_t tempPixelSize = PixelSize(pixelType);
+	const size_t tempRowBytes = (tempBuffer.width() * tempPixelSize);
+	const size_t tempChannelSize = (tempBuffer.height() * tempRowBytes);
+	
+	unsigned int staging_index = 0;
+	
+	for(ChannelList::ConstIterator i = channels.begin(); i != channels.end(); ++i)
+	{
+		char *origin = stagingBuffer(tempChannelSize, staging_index++) - (dataW.min.x * tempPixelSize) - (dataW.min.y * tempRowBytes);
+		
+		tempBuffer.insert(i.name(), Slice(pixelType, origin, tempPixelSize, tempRowBytes));
+	}
+	
+	tempBuffer.copyFromFrame(frame);
+	
+	return tempBuffer;
+}
+
+
+static int
+DecompositionLevels(int width, int height, int tileSize)
+{
+	// OpenJPEG's default is 5, but every level halves the smallest
+	// side of a tile and neither library will go below one sample
+	const int tile_w = (tileSize > 0 && tileSize < width ? tileSize : width);
+	const int tile_h = (tileSize > 0 && tileSize < height ? tileSize : height);
+	
+	const int smallest = (tile_w < tile_h ? tile_w : tile_h);
+	
+	int levels = 0;
+	
+	while(levels < 5 && (smallest >> (levels + 1)) > 0)
+		levels++;
+	
+	return levels;
+}
+
+
 void
 JPEG2000Codec::compress(const FrameBuffer &frame)
 {
+	if(_highThroughput)
+	{
+		compressHT(frame);
+		
+		return;
+	}
+	
+
 	//const PixelType pixel_type = (_depth == JP2_8 ? MoxFiles::UINT8 : MoxFiles::UINT16);
 	//const size_t bytes_per_subpixel = PixelSize(pixel_type);
 	const int num_channels = (_channels == JP2_RGBA ? 4 : 3);
@@ -313,7 +497,8 @@ JPEG2000Codec::compress(const FrameBuffer &frame)
 			opj_set_warning_handler(codec, WarningHandler, NULL);
 			opj_set_info_handler(codec, InfoHandler, NULL);
 			
-			//opj_codec_set_threads(codec, NumberOfCPUs());
+			// OpenJPEG spreads the code-blocks over its own threads
+			opj_codec_set_threads(codec, codecThreadCount());
 			
 			const OPJ_UINT32 depth = (_depth == JP2_8 ? 8 :
 										_depth == JP2_10 ? 10 :
@@ -354,30 +539,12 @@ JPEG2000Codec::compress(const FrameBuffer &frame)
 				image->y1 = height;
 				
 				
-				const PixelType nativeType = (_depth == JP2_8 ? UINT8 :
-												_depth == JP2_10 ? UINT10 :
-												_depth == JP2_12 ? UINT12 :
-												_depth == JP2_16 ? UINT16 :
-												UINT8);
-												
-				FrameBuffer tempBuffer(dataW);
-				
-				const size_t tempPixelSize = PixelSize(nativeType);
-				const size_t tempRowBytes = (width * tempPixelSize);
-				const size_t tempChannelSize = (height * tempRowBytes);
-												
 				const char *chanNames[4] = { "R", "G", "B", "A" };
 				
-				for(int i=0; i < num_channels; i++)
-				{
-					DataChunkPtr chanData = new DataChunk(tempChannelSize);
-					
-					tempBuffer.insert(chanNames[i], Slice(nativeType, (char *)chanData->Data, tempPixelSize, tempRowBytes));
-					
-					tempBuffer.attachData(chanData);
-				}
+				// OpenJPEG's buffers get filled straight from the caller's slices if we can
+				FrameBuffer tempBuffer(dataW);
 				
-				tempBuffer.copyFromFrame(frame);
+				const FrameBuffer &frame_to_use = nativeInput(frame, tempBuffer);
 				
 				
 				{
@@ -385,17 +552,15 @@ JPEG2000Codec::compress(const FrameBuffer &frame)
 				
 					for(OPJ_UINT32 i=0U; i < num_channels; i++)
 					{
-						const Slice *slice = tempBuffer.findSlice(chanNames[i]);
+						const Slice *slice = frame_to_use.findSlice(chanNames[i]);
 					
 						if(slice != NULL)
 						{
 							const opj_image_comp_t &comp = image->comps[i];
 							
-							assert(dataW.min.x == 0 && dataW.min.y == 0);
-							
-							for(int y=0; y < height; y++)
+							for(int y = dataW.min.y; y <= dataW.max.y; y++)
 							{
-								ThreadPool::addGlobalTask(new CopyToJP2Buffer(&taskGroup, comp, *slice, y));
+								ThreadPool::addGlobalTask(new CopyToJP2Buffer(&taskGroup, comp, *slice, dataW, y));
 							}
 						}
 						else
@@ -408,6 +573,20 @@ JPEG2000Codec::compress(const FrameBuffer &frame)
 				
 				opj_set_default_encoder_parameters(&params);
 				
+				if(_tileSize > 0 && (_tileSize < width || _tileSize < height))
+				{
+					params.tile_size_on = OPJ_TRUE;
+					params.cp_tx0 = 0;
+					params.cp_ty0 = 0;
+					params.cp_tdx = _tileSize;
+					params.cp_tdy = _tileSize;
+				}
+				
+				params.cblockw_init = _codeBlockSize;
+				params.cblockh_init = _codeBlockSize;
+				
+				params.numresolution = DecompositionLevels(width, height, _tileSize) + 1;
+				
 				
 				if(_lossless)
 				{
@@ -489,6 +668,141 @@ JPEG2000Codec::compress(const FrameBuffer &frame)
 }
 
 
+#ifdef MOXFILES_USE_OPENJPH
+template <typename PIXTYPE>
+static void
+CopyToHTLine(ojph::si32 *out, const char *in, ptrdiff_t inStride, int len)
+{
+	for(int x=0; x < len; x++)
+	{
+		*out++ = *(const PIXTYPE *)in;
+		
+		in += inStride;
+	}
+}
+
+
+static float
+QuantizationStep(int quality)
+{
+	// quality 100 is a very fine step, 1 is coarse
+	return (0.1f * powf(0.001f, (float)(quality - 1) / 99.0f));
+}
+#endif
+
+
+void
+JPEG2000Codec::compressHT(const FrameBuffer &frame)
+{
+#ifdef MOXFILES_USE_OPENJPH
+	// OpenJPEG can only decode HT codestreams, so we write them with OpenJPH
+	const int num_channels = (_channels == JP2_RGBA ? 4 : 3);
+	
+	const Box2i dataW = dataWindow();
+	
+	const int width = (dataW.max.x - dataW.min.x + 1);
+	const int height = (dataW.max.y - dataW.min.y + 1);
+	
+	FrameBuffer tempBuffer(dataW);
+	
+	const FrameBuffer &frame_to_use = nativeInput(frame, tempBuffer);
+	
+	const char *chanNames[4] = { "R", "G", "B", "A" };
+	
+	const Slice *slices[4];
+	
+	for(int i=0; i < num_channels; i++)
+		slices[i] = &frame_to_use[chanNames[i]];
+	
+	
+	DataChunkPtr data;
+	
+	try
+	{
+		ojph::codestream codestream;
+		
+		ojph::param_siz siz = codestream.access_siz();
+		
+		siz.set_image_extent(ojph::point(width, height));
+		siz.set_image_offset(ojph::point(0, 0));
+		siz.set_num_components(num_channels);
+		
+		for(int i=0; i < num_channels; i++)
+			siz.set_component(i, ojph::point(1, 1), PixelBits(nativeType()), false);
+		
+		if(_tileSize > 0)
+			siz.set_tile_size(ojph::size(_tileSize, _tileSize));
+		
+		siz.set_tile_offset(ojph::point(0, 0));
+		
+		
+		ojph::param_cod cod = codestream.access_cod();
+		
+		cod.set_num_decomposition(DecompositionLevels(width, height, _tileSize));
+		cod.set_block_dims(_codeBlockSize, _codeBlockSize);
+		cod.set_color_transform(true); // RCT or ICT on R, G, B
+		cod.set_reversible(_lossless);
+		
+		if(!_lossless)
+			codestream.access_qcd().set_irrev_quant(QuantizationStep(_quality));
+		
+		codestream.set_planar(false);
+		
+		
+		ojph::mem_outfile file;
+		
+		file.open();
+		
+		codestream.write_headers(&file);
+		
+		
+		// lines are asked for one component at a time, row by row
+		ojph::ui32 next_comp = 0;
+		
+		ojph::line_buf *line = codestream.exchange(NULL, next_comp);
+		
+		for(int y = dataW.min.y; y <= dataW.max.y; y++)
+		{
+			for(int i=0; i < num_channels; i++)
+			{
+				assert(next_comp == i);
+				
+				const Slice &slice = *slices[next_comp];
+				
+				const char *inRow = (slice.base + (y * slice.yStride) + (dataW.min.x * slice.xStride));
+				
+				if(slice.type == UINT8)
+					CopyToHTLine<unsigned char>(line->i32, inRow, slice.xStride, width);
+				else
+					CopyToHTLine<unsigned short>(line->i32, inRow, slice.xStride, width);
+				
+				line = codestream.exchange(line, next_comp);
+			}
+		}
+		
+		codestream.flush();
+		
+		
+		// closing the codestream closes (and frees) the file
+		data = new PooledDataChunk(file.tell());
+		
+		memcpy(data->Data, file.get_data(), data->Size);
+		
+		codestream.close();
+	}
+	catch(const std::runtime_error &e)
+	{
+		// OJPH_ERROR throws std::runtime_error, anything else can go up as is
+		throw MoxMxf::ArgExc(std::string("HTJ2K compression error: ") + e.what());
+	}
+	
+	storeData(data);
+#else
+	throw MoxMxf::NoImplExc("Writing HTJ2K needs OpenJPH");
+#endif
+}
+
+
 static OPJ_SIZE_T
 InputStreamRead(void * p_buffer, OPJ_SIZE_T p_nb_bytes, void * p_user_data)
 {
@@ -543,7 +857,7 @@ InputStreamSeek(OPJ_OFF_T p_nb_bytes, void * p_user_data)
 class CopyFromJP2Buffer : public Task
 {
   public:
-	CopyFromJP2Buffer(TaskGroup *group, const Slice &slice, const opj_image_comp_t &component, int y);
+	CopyFromJP2Buffer(TaskGroup *group, const Slice &slice, const opj_image_comp_t &component, const Box2i &dw, int y);
 	~CopyFromJP2Buffer() {}
 	
 	virtual void execute();
@@ -551,16 +865,18 @@ class CopyFromJP2Buffer : public Task
   private:
 	const Slice &_slice;
 	const opj_image_comp_t &_comp;
+	const Box2i &_dw;
 	const int _y;
 	
 	template <typename PIXTYPE>
 	void CopyRow(PIXTYPE *out, int outStep, const OPJ_INT32 *in, int len);
 };
 
-CopyFromJP2Buffer::CopyFromJP2Buffer(TaskGroup *group, const Slice &slice, const opj_image_comp_t &component, int y) :
+CopyFromJP2Buffer::CopyFromJP2Buffer(TaskGroup *group, const Slice &slice, const opj_image_comp_t &component, const Box2i &dw, int y) :
 	Task(group),
 	_slice(slice),
 	_comp(component),
+	_dw(dw),
 	_y(y)
 {
 
@@ -569,11 +885,12 @@ CopyFromJP2Buffer::CopyFromJP2Buffer(TaskGroup *group, const Slice &slice, const
 void
 CopyFromJP2Buffer::execute()
 {
-	const char *outRow = (_slice.base + (_y * _slice.yStride));
+	// _y is in data window coordinates, the component starts at 0
+	const char *outRow = (_slice.base + (_y * _slice.yStride) + (_dw.min.x * _slice.xStride));
 	const int outStep = (_slice.xStride / PixelSize(_slice.type));
 	const int outDepth = PixelBits(_slice.type);
 	
-	OPJ_INT32 *inRow = (_comp.data + (_y * _comp.w));
+	OPJ_INT32 *inRow = (_comp.data + ((_y - _dw.min.y) * _comp.w));
 	const int inDepth = _comp.prec;
 	
 	assert(outDepth == inDepth);
@@ -605,10 +922,167 @@ CopyFromJP2Buffer::CopyRow(PIXTYPE *out, int outStep, const OPJ_INT32 *in, int l
 }
 
 
+PixelType
+JPEG2000Codec::nativeType() const
+{
+	return (_depth == JP2_8 ? UINT8 :
+			_depth == JP2_10 ? UINT10 :
+			_depth == JP2_12 ? UINT12 :
+			_depth == JP2_16 ? UINT16 :
+			UINT8);
+}
+
+
+ChannelList
+JPEG2000Codec::nativeChannels() const
+{
+	ChannelList channels;
+	
+	channels.insert("R", Channel(nativeType()));
+	channels.insert("G", Channel(nativeType()));
+	channels.insert("B", Channel(nativeType()));
+	
+	if(_channels == JP2_RGBA)
+		channels.insert("A", Channel(nativeType()));
+	
+	return channels;
+}
+
+
+FrameBufferPtr
+JPEG2000Codec::nativeFrame(const Box2i &dataW, const ChannelList &channels) const
+{
+	const int width = (dataW.max.x - dataW.min.x + 1);
+	const int height = (dataW.max.y - dataW.min.y + 1);
+	
+	const PixelType pixelType = nativeType();
+	
+	const size_t pixsize = PixelSize(pixelType);
+	const size_t rowbytes = width * pixsize;
+	const size_t buffer_size = rowbytes * height;
+	
+	FrameBufferPtr frame_buffer = new FrameBuffer(dataW);
+	
+	for(ChannelList::ConstIterator i = channels.begin(); i != channels.end(); ++i)
+	{
+		DataChunkPtr channel_data = new PooledDataChunk(buffer_size);
+		
+		char *origin = (char *)channel_data->Data - (dataW.min.x * pixsize) - (dataW.min.y * rowbytes);
+		
+		frame_buffer->insert(i.name(), Slice(pixelType, origin, pixsize, rowbytes));
+		
+		frame_buffer->attachData(channel_data);
+	}
+	
+	return frame_buffer;
+}
+
+
 void
 JPEG2000Codec::decompress(const DataChunk &data)
 {
+	FrameBufferPtr frame_buffer = nativeFrame(dataWindow(), nativeChannels());
+	
+	decompressFrame(data, *frame_buffer);
+	
+	storeFrame(frame_buffer);
+}
+
+
+bool
+JPEG2000Codec::decompressInto(const DataChunk &data, FrameBuffer &frameBuffer)
+{
+	if(frameBuffer.dataWindow() == dataWindow() && subsetOfChannels(frameBuffer, nativeChannels()))
+	{
+		// components get copied straight to the caller's slices
+		decompressFrame(data, frameBuffer);
+	}
+	else
+	{
+		// only decode the channels that will get used, then convert
+		FrameBufferPtr frame_buffer = nativeFrame(dataWindow(), wantedChannels(frameBuffer, nativeChannels()));
+		
+		decompressFrame(data, *frame_buffer);
+		
+		frameBuffer.copyFromFrame(*frame_buffer);
+	}
+	
+	return true;
+}
+
+
+bool
+JPEG2000Codec::decompressReduced(const DataChunk &data, FrameBuffer &frameBuffer, int resolutionFactor)
+{
+	if(resolutionFactor == 1)
+		return decompressInto(data, frameBuffer);
+	
+	// OpenJPEG can stop at a lower resolution level and skip
+	// the rest of the wavelet transform, if the factor is a power of 2
+	if((resolutionFactor & (resolutionFactor - 1)) == 0)
+	{
+		const Box2i reducedW = ReducedWindow(dataWindow(), resolutionFactor);
+		
+		if(frameBuffer.dataWindow() == reducedW && subsetOfChannels(frameBuffer, nativeChannels()))
+		{
+			if( decompressFrame(data, frameBuffer, resolutionFactor) )
+				return true;
+		}
+		else
+		{
+			FrameBufferPtr reduced_frame = nativeFrame(reducedW, wantedChannels(frameBuffer, nativeChannels()));
+			
+			if( decompressFrame(data, *reduced_frame, resolutionFactor) )
+			{
+				frameBuffer.copyFromFrame(*reduced_frame);
+				
+				return true;
+			}
+		}
+	}
+	
+	// not enough resolution levels in the codestream
+	return VideoCodec::decompressReduced(data, frameBuffer, resolutionFactor);
+}
+
+
+bool
+JPEG2000Codec::decompressRegion(const DataChunk &data, FrameBuffer &frameBuffer, const Box2i &region)
+{
+	if( subsetOfChannels(frameBuffer, nativeChannels()) )
+	{
+		if( decompressFrame(data, frameBuffer, 1, &region) )
+			return true;
+	}
+	else
+	{
+		FrameBufferPtr region_frame = nativeFrame(region, wantedChannels(frameBuffer, nativeChannels()));
+		
+		if( decompressFrame(data, *region_frame, 1, &region) )
+		{
+			FrameBuffer region_view(frameBuffer, region);
+			
+			region_view.copyFromFrame(*region_frame);
+			
+			return true;
+		}
+	}
+	
+	// OpenJPEG didn't like the area
+	return VideoCodec::decompressRegion(data, frameBuffer, region);
+}
+
+
+bool
+JPEG2000Codec::decompressFrame(const DataChunk &data, FrameBuffer &frameBuffer, int resolutionFactor, const Box2i *region)
+{
+#ifndef MOXFILES_OPJ_HTJ2K
+	if(_highThroughput)
+		throw MoxMxf::NoImplExc("Reading HTJ2K needs OpenJPEG 2.5");
+#endif
+	
 	bool success = true;
+	bool configured = true;
 	
 	opj_stream_t *stream = opj_stream_create(OPJ_J2K_STREAM_CHUNK_SIZE, OPJ_TRUE);
 	
@@ -631,7 +1105,7 @@ JPEG2000Codec::decompress(const DataChunk &data)
 			opj_set_warning_handler(codec, WarningHandler, NULL);
 			opj_set_info_handler(codec, InfoHandler, NULL);
 			
-			opj_codec_set_threads(codec, ThreadPool::globalThreadPool().numThreads());
+			opj_codec_set_threads(codec, codecThreadCount());
 			
 			
 			opj_image_t *image = NULL;
@@ -639,71 +1113,105 @@ JPEG2000Codec::decompress(const DataChunk &data)
 			OPJ_BOOL imageRead = opj_read_header(stream, codec, &image);
 			
 			if(imageRead && image != NULL)
+			{
+				assert(_descriptor.getStoredWidth() == image->x1);
+				assert(_descriptor.getStoredHeight() == image->y1);
+				assert((_channels == JP2_RGBA ? 4 : 3) == image->numcomps);
+			}
+			
+			if(imageRead && image != NULL && resolutionFactor > 1)
+			{
+				OPJ_UINT32 reduce = 0;
+				
+				while((1 << reduce) < resolutionFactor)
+					reduce++;
+				
+				// fails if the codestream has fewer decomposition levels
+				configured = opj_set_decoded_resolution_factor(codec, reduce);
+			}
+			
+			if(imageRead && image != NULL && region != NULL)
+			{
+				assert(resolutionFactor == 1);
+				
+				// only the code-blocks touching the area get decoded,
+				// which is in codestream coordinates, starting at 0
+				const Box2i dataW = dataWindow();
+				
+				configured = opj_set_decode_area(codec, image,
+													region->min.x - dataW.min.x, region->min.y - dataW.min.y,
+													region->max.x - dataW.min.x + 1, region->max.y - dataW.min.y + 1);
+			}
+			
+			const OPJ_UINT32 num_channels = (_channels == JP2_RGBA ? 4 : 3);
+			
+			const char *chanNames[4] = { "R", "G", "B", "A" };
+			
+			// which channel each component in the decoded image is
+			std::vector<OPJ_UINT32> components;
+			
+			for(OPJ_UINT32 i=0U; i < num_channels; i++)
+				components.push_back(i);
+			
+#ifdef MOXFILES_OPJ_DECODED_COMPONENTS
+			if(imageRead && image != NULL && configured && _channels == JP2_RGBA &&
+				frameBuffer.findSlice("A") != NULL &&
+				frameBuffer.findSlice("R") == NULL && frameBuffer.findSlice("G") == NULL && frameBuffer.findSlice("B") == NULL)
+			{
+				// Just the alpha.  Picking components turns off the inverse
+				// color transform, which is why we can't leave out only some of RGB.
+				const OPJ_UINT32 alpha = 3;
+				
+				if( opj_set_decoded_components(codec, 1, &alpha, OPJ_FALSE) )
+				{
+					components.clear();
+					components.push_back(alpha);
+				}
+			}
+#endif
+			
+			if(!configured)
+			{
+				// let the caller do it another way
+			}
+			else if(imageRead && image != NULL)
 			{
 				imageRead = opj_decode(codec, stream, image);
 			
 				if(imageRead)
 				{
-					assert(_descriptor.getStoredWidth() == image->x1);
-					assert(_descriptor.getStoredHeight() == image->y1);
-					assert((_channels == JP2_RGBA ? 4 : 3) == image->numcomps);
-					
-					const Box2i dataW = dataWindow();
+					const Box2i dataW = (region != NULL ? *region : ReducedWindow(dataWindow(), resolutionFactor));
 					
 					const int width = (dataW.max.x - dataW.min.x + 1);
 					const int height = (dataW.max.y - dataW.min.y + 1);
 					
-					const PixelType nativeType = (_depth == JP2_8 ? UINT8 :
-													_depth == JP2_10 ? UINT10 :
-													_depth == JP2_12 ? UINT12 :
-													_depth == JP2_16 ? UINT16 :
-													UINT8);
-													
-					const size_t pixsize = PixelSize(nativeType);
-					const size_t rowbytes = width * pixsize;
-					const size_t buffer_size = rowbytes * height;
-					
-					const int num_channels = (_channels == JP2_RGBA ? 4 : 3);
-					
-					
-					const char *chanNames[4] = { "R", "G", "B", "A" };
-					
-					FrameBufferPtr frame_buffer = new FrameBuffer(dataW);
-					
-					for(int i=0; i < num_channels; i++)
-					{
-						DataChunkPtr channel_data = new DataChunk(buffer_size);
-						
-						frame_buffer->insert(chanNames[i], Slice(nativeType, (char *)channel_data->Data, pixsize, rowbytes));
-						
-						frame_buffer->attachData(channel_data);
-					}
+					assert(components.size() == image->numcomps);
 					
 					{
 						TaskGroup taskGroup;
 					
-						for(OPJ_UINT32 i=0U; i < num_channels; i++)
+						for(OPJ_UINT32 i=0U; i < components.size(); i++)
 						{
-							const Slice *slice = frame_buffer->findSlice(chanNames[i]);
+							const Slice *slice = frameBuffer.findSlice(chanNames[components[i]]);
 						
 							if(slice != NULL)
 							{
 								const opj_image_comp_t &comp = image->comps[i];
 								
-								assert(width == comp.w && height == comp.h);
-								assert(dataW.min.x == 0 && dataW.min.y == 0);
+								if(width != comp.w || height != comp.h)
+								{
+									success = false;
+									
+									break;
+								}
 								
-								for(int y=0; y < height; y++)
+								for(int y = dataW.min.y; y <= dataW.max.y; y++)
 								{
-									ThreadPool::addGlobalTask(new CopyFromJP2Buffer(&taskGroup, *slice, comp, y));
+									ThreadPool::addGlobalTask(new CopyFromJP2Buffer(&taskGroup, *slice, comp, dataW, y));
 								}
 							}
-							else
-								assert(false);
 						}
 					}
-					
-					storeFrame(frame_buffer);
 				}
 				else
 					success = false;
@@ -727,6 +1235,8 @@ JPEG2000Codec::decompress(const DataChunk &data)
 	
 	if(!success)
 		throw MoxMxf::ArgExc("JPEG 2000 decompression error");
+	
+	return configured;
 }
 
 
@@ -24,7 +24,27 @@ namespace MoxFiles
 		virtual const MoxMxf::VideoDescriptor * getDescriptor() const { return &_descriptor; }
 		
 		virtual void compress(const FrameBuffer &frame);
+		virtual bool convertsInput() const { return true; }
 		virtual void decompress(const DataChunk &data);
+		virtual bool decompressInto(const DataChunk &data, FrameBuffer &frameBuffer);
+		virtual bool decompressReduced(const DataChunk &data, FrameBuffer &frameBuffer, int resolutionFactor);
+		virtual bool decompressRegion(const DataChunk &data, FrameBuffer &frameBuffer, const Box2i &region);
+		
+	  public:
+		// Encoder settings that go in the Header.  With tiles (a power of 2, 0 for one big
+		// tile) a region decode only has to touch some of the codestream.  Code-blocks
+		// (4 to 64, a power of 2) are what OpenJPEG's threads work on.
+		static int getTileSize(const Header &header);
+		static void setTileSize(Header &header, int tileSize);
+		
+		static int getCodeBlockSize(const Header &header);
+		static void setCodeBlockSize(Header &header, int codeBlockSize);
+		
+		// High-Throughput JPEG 2000 (Part 15) block coding: an order of magnitude
+		// faster than the classic kind.  Writing it needs MOXFILES_USE_OPENJPH,
+		// reading needs OpenJPEG 2.5.  Set in the header of files that have it.
+		static bool getHighThroughput(const Header &header);
+		static void setHighThroughput(Header &header, bool highThroughput);
 	
 	  private:
 		MoxMxf::RGBADescriptor _descriptor;
@@ -45,8 +65,25 @@ namespace MoxFiles
 		
 		JP2_Depth _depth;
 		
+		PixelType nativeType() const;
+		ChannelList nativeChannels() const;
+		FrameBufferPtr nativeFrame(const Box2i &dataW, const ChannelList &channels) const;
+		
+		// returns false if the codestream can't be reduced that much (or OpenJPEG
+		// won't take the region, which is in the unreduced data window)
+		bool decompressFrame(const DataChunk &data, FrameBuffer &frameBuffer, int resolutionFactor = 1, const Box2i *region = NULL);
+		
 		bool _lossless;
 		int _quality;
+		
+		int _tileSize;
+		int _codeBlockSize;
+		
+		bool _highThroughput;
+		
+		const FrameBuffer & nativeInput(const FrameBuffer &frame, FrameBuffer &tempBuffer);
+		
+		void compressHT(const FrameBuffer &frame);
 	};
 	
 	
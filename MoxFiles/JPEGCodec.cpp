@@ -9,11 +9,15 @@
 
 #include <MoxFiles/JPEGCodec.h>
 
-#include <MoxFiles/MemoryFile.h>
+#include <MoxFiles/Thread.h>
 
-#include <iostream>
+#include <algorithm>
+#include <string>
+#include <vector>
 
 #include <assert.h>
+#include <stdio.h>
+#include <string.h>
 
 #include "jpeglib.h"
 
@@ -24,7 +28,12 @@ namespace MoxFiles
 
 JPEGCodec::JPEGCodec(const Header &header, const ChannelList &channels) :
 	VideoCodec(header, channels),
-	_descriptor(header.frameRate(), header.width(), header.height(), MoxMxf::VideoDescriptor::VideoCodecJPEG)
+	_descriptor(header.frameRate(), header.width(), header.height(), MoxMxf::VideoDescriptor::VideoCodecJPEG),
+	_restartRows(0),
+	_lastCompressedSize(0),
+	_errorMgr(NULL),
+	_compressor(NULL),
+	_decompressor(NULL)
 {
 	setWindows(_descriptor, header);
 	
@@ -50,15 +59,23 @@ JPEGCodec::JPEGCodec(const Header &header, const ChannelList &channels) :
 	
 	
 	_quality = (isLossless(header) ? 100 : getQuality(header));
+	
+	_restartRows = getRestartInterval(header);
 }
 
 
 JPEGCodec::JPEGCodec(const MoxMxf::VideoDescriptor &descriptor, Header &header, ChannelList &channels) :
 	VideoCodec(descriptor, header, channels),
-	_descriptor(dynamic_cast<const MoxMxf::RGBADescriptor &>(descriptor))
+	_descriptor(dynamic_cast<const MoxMxf::RGBADescriptor &>(descriptor)),
+	_quality(100),
+	_restartRows(0),
+	_lastCompressedSize(0),
+	_errorMgr(NULL),
+	_compressor(NULL),
+	_decompressor(NULL)
 {
 	assert(_descriptor.getVideoCodec() == MoxMxf::VideoDescriptor::VideoCodecJPEG);
-
+	
 	const MoxMxf::RGBADescriptor::RGBALayout &pixelLayout = _descriptor.getPixelLayout();
 	
 	assert(pixelLayout.size() == 3 && pixelLayout.at(0).depth == 8);
@@ -71,15 +88,53 @@ JPEGCodec::JPEGCodec(const MoxMxf::VideoDescriptor &descriptor, Header &header,
 
 JPEGCodec::~JPEGCodec()
 {
+	if(_compressor != NULL)
+	{
+		jpeg_destroy_compress(_compressor);
+		
+		delete _compressor;
+	}
+	
+	if(_decompressor != NULL)
+	{
+		jpeg_destroy_decompress(_decompressor);
+		
+		delete _decompressor;
+	}
+	
+	for(std::vector<JPEGStripeDecoder *>::iterator i = _stripeDecoders.begin(); i != _stripeDecoders.end(); ++i)
+		delete *i;
+	
+	delete _errorMgr;
+}
+
+
+int
+JPEGCodec::getRestartInterval(const Header &header)
+{
+	const IntAttribute *restartAttr = header.findTypedAttribute<IntAttribute>("jpegRestartInterval");
+	
+	return (restartAttr != NULL ? restartAttr->value() : 0);
+}
 
+
+void
+JPEGCodec::setRestartInterval(Header &header, int mcuRows)
+{
+	if(mcuRows < 0 || mcuRows > 65535)
+		throw MoxMxf::ArgExc("JPEG restart interval must be 0 to 65535 MCU rows");
+	
+	header.insert("jpegRestartInterval", IntAttribute(mcuRows));
 }
 
 
 static void my_error_exit(j_common_ptr cinfo)
 {
-	std::cout << "my_error_exit" << std::endl;
+	char buffer[JMSG_LENGTH_MAX];
 	
-	throw MoxMxf::ArgExc("fatal libjpeg error");
+	(*cinfo->err->format_message)(cinfo, buffer);
+	
+	throw MoxMxf::ArgExc(std::string("fatal libjpeg error: ") + buffer);
 }
 
 static void my_emit_message(j_common_ptr cinfo, int msg_level)
@@ -90,13 +145,11 @@ static void my_emit_message(j_common_ptr cinfo, int msg_level)
 	if(msg_level < 0)
 	{
 		// warning
-		std::cout << "my_emit_message warning: " << msg_level << std::endl;
-		
 		if(err->num_warnings == 0 || err->trace_level >= 3)
 		{
 			(*err->output_message) (cinfo);
 		}
-	  
+		
 		err->num_warnings++;
 	}
 	else
@@ -111,13 +164,11 @@ static void my_emit_message(j_common_ptr cinfo, int msg_level)
 
 static void my_output_message(j_common_ptr cinfo)
 {
-	std::cout << "my_output_message" << std::endl;
+	// warnings and traces are dropped, errors come out in the exception
 }
 
 static void my_format_message(j_common_ptr cinfo, char *buffer)
 {
-	std::cout << "my_format_message" << std::endl;
-	
 	struct jpeg_error_mgr *err = cinfo->err;
 	
 	const int msg_code = err->msg_code;
@@ -135,7 +186,25 @@ static void my_format_message(j_common_ptr cinfo, char *buffer)
 		msgtext = err->addon_message_table[msg_code - err->first_addon_message];
 	}
 	
-	assert(msgtext != NULL);
+	if(msgtext == NULL)
+	{
+		err->msg_parm.i[0] = msg_code;
+		msgtext = err->jpeg_message_table[0];
+	}
+	
+	// same as libjpeg's own: a %s anywhere means the parameter is a string
+	if(strstr(msgtext, "%s") != NULL)
+	{
+		sprintf(buffer, msgtext, err->msg_parm.s);
+	}
+	else
+	{
+		sprintf(buffer, msgtext,
+				err->msg_parm.i[0], err->msg_parm.i[1],
+				err->msg_parm.i[2], err->msg_parm.i[3],
+				err->msg_parm.i[4], err->msg_parm.i[5],
+				err->msg_parm.i[6], err->msg_parm.i[7]);
+	}
 }
 
 static void my_reset_error_mgr(j_common_ptr cinfo)
@@ -152,104 +221,318 @@ static const char * const jpeg_std_message_table[] = {
 };
 
 
-typedef struct
+static void
+InitErrorManager(struct jpeg_error_mgr &jerr)
 {
-  struct jpeg_destination_mgr pub; /* public fields */
+	jerr.error_exit = my_error_exit;
+	jerr.emit_message = my_emit_message;
+	jerr.output_message = my_output_message;
+	jerr.format_message = my_format_message;
+	jerr.reset_error_mgr = my_reset_error_mgr;
+	
+	jerr.trace_level = 0;
+	jerr.num_warnings = 0;
+	jerr.msg_code = 0;
+	
+	jerr.jpeg_message_table = jpeg_std_message_table;
+	jerr.last_jpeg_message = (int) JMSG_LASTMSGCODE - 1;
+	
+	jerr.addon_message_table = NULL;
+	jerr.first_addon_message = 0;
+	jerr.last_addon_message = 0;
+}
 
-  MemoryFile *outfile;                /* target stream */
-  
-  JOCTET *buffer;
-  size_t bufferSize;
-  
-} my_destination_mgr;
 
-static void my_init_destination(j_compress_ptr cinfo)
+struct jpeg_error_mgr *
+JPEGCodec::errorManager()
 {
-	my_destination_mgr *mgr = (my_destination_mgr *)cinfo->dest;
-	
-	const size_t bufSize = 4096;
+	if(_errorMgr == NULL)
+	{
+		_errorMgr = new jpeg_error_mgr;
+		
+		InitErrorManager(*_errorMgr);
+	}
 	
-	mgr->buffer = (JOCTET *)malloc(bufSize);
-	mgr->bufferSize = bufSize / sizeof(JOCTET);
+	return _errorMgr;
+}
+
+
+struct jpeg_compress_struct &
+JPEGCodec::compressor()
+{
+	// Made once and reused, so libjpeg isn't setting up its
+	// memory manager and tables for every frame.
+	if(_compressor == NULL)
+	{
+		_compressor = new jpeg_compress_struct;
+		
+		_compressor->err = errorManager();
+		
+		jpeg_create_compress(_compressor);
+	}
 	
-	if(mgr->buffer == NULL)
-		throw MoxMxf::NullExc("out of memory");
+	return *_compressor;
+}
+
+
+struct jpeg_decompress_struct &
+JPEGCodec::decompressor()
+{
+	if(_decompressor == NULL)
+	{
+		_decompressor = new jpeg_decompress_struct;
+		
+		_decompressor->err = errorManager();
+		
+		jpeg_create_decompress(_decompressor);
+	}
 	
-	mgr->pub.next_output_byte = mgr->buffer;
-	mgr->pub.free_in_buffer = mgr->bufferSize;
+	return *_decompressor;
 }
 
-static boolean my_empty_output_buffer(j_compress_ptr cinfo)
+
+static const char * const RGBNames[3] = { "R", "G", "B" };
+static const char * const YCbCrNames[3] = { "Y", "Cb", "Cr" };
+
+static bool
+IsJFIFYCbCr(const FrameBuffer &frameBuffer)
 {
-	my_destination_mgr *mgr = (my_destination_mgr *)cinfo->dest;
+	// JFIF Y'CbCr is full-range Rec. 601, so that's the only kind
+	// we can hand to libjpeg without converting it ourselves
+	return (frameBuffer.isYCbCr() && frameBuffer.coefficients() == FrameBuffer::Rec601_FullRange);
+}
 
-	const MoxMxf::UInt64 wrote = mgr->outfile->FileWrite(mgr->buffer, mgr->bufferSize);
+
+static bool
+NativeYCbCr(const FrameBuffer &frameBuffer)
+{
+	if( !IsJFIFYCbCr(frameBuffer) )
+		return false;
 	
-	if(wrote != mgr->bufferSize)
+	for(int i=0; i < 3; i++)
 	{
-		ERREXIT(cinfo, JERR_FILE_WRITE);
+		const Slice &slice = frameBuffer[YCbCrNames[i]];
+		
+		if(slice.xSampling != 1 || slice.ySampling != 1)
+			return false;
 	}
 	
-	mgr->pub.next_output_byte = mgr->buffer;
-	mgr->pub.free_in_buffer = mgr->bufferSize;
+	return true;
+}
+
+
+static bool
+PlanarYCbCr(const FrameBuffer &frameBuffer, int &xSampling, int &ySampling)
+{
+	// Planar 8-bit Y'CbCr with the chroma already subsampled 2x1 or 2x2.
+	// libjpeg can take and give that as raw data, skipping color conversion
+	// and chroma resampling altogether.
+	if( !IsJFIFYCbCr(frameBuffer) )
+		return false;
+	
+	const Box2i &dw = frameBuffer.dataWindow();
 	
-	return TRUE;
+	if(dw.min.x != 0 || dw.min.y != 0)
+		return false;
+	
+	for(int i=0; i < 3; i++)
+	{
+		const Slice &slice = frameBuffer[YCbCrNames[i]];
+		
+		if(slice.type != UINT8 || slice.xStride != 1)
+			return false;
+	}
+	
+	const Slice &Y = frameBuffer["Y"];
+	const Slice &Cb = frameBuffer["Cb"];
+	const Slice &Cr = frameBuffer["Cr"];
+	
+	if(Y.xSampling != 1 || Y.ySampling != 1)
+		return false;
+	
+	if(Cb.xSampling != Cr.xSampling || Cb.ySampling != Cr.ySampling)
+		return false;
+	
+	if(Cb.xSampling != 2 || (Cb.ySampling != 1 && Cb.ySampling != 2))
+		return false;
+	
+	xSampling = Cb.xSampling;
+	ySampling = Cb.ySampling;
+	
+	return true;
 }
 
-static void my_term_destination(j_compress_ptr cinfo)
+
+// One component's rows for jpeg_write_raw_data() or jpeg_read_raw_data().
+// libjpeg works a whole iMCU row at a time and wants the width padded out
+// to a multiple of DCTSIZE, so rows that fit point straight into the plane
+// and the rest go through a small band buffer.
+class RawPlane
 {
-	my_destination_mgr *mgr = (my_destination_mgr *)cinfo->dest;
+  public:
+	RawPlane(const Slice &slice, const jpeg_component_info &component, char *band);
+	~RawPlane() {}
 	
-	const size_t leftToWrite = (mgr->bufferSize - mgr->pub.free_in_buffer);
+	JSAMPARRAY rows(int iMCURow, bool fill);
+	void store();
+	
+	static size_t bandSize(const jpeg_component_info &component);
+
+  private:
+	char * const _plane;
+	const ptrdiff_t _rowbytes;
+	const int _width;
+	const int _height;
+	const int _paddedWidth;
+	const int _bandRows;
+	char * const _band;
+	
+	int _firstRow;
+	
+	JSAMPROW _rows[MAX_SAMP_FACTOR * DCTSIZE];
+	
+	bool inBand(int i) const { return (_rows[i] == (JSAMPROW)(_band + (i * _paddedWidth))); }
+};
+
+
+RawPlane::RawPlane(const Slice &slice, const jpeg_component_info &component, char *band) :
+	_plane(slice.base),
+	_rowbytes(slice.yStride),
+	_width(component.downsampled_width),
+	_height(component.downsampled_height),
+	_paddedWidth(component.width_in_blocks * DCTSIZE),
+	_bandRows(component.v_samp_factor * DCTSIZE),
+	_band(band),
+	_firstRow(0)
+{
+	assert(_bandRows <= (MAX_SAMP_FACTOR * DCTSIZE));
+}
+
+
+size_t
+RawPlane::bandSize(const jpeg_component_info &component)
+{
+	return (component.width_in_blocks * DCTSIZE * component.v_samp_factor * DCTSIZE);
+}
+
+
+JSAMPARRAY
+RawPlane::rows(int iMCURow, bool fill)
+{
+	_firstRow = (iMCURow * _bandRows);
 	
-	if(leftToWrite > 0)
+	for(int i=0; i < _bandRows; i++)
 	{
-		const MoxMxf::UInt64 wrote = mgr->outfile->FileWrite(mgr->buffer, leftToWrite);
+		const int y = (_firstRow + i);
 		
-		if(wrote != leftToWrite)
+		if(y < _height && _paddedWidth == _width)
+		{
+			_rows[i] = (JSAMPROW)(_plane + (y * _rowbytes));
+		}
+		else
 		{
-			ERREXIT(cinfo, JERR_FILE_WRITE);
+			_rows[i] = (JSAMPROW)(_band + (i * _paddedWidth));
+			
+			if(fill)
+			{
+				// repeat the last row and column out to the block edges
+				const char *src = _plane + (std::min(y, _height - 1) * _rowbytes);
+				
+				memcpy(_rows[i], src, _width);
+				
+				memset(_rows[i] + _width, src[_width - 1], _paddedWidth - _width);
+			}
 		}
 	}
+	
+	return _rows;
 }
 
 
 void
-JPEGCodec::compress(const FrameBuffer &frame)
+RawPlane::store()
+{
+	for(int i=0; i < _bandRows; i++)
+	{
+		const int y = (_firstRow + i);
+		
+		if(y < _height && inBand(i))
+			memcpy(_plane + (y * _rowbytes), _rows[i], _width);
+	}
+}
+
+
+// libjpeg reads up to this many rows at a time anyway
+static const int MaxRows = 16;
+
+
+typedef struct
+{
+  struct jpeg_destination_mgr pub; /* public fields */
+
+  DataChunkPtr chunk;              /* compressed frame, from the pool */
+  size_t capacity;
+
+} my_destination_mgr;
+
+static void my_init_destination(j_compress_ptr cinfo)
 {
-	struct jpeg_error_mgr jerr;
+	my_destination_mgr *mgr = (my_destination_mgr *)cinfo->dest;
 	
-	jerr.error_exit = my_error_exit;
-	jerr.emit_message = my_emit_message;
-	jerr.output_message = my_output_message;
-	jerr.format_message = my_format_message;
-	jerr.reset_error_mgr = my_reset_error_mgr;
+	mgr->pub.next_output_byte = mgr->chunk->Data;
+	mgr->pub.free_in_buffer = mgr->capacity;
+}
+
+static boolean my_empty_output_buffer(j_compress_ptr cinfo)
+{
+	// Guessed too small.  libjpeg only calls this when the buffer
+	// is completely full, so move what we have to one twice the size.
+	my_destination_mgr *mgr = (my_destination_mgr *)cinfo->dest;
 	
-	jerr.trace_level = 0;
-	jerr.num_warnings = 0;
-	jerr.msg_code = 0;
+	const size_t used = mgr->capacity;
 	
-	jerr.jpeg_message_table = jpeg_std_message_table;
-	jerr.last_jpeg_message = (int) JMSG_LASTMSGCODE - 1;
+	PooledDataChunk *bigger = new PooledDataChunk(2 * used);
 	
-	jerr.addon_message_table = NULL;
-	jerr.first_addon_message = 0;
-	jerr.last_jpeg_message = 0;
+	memcpy(bigger->Data, mgr->chunk->Data, used);
+	
+	mgr->chunk = bigger;
+	mgr->capacity = bigger->capacity();
+	
+	mgr->pub.next_output_byte = mgr->chunk->Data + used;
+	mgr->pub.free_in_buffer = mgr->capacity - used;
+	
+	return TRUE;
+}
+
+static void my_term_destination(j_compress_ptr cinfo)
+{
+	my_destination_mgr *mgr = (my_destination_mgr *)cinfo->dest;
+	
+	mgr->chunk->Size = (mgr->capacity - mgr->pub.free_in_buffer);
+}
+
+
+void
+JPEGCodec::compress(const FrameBuffer &frame)
+{
+	const Box2i dataW = dataWindow();
 	
+	const int width = (dataW.max.x - dataW.min.x + 1);
+	const int height = (dataW.max.y - dataW.min.y + 1);
 	
 	
-	struct jpeg_compress_struct cinfo;
+	struct jpeg_compress_struct &cinfo = compressor();
 	
-	cinfo.err = &jerr;
 	
-	jpeg_create_compress(&cinfo);
+	// libjpeg writes straight into a pooled chunk, sized from the last frame
+	const size_t guess = (_lastCompressedSize > 0 ? (_lastCompressedSize + (_lastCompressedSize / 4)) : (width * height));
 	
+	PooledDataChunk *chunk = new PooledDataChunk(guess + 4096);
 	
 	my_destination_mgr mgr;
 	
-	mgr.outfile = new MemoryFile;
-	mgr.buffer = NULL;
-	mgr.bufferSize = 0;
+	mgr.chunk = chunk;
+	mgr.capacity = chunk->capacity();
 	
 	mgr.pub.init_destination = my_init_destination;
 	mgr.pub.empty_output_buffer = my_empty_output_buffer;
@@ -259,87 +542,130 @@ JPEGCodec::compress(const FrameBuffer &frame)
 	cinfo.dest = (jpeg_destination_mgr *)&mgr;
 	
 	
-	const Box2i dataW = dataWindow();
+	int xSampling = 1, ySampling = 1;
 	
-	const int width = (dataW.max.x - dataW.min.x + 1);
-	const int height = (dataW.max.y - dataW.min.y + 1);
+	const bool planar = (frame.dataWindow() == dataW && PlanarYCbCr(frame, xSampling, ySampling));
+	const bool ycbcr = (planar || NativeYCbCr(frame));
 	
 	cinfo.image_width = width;
 	cinfo.image_height = height;
 	cinfo.input_components = 3;
-	cinfo.in_color_space = JCS_RGB;
-	
-	jpeg_set_defaults(&cinfo);
-	
-	
-	jpeg_set_quality(&cinfo, _quality, TRUE);
+	cinfo.in_color_space = (ycbcr ? JCS_YCbCr : JCS_RGB);
 	
 	
 	bool success = true;
 	
 	try
 	{
-		jpeg_start_compress(&cinfo, TRUE);
-		
+		jpeg_set_defaults(&cinfo);
 		
-		const size_t tempPixelSize = (3 * PixelSize(UINT8));
-		const size_t tempRowbytes = (tempPixelSize * width);
-		const size_t tempBufSize = (tempRowbytes * height);
+		jpeg_set_quality(&cinfo, _quality, TRUE);
 		
-		DataChunk dataChunk(tempBufSize);
+		cinfo.restart_in_rows = _restartRows;
 		
-		char *tempBuffer = (char *)dataChunk.Data;
 		
-		FrameBuffer tempFrameBuffer(dataW);
-		
-		tempFrameBuffer.insert("R", Slice(UINT8, &tempBuffer[0], tempPixelSize, tempRowbytes));
-		tempFrameBuffer.insert("G", Slice(UINT8, &tempBuffer[1], tempPixelSize, tempRowbytes));
-		tempFrameBuffer.insert("B", Slice(UINT8, &tempBuffer[2], tempPixelSize, tempRowbytes));
-		
-		tempFrameBuffer.copyFromFrame(frame);
-		
-		
-		JSAMPARRAY scanlines = (JSAMPARRAY)malloc(height * sizeof(JSAMPROW));
-		
-		if(scanlines == NULL)
-			throw MoxMxf::NullExc("out of memory");
-		
-		for(int y=0; y < height; y++)
+		if(planar)
 		{
-			scanlines[y] = (JSAMPROW)(tempBuffer + (y * tempRowbytes));
+			cinfo.raw_data_in = TRUE;
+			
+			cinfo.comp_info[0].h_samp_factor = xSampling;
+			cinfo.comp_info[0].v_samp_factor = ySampling;
+			
+			for(int i=1; i < 3; i++)
+			{
+				cinfo.comp_info[i].h_samp_factor = 1;
+				cinfo.comp_info[i].v_samp_factor = 1;
+			}
+			
+			jpeg_start_compress(&cinfo, TRUE);
+			
+			
+			RawPlane Y(frame["Y"], cinfo.comp_info[0], stagingBuffer(RawPlane::bandSize(cinfo.comp_info[0]), 0));
+			RawPlane Cb(frame["Cb"], cinfo.comp_info[1], stagingBuffer(RawPlane::bandSize(cinfo.comp_info[1]), 1));
+			RawPlane Cr(frame["Cr"], cinfo.comp_info[2], stagingBuffer(RawPlane::bandSize(cinfo.comp_info[2]), 2));
+			
+			const JDIMENSION lines = (cinfo.max_v_samp_factor * DCTSIZE);
+			
+			for(int row=0; cinfo.next_scanline < cinfo.image_height; row++)
+			{
+				JSAMPARRAY planes[3] = { Y.rows(row, true), Cb.rows(row, true), Cr.rows(row, true) };
+				
+				const JDIMENSION linesWrote = jpeg_write_raw_data(&cinfo, planes, lines);
+				
+				assert(linesWrote == lines);
+			}
+		}
+		else
+		{
+			const char * const *names = (ycbcr ? YCbCrNames : RGBNames);
+			
+			const std::vector<std::string> channels(names, names + 3);
+			
+			ptrdiff_t rowbytes = 0;
+			
+			char *origin = interleavedRows(frame, channels, UINT8, rowbytes);
+			
+			if(origin == NULL)
+			{
+				const size_t tempPixelSize = (3 * PixelSize(UINT8));
+				const size_t tempRowbytes = (tempPixelSize * width);
+				const size_t tempBufSize = (tempRowbytes * height);
+				
+				char *tempBuffer = stagingBuffer(tempBufSize);
+				
+				FrameBuffer tempFrameBuffer(dataW);
+				
+				tempFrameBuffer.coefficients() = FrameBuffer::Rec601_FullRange;
+				
+				tempFrameBuffer.insert(names[0], Slice(UINT8, &tempBuffer[0], tempPixelSize, tempRowbytes));
+				tempFrameBuffer.insert(names[1], Slice(UINT8, &tempBuffer[1], tempPixelSize, tempRowbytes));
+				tempFrameBuffer.insert(names[2], Slice(UINT8, &tempBuffer[2], tempPixelSize, tempRowbytes));
+				
+				tempFrameBuffer.copyFromFrame(frame);
+				
+				origin = tempBuffer;
+				rowbytes = tempRowbytes;
+			}
+			
+			
+			jpeg_start_compress(&cinfo, TRUE);
+			
+			JSAMPROW scanlines[MaxRows];
+			
+			while(cinfo.next_scanline < cinfo.image_height)
+			{
+				const JDIMENSION first = cinfo.next_scanline;
+				const JDIMENSION count = std::min<JDIMENSION>(MaxRows, cinfo.image_height - first);
+				
+				for(JDIMENSION i=0; i < count; i++)
+				{
+					scanlines[i] = (JSAMPROW)(origin + ((first + i) * rowbytes));
+				}
+				
+				const JDIMENSION linesWrote = jpeg_write_scanlines(&cinfo, scanlines, count);
+				
+				assert(linesWrote == count);
+			}
 		}
-		
-		
-		const JDIMENSION linesWrote = jpeg_write_scanlines(&cinfo, scanlines, height);
-		
-		assert(linesWrote == height);
 		
 		
 		jpeg_finish_compress(&cinfo);
 		
 		
-		assert(jerr.msg_code == 0);
-		
-		storeData( mgr.outfile->getDataChunk() );
+		assert(_errorMgr->msg_code == 0);
 		
+		_lastCompressedSize = mgr.chunk->Size;
 		
-		free(scanlines);
+		storeData(mgr.chunk);
 	}
 	catch(...)
 	{
+		jpeg_abort_compress(&cinfo);
+		
 		success = false;
 	}
 	
 	
-	jpeg_destroy_compress(&cinfo);
-	
-	
-	if(mgr.buffer != NULL)
-		free(mgr.buffer);
-	
-	delete mgr.outfile;
-	
-	
 	if(!success)
 		throw MoxMxf::ArgExc("JPEG compression error");
 }
@@ -348,208 +674,955 @@ JPEGCodec::compress(const FrameBuffer &frame)
 typedef struct
 {
   struct jpeg_source_mgr pub; /* public fields */
-
-  MemoryFile *infile;                /* target stream */
   
-  JOCTET *buffer;
-  size_t bufferSize;
+  const JOCTET *segment[3];        /* pieces of the stream, read in order */
+  size_t segmentSize[3];
+  int segments;
+  int nextSegment;
+  
+  int restartOffset;               /* RSTn of the first interval, mod 8 */
   
 } my_source_mgr;
 
 static void my_init_source(j_decompress_ptr cinfo)
 {
-	my_source_mgr *mgr = (my_source_mgr *)cinfo->src;
-	
-	mgr->infile->FileSeek(0);
+	// everything is already in memory
 }
 
+static const JOCTET fake_eoi[2] = { 0xFF, JPEG_EOI };
+
 static boolean my_fill_input_buffer(j_decompress_ptr cinfo)
 {
 	my_source_mgr *mgr = (my_source_mgr *)cinfo->src;
 	
-	MoxMxf::UInt64 bytesRead = mgr->infile->FileRead(mgr->buffer, mgr->bufferSize);
-	
-	if(bytesRead == 0)
+	if(mgr->nextSegment < mgr->segments)
 	{
-		if(mgr->infile->FileSize() == 0)
-			ERREXIT(cinfo, JERR_INPUT_EMPTY);
+		mgr->pub.next_input_byte = mgr->segment[mgr->nextSegment];
+		mgr->pub.bytes_in_buffer = mgr->segmentSize[mgr->nextSegment];
 		
+		mgr->nextSegment++;
+	}
+	else
+	{
+		// the data ran out before the image did
 		WARNMS(cinfo, JWRN_JPEG_EOF);
 		
-		mgr->buffer[0] = 0xFF;
-		mgr->buffer[0] = JPEG_EOI;
-		bytesRead = 2;
+		mgr->pub.next_input_byte = fake_eoi;
+		mgr->pub.bytes_in_buffer = 2;
 	}
 	
-	mgr->pub.next_input_byte = mgr->buffer;
-	mgr->pub.bytes_in_buffer = bytesRead;
-	
 	return TRUE;
 }
 
 static void my_skip_input_data(j_decompress_ptr cinfo, long num_bytes)
 {
-	struct jpeg_source_mgr *mgr = cinfo->src;
+	my_source_mgr *mgr = (my_source_mgr *)cinfo->src;
 	
 	if(num_bytes > 0)
 	{
-		while(num_bytes > mgr->bytes_in_buffer)
+		while(num_bytes > mgr->pub.bytes_in_buffer && mgr->nextSegment < mgr->segments)
 		{
-			num_bytes -= mgr->bytes_in_buffer;
+			num_bytes -= mgr->pub.bytes_in_buffer;
 			
-			(*mgr->fill_input_buffer)(cinfo);
+			(*mgr->pub.fill_input_buffer)(cinfo);
 		}
 		
-		mgr->next_input_byte += num_bytes;
-		mgr->bytes_in_buffer -= num_bytes;
+		if(num_bytes > mgr->pub.bytes_in_buffer)
+		{
+			(*mgr->pub.fill_input_buffer)(cinfo);
+		}
+		else
+		{
+			mgr->pub.next_input_byte += num_bytes;
+			mgr->pub.bytes_in_buffer -= num_bytes;
+		}
 	}
 	else
 		assert(false); // why bother calling this?
 }
 
+static boolean my_resync_to_restart(j_decompress_ptr cinfo, int desired)
+{
+	my_source_mgr *mgr = (my_source_mgr *)cinfo->src;
+	
+	// a stripe starts partway into the frame, so its markers don't start at RST0
+	if(cinfo->unread_marker == (JPEG_RST0 + ((desired + mgr->restartOffset) & 7)))
+	{
+		cinfo->unread_marker = 0;
+		
+		return TRUE;
+	}
+	
+	return jpeg_resync_to_restart(cinfo, desired);
+}
+
 static void my_term_source(j_decompress_ptr cinfo)
 {
-	//my_source_mgr *mgr = (my_source_mgr *)cinfo->src;
+
+}
+
+
+static void
+ReadFrom(struct jpeg_decompress_struct &cinfo, my_source_mgr &mgr, const JOCTET * const segment[], const size_t segmentSize[], int segments)
+{
+	assert(segments >= 1 && segments <= 3);
+	
+	// libjpeg reads right out of the essence
+	mgr.segments = 0;
+	
+	for(int i=0; i < segments; i++)
+	{
+		if(segmentSize[i] > 0)
+		{
+			mgr.segment[mgr.segments] = segment[i];
+			mgr.segmentSize[mgr.segments] = segmentSize[i];
+			
+			mgr.segments++;
+		}
+	}
+	
+	if(mgr.segments == 0)
+		throw MoxMxf::InputExc("Empty JPEG frame");
+	
+	mgr.pub.next_input_byte = mgr.segment[0];
+	mgr.pub.bytes_in_buffer = mgr.segmentSize[0];
+	
+	mgr.nextSegment = 1;
+	mgr.restartOffset = 0;
+	
+	mgr.pub.init_source = my_init_source;
+	mgr.pub.fill_input_buffer = my_fill_input_buffer;
+	mgr.pub.skip_input_data = my_skip_input_data;
+	mgr.pub.resync_to_restart = my_resync_to_restart;
+	mgr.pub.term_source = my_term_source;
+	
+	cinfo.src = (jpeg_source_mgr *)&mgr;
+}
+
+
+static void
+ReadFrom(struct jpeg_decompress_struct &cinfo, my_source_mgr &mgr, const DataChunk &data)
+{
+	const JOCTET *segment = data.Data;
+	const size_t segmentSize = data.Size;
+	
+	ReadFrom(cinfo, mgr, &segment, &segmentSize, 1);
 }
 
 
 void
 JPEGCodec::decompress(const DataChunk &data)
 {
-	struct jpeg_error_mgr jerr;
+	const Box2i dataW = dataWindow();
 	
-	jerr.error_exit = my_error_exit;
-	jerr.emit_message = my_emit_message;
-	jerr.output_message = my_output_message;
-	jerr.format_message = my_format_message;
-	jerr.reset_error_mgr = my_reset_error_mgr;
+	const int width = (dataW.max.x - dataW.min.x + 1);
+	const int height = (dataW.max.y - dataW.min.y + 1);
 	
-	jerr.trace_level = 0;
-	jerr.num_warnings = 0;
-	jerr.msg_code = 0;
+	const size_t pixelSize = (3 * PixelSize(UINT8));
+	const size_t rowBytes = (width * pixelSize);
+	const size_t bufSize = (height * rowBytes);
 	
-	jerr.jpeg_message_table = jpeg_std_message_table;
-	jerr.last_jpeg_message = (int) JMSG_LASTMSGCODE - 1;
+	DataChunkPtr frameData = new PooledDataChunk(bufSize);
 	
-	jerr.addon_message_table = NULL;
-	jerr.first_addon_message = 0;
-	jerr.last_jpeg_message = 0;
+	char *buf = (char *)frameData->Data;
 	
+	assert(dataW.min.x == 0);
+	assert(dataW.min.y == 0);
 	
-	my_source_mgr mgr;
+	FrameBufferPtr frameBuffer = new FrameBuffer(dataW);
 	
-	mgr.infile = new MemoryFile(data);
-	mgr.buffer = (JOCTET *)malloc(4096 * sizeof(JOCTET));
-	mgr.bufferSize = 4096;
-	mgr.pub.bytes_in_buffer = 0;
-	mgr.pub.next_input_byte = NULL;
+	frameBuffer->insert("R", Slice(UINT8, &buf[0], pixelSize, rowBytes));
+	frameBuffer->insert("G", Slice(UINT8, &buf[1], pixelSize, rowBytes));
+	frameBuffer->insert("B", Slice(UINT8, &buf[2], pixelSize, rowBytes));
 	
-	if(mgr.buffer == NULL)
-		throw MoxMxf::NullExc("out of memory");
+	frameBuffer->attachData(frameData);
 	
-	mgr.pub.init_source = my_init_source;
-	mgr.pub.fill_input_buffer = my_fill_input_buffer;
-	mgr.pub.skip_input_data = my_skip_input_data;
-	mgr.pub.resync_to_restart = jpeg_resync_to_restart;
-	mgr.pub.term_source = my_term_source;
+	decompressRows(data, buf, rowBytes);
 	
+	storeFrame(frameBuffer);
+}
+
+
+bool
+JPEGCodec::decompressInto(const DataChunk &data, FrameBuffer &frameBuffer)
+{
+	int xSampling = 1, ySampling = 1;
 	
-	struct jpeg_decompress_struct cinfo;
+	if(frameBuffer.dataWindow() == dataWindow() && PlanarYCbCr(frameBuffer, xSampling, ySampling))
+	{
+		if( decompressPlanes(data, frameBuffer, xSampling, ySampling) )
+			return true;
+		else
+			throw MoxMxf::NoImplExc("JPEG chroma is not subsampled like the frame buffer");
+	}
 	
-	cinfo.err = &jerr;
 	
-	jpeg_create_decompress(&cinfo);
+	const bool ycbcr = NativeYCbCr(frameBuffer);
 	
+	const char * const *names = (ycbcr ? YCbCrNames : RGBNames);
 	
-	cinfo.src = (jpeg_source_mgr *)&mgr;
+	const std::vector<std::string> channels(names, names + 3);
 	
+	ptrdiff_t rowbytes = 0;
 	
-	bool success = true;
+	char *origin = interleavedRows(frameBuffer, channels, UINT8, rowbytes);
 	
-	try
+	if(origin != NULL)
 	{
-		const int status = jpeg_read_header(&cinfo, TRUE);
+		// libjpeg can put the scanlines right where the caller wants them
+		decompressRows(data, origin, rowbytes, 1, NULL, ycbcr);
 		
-		if(status == JPEG_HEADER_OK)
+		return true;
+	}
+	else if(ycbcr)
+	{
+		// still saves libjpeg's conversion to RGB and ours back
+		const Box2i dataW = dataWindow();
+		
+		const size_t pixelSize = (3 * PixelSize(UINT8));
+		const size_t tempRowbytes = ((dataW.max.x - dataW.min.x + 1) * pixelSize);
+		
+		char *buf = stagingBuffer(tempRowbytes * (dataW.max.y - dataW.min.y + 1));
+		
+		assert(dataW.min.x == 0 && dataW.min.y == 0);
+		
+		FrameBuffer tempFrameBuffer(dataW);
+		
+		tempFrameBuffer.coefficients() = FrameBuffer::Rec601_FullRange;
+		
+		tempFrameBuffer.insert("Y", Slice(UINT8, &buf[0], pixelSize, tempRowbytes));
+		tempFrameBuffer.insert("Cb", Slice(UINT8, &buf[1], pixelSize, tempRowbytes));
+		tempFrameBuffer.insert("Cr", Slice(UINT8, &buf[2], pixelSize, tempRowbytes));
+		
+		decompressRows(data, buf, tempRowbytes, 1, NULL, true);
+		
+		frameBuffer.copyFromFrame(tempFrameBuffer);
+		
+		return true;
+	}
+	else
+		return VideoCodec::decompressInto(data, frameBuffer);
+}
+
+
+bool
+JPEGCodec::decompressReduced(const DataChunk &data, FrameBuffer &frameBuffer, int resolutionFactor)
+{
+	if(resolutionFactor != 2 && resolutionFactor != 4 && resolutionFactor != 8)
+		return VideoCodec::decompressReduced(data, frameBuffer, resolutionFactor);
+	
+	// libjpeg scales in the IDCT, so it does a fraction of the work
+	std::vector<std::string> channels;
+	
+	channels.push_back("R");
+	channels.push_back("G");
+	channels.push_back("B");
+	
+	ptrdiff_t rowbytes = 0;
+	
+	char *origin = interleavedRows(frameBuffer, channels, UINT8, rowbytes, resolutionFactor);
+	
+	if(origin != NULL)
+	{
+		decompressRows(data, origin, rowbytes, resolutionFactor);
+	}
+	else
+	{
+		const Box2i reducedW = ReducedWindow(dataWindow(), resolutionFactor);
+		
+		const size_t pixelSize = (3 * PixelSize(UINT8));
+		const size_t reducedRowBytes = ((reducedW.max.x - reducedW.min.x + 1) * pixelSize);
+		const size_t bufSize = ((reducedW.max.y - reducedW.min.y + 1) * reducedRowBytes);
+		
+		DataChunkPtr frameData = new PooledDataChunk(bufSize);
+		
+		char *buf = (char *)frameData->Data;
+		
+		assert(reducedW.min.x == 0 && reducedW.min.y == 0);
+		
+		FrameBuffer reducedFrame(reducedW);
+		
+		reducedFrame.insert("R", Slice(UINT8, &buf[0], pixelSize, reducedRowBytes));
+		reducedFrame.insert("G", Slice(UINT8, &buf[1], pixelSize, reducedRowBytes));
+		reducedFrame.insert("B", Slice(UINT8, &buf[2], pixelSize, reducedRowBytes));
+		
+		decompressRows(data, buf, reducedRowBytes, resolutionFactor);
+		
+		frameBuffer.copyFromFrame(reducedFrame);
+	}
+	
+	return true;
+}
+
+
+bool
+JPEGCodec::decompressRegion(const DataChunk &data, FrameBuffer &frameBuffer, const Box2i &region)
+{
+#ifdef LIBJPEG_TURBO_VERSION
+	const int width = (region.max.x - region.min.x + 1);
+	const int height = (region.max.y - region.min.y + 1);
+	
+	const size_t pixelSize = (3 * PixelSize(UINT8));
+	const size_t rowBytes = (width * pixelSize);
+	const size_t bufSize = (height * rowBytes);
+	
+	DataChunkPtr regionData = new PooledDataChunk(bufSize);
+	
+	char *buf = (char *)regionData->Data;
+	char *origin = buf - (region.min.x * pixelSize) - (region.min.y * rowBytes);
+	
+	FrameBuffer regionFrame(region);
+	
+	regionFrame.insert("R", Slice(UINT8, origin + 0, pixelSize, rowBytes));
+	regionFrame.insert("G", Slice(UINT8, origin + 1, pixelSize, rowBytes));
+	regionFrame.insert("B", Slice(UINT8, origin + 2, pixelSize, rowBytes));
+	
+	decompressRows(data, buf, rowBytes, 1, &region);
+	
+	FrameBuffer region_view(frameBuffer, region);
+	
+	region_view.copyFromFrame(regionFrame);
+	
+	return true;
+#else
+	// plain libjpeg has to decode every scanline anyway
+	return VideoCodec::decompressRegion(data, frameBuffer, region);
+#endif
+}
+
+
+static void
+ReadScanlines(struct jpeg_decompress_struct &cinfo, char *origin, ptrdiff_t rowbytes)
+{
+	JSAMPROW scanlines[MaxRows];
+	
+	while(cinfo.output_scanline < cinfo.output_height)
+	{
+		const JDIMENSION first = cinfo.output_scanline;
+		const JDIMENSION count = std::min<JDIMENSION>(MaxRows, cinfo.output_height - first);
+		
+		for(JDIMENSION i=0; i < count; i++)
 		{
-			jpeg_start_decompress(&cinfo);
-			
-			const JDIMENSION width = cinfo.image_width;
-			const JDIMENSION height = cinfo.image_height;
-			
-			assert(cinfo.num_components == 3);
-			assert(cinfo.out_color_space == JCS_RGB);
+			scanlines[i] = (JSAMPROW)(origin + ((first + i) * rowbytes));
+		}
+		
+		if(jpeg_read_scanlines(&cinfo, scanlines, count) == 0)
+			throw MoxMxf::InputExc("Ran out of scanlines");
+	}
+}
+
+
+// Where the restart intervals in a frame start.  Only handles a single
+// interleaved Huffman scan, which is what we write.
+struct RestartMap
+{
+	size_t headerSize;		// everything through the SOS segment
+	size_t heightOffset;	// of the height in SOF
+	size_t dataEnd;			// where EOI is
+	
+	int width;
+	int height;
+	int mcuWidth;
+	int mcuHeight;
+	int restartInterval;	// in MCUs
+	
+	std::vector<size_t> intervals; // first byte of each
+};
+
+
+static inline int
+ReadShort(const JOCTET *p)
+{
+	return ((p[0] << 8) | p[1]);
+}
+
+
+static bool
+FindRestarts(const DataChunk &data, RestartMap &map)
+{
+	const JOCTET *buf = data.Data;
+	const size_t size = data.Size;
+	
+	if(size < 4 || buf[0] != 0xFF || buf[1] != 0xD8)
+		return false;
+	
+	map.headerSize = 0;
+	map.heightOffset = 0;
+	map.restartInterval = 0;
+	
+	int components = 0;
+	
+	size_t pos = 2;
+	
+	while(map.headerSize == 0)
+	{
+		if(pos + 4 > size || buf[pos] != 0xFF)
+			return false;
+		
+		const JOCTET marker = buf[pos + 1];
+		
+		if(marker == 0xFF)
+		{
+			pos++; // fill byte
 			
+			continue;
+		}
+		
+		const size_t length = ReadShort(&buf[pos + 2]);
+		
+		if(length < 2 || pos + 2 + length > size)
+			return false;
+		
+		const JOCTET *segment = &buf[pos + 4];
+		
+		if(marker == 0xC0 || marker == 0xC1)
+		{
+			// baseline or extended sequential, Huffman coded
+			if(length < 8)
+				return false;
 			
-			const size_t pixelSize = (3 * PixelSize(UINT8));
-			const size_t rowBytes = (width * pixelSize);
-			const size_t bufSize = (height * rowBytes);
+			map.heightOffset = (pos + 5);
+			map.height = ReadShort(&segment[1]);
+			map.width = ReadShort(&segment[3]);
 			
-			DataChunkPtr frameData = new DataChunk(bufSize);
+			components = segment[5];
 			
-			char *buf = (char *)frameData->Data;
+			if(length != (8 + (3 * components)))
+				return false;
 			
-			const Box2i dataW = dataWindow();
+			int hMax = 1, vMax = 1;
 			
-			assert(width == (dataW.max.x - dataW.min.x + 1));
-			assert(height == (dataW.max.y - dataW.min.y + 1));
-			assert(dataW.min.x == 0);
-			assert(dataW.min.y == 0);
+			for(int i=0; i < components; i++)
+			{
+				const JOCTET sampling = segment[6 + (3 * i) + 1];
 				
-			FrameBufferPtr frameBuffer = new FrameBuffer(dataW);
+				hMax = std::max(hMax, sampling >> 4);
+				vMax = std::max(vMax, sampling & 0x0f);
+			}
 			
-			frameBuffer->insert("R", Slice(UINT8, &buf[0], pixelSize, rowBytes));
-			frameBuffer->insert("G", Slice(UINT8, &buf[1], pixelSize, rowBytes));
-			frameBuffer->insert("B", Slice(UINT8, &buf[2], pixelSize, rowBytes));
+			map.mcuWidth = (hMax * DCTSIZE);
+			map.mcuHeight = (vMax * DCTSIZE);
+		}
+		else if(marker >= 0xC2 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC)
+		{
+			return false; // progressive, lossless, arithmetic...
+		}
+		else if(marker == 0xDD)
+		{
+			if(length != 4)
+				return false;
 			
-			frameBuffer->attachData(frameData);
+			map.restartInterval = ReadShort(segment);
+		}
+		else if(marker == 0xDA)
+		{
+			// has to be one scan with all the components
+			if(components < 2 || segment[0] != components)
+				return false;
 			
+			map.headerSize = (pos + 2 + length);
+		}
+		
+		pos += (2 + length);
+	}
+	
+	if(map.heightOffset == 0 || map.restartInterval == 0 || map.height == 0 || map.width == 0)
+		return false;
+	
+	
+	map.intervals.clear();
+	map.intervals.push_back(map.headerSize);
+	
+	map.dataEnd = 0;
+	
+	const JOCTET *p = &buf[map.headerSize];
+	const JOCTET *end = (buf + size);
+	
+	while(map.dataEnd == 0)
+	{
+		p = (const JOCTET *)memchr(p, 0xFF, end - p);
+		
+		if(p == NULL || (p + 1) >= end)
+			return false;
+		
+		const JOCTET marker = p[1];
+		
+		if(marker == 0x00)
+		{
+			p += 2; // stuffed byte
+		}
+		else if(marker == 0xFF)
+		{
+			p += 1; // fill byte
+		}
+		else if(marker >= 0xD0 && marker <= 0xD7)
+		{
+			// RST0 through RST7 and around again
+			if((marker - 0xD0) != ((map.intervals.size() - 1) % 8))
+				return false;
 			
-			JSAMPARRAY scanlines = (JSAMPARRAY)malloc(height * sizeof(JSAMPROW));
+			p += 2;
 			
-			if(scanlines == NULL)
-				throw MoxMxf::NullExc("out of memory");
+			map.intervals.push_back(p - buf);
+		}
+		else if(marker == JPEG_EOI)
+		{
+			map.dataEnd = (p - buf);
+		}
+		else
+			return false; // DNL, another scan...
+	}
+	
+	const size_t mcus = ((map.width + map.mcuWidth - 1) / map.mcuWidth) * ((map.height + map.mcuHeight - 1) / map.mcuHeight);
+	
+	return (map.intervals.size() == ((mcus + map.restartInterval - 1) / map.restartInterval));
+}
+
+
+struct JPEGStripeDecoder
+{
+	struct jpeg_error_mgr err;
+	struct jpeg_decompress_struct cinfo;
+	
+	std::vector<JOCTET> header;
+	std::vector<JSAMPLE> scratch;
+	
+	bool success;
+	
+	JPEGStripeDecoder();
+	~JPEGStripeDecoder();
+};
+
+
+JPEGStripeDecoder::JPEGStripeDecoder() :
+	success(true)
+{
+	InitErrorManager(err);
+	
+	cinfo.err = &err;
+	
+	jpeg_create_decompress(&cinfo);
+}
+
+
+JPEGStripeDecoder::~JPEGStripeDecoder()
+{
+	jpeg_destroy_decompress(&cinfo);
+}
+
+
+class DecodeStripeTask : public Task
+{
+  public:
+	DecodeStripeTask(TaskGroup *group, JPEGStripeDecoder &decoder, const JOCTET *data, size_t size, int restartOffset,
+						char *origin, ptrdiff_t rowbytes, int skipRows, int rows, int scale, bool ycbcr);
+	~DecodeStripeTask() {}
+	
+	virtual void execute();
+	
+  private:
+	JPEGStripeDecoder &_decoder;
+	const JOCTET * const _data;
+	const size_t _size;
+	const int _restartOffset;
+	char * const _origin;
+	const ptrdiff_t _rowbytes;
+	const int _skipRows;
+	const int _rows;
+	const int _scale;
+	const bool _ycbcr;
+};
+
+
+DecodeStripeTask::DecodeStripeTask(TaskGroup *group, JPEGStripeDecoder &decoder, const JOCTET *data, size_t size, int restartOffset,
+									char *origin, ptrdiff_t rowbytes, int skipRows, int rows, int scale, bool ycbcr) :
+	Task(group),
+	_decoder(decoder),
+	_data(data),
+	_size(size),
+	_restartOffset(restartOffset),
+	_origin(origin),
+	_rowbytes(rowbytes),
+	_skipRows(skipRows),
+	_rows(rows),
+	_scale(scale),
+	_ycbcr(ycbcr)
+{
+
+}
+
+
+void
+DecodeStripeTask::execute()
+{
+	struct jpeg_decompress_struct &cinfo = _decoder.cinfo;
+	
+	my_source_mgr mgr;
+	
+	try
+	{
+		// the stripe's own header, its intervals right out of the essence, and an end
+		const JOCTET * const segment[3] = { &_decoder.header[0], _data, fake_eoi };
+		const size_t segmentSize[3] = { _decoder.header.size(), _size, sizeof(fake_eoi) };
+		
+		ReadFrom(cinfo, mgr, segment, segmentSize, 3);
+		
+		mgr.restartOffset = _restartOffset;
+		
+		if(jpeg_read_header(&cinfo, TRUE) != JPEG_HEADER_OK)
+			throw MoxMxf::ArgExc("Error reading header");
+		
+		cinfo.scale_num = 1;
+		cinfo.scale_denom = _scale;
+		
+		if(_ycbcr)
+		{
+			if(cinfo.jpeg_color_space != JCS_YCbCr)
+				throw MoxMxf::InputExc("JPEG is not Y'CbCr");
 			
-			for(int y=0; y < height; y++)
+			cinfo.out_color_space = JCS_YCbCr;
+		}
+		
+		jpeg_start_decompress(&cinfo);
+		
+		if(cinfo.output_components != 3 || cinfo.output_height < (_skipRows + _rows))
+			throw MoxMxf::InputExc("Stripe is wrong size");
+		
+		// rows that were only decoded so the upsampling had something to look at
+		_decoder.scratch.resize(cinfo.output_width * cinfo.output_components);
+		
+		JSAMPROW row = &_decoder.scratch[0];
+		
+		while(cinfo.output_scanline < _skipRows)
+		{
+			if(jpeg_read_scanlines(&cinfo, &row, 1) != 1)
+				throw MoxMxf::InputExc("Ran out of scanlines");
+		}
+		
+		JSAMPROW scanlines[MaxRows];
+		
+		const JDIMENSION end = (_skipRows + _rows);
+		
+		while(cinfo.output_scanline < end)
+		{
+			const JDIMENSION first = cinfo.output_scanline;
+			const JDIMENSION count = std::min<JDIMENSION>(MaxRows, end - first);
+			
+			for(JDIMENSION i=0; i < count; i++)
 			{
-				scanlines[y] = (JSAMPROW)(buf + (y * rowBytes));
+				scanlines[i] = (JSAMPROW)(_origin + ((first + i - _skipRows) * _rowbytes));
 			}
 			
+			if(jpeg_read_scanlines(&cinfo, scanlines, count) == 0)
+				throw MoxMxf::InputExc("Ran out of scanlines");
+		}
+		
+		if(cinfo.output_scanline < cinfo.output_height)
+			jpeg_abort_decompress(&cinfo);
+		else
+			jpeg_finish_decompress(&cinfo);
+	}
+	catch(...)
+	{
+		jpeg_abort_decompress(&cinfo);
+		
+		_decoder.success = false;
+	}
+}
+
+
+bool
+JPEGCodec::decompressStripes(const DataChunk &data, char *origin, ptrdiff_t rowbytes, int scale, bool ycbcr)
+{
+	const int threads = ThreadPool::globalThreadPool().numThreads();
+	
+	if(threads < 2)
+		return false;
+	
+	RestartMap map;
+	
+	if( !FindRestarts(data, map) )
+		return false;
+	
+	const Box2i dataW = dataWindow();
+	
+	if(map.width != (dataW.max.x - dataW.min.x + 1) || map.height != (dataW.max.y - dataW.min.y + 1))
+		return false;
+	
+	
+	// Stripes start at restart intervals that begin an MCU row.
+	const int mcusPerRow = ((map.width + map.mcuWidth - 1) / map.mcuWidth);
+	const int mcuRows = ((map.height + map.mcuHeight - 1) / map.mcuHeight);
+	
+	std::vector<int> rowStarts; // interval that starts each usable MCU row
+	std::vector<int> rows;
+	
+	for(int k=0; k < map.intervals.size(); k++)
+	{
+		const int mcu = (k * map.restartInterval);
+		
+		if((mcu % mcusPerRow) == 0)
+		{
+			rowStarts.push_back(k);
+			rows.push_back(mcu / mcusPerRow);
+		}
+	}
+	
+	rowStarts.push_back(map.intervals.size());
+	rows.push_back(mcuRows);
+	
+	// With vertically subsampled chroma, the rows at the edge of a stripe
+	// get upsampled using the chroma rows on the other side.  So stripes also
+	// decode from the usable row above and to the one below (an MCU row or more,
+	// depending on the restart interval) and throw those rows away.
+	const bool context = (map.mcuHeight > DCTSIZE);
+	
+	std::vector<int> splits(1, 0); // indexes into rowStarts
+	
+	for(int i=1; i < (rowStarts.size() - 1); i++)
+	{
+		if((rows[i] * threads) >= (splits.size() * mcuRows))
+			splits.push_back(i);
+	}
+	
+	splits.push_back(rowStarts.size() - 1);
+	
+	const int stripes = (splits.size() - 1);
+	
+	if(stripes < 2)
+		return false;
+	
+	while(_stripeDecoders.size() < stripes)
+		_stripeDecoders.push_back(new JPEGStripeDecoder);
+	
+	
+	{
+		TaskGroup taskGroup;
+		
+		for(int i=0; i < stripes; i++)
+		{
+			const int first = splits[i];
+			const int last = splits[i + 1];
+			
+			const int decodeFirst = ((context && first > 0) ? (first - 1) : first);
+			const int decodeLast = ((context && last < (rowStarts.size() - 1)) ? (last + 1) : last);
+			
+			const int top = std::min(rows[first] * map.mcuHeight, map.height);
+			const int bottom = std::min(rows[last] * map.mcuHeight, map.height);
+			const int decodeTop = std::min(rows[decodeFirst] * map.mcuHeight, map.height);
+			const int decodeBottom = std::min(rows[decodeLast] * map.mcuHeight, map.height);
+			
+			const int decodeHeight = (decodeBottom - decodeTop);
+			
+			const size_t begin = map.intervals[rowStarts[decodeFirst]];
+			const size_t end = (rowStarts[decodeLast] < map.intervals.size() ? (map.intervals[rowStarts[decodeLast]] - 2) : map.dataEnd);
+			
+			JPEGStripeDecoder &decoder = *_stripeDecoders[i];
+			
+			// same headers, but the frame is only as tall as the stripe
+			decoder.header.assign(data.Data, data.Data + map.headerSize);
+			
+			decoder.header[map.heightOffset] = (decodeHeight >> 8);
+			decoder.header[map.heightOffset + 1] = (decodeHeight & 0xff);
+			
+			decoder.success = true;
 			
-			JDIMENSION linesRead = 0;
+			assert((top % scale) == 0 && (decodeTop % scale) == 0);
+			
+			const int outputTop = (top / scale);
+			const int outputBottom = ((bottom + scale - 1) / scale);
+			
+			ThreadPool::addGlobalTask(new DecodeStripeTask(&taskGroup, decoder, data.Data + begin, end - begin, (rowStarts[decodeFirst] % 8),
+															origin + (outputTop * rowbytes), rowbytes,
+															outputTop - (decodeTop / scale), outputBottom - outputTop, scale, ycbcr));
+		}
+	}
+	
+	for(int i=0; i < stripes; i++)
+	{
+		if(!_stripeDecoders[i]->success)
+			throw MoxMxf::ArgExc("JPEG decompression error");
+	}
+	
+	return true;
+}
+
+
+void
+JPEGCodec::decompressRows(const DataChunk &data, char *origin, ptrdiff_t rowbytes, int scale, const Box2i *region, bool ycbcr)
+{
+	// frames with restart markers can be split up
+	if(region == NULL && decompressStripes(data, origin, rowbytes, scale, ycbcr))
+		return;
+	
+	
+	struct jpeg_decompress_struct &cinfo = decompressor();
+	
+	my_source_mgr mgr;
+	
+	
+	bool success = true;
+	
+	try
+	{
+		ReadFrom(cinfo, mgr, data);
+		
+		const int status = jpeg_read_header(&cinfo, TRUE);
+		
+		if(status == JPEG_HEADER_OK)
+		{
+			cinfo.scale_num = 1;
+			cinfo.scale_denom = scale;
 			
-			while(linesRead < height)
+			if(ycbcr)
 			{
-				linesRead += jpeg_read_scanlines(&cinfo, &scanlines[linesRead], height - linesRead);
+				if(cinfo.jpeg_color_space != JCS_YCbCr)
+					throw MoxMxf::InputExc("JPEG is not Y'CbCr");
+				
+				cinfo.out_color_space = JCS_YCbCr;
 			}
 			
+			jpeg_start_decompress(&cinfo);
 			
-			free(scanlines);
+			const JDIMENSION width = cinfo.output_width;
+			const JDIMENSION height = cinfo.output_height;
 			
-			jpeg_finish_decompress(&cinfo);
+			assert(cinfo.num_components == 3);
+			assert(cinfo.out_color_space == (ycbcr ? JCS_YCbCr : JCS_RGB));
 			
+			const Box2i dataW = ReducedWindow(dataWindow(), scale);
 			
-			storeFrame(frameBuffer);
+			if(width != (dataW.max.x - dataW.min.x + 1) || height != (dataW.max.y - dataW.min.y + 1))
+				throw MoxMxf::InputExc("Stored data is wrong size");
+
+#ifdef LIBJPEG_TURBO_VERSION
+			if(region != NULL)
+			{
+				assert(scale == 1);
+				
+				// libjpeg-turbo can skip the rows above the region without doing
+				// the IDCT, and crop to the iMCU column that holds it
+				const JDIMENSION regionX = (region->min.x - dataW.min.x);
+				const JDIMENSION regionWidth = (region->max.x - region->min.x + 1);
+				const JDIMENSION regionHeight = (region->max.y - region->min.y + 1);
+				
+				JDIMENSION xoffset = regionX;
+				JDIMENSION cropWidth = regionWidth;
+				
+				jpeg_crop_scanline(&cinfo, &xoffset, &cropWidth);
+				
+				const size_t pixelSize = cinfo.output_components;
+				const size_t left = ((regionX - xoffset) * pixelSize);
+				
+				JSAMPROW row = (JSAMPROW)stagingBuffer(cinfo.output_width * pixelSize);
+				
+				if(region->min.y > dataW.min.y)
+					jpeg_skip_scanlines(&cinfo, region->min.y - dataW.min.y);
+				
+				for(int y=0; y < regionHeight; y++)
+				{
+					if(jpeg_read_scanlines(&cinfo, &row, 1) != 1)
+						throw MoxMxf::InputExc("Ran out of scanlines");
+					
+					memcpy(origin + (y * rowbytes), &row[left], regionWidth * pixelSize);
+				}
+				
+				// didn't read to the end, so no jpeg_finish_decompress()
+				jpeg_abort_decompress(&cinfo);
+			}
+			else
+#endif
+			{
+				ReadScanlines(cinfo, origin, rowbytes);
+				
+				jpeg_finish_decompress(&cinfo);
+			}
 		}
 		else
 			throw MoxMxf::ArgExc("Error reading header");
 	}
 	catch(...)
 	{
+		jpeg_abort_decompress(&cinfo);
+		
 		success = false;
 	}
 	
 	
-	jpeg_destroy_decompress(&cinfo);
+	if(!success)
+		throw MoxMxf::ArgExc("JPEG decompression error");
+}
+
+
+bool
+JPEGCodec::decompressPlanes(const DataChunk &data, FrameBuffer &frameBuffer, int xSampling, int ySampling)
+{
+	struct jpeg_decompress_struct &cinfo = decompressor();
+	
+	my_source_mgr mgr;
 	
 	
-	free(mgr.buffer);
+	bool matched = true;
+	bool success = true;
 	
-	delete mgr.infile;
+	try
+	{
+		ReadFrom(cinfo, mgr, data);
+		
+		if(jpeg_read_header(&cinfo, TRUE) != JPEG_HEADER_OK)
+			throw MoxMxf::ArgExc("Error reading header");
+		
+		const Box2i dataW = dataWindow();
+		
+		if(cinfo.image_width != (dataW.max.x - dataW.min.x + 1) || cinfo.image_height != (dataW.max.y - dataW.min.y + 1))
+			throw MoxMxf::InputExc("Stored data is wrong size");
+		
+		matched = (cinfo.num_components == 3 && cinfo.jpeg_color_space == JCS_YCbCr &&
+					cinfo.comp_info[0].h_samp_factor == xSampling && cinfo.comp_info[0].v_samp_factor == ySampling &&
+					cinfo.comp_info[1].h_samp_factor == 1 && cinfo.comp_info[1].v_samp_factor == 1 &&
+					cinfo.comp_info[2].h_samp_factor == 1 && cinfo.comp_info[2].v_samp_factor == 1);
+		
+		if(matched)
+		{
+			cinfo.raw_data_out = TRUE;
+			
+			jpeg_start_decompress(&cinfo);
+			
+			RawPlane Y(frameBuffer["Y"], cinfo.comp_info[0], stagingBuffer(RawPlane::bandSize(cinfo.comp_info[0]), 0));
+			RawPlane Cb(frameBuffer["Cb"], cinfo.comp_info[1], stagingBuffer(RawPlane::bandSize(cinfo.comp_info[1]), 1));
+			RawPlane Cr(frameBuffer["Cr"], cinfo.comp_info[2], stagingBuffer(RawPlane::bandSize(cinfo.comp_info[2]), 2));
+			
+			const JDIMENSION lines = (cinfo.max_v_samp_factor * DCTSIZE);
+			
+			for(int row=0; cinfo.output_scanline < cinfo.output_height; row++)
+			{
+				JSAMPARRAY planes[3] = { Y.rows(row, false), Cb.rows(row, false), Cr.rows(row, false) };
+				
+				if(jpeg_read_raw_data(&cinfo, planes, lines) != lines)
+					throw MoxMxf::InputExc("Ran out of scanlines");
+				
+				Y.store();
+				Cb.store();
+				Cr.store();
+			}
+			
+			jpeg_finish_decompress(&cinfo);
+		}
+		else
+			jpeg_abort_decompress(&cinfo);
+	}
+	catch(...)
+	{
+		jpeg_abort_decompress(&cinfo);
+		
+		success = false;
+	}
 	
 	
 	if(!success)
 		throw MoxMxf::ArgExc("JPEG decompression error");
+	
+	return matched;
 }
 
 
@@ -567,13 +1640,13 @@ JPEGCodecInfo::getChannelCapabilites() const
 }
 
 
-VideoCodec * 
+VideoCodec *
 JPEGCodecInfo::createCodec(const Header &header, const ChannelList &channels) const
 {
 	return new JPEGCodec(header, channels);
 }
 
-VideoCodec * 
+VideoCodec *
 JPEGCodecInfo::createCodec(const MoxMxf::VideoDescriptor &descriptor, Header &header, ChannelList &channels) const
 {
 	return new JPEGCodec(descriptor, header, channels);
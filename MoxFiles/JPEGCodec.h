@@ -12,8 +12,27 @@
 
 #include <MoxFiles/Codec.h>
 
+struct jpeg_error_mgr;
+struct jpeg_compress_struct;
+struct jpeg_decompress_struct;
+
 namespace MoxFiles
 {
+	struct JPEGStripeDecoder;
+	
+	// Baseline JPEG through libjpeg(-turbo), stored as RGB.
+	//
+	// If the FrameBuffer has full-range Rec. 601 "Y", "Cb", "Cr" slices instead,
+	// which is what JFIF uses inside, they go to and from libjpeg as they are and
+	// no color conversion is done.  If those are planar with Cb and Cr already
+	// subsampled (xSampling 2, ySampling 1 or 2), the chroma resampling is
+	// skipped too.  Frames written that way are stored with the same sampling,
+	// and reading planes back requires the file to match.
+	//
+	// decompressRegion() only skips the rows and columns outside the region
+	// when built against libjpeg-turbo (LIBJPEG_TURBO_VERSION is defined).
+	// With plain libjpeg it decodes the whole frame and copies the region out.
+
 	class JPEGCodec : public VideoCodec
 	{
 	  public:
@@ -24,12 +43,40 @@ namespace MoxFiles
 		virtual const MoxMxf::VideoDescriptor * getDescriptor() const { return &_descriptor; }
 		
 		virtual void compress(const FrameBuffer &frame);
+		virtual bool convertsInput() const { return true; }
 		virtual void decompress(const DataChunk &data);
+		virtual bool decompressInto(const DataChunk &data, FrameBuffer &frameBuffer);
+		virtual bool decompressReduced(const DataChunk &data, FrameBuffer &frameBuffer, int resolutionFactor);
+		virtual bool decompressRegion(const DataChunk &data, FrameBuffer &frameBuffer, const Box2i &region);
+		
+	  public:
+		// Encoder setting that goes in the Header: a restart marker every so many MCU
+		// rows (0 for none).  Frames that have them are decoded in stripes on the
+		// global thread pool.  One MCU row gives the most places to split.
+		static int getRestartInterval(const Header &header);
+		static void setRestartInterval(Header &header, int mcuRows);
 	
 	  private:
+		void decompressRows(const DataChunk &data, char *origin, ptrdiff_t rowbytes, int scale = 1, const Box2i *region = NULL, bool ycbcr = false);
+		bool decompressStripes(const DataChunk &data, char *origin, ptrdiff_t rowbytes, int scale, bool ycbcr);
+		bool decompressPlanes(const DataChunk &data, FrameBuffer &frameBuffer, int xSampling, int ySampling);
+		
 		MoxMxf::RGBADescriptor _descriptor;
 		
 		int _quality;
+		int _restartRows;
+		
+		size_t _lastCompressedSize;
+		
+		// kept from frame to frame
+		struct jpeg_error_mgr *_errorMgr;
+		struct jpeg_compress_struct *_compressor;
+		struct jpeg_decompress_struct *_decompressor;
+		std::vector<JPEGStripeDecoder *> _stripeDecoders;
+		
+		struct jpeg_error_mgr * errorManager();
+		struct jpeg_compress_struct & compressor();
+		struct jpeg_decompress_struct & decompressor();
 	};
 	
 	
@@ -10,10 +10,14 @@
 #include <MoxFiles/JPEGLSCodec.h>
 
 #include <MoxFiles/MemoryFile.h>
+#include <MoxFiles/Thread.h>
 
 //#include <iostream>
 
+#include <algorithm>
+
 #include <assert.h>
+#include <string.h>
 
 #undef ASSERT // defined in mxflib
 
@@ -22,9 +26,44 @@
 namespace MoxFiles
 {
 
+// A plain frame is one JPEG-LS stream.  A striped frame is, all little-endian:
+//
+//   "MXLS", rows per stripe, stripe count (UInt32s),
+//   each stripe's size (UInt32)
+//
+// followed by the stripes, each a JPEG-LS stream of just its rows.
+
+static const unsigned char StripedMagic[4] = { 'M', 'X', 'L', 'S' };
+static const size_t StripedHeaderSize = 12;
+
+// coding variant for striped frames, see VideoDescriptor::setCodingVariant()
+static const UInt8 StripedVariant = 1;
+
+// about this many bytes of samples in a stripe
+static const size_t JPEGLSStripeSize = (1024 * 1024);
+
+
+static inline void
+PutUInt32(unsigned char *p, UInt32 value)
+{
+	p[0] = (value & 0xff);
+	p[1] = ((value >> 8) & 0xff);
+	p[2] = ((value >> 16) & 0xff);
+	p[3] = ((value >> 24) & 0xff);
+}
+
+
+static inline UInt32
+GetUInt32(const unsigned char *p)
+{
+	return (p[0] | (p[1] << 8) | (p[2] << 16) | ((UInt32)p[3] << 24));
+}
+
+
 JPEGLSCodec::JPEGLSCodec(const Header &header, const ChannelList &channels) :
 	VideoCodec(header, channels),
-	_descriptor(header.frameRate(), header.width(), header.height(), MoxMxf::VideoDescriptor::VideoCodecJPEGLS)
+	_descriptor(header.frameRate(), header.width(), header.height(), MoxMxf::VideoDescriptor::VideoCodecJPEGLS),
+	_striped(getStriped(header))
 {
 	setWindows(_descriptor, header);
 	
@@ -57,12 +96,18 @@ JPEGLSCodec::JPEGLSCodec(const Header &header, const ChannelList &channels) :
 		layout.push_back(MoxMxf::RGBADescriptor::RGBALayoutItem('A', bit_depth));
 	
 	_descriptor.setPixelLayout(layout);
+	
+	if(_striped)
+		_descriptor.setCodingVariant(StripedVariant);
 }
 
 
 JPEGLSCodec::JPEGLSCodec(const MoxMxf::VideoDescriptor &descriptor, Header &header, ChannelList &channels) :
 	VideoCodec(descriptor, header, channels),
-	_descriptor(dynamic_cast<const MoxMxf::RGBADescriptor &>(descriptor))
+	_descriptor(dynamic_cast<const MoxMxf::RGBADescriptor &>(descriptor)),
+	_channels(JPEGLS_RGB),
+	_depth(JPEGLS_8),
+	_striped(_descriptor.getCodingVariant() == StripedVariant)
 {
 	assert(_descriptor.getVideoCodec() == MoxMxf::VideoDescriptor::VideoCodecJPEGLS);
 
@@ -88,12 +133,8 @@ JPEGLSCodec::JPEGLSCodec(const MoxMxf::VideoDescriptor &descriptor, Header &head
 	}
 	
 	
-	const PixelType pixel_type = (_depth == JPEGLS_8 ? UINT8 :
-									_depth == JPEGLS_10 ? UINT10 :
-									_depth == JPEGLS_12 ? UINT12 :
-									_depth == JPEGLS_16 ? UINT16 :
-									UINT8);
-									
+	const PixelType pixel_type = pixelType();
+	
 	channels.insert("R", Channel(pixel_type));
 	channels.insert("G", Channel(pixel_type));
 	channels.insert("B", Channel(pixel_type));
@@ -109,6 +150,202 @@ JPEGLSCodec::~JPEGLSCodec()
 }
 
 
+bool
+JPEGLSCodec::getStriped(const Header &header)
+{
+	const IntAttribute *stripedAttr = header.findTypedAttribute<IntAttribute>("jpeglsStriped");
+	
+	return (stripedAttr != NULL && stripedAttr->value() != 0);
+}
+
+
+void
+JPEGLSCodec::setStriped(Header &header, bool striped)
+{
+	header.insert("jpeglsStriped", IntAttribute(striped ? 1 : 0));
+}
+
+
+static CodecThreads gJPEGLSThreads("JPEG-LS");
+
+
+int
+JPEGLSCodec::threadCount()
+{
+	return gJPEGLSThreads.count();
+}
+
+
+void
+JPEGLSCodec::setThreadCount(int count)
+{
+	gJPEGLSThreads.setCount(count);
+}
+
+
+PixelType
+JPEGLSCodec::pixelType() const
+{
+	return (_depth == JPEGLS_8 ? UINT8 :
+			_depth == JPEGLS_10 ? UINT10 :
+			_depth == JPEGLS_12 ? UINT12 :
+			_depth == JPEGLS_16 ? UINT16 :
+			UINT8);
+}
+
+
+namespace
+{
+
+// Rows of the interleaved frame, and the JPEG-LS stream they go to or come from.
+struct JPEGLSStripe
+{
+	int firstRow;
+	int rows;
+	
+	DataChunkPtr compressed; // encoding, grown as needed
+	
+	const unsigned char *buf; // decoding
+	size_t size;
+	
+	bool success;
+	
+	JPEGLSStripe(int f = 0, int r = 0) : firstRow(f), rows(r), buf(NULL), size(0), success(false) {}
+};
+
+
+class JPEGLSEncodeTask : public Task
+{
+  public:
+	JPEGLSEncodeTask(TaskGroup *group, JPEGLSStripe &stripe, const char *origin, size_t rowBytes, const JlsParameters &params);
+	~JPEGLSEncodeTask() {}
+	
+	virtual void execute();
+
+  private:
+	JPEGLSStripe &_stripe;
+	const char * const _origin;
+	const size_t _rowBytes;
+	const JlsParameters &_params;
+};
+
+
+JPEGLSEncodeTask::JPEGLSEncodeTask(TaskGroup *group, JPEGLSStripe &stripe, const char *origin, size_t rowBytes, const JlsParameters &params) :
+	Task(group),
+	_stripe(stripe),
+	_origin(origin),
+	_rowBytes(rowBytes),
+	_params(params)
+{
+
+}
+
+
+void
+JPEGLSEncodeTask::execute()
+{
+	JlsParameters params = _params;
+	
+	params.height = _stripe.rows;
+	
+	const char *rows = _origin + (_stripe.firstRow * _rowBytes);
+	const size_t rows_size = (_stripe.rows * _rowBytes);
+	
+	DataChunk &out = *_stripe.compressed;
+	
+	// the buffer's whole Size is room to write in
+	if(out.Size < rows_size)
+		out.Resize(rows_size, false);
+	
+	JLS_ERROR err = OK;
+	
+	do
+	{
+		ByteStreamInfo inStream = FromByteArray(rows, rows_size);
+		ByteStreamInfo outStream = FromByteArray(out.Data, out.Size);
+		
+		size_t bytesWritten = 0;
+		
+		err = JpegLsEncodeStream(outStream, &bytesWritten, inStream, &params);
+		
+		if(err == CompressedBufferTooSmall)
+		{
+			out.Resize(2 * out.Size, false);
+		}
+		else if(err == OK)
+		{
+			assert(bytesWritten > 0);
+			
+			_stripe.size = bytesWritten;
+		}
+	
+	}while(err == CompressedBufferTooSmall);
+	
+	assert(err != TooMuchCompressedData);
+	
+	_stripe.success = (err == OK);
+}
+
+
+class JPEGLSDecodeTask : public Task
+{
+  public:
+	JPEGLSDecodeTask(TaskGroup *group, JPEGLSStripe &stripe, char *origin, size_t rowBytes,
+						int width, int components, unsigned int bitDepth);
+	~JPEGLSDecodeTask() {}
+	
+	virtual void execute();
+
+  private:
+	JPEGLSStripe &_stripe;
+	char * const _origin;
+	const size_t _rowBytes;
+	const int _width;
+	const int _components;
+	const unsigned int _bitDepth;
+};
+
+
+JPEGLSDecodeTask::JPEGLSDecodeTask(TaskGroup *group, JPEGLSStripe &stripe, char *origin, size_t rowBytes,
+									int width, int components, unsigned int bitDepth) :
+	Task(group),
+	_stripe(stripe),
+	_origin(origin),
+	_rowBytes(rowBytes),
+	_width(width),
+	_components(components),
+	_bitDepth(bitDepth)
+{
+
+}
+
+
+void
+JPEGLSDecodeTask::execute()
+{
+	ByteStreamInfo inStream = FromByteArray(_stripe.buf, _stripe.size);
+	
+	struct JlsParameters info;
+	
+	if(JpegLsReadHeaderStream(inStream, &info) != OK)
+		return;
+	
+	if(info.width != _width || info.height != _stripe.rows || info.components != _components ||
+		info.bitspersample != _bitDepth || info.colorTransform != COLORXFORM_NONE)
+	{
+		return;
+	}
+	
+	char *rows = _origin + (_stripe.firstRow * _rowBytes);
+	
+	ByteStreamInfo outStream = FromByteArray(rows, _stripe.rows * _rowBytes);
+	
+	_stripe.success = (JpegLsDecodeStream(outStream, inStream, &info) == OK);
+}
+
+} // namespace
+
+
 void
 JPEGLSCodec::compress(const FrameBuffer &frame)
 {
@@ -117,11 +354,7 @@ JPEGLSCodec::compress(const FrameBuffer &frame)
 	const int width = (dataW.max.x - dataW.min.x + 1);
 	const int height = (dataW.max.y - dataW.min.y + 1);
 
-	const PixelType pixType = (_depth == JPEGLS_8 ? UINT8 :
-								_depth == JPEGLS_10 ? UINT10 :
-								_depth == JPEGLS_12 ? UINT12 :
-								_depth == JPEGLS_16 ? UINT16 :
-								UINT8);
+	const PixelType pixType = pixelType();
 	
 	const size_t pixSize = PixelSize(pixType);
 	const unsigned int bitDepth = PixelBits(pixType);
@@ -131,9 +364,7 @@ JPEGLSCodec::compress(const FrameBuffer &frame)
 	const size_t tempRowbytes = (tempPixelSize * width);
 	const size_t tempBufSize = (tempRowbytes * height);
 	
-	DataChunk dataChunk(tempBufSize);
-	
-	char *tempBuffer = (char *)dataChunk.Data;
+	char *tempBuffer = stagingBuffer(tempBufSize);
 	
 	assert(dataW.min.x == 0 && dataW.min.y == 0);
 	
@@ -179,113 +410,175 @@ JPEGLSCodec::compress(const FrameBuffer &frame)
 	*/
 	
 	
-	ByteStreamInfo inStream = FromByteArray(dataChunk.Data, dataChunk.Size);
+	// Stripes are sized by bytes, not threads, so files written on a small
+	// machine still decode in parallel on a big one.
+	const int rows_per_stripe = (_striped ? std::max<int>(1, std::min<size_t>(height, JPEGLSStripeSize / tempRowbytes)) : height);
 	
-	DataChunkPtr outDataChunk = new DataChunk(tempBufSize);
+	std::vector<JPEGLSStripe> stripes;
 	
+	for(int y = 0; y < height; y += rows_per_stripe)
+		stripes.push_back(JPEGLSStripe(y, std::min(rows_per_stripe, height - y)));
 	
-	size_t bytesWritten = 0;
+	while(_stripeBuffers.size() < stripes.size())
+		_stripeBuffers.push_back(new DataChunk);
 	
-	JLS_ERROR err = OK;
+	for(int i = 0; i < stripes.size(); i++)
+		stripes[i].compressed = _stripeBuffers[i];
+	
+	const bool threaded = (threadCount() != 0 && stripes.size() > 1);
 	
-	do
 	{
-		ByteStreamInfo outStream = FromByteArray(outDataChunk->Data, outDataChunk->Size);
-		
-		err = JpegLsEncodeStream(outStream, &bytesWritten, inStream, &params);
+		TaskGroup taskGroup;
 		
-		if(err == CompressedBufferTooSmall)
+		for(int i = 0; i < stripes.size(); i++)
 		{
-			outDataChunk->Resize(2 * outDataChunk->Size, false);
+			runTask(new JPEGLSEncodeTask(&taskGroup, stripes[i], tempBuffer, tempRowbytes, params), threaded);
 		}
+	}
 	
-	}while(err == CompressedBufferTooSmall);
+	size_t data_size = (_striped ? StripedHeaderSize + (4 * stripes.size()) : 0);
+	
+	for(int i = 0; i < stripes.size(); i++)
+	{
+		if(!stripes[i].success)
+			throw MoxMxf::ArgExc("JPEG-LS compression error");
+		
+		data_size += stripes[i].size;
+	}
 	
-	assert(err != TooMuchCompressedData);
 	
+	DataChunkPtr outDataChunk = new PooledDataChunk(data_size);
 	
-	if(err == OK)
+	unsigned char *p = outDataChunk->Data;
+	
+	if(_striped)
 	{
-		assert(bytesWritten > 0);
+		memcpy(p, StripedMagic, 4);
+		
+		PutUInt32(p + 4, rows_per_stripe);
+		PutUInt32(p + 8, stripes.size());
+		
+		p += StripedHeaderSize;
+		
+		for(int i = 0; i < stripes.size(); i++)
+		{
+			PutUInt32(p, stripes[i].size);
+			
+			p += 4;
+		}
+	}
 	
-		outDataChunk->Resize(bytesWritten);
+	for(int i = 0; i < stripes.size(); i++)
+	{
+		memcpy(p, stripes[i].compressed->Data, stripes[i].size);
 		
-		storeData(outDataChunk);
+		p += stripes[i].size;
 	}
-	else
-		throw MoxMxf::ArgExc("JPEG-LS compression error");
+	
+	assert(p == outDataChunk->Data + data_size);
+	
+	storeData(outDataChunk);
 }
 
 
 void
 JPEGLSCodec::decompress(const DataChunk &data)
 {
-	ByteStreamInfo inStream = FromByteArray(data.Data, data.Size);
+	const Box2i dataW = dataWindow();
+	
+	const int width = (dataW.max.x - dataW.min.x + 1);
+	const int height = (dataW.max.y - dataW.min.y + 1);
 	
+	assert(dataW.min.x == 0);
+	assert(dataW.min.y == 0);
 	
-	struct JlsParameters info;
+	const PixelType pixType = pixelType();
 	
-	JLS_ERROR err = JpegLsReadHeaderStream(inStream, &info);
+	const size_t pixSize = PixelSize(pixType);
+	const unsigned int bitDepth = PixelBits(pixType);
+	const int numChannels = (_channels == JPEGLS_RGBA ? 4 : 3);
 	
-	if(err == OK)
+	
+	std::vector<JPEGLSStripe> stripes;
+	
+	if(data.Size >= StripedHeaderSize && memcmp(data.Data, StripedMagic, 4) == 0)
 	{
-		const int width = info.width;
-		const int height = info.height;
-		
-		assert(info.components == (_channels == JPEGLS_RGBA ? 4 : 3));
-		assert(info.colorTransform == COLORXFORM_NONE);
+		const UInt32 rows_per_stripe = GetUInt32(data.Data + 4);
+		const UInt32 stripe_count = GetUInt32(data.Data + 8);
 		
-		const PixelType pixType = (_depth == JPEGLS_8 ? UINT8 :
-									_depth == JPEGLS_10 ? UINT10 :
-									_depth == JPEGLS_12 ? UINT12 :
-									_depth == JPEGLS_16 ? UINT16 :
-									UINT8);
-		
-		const size_t pixSize = PixelSize(pixType);
-		const unsigned int bitDepth = PixelBits(pixType);
-		
-		assert(info.bitspersample == bitDepth);
-									
-		const size_t pixelSize = (info.components * PixelSize(pixType));
-		const size_t rowBytes = (width * pixelSize);
-		const size_t bufSize = (height * rowBytes);
-		
-		DataChunkPtr frameData = new DataChunk(bufSize);
-		
-		char *buf = (char *)frameData->Data;
+		if(rows_per_stripe == 0 || stripe_count != ((height + rows_per_stripe - 1) / rows_per_stripe) ||
+			data.Size < StripedHeaderSize + (4 * (size_t)stripe_count))
+		{
+			throw MoxMxf::InputExc("JPEG-LS stripes don't match the descriptor");
+		}
 		
-		const Box2i dataW = dataWindow();
+		const unsigned char *stripe_sizes = data.Data + StripedHeaderSize;
+		const unsigned char *buf = stripe_sizes + (4 * stripe_count);
 		
-		assert(width == (dataW.max.x - dataW.min.x + 1));
-		assert(height == (dataW.max.y - dataW.min.y + 1));
-		assert(dataW.min.x == 0);
-		assert(dataW.min.y == 0);
+		for(int i = 0; i < stripe_count; i++)
+		{
+			JPEGLSStripe stripe(i * rows_per_stripe, std::min<int>(rows_per_stripe, height - (i * rows_per_stripe)));
 			
-		FrameBufferPtr frameBuffer = new FrameBuffer(dataW);
-		
-		frameBuffer->insert("R", Slice(pixType, &buf[0 * pixSize], pixelSize, rowBytes));
-		frameBuffer->insert("G", Slice(pixType, &buf[1 * pixSize], pixelSize, rowBytes));
-		frameBuffer->insert("B", Slice(pixType, &buf[2 * pixSize], pixelSize, rowBytes));
-		
-		if(info.components >= 4)
-			frameBuffer->insert("A", Slice(pixType, &buf[3 * pixSize], pixelSize, rowBytes));
-		
-		frameBuffer->attachData(frameData);
-		
-		
-		ByteStreamInfo outStream = FromByteArray(frameData->Data, frameData->Size);
+			stripe.buf = buf;
+			stripe.size = GetUInt32(stripe_sizes + (4 * i));
+			
+			if(stripe.size > (size_t)((data.Data + data.Size) - buf))
+				throw MoxMxf::InputExc("JPEG-LS frame is cut short");
+			
+			buf += stripe.size;
+			
+			stripes.push_back(stripe);
+		}
+	}
+	else
+	{
+		JPEGLSStripe stripe(0, height);
 		
+		stripe.buf = data.Data;
+		stripe.size = data.Size;
 		
-		err = JpegLsDecodeStream(outStream, inStream, &info);
+		stripes.push_back(stripe);
+	}
+	
+	
+	const size_t pixelSize = (numChannels * pixSize);
+	const size_t rowBytes = (width * pixelSize);
+	const size_t bufSize = (height * rowBytes);
+	
+	DataChunkPtr frameData = new PooledDataChunk(bufSize);
+	
+	char *buf = (char *)frameData->Data;
+	
+	FrameBufferPtr frameBuffer = new FrameBuffer(dataW);
+	
+	frameBuffer->insert("R", Slice(pixType, &buf[0 * pixSize], pixelSize, rowBytes));
+	frameBuffer->insert("G", Slice(pixType, &buf[1 * pixSize], pixelSize, rowBytes));
+	frameBuffer->insert("B", Slice(pixType, &buf[2 * pixSize], pixelSize, rowBytes));
+	
+	if(numChannels >= 4)
+		frameBuffer->insert("A", Slice(pixType, &buf[3 * pixSize], pixelSize, rowBytes));
+	
+	frameBuffer->attachData(frameData);
+	
+	
+	const bool threaded = (threadCount() != 0 && stripes.size() > 1);
+	
+	{
+		TaskGroup taskGroup;
 		
-		if(err == OK)
+		for(int i = 0; i < stripes.size(); i++)
 		{
-			storeFrame(frameBuffer);
+			runTask(new JPEGLSDecodeTask(&taskGroup, stripes[i], buf, rowBytes, width, numChannels, bitDepth), threaded);
 		}
 	}
 	
-	if(err != OK)
-		throw MoxMxf::ArgExc("JPEG-LS decompression error");
+	for(int i = 0; i < stripes.size(); i++)
+	{
+		if(!stripes[i].success)
+			throw MoxMxf::ArgExc("JPEG-LS decompression error");
+	}
+	
+	storeFrame(frameBuffer);
 }
 
 
@@ -24,8 +24,21 @@ namespace MoxFiles
 		virtual const MoxMxf::VideoDescriptor * getDescriptor() const { return &_descriptor; }
 		
 		virtual void compress(const FrameBuffer &frame);
+		virtual bool convertsInput() const { return true; }
 		virtual void decompress(const DataChunk &data);
 	
+	  public:
+		// Encoder setting that goes in the Header.  Striped frames are cut into
+		// horizontal stripes, each a JPEG-LS stream of its own, that are encoded
+		// and decoded at the same time on the global thread pool.  Other JPEG-LS
+		// readers can't read them, so it's off by default.
+		static bool getStriped(const Header &header);
+		static void setStriped(Header &header, bool striped);
+		
+		// Whether the stripes go on the global pool, see CodecThreads in Thread.h.
+		static int threadCount();
+		static void setThreadCount(int count);
+	
 	  private:
 		MoxMxf::RGBADescriptor _descriptor;
 		
@@ -44,6 +57,13 @@ namespace MoxFiles
 		};
 		
 		JPEGLS_Depth _depth;
+		
+		bool _striped;
+		
+		PixelType pixelType() const;
+		
+		// compressed stripes, kept from frame to frame so they only grow
+		std::vector<DataChunkPtr> _stripeBuffers;
 	};
 	
 	
@@ -9,6 +9,14 @@
 
 #include <MoxFiles/MPEGCodec.h>
 
+#ifdef MOXFILES_USE_LIBMPEG2
+#include <inttypes.h>
+
+extern "C" {
+#include <mpeg2dec/mpeg2.h>
+}
+#endif
+
 
 namespace MoxFiles
 {
@@ -23,33 +31,316 @@ MPEGCodec::MPEGCodec(const Header &header, const ChannelList &channels) :
 
 MPEGCodec::MPEGCodec(const MoxMxf::VideoDescriptor &descriptor, Header &header, ChannelList &channels) :
 	VideoCodec(descriptor, header, channels),
-	_descriptor(dynamic_cast<const MoxMxf::MPEGDescriptor &>(descriptor))
+	_descriptor(dynamic_cast<const MoxMxf::MPEGDescriptor &>(descriptor)),
+	_coefficients(FrameBuffer::Rec601),
+	_xSampling(2),
+	_ySampling(2),
+	_decoder(NULL),
+	_storedFrame(0),
+	_gopStart(0),
+	_lastFrameNumber(-1),
+	_decodedPictures(0),
+	_lastFrameLatency(0)
 {
 	assert(header.width() == _descriptor.getStoredWidth());
 	assert(header.height() == _descriptor.getStoredHeight());
 	
+#ifdef MOXFILES_USE_LIBMPEG2
+	// MPEG-2 is 4:2:0 unless it's 4:2:2 profile
+	if(_descriptor.getHorizontalSubsampling() == 2 && _descriptor.getVerticalSubsampling() == 1)
+		_ySampling = 1;
+	else if(_descriptor.getHorizontalSubsampling() != 0 && (_descriptor.getHorizontalSubsampling() != 2 || _descriptor.getVerticalSubsampling() != 2))
+		throw MoxMxf::NoImplExc("Only handling 4:2:0 and 4:2:2 MPEG-2");
+	
+	_coefficients = (_descriptor.getStoredHeight() > 576 ? FrameBuffer::Rec709 : FrameBuffer::Rec601);
+	
+	channels.insert("Y", Channel(MoxFiles::UINT8));
+	channels.insert("Cb", Channel(MoxFiles::UINT8, _xSampling, _ySampling));
+	channels.insert("Cr", Channel(MoxFiles::UINT8, _xSampling, _ySampling));
+	
+	startStream(0);
+#else
 	channels.insert("R", Channel(MoxFiles::UINT8));
 	channels.insert("G", Channel(MoxFiles::UINT8));
 	channels.insert("B", Channel(MoxFiles::UINT8));
+#endif
 }
 
 
 MPEGCodec::~MPEGCodec()
 {
+#ifdef MOXFILES_USE_LIBMPEG2
+	if(_decoder != NULL)
+		mpeg2_close(_decoder);
 
+	for(std::list<Picture *>::iterator i = _pictures.begin(); i != _pictures.end(); ++i)
+		delete *i;
+#endif
 }
 
 
 void
 MPEGCodec::compress(const FrameBuffer &frame)
 {
-	throw MoxMxf::NoImplExc("This is a fake codec");
+	throw MoxMxf::NoImplExc("Can't write MPEG-2");
+}
+
+
+bool
+MPEGCodec::reordersFrames() const
+{
+#ifdef MOXFILES_USE_LIBMPEG2
+	return true;
+#else
+	return false;
+#endif
+}
+
+
+#ifdef MOXFILES_USE_LIBMPEG2
+
+void
+MPEGCodec::startStream(int storedFrame)
+{
+	// A new decoder rather than mpeg2_reset(), so it lets go of all its
+	// pictures and we can free them.
+	if(_decoder != NULL)
+		mpeg2_close(_decoder);
+	
+	for(std::list<Picture *>::iterator i = _pictures.begin(); i != _pictures.end(); ++i)
+		delete *i;
+	
+	_pictures.clear();
+	
+	_decoder = mpeg2_init();
+	
+	if(_decoder == NULL)
+		throw MoxMxf::NullExc("Error creating MPEG-2 decoder");
+	
+	_storedFrame = storedFrame;
+	_gopStart = storedFrame;
+	
+	_decodedPictures = 0;
+}
+
+
+static bool
+HasGOPHeader(const DataChunk &data)
+{
+	// the group_start_code comes before the picture, if there is one
+	const unsigned char *buf = data.Data;
+	const unsigned char *end = data.Data + data.Size;
+	
+	for(const unsigned char *p = buf; (end - p) >= 4; p++)
+	{
+		if(p[0] == 0x00 && p[1] == 0x00 && p[2] == 0x01)
+		{
+			if(p[3] == 0xb8)
+				return true;
+			else if(p[3] == 0x00) // picture_start_code
+				return false;
+			
+			p += 3;
+		}
+	}
+	
+	return false;
 }
 
 
 void
 MPEGCodec::decompress(const DataChunk &data)
 {
+	// Counted before parsing, so the numbering stays right if this picture
+	// turns out to be broken and libmpeg2 has to find its way back.
+	const int storedFrame = _storedFrame++;
+	
+	// Each DataChunk is one coded picture.  temporal_reference counts from
+	// the GOP header in display order, and the GOP holds the same frames in
+	// display and stored order, so that's enough to number the frames.
+	if( HasGOPHeader(data) )
+		_gopStart = storedFrame;
+	
+	mpeg2_tag_picture(_decoder, storedFrame, _gopStart);
+	
+	mpeg2_buffer(_decoder, data.Data, data.Data + data.Size);
+	
+	parse();
+}
+
+
+void
+MPEGCodec::end_of_stream()
+{
+	// A sequence_end_code, to get the last reference picture out.
+	static unsigned char sequence_end[4] = { 0x00, 0x00, 0x01, 0xb7 };
+	
+	mpeg2_buffer(_decoder, sequence_end, sequence_end + 4);
+	
+	parse();
+}
+
+
+void
+MPEGCodec::parse()
+{
+	const mpeg2_info_t *info = mpeg2_info(_decoder);
+	
+	while(true)
+	{
+		const mpeg2_state_t state = mpeg2_parse(_decoder);
+		
+		if(state == STATE_BUFFER)
+		{
+			return;
+		}
+		else if(state == STATE_INVALID)
+		{
+			// libmpeg2 goes looking for the next header by itself, and the
+			// next mpeg2_buffer() replaces whatever's left of this one
+			throw MoxMxf::InputExc("Invalid MPEG-2 data");
+		}
+		else if(state == STATE_SEQUENCE)
+		{
+			const mpeg2_sequence_t *sequence = info->sequence;
+			
+			if(sequence->picture_width < _descriptor.getStoredWidth() || sequence->picture_height < _descriptor.getStoredHeight())
+				throw MoxMxf::InputExc("MPEG-2 picture is smaller than the descriptor says");
+			
+			if(sequence->chroma_width != (sequence->width / _xSampling) || sequence->chroma_height != (sequence->height / _ySampling))
+				throw MoxMxf::InputExc("MPEG-2 chroma format doesn't match the descriptor");
+			
+			mpeg2_custom_fbuf(_decoder, 1);
+		}
+		else if(state == STATE_PICTURE)
+		{
+			const mpeg2_sequence_t *sequence = info->sequence;
+			
+			const size_t luma_size = (size_t)sequence->width * sequence->height;
+			const size_t chroma_size = (size_t)sequence->chroma_width * sequence->chroma_height;
+			
+			Picture *picture = new Picture;
+			
+			picture->data = new PooledDataChunk(luma_size + (2 * chroma_size));
+			
+			picture->planes[0] = picture->data->Data;
+			picture->planes[1] = picture->planes[0] + luma_size;
+			picture->planes[2] = picture->planes[1] + chroma_size;
+			
+			_pictures.push_back(picture);
+			
+			mpeg2_set_buf(_decoder, picture->planes, picture);
+			
+			_decodedPictures++;
+		}
+		else if(state == STATE_SLICE || state == STATE_END || state == STATE_INVALID_END)
+		{
+			if(info->display_fbuf != NULL && info->display_picture != NULL &&
+				!(info->display_picture->flags & PIC_FLAG_SKIP))
+			{
+				const mpeg2_picture_t *picture = info->display_picture;
+				
+				const int frameNumber = picture->tag2 + picture->temporal_reference;
+				
+				outputPicture(*(Picture *)info->display_fbuf->id, frameNumber);
+			}
+			
+			if(info->discard_fbuf != NULL)
+				releasePicture((Picture *)info->discard_fbuf->id);
+		}
+	}
+}
+
+
+void
+MPEGCodec::outputPicture(const Picture &picture, int frameNumber)
+{
+	const mpeg2_sequence_t *sequence = mpeg2_info(_decoder)->sequence;
+	
+	const Box2i dataW = dataWindow();
+	
+	FrameBufferPtr frame_buffer = new FrameBuffer(dataW);
+	
+	frame_buffer->coefficients() = _coefficients;
+	
+	// the decoder's planes, as they are
+	const int x_sampling[3] = { 1, _xSampling, _xSampling };
+	const int y_sampling[3] = { 1, _ySampling, _ySampling };
+	const ptrdiff_t rowbytes[3] = { sequence->width, sequence->chroma_width, sequence->chroma_width };
+	const char *names[3] = { "Y", "Cb", "Cr" };
+	
+	for(int i=0; i < 3; i++)
+	{
+		char *origin = (char *)picture.planes[i] - ((dataW.min.x / x_sampling[i]) * sizeof(UInt8)) - ((dataW.min.y / y_sampling[i]) * rowbytes[i]);
+		
+		frame_buffer->insert(names[i], Slice(MoxFiles::UINT8, origin, sizeof(UInt8), rowbytes[i], x_sampling[i], y_sampling[i]));
+	}
+	
+	frame_buffer->attachData(picture.data);
+	
+	storeFrame(frame_buffer);
+	
+	_frameNumbers.push(frameNumber);
+	
+	// everything decoded since the last frame went out went toward this one
+	_latencies.push(_decodedPictures);
+	
+	_decodedPictures = 0;
+}
+
+
+void
+MPEGCodec::releasePicture(Picture *picture)
+{
+	// Only our reference goes away.  A frame that went out still has the data.
+	for(std::list<Picture *>::iterator i = _pictures.begin(); i != _pictures.end(); ++i)
+	{
+		if(*i == picture)
+		{
+			_pictures.erase(i);
+			
+			delete picture;
+			
+			return;
+		}
+	}
+	
+	assert(false);
+}
+
+
+FrameBufferPtr
+MPEGCodec::getNextFrame()
+{
+	FrameBufferPtr frame = VideoCodec::getNextFrame();
+	
+	if(frame)
+	{
+		assert(!_frameNumbers.empty() && !_latencies.empty());
+		
+		_lastFrameNumber = _frameNumbers.front();
+		_lastFrameLatency = _latencies.front();
+		
+		_frameNumbers.pop();
+		_latencies.pop();
+	}
+	
+	return frame;
+}
+
+#else // MOXFILES_USE_LIBMPEG2
+
+void
+MPEGCodec::startStream(int storedFrame)
+{
+
+}
+
+
+void
+MPEGCodec::decompress(const DataChunk &data)
+{
+	// no decoder, so the frames come out black
 	const int channels = 3;
 	const size_t bytes_per_channel = sizeof(unsigned char);
 	
@@ -80,6 +371,23 @@ MPEGCodec::decompress(const DataChunk &data)
 	storeFrame(buf);
 }
 
+
+void
+MPEGCodec::end_of_stream()
+{
+
+}
+
+
+FrameBufferPtr
+MPEGCodec::getNextFrame()
+{
+	return VideoCodec::getNextFrame();
+}
+
+#endif // MOXFILES_USE_LIBMPEG2
+
+
 bool
 MPEGCodecInfo::canCompressType(PixelType pixelType) const
 {
@@ -89,7 +397,11 @@ MPEGCodecInfo::canCompressType(PixelType pixelType) const
 ChannelCapabilities
 MPEGCodecInfo::getChannelCapabilites() const
 {
+#ifdef MOXFILES_USE_LIBMPEG2
+	return Channels_YCbCr;
+#else
 	return Channels_RGB;
+#endif
 }
 
 
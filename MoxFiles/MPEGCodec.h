@@ -12,8 +12,19 @@
 
 #include <MoxFiles/Codec.h>
 
+#include <list>
+
+struct mpeg2dec_s;
+
 namespace MoxFiles
 {
+	// MPEG-2 video, decoded with libmpeg2 into native 4:2:0 or 4:2:2 Y'CbCr.
+	// Long-GOP streams are stored in coded order, so this reorders frames
+	// (see VideoCodec::reordersFrames()) and InputFile takes care of starting
+	// from key frames.  Can't write MPEG-2.
+	//
+	// libmpeg2 is GPL, so it's only used when MoxFiles is built with
+	// MOXFILES_USE_LIBMPEG2.  Without it, frames come out black and RGB.
 	class MPEGCodec : public VideoCodec
 	{
 	  public:
@@ -25,9 +36,51 @@ namespace MoxFiles
 		
 		virtual void compress(const FrameBuffer &frame);
 		virtual void decompress(const DataChunk &data);
+		virtual FrameBufferPtr getNextFrame();
+		
+		virtual void end_of_stream();
+		
+		virtual bool reordersFrames() const;
+		virtual void startStream(int storedFrame);
+		virtual int lastFrameNumber() const { return _lastFrameNumber; }
 		
+		// Pictures decoded for the last frame getNextFrame() returned, counting
+		// the reference pictures that had to be decoded before it could go out.
+		int lastFrameLatency() const { return _lastFrameLatency; }
+	
 	  private:
 		MoxMxf::MPEGDescriptor _descriptor;
+		
+		FrameBuffer::Coefficients _coefficients;
+		int _xSampling;
+		int _ySampling;
+		
+		struct mpeg2dec_s *_decoder;
+		
+		// Decoded pictures, reference or waiting to be displayed.  They're
+		// handed out without copying, so a new one is allocated for every
+		// picture, which the BufferPool makes cheap.
+		struct Picture
+		{
+			DataChunkPtr data;
+			UInt8 *planes[3];
+		};
+		
+		std::list<Picture *> _pictures;
+		
+		int _storedFrame; // of the next DataChunk
+		int _gopStart; // where the last GOP header was
+		
+		std::queue<int> _frameNumbers; // goes with the frames stored for getNextFrame()
+		int _lastFrameNumber;
+		
+		int _decodedPictures;
+		std::queue<int> _latencies;
+		int _lastFrameLatency;
+		
+		void parse();
+		void outputPicture(const Picture &picture, int frameNumber);
+		void releasePicture(Picture *picture);
 	};
 	
 	
@@ -47,4 +100,4 @@ namespace MoxFiles
 
 } // namespace
 
-#endif // MOXFILES_MPEGCODEC_H
\ No newline at end of file
+#endif // MOXFILES_MPEGCODEC_H
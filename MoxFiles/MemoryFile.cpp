@@ -19,9 +19,9 @@ MemoryFile::MemoryFile(size_t granularity) :
 	_write_data(NULL),
 	_pos(0)
 {
-	_storage = _write_data = new DataChunk;
+	_storage = _write_data = new PooledDataChunk(granularity);
 	
-	_write_data->SetGranularity(granularity);
+	_write_data->Size = 0;
 }
 
 
@@ -89,16 +89,25 @@ MemoryFile::FileWrite(const unsigned char *source, MoxMxf::UInt64 size)
 	if( readOnly() || _write_data == NULL)
 		throw MoxMxf::ArgExc("Trying to write to read-only file");
 	
-	DataChunk &data = *_write_data;
-	
 	const size_t size_needed = _pos + size;
 	
-	if(data.Size < size_needed)
+	if(_write_data->capacity() < size_needed)
 	{
-		data.Resize(size_needed);
+		// Move to a bigger block, at least doubling so a big frame
+		// written in small pieces isn't copied over and over.
+		PooledDataChunk *bigger = new PooledDataChunk(std::max(size_needed, 2 * _write_data->capacity()));
+		
+		memcpy(bigger->Data, _write_data->Data, _write_data->Size);
+		
+		bigger->Size = _write_data->Size;
+		
+		_storage = _write_data = bigger;
 	}
 	
-	char *dest = (char *)data.Data + _pos;
+	if(_write_data->Size < size_needed)
+		_write_data->Size = size_needed;
+	
+	char *dest = (char *)_write_data->Data + _pos;
 	
 	memcpy(dest, source, size);
 	
@@ -10,14 +10,14 @@
 #ifndef MOXFILES_MEMORYFILE_H
 #define MOXFILES_MEMORYFILE_H
 
-#include <MoxFiles/Types.h>
+#include <MoxFiles/BufferPool.h>
 
 namespace MoxFiles
 {
 	class MemoryFile
 	{
 	  public:
-		MemoryFile(size_t granularity = (1024 * 1024)); // writing
+		MemoryFile(size_t granularity = (1024 * 1024)); // writing, granularity is the starting size
 		MemoryFile(const DataChunk &data); // reading
 		~MemoryFile();
 		
@@ -32,7 +32,7 @@ namespace MoxFiles
 		
 	  private:
 		const DataChunk * const _read_data;
-		DataChunk *_write_data;
+		PooledDataChunk *_write_data;
 		DataChunkPtr _storage;
 		
 		MoxMxf::UInt64 _pos;
@@ -10,10 +10,14 @@
 #include <MoxFiles/OpenEXRCodec.h>
 
 #include <MoxFiles/MemoryFile.h>
+#include <MoxFiles/Thread.h>
 
 #include "ImfHybridInputFile.h"
 #include "ImfOutputFile.h"
+#include "ImfTiledInputFile.h"
+#include "ImfTiledOutputFile.h"
 #include "ImfStandardAttributes.h"
+#include "ImfVersion.h"
 
 namespace MoxFiles
 {
@@ -90,7 +94,8 @@ PixelTypeFromBits(unsigned int bit_depth)
 OpenEXRCodec::OpenEXRCodec(const Header &header, const ChannelList &channels) :
 	VideoCodec(header, channels),
 	_descriptor(header.frameRate(), header.width(), header.height(), MoxMxf::VideoDescriptor::VideoCodecOpenEXR),
-	_exr_header(NULL)
+	_exr_header(NULL),
+	_lastCompressedSize(0)
 {
 	setWindows(_descriptor, header);
 	
@@ -99,13 +104,18 @@ OpenEXRCodec::OpenEXRCodec(const Header &header, const ChannelList &channels) :
 	const float screenWindowWidth = 1;
 	const Imf::LineOrder lineOrder = Imf::INCREASING_Y;
 	
-	const Imf::Compression compression = (isLossless(header) ? Imf::PIZ_COMPRESSION : Imf::DWAB_COMPRESSION);
+	const Imf::Compression compression = getCompression(header);
 	
 	_exr_header = new Imf::Header(displayWindow(), dataWindow(),
 									pixelAspectRatio, screenWindowCenter, screenWindowWidth, lineOrder,
 									compression);
 	
-	if( !isLossless(header) )
+	// Only remembered when it was asked for, files coded the default way
+	// keep the plain OpenEXR label that older readers look for.
+	if(header.findTypedAttribute<IntAttribute>("openexrCompression") != NULL)
+		_descriptor.setCodingVariant(compression + 1);
+	
+	if(compression == Imf::DWAA_COMPRESSION || compression == Imf::DWAB_COMPRESSION)
 	{
 		const int quality = getQuality(header);
 	
@@ -114,6 +124,11 @@ OpenEXRCodec::OpenEXRCodec(const Header &header, const ChannelList &channels) :
 		Imf::addDwaCompressionLevel(*_exr_header, compressionLevel);
 	}
 	
+	const int tileSize = getTileSize(header);
+	
+	if(tileSize > 0)
+		_exr_header->setTileDescription(Imf::TileDescription(tileSize, tileSize, Imf::MIPMAP_LEVELS, Imf::ROUND_UP));
+	
 	
 	MoxMxf::RGBADescriptor::RGBALayout layout;
 	
@@ -132,6 +147,9 @@ OpenEXRCodec::OpenEXRCodec(const Header &header, const ChannelList &channels) :
 												chan.type == MoxFiles::FLOAT ? Imf::FLOAT :
 												Imf::HALF);
 		
+		if(tileSize > 0 && (chan.xSampling != 1 || chan.ySampling != 1))
+			throw MoxMxf::ArgExc("Tiled OpenEXR channels can't be subsampled");
+		
 		_exr_header->channels().insert(name, Imf::Channel(exr_pixel_type, chan.xSampling, chan.ySampling));
 	}
 		
@@ -142,7 +160,8 @@ OpenEXRCodec::OpenEXRCodec(const Header &header, const ChannelList &channels) :
 OpenEXRCodec::OpenEXRCodec(const MoxMxf::VideoDescriptor &descriptor, Header &header, ChannelList &channels) :
 	VideoCodec(descriptor, header, channels),
 	_descriptor(dynamic_cast<const MoxMxf::RGBADescriptor &>(descriptor)),
-	_exr_header(NULL)
+	_exr_header(NULL),
+	_lastCompressedSize(0)
 {
 	const MoxMxf::RGBADescriptor::RGBALayout &pixelLayout = _descriptor.getPixelLayout();
 	
@@ -154,6 +173,11 @@ OpenEXRCodec::OpenEXRCodec(const MoxMxf::VideoDescriptor &descriptor, Header &he
 		
 		channels.insert(name.c_str(), Channel(PixelTypeFromBits(item.depth)));
 	}
+	
+	const unsigned int variant = _descriptor.getCodingVariant();
+	
+	if(variant > 0 && variant <= Imf::NUM_COMPRESSION_METHODS)
+		setCompression(header, (Imf::Compression)(variant - 1));
 }
 
 
@@ -163,6 +187,64 @@ OpenEXRCodec::~OpenEXRCodec()
 }
 
 
+Imf::Compression
+OpenEXRCodec::getCompression(const Header &header)
+{
+	const IntAttribute *compressionAttr = header.findTypedAttribute<IntAttribute>("openexrCompression");
+	
+	if(compressionAttr != NULL)
+		return (Imf::Compression)compressionAttr->value();
+	else
+		return (isLossless(header) ? Imf::PIZ_COMPRESSION : Imf::DWAB_COMPRESSION);
+}
+
+
+void
+OpenEXRCodec::setCompression(Header &header, Imf::Compression compression)
+{
+	if(compression < Imf::NO_COMPRESSION || compression >= Imf::NUM_COMPRESSION_METHODS)
+		throw MoxMxf::ArgExc("Invalid OpenEXR compression");
+	
+	header.insert("openexrCompression", IntAttribute(compression));
+}
+
+
+int
+OpenEXRCodec::getTileSize(const Header &header)
+{
+	const IntAttribute *tileSizeAttr = header.findTypedAttribute<IntAttribute>("openexrTileSize");
+	
+	return (tileSizeAttr != NULL ? tileSizeAttr->value() : 0);
+}
+
+
+void
+OpenEXRCodec::setTileSize(Header &header, int tileSize)
+{
+	if(tileSize < 0)
+		throw MoxMxf::ArgExc("Invalid OpenEXR tile size");
+	
+	header.insert("openexrTileSize", IntAttribute(tileSize));
+}
+
+
+static CodecThreads gEXRThreads("OpenEXR");
+
+
+int
+OpenEXRCodec::threadCount()
+{
+	return gEXRThreads.count();
+}
+
+
+void
+OpenEXRCodec::setThreadCount(int count)
+{
+	gEXRThreads.setCount(count);
+}
+
+
 class MoxOStream : public Imf::OStream
 {
   public:
@@ -211,6 +293,81 @@ MoxOStream::seekp(Imf::Int64 pos)
 }
 
 
+static void
+WriteMipLevels(Imf::OStream &stream, const Imf::Header &header, const Imf::FrameBuffer &exr_frameBuffer, const FrameBuffer &frame)
+{
+	Imf::TiledOutputFile file(stream, header, OpenEXRCodec::threadCount());
+	
+	file.setFrameBuffer(exr_frameBuffer);
+	
+	file.writeTiles(0, file.numXTiles(0) - 1, 0, file.numYTiles(0) - 1, 0);
+	
+	
+	// Each level is the one above box filtered by 2.  ReducedWindow() rounds up
+	// the same way ROUND_UP levels do when the window starts at 0, 0, so the
+	// levels are made there and then moved to the level's data window.
+	const Box2i &dataW = header.dataWindow();
+	
+	FrameBufferPtr previous = new FrameBuffer(Box2i(V2i(0, 0), dataW.max - dataW.min));
+	
+	for(Imf::ChannelList::ConstIterator i = header.channels().begin(); i != header.channels().end(); ++i)
+	{
+		const MoxFiles::Slice &slice = frame[i.name()];
+		
+		char *origin = slice.base + (dataW.min.x * slice.xStride) + (dataW.min.y * slice.yStride);
+		
+		previous->insert(i.name(), MoxFiles::Slice(slice.type, origin, slice.xStride, slice.yStride));
+	}
+	
+	for(int level = 1; level < file.numLevels(); level++)
+	{
+		const Box2i levelW = file.dataWindowForLevel(level);
+		
+		FrameBufferPtr current = new FrameBuffer(ReducedWindow(previous->dataWindow(), 2));
+		
+		assert(current->width() == levelW.max.x - levelW.min.x + 1);
+		assert(current->height() == levelW.max.y - levelW.min.y + 1);
+		
+		const int width = current->width();
+		const int height = current->height();
+		
+		Imf::FrameBuffer level_frameBuffer;
+		
+		for(Imf::ChannelList::ConstIterator i = header.channels().begin(); i != header.channels().end(); ++i)
+		{
+			const char *name = i.name();
+			const Imf::Channel &chan = i.channel();
+			
+			const MoxFiles::PixelType pixel_type = (chan.type == Imf::UINT ? MoxFiles::UINT32 :
+													chan.type == Imf::FLOAT ? MoxFiles::FLOAT :
+													MoxFiles::HALF);
+			
+			const size_t subpixel_size = PixelSize(pixel_type);
+			const size_t rowbytes = subpixel_size * width;
+			
+			DataChunkPtr chan_buffer = new PooledDataChunk(rowbytes * height);
+			
+			current->attachData(chan_buffer);
+			
+			char *origin = (char *)chan_buffer->Data;
+			
+			current->insert(name, MoxFiles::Slice(pixel_type, origin, subpixel_size, rowbytes));
+			
+			level_frameBuffer.insert(name, Imf::Slice(chan.type, origin - (levelW.min.x * subpixel_size) - (levelW.min.y * rowbytes),
+										subpixel_size, rowbytes));
+		}
+		
+		current->reduceFromFrame(*previous, 2);
+		
+		file.setFrameBuffer(level_frameBuffer);
+		
+		file.writeTiles(0, file.numXTiles(level) - 1, 0, file.numYTiles(level) - 1, level);
+		
+		previous = current;
+	}
+}
+
+
 void
 OpenEXRCodec::compress(const FrameBuffer &frame)
 {
@@ -221,53 +378,115 @@ OpenEXRCodec::compress(const FrameBuffer &frame)
 	const int width = dataW.max.x - dataW.min.x + 1;
 	const int height = dataW.max.y - dataW.min.y + 1;
 
+	// OpenEXR will convert between its own pixel types while writing, so if the
+	// caller's slices are all HALF, FLOAT or UINT32 we can hand them over as is.
+	bool input_matches = (frame.dataWindow() == dataW);
+	
+	for(Imf::ChannelList::ConstIterator i = _exr_header->channels().begin(); i != _exr_header->channels().end() && input_matches; ++i)
+	{
+		const Imf::Channel &chan = i.channel();
+		
+		const MoxFiles::Slice *slice = frame.findSlice(i.name());
+		
+		if(slice == NULL ||
+			!(slice->type == MoxFiles::HALF || slice->type == MoxFiles::FLOAT || slice->type == MoxFiles::UINT32) ||
+			slice->xSampling != chan.xSampling || slice->ySampling != chan.ySampling)
+		{
+			input_matches = false;
+		}
+	}
+	
+	
 	FrameBuffer converted_frameBufer(dataW);
 	
 	Imf::FrameBuffer exr_frameBuffer;
 	
+	unsigned int staging_index = 0;
+	
 	for(Imf::ChannelList::ConstIterator i = _exr_header->channels().begin(); i != _exr_header->channels().end(); ++i)
 	{
 		const char *name = i.name();
 		const Imf::Channel &chan = i.channel();
-	
-		const MoxFiles::PixelType pixel_type = (chan.type == Imf::UINT ? MoxFiles::UINT32 :
-												chan.type == Imf::FLOAT ? MoxFiles::FLOAT :
-												MoxFiles::HALF);
-												
-		const size_t subpixel_size = PixelSize(pixel_type);
-		const size_t rowbytes = subpixel_size * width;
-		const size_t data_size = rowbytes * height;
-		
-		DataChunkPtr chan_buffer = new DataChunk(data_size);
 		
-		converted_frameBufer.attachData(chan_buffer);
-		
-		converted_frameBufer.insert(name, MoxFiles::Slice(pixel_type, (char *)chan_buffer->Data, subpixel_size, rowbytes,
+		if(input_matches)
+		{
+			const MoxFiles::Slice &slice = frame[name];
+			
+			const Imf::PixelType exr_type = (slice.type == MoxFiles::UINT32 ? Imf::UINT :
+												slice.type == MoxFiles::FLOAT ? Imf::FLOAT :
+												Imf::HALF);
+			
+			exr_frameBuffer.insert(name, Imf::Slice(exr_type, slice.base, slice.xStride, slice.yStride,
+									slice.xSampling, slice.ySampling));
+		}
+		else
+		{
+			const MoxFiles::PixelType pixel_type = (chan.type == Imf::UINT ? MoxFiles::UINT32 :
+													chan.type == Imf::FLOAT ? MoxFiles::FLOAT :
+													MoxFiles::HALF);
+													
+			const size_t subpixel_size = PixelSize(pixel_type);
+			const size_t rowbytes = subpixel_size * width;
+			const size_t data_size = rowbytes * height;
+			
+			char *origin = stagingBuffer(data_size, staging_index++) -
+							((dataW.min.x / chan.xSampling) * subpixel_size) - ((dataW.min.y / chan.ySampling) * rowbytes);
+			
+			converted_frameBufer.insert(name, MoxFiles::Slice(pixel_type, origin, subpixel_size, rowbytes,
+										chan.xSampling, chan.ySampling));
+			
+			exr_frameBuffer.insert(name, Imf::Slice(chan.type, origin, subpixel_size, rowbytes,
 									chan.xSampling, chan.ySampling));
-		
-		exr_frameBuffer.insert(name, Imf::Slice(chan.type, (char *)chan_buffer->Data, subpixel_size, rowbytes,
-								chan.xSampling, chan.ySampling));
+		}
 	}
 	
-	converted_frameBufer.copyFromFrame(frame);
+	if(!input_matches)
+		converted_frameBufer.copyFromFrame(frame);
 	
 	
+	// Start with room for the last frame and then some, so the file isn't
+	// moved to a bigger block while it's being written.  The first frame gets
+	// half its uncompressed size.
+	size_t guess = _lastCompressedSize + (_lastCompressedSize / 4);
+	
+	if(_lastCompressedSize == 0)
+	{
+		for(Imf::ChannelList::ConstIterator i = _exr_header->channels().begin(); i != _exr_header->channels().end(); ++i)
+		{
+			const Imf::Channel &chan = i.channel();
+			
+			const size_t subpixel_size = (chan.type == Imf::HALF ? 2 : 4);
+			
+			guess += subpixel_size * (width / chan.xSampling) * (height / chan.ySampling) / 2;
+		}
+	}
 	
-	MemoryFile mem_file;
+	MemoryFile mem_file(guess + 65536);
 		
 	{
 		MoxOStream stream(mem_file);
 		
-		Imf::OutputFile file(stream, *_exr_header);
+		if( _exr_header->hasTileDescription() )
+		{
+			WriteMipLevels(stream, *_exr_header, exr_frameBuffer, (input_matches ? frame : converted_frameBufer));
+		}
+		else
+		{
+			Imf::OutputFile file(stream, *_exr_header, threadCount());
 		
-		file.setFrameBuffer(exr_frameBuffer);
+			file.setFrameBuffer(exr_frameBuffer);
 		
-		file.writePixels(height);
+			file.writePixels(height);
+		}
 		
 		// Imf::OutputFile must go out of scope before we write
 	}
 	
-	storeData( mem_file.getDataChunk() );
+	DataChunkPtr data = mem_file.getDataChunk();
+	
+	_lastCompressedSize = data->Size;
+	
+	storeData(data);
 }
 
 
@@ -333,7 +552,7 @@ OpenEXRCodec::decompress(const DataChunk &data)
 	
 	MoxIStream stream(mem_file);
 	
-	Imf::HybridInputFile file(stream);
+	Imf::HybridInputFile file(stream, false, threadCount());
 	
 	
 	const Imath::Box2i &dataW = file.dataWindow();
@@ -361,7 +580,7 @@ OpenEXRCodec::decompress(const DataChunk &data)
 		const size_t rowbytes = subpixel_size * width;
 		const size_t data_size = rowbytes * height;
 		
-		DataChunkPtr chan_buffer = new DataChunk(data_size);
+		DataChunkPtr chan_buffer = new PooledDataChunk(data_size);
 		
 		frameBuffer->attachData(chan_buffer);
 		
@@ -382,6 +601,293 @@ OpenEXRCodec::decompress(const DataChunk &data)
 }
 
 
+bool
+OpenEXRCodec::decompressInto(const DataChunk &data, FrameBuffer &frameBuffer)
+{
+	if(frameBuffer.dataWindow() != dataWindow())
+		return VideoCodec::decompressInto(data, frameBuffer);
+	
+	return decompressRegion(data, frameBuffer, dataWindow());
+}
+
+
+// Single-part tiled files say so in the version field, right after the magic number.
+static bool
+IsTiled(const DataChunk &data)
+{
+	if(data.Size < 8)
+		return false;
+	
+	const unsigned char *v = data.Data + 4;
+	
+	const int version = v[0] | (v[1] << 8) | (v[2] << 16) | (v[3] << 24);
+	
+	return (Imf::isTiled(version) && !Imf::isMultiPart(version));
+}
+	
+	
+// OpenEXR converts between half, float and uint on its own, so the caller's
+// slices can be used as long as the channels are in the file and nothing is
+// subsampled.  offset is where our coordinates are in the file's.
+static bool
+DirectFrameBuffer(const FrameBuffer &frameBuffer, const Imf::ChannelList &channels, Imf::FrameBuffer &exr_frameBuffer, const V2i &offset = V2i(0, 0))
+{
+	for(FrameBuffer::ConstIterator i = frameBuffer.begin(); i != frameBuffer.end(); ++i)
+	{
+		const std::string &name = i.name();
+		const Slice &slice = i.slice();
+		
+		const Imf::Channel *chan = channels.findChannel(name.c_str());
+		
+		if(chan == NULL || chan->xSampling != 1 || chan->ySampling != 1 ||
+			slice.xSampling != 1 || slice.ySampling != 1 ||
+			!(slice.type == MoxFiles::HALF || slice.type == MoxFiles::FLOAT || slice.type == MoxFiles::UINT32))
+		{
+			return false;
+		}
+		
+		const Imf::PixelType exr_pixel_type = (slice.type == MoxFiles::UINT32 ? Imf::UINT :
+												slice.type == MoxFiles::FLOAT ? Imf::FLOAT :
+												Imf::HALF);
+			
+		char *origin = slice.base - (offset.x * slice.xStride) - (offset.y * slice.yStride);
+		
+		exr_frameBuffer.insert(name, Imf::Slice(exr_pixel_type, origin, slice.xStride, slice.yStride));
+	}
+		
+	return true;
+}
+	
+	
+// OpenEXR only reads subsampled channels into slices sampled the same way,
+// so if the caller wants one the whole frame goes through decompress() and
+// copyFromFrame() upsamples it.
+bool
+OpenEXRCodec::subsampledWanted(const FrameBuffer &frameBuffer, const Imf::ChannelList &channels) const
+{
+	for(Imf::ChannelList::ConstIterator i = channels.begin(); i != channels.end(); ++i)
+	{
+		const Imf::Channel &chan = i.channel();
+		
+		if((chan.xSampling != 1 || chan.ySampling != 1) && channelWanted(frameBuffer, i.name()))
+			return true;
+	}
+	
+	return false;
+}
+	
+	
+// Otherwise OpenEXR reads the channels the caller wants into our own buffers
+// covering the staged frame, for copyFromFrame() to take it from there.
+void
+OpenEXRCodec::stageChannels(const FrameBuffer &frameBuffer, const Imf::ChannelList &channels, FrameBuffer &staged, Imf::FrameBuffer &exr_frameBuffer, const V2i &offset) const
+{
+	const Box2i &box = staged.dataWindow();
+	
+	const int width = staged.width();
+	const int height = staged.height();
+	
+	for(Imf::ChannelList::ConstIterator i = channels.begin(); i != channels.end(); ++i)
+	{
+		const char *name = i.name();
+		const Imf::Channel &chan = i.channel();
+		
+		if(chan.xSampling != 1 || chan.ySampling != 1 || !channelWanted(frameBuffer, name))
+			continue;
+		
+		MoxFiles::PixelType pixel_type = (chan.type == Imf::UINT ? MoxFiles::UINT32 :
+											chan.type == Imf::FLOAT ? MoxFiles::FLOAT :
+											MoxFiles::HALF);
+		
+		const size_t subpixel_size = PixelSize(pixel_type);
+		const size_t rowbytes = subpixel_size * width;
+		const size_t data_size = rowbytes * height;
+		
+		DataChunkPtr chan_buffer = new PooledDataChunk(data_size);
+		
+		staged.attachData(chan_buffer);
+		
+		char *origin = (char *)chan_buffer->Data - (box.min.x * subpixel_size) - (box.min.y * rowbytes);
+		
+		staged.insert(name, MoxFiles::Slice(pixel_type, origin, subpixel_size, rowbytes));
+		
+		exr_frameBuffer.insert(name, Imf::Slice(chan.type, origin - (offset.x * subpixel_size) - (offset.y * rowbytes),
+								subpixel_size, rowbytes));
+	}
+}
+
+
+bool
+OpenEXRCodec::decompressReduced(const DataChunk &data, FrameBuffer &frameBuffer, int resolutionFactor)
+{
+	// only tiled files have levels to read from
+	const Box2i reducedW = ReducedWindow(dataWindow(), resolutionFactor);
+	
+	if(resolutionFactor == 1 || frameBuffer.dataWindow() != reducedW || !IsTiled(data))
+		return VideoCodec::decompressReduced(data, frameBuffer, resolutionFactor);
+	
+	MemoryFile mem_file(data);
+	
+	MoxIStream stream(mem_file);
+	
+	Imf::TiledInputFile file(stream, threadCount());
+	
+	int level = 0;
+	
+	while((1 << level) < resolutionFactor)
+		level++;
+	
+	if((1 << level) != resolutionFactor || file.levelMode() != Imf::MIPMAP_LEVELS || level >= file.numLevels())
+		return VideoCodec::decompressReduced(data, frameBuffer, resolutionFactor);
+	
+	// With the data window at 0, 0 this is always the case.
+	const Box2i levelW = file.dataWindowForLevel(level);
+	
+	if(levelW.size() != reducedW.size())
+		return VideoCodec::decompressReduced(data, frameBuffer, resolutionFactor);
+	
+	const V2i offset = levelW.min - reducedW.min;
+	
+	
+	Imf::FrameBuffer exr_frameBuffer;
+	
+	if( DirectFrameBuffer(frameBuffer, file.header().channels(), exr_frameBuffer, offset) )
+	{
+		file.setFrameBuffer(exr_frameBuffer);
+		
+		file.readTiles(0, file.numXTiles(level) - 1, 0, file.numYTiles(level) - 1, level);
+	}
+	else
+	{
+		FrameBuffer level_frameBuffer(reducedW);
+		
+		Imf::FrameBuffer level_exr_frameBuffer;
+		
+		stageChannels(frameBuffer, file.header().channels(), level_frameBuffer, level_exr_frameBuffer, offset);
+		
+		file.setFrameBuffer(level_exr_frameBuffer);
+		
+		file.readTiles(0, file.numXTiles(level) - 1, 0, file.numYTiles(level) - 1, level);
+		
+		frameBuffer.copyFromFrame(level_frameBuffer);
+	}
+	
+	return true;
+}
+
+
+bool
+OpenEXRCodec::decompressRegion(const DataChunk &data, FrameBuffer &frameBuffer, const Box2i &region)
+{
+	if( IsTiled(data) )
+		return decompressTiles(data, frameBuffer, region);
+	
+	MemoryFile mem_file(data);
+	
+	MoxIStream stream(mem_file);
+	
+	Imf::HybridInputFile file(stream, false, threadCount());
+	
+	const Imath::Box2i &dataW = file.dataWindow();
+	
+	if( subsampledWanted(frameBuffer, file.channels()) )
+		return VideoCodec::decompressRegion(data, frameBuffer, region);
+	
+	
+	// OpenEXR always fills whole scanlines, so the caller's memory can only be used
+	// if the region goes all the way across.  Only the channels in the FrameBuffer
+	// get decompressed.
+	Imf::FrameBuffer exr_frameBuffer;
+	
+	if(region.min.x == dataW.min.x && region.max.x == dataW.max.x &&
+		DirectFrameBuffer(frameBuffer, file.channels(), exr_frameBuffer))
+	{
+		file.setFrameBuffer(exr_frameBuffer);
+		
+		// only the chunks holding these scanlines get decompressed
+		file.readPixels(region.min.y, region.max.y);
+		
+		return true;
+	}
+	
+	
+	// read the band of scanlines and the channels we need into our own buffers,
+	// then copy the region out
+	const Box2i band(V2i(dataW.min.x, region.min.y), V2i(dataW.max.x, region.max.y));
+	
+	FrameBuffer band_frameBuffer(band);
+	
+	Imf::FrameBuffer band_exr_frameBuffer;
+	
+	stageChannels(frameBuffer, file.channels(), band_frameBuffer, band_exr_frameBuffer);
+	
+	file.setFrameBuffer(band_exr_frameBuffer);
+	
+	file.readPixels(region.min.y, region.max.y);
+	
+	
+	FrameBuffer region_view(frameBuffer, region);
+	
+	region_view.copyFromFrame(band_frameBuffer);
+	
+	return true;
+}
+
+
+bool
+OpenEXRCodec::decompressTiles(const DataChunk &data, FrameBuffer &frameBuffer, const Box2i &region)
+{
+	MemoryFile mem_file(data);
+	
+	MoxIStream stream(mem_file);
+	
+	Imf::TiledInputFile file(stream, threadCount());
+	
+	const Box2i &dataW = file.header().dataWindow();
+	
+	const Imf::TileDescription &tiles = file.header().tileDescription();
+	
+	// only the tiles the region touches get decompressed
+	const int tx1 = (region.min.x - dataW.min.x) / tiles.xSize;
+	const int tx2 = (region.max.x - dataW.min.x) / tiles.xSize;
+	const int ty1 = (region.min.y - dataW.min.y) / tiles.ySize;
+	const int ty2 = (region.max.y - dataW.min.y) / tiles.ySize;
+	
+	const Box2i tileBox(file.dataWindowForTile(tx1, ty1, 0).min, file.dataWindowForTile(tx2, ty2, 0).max);
+	
+	
+	// whole tiles get written, so the caller's memory works if the region is made of them
+	Imf::FrameBuffer exr_frameBuffer;
+	
+	if(region == tileBox && DirectFrameBuffer(frameBuffer, file.header().channels(), exr_frameBuffer))
+	{
+		file.setFrameBuffer(exr_frameBuffer);
+		
+		file.readTiles(tx1, tx2, ty1, ty2, 0);
+		
+		return true;
+	}
+	
+	
+	FrameBuffer tile_frameBuffer(tileBox);
+	
+	Imf::FrameBuffer tile_exr_frameBuffer;
+	
+	stageChannels(frameBuffer, file.header().channels(), tile_frameBuffer, tile_exr_frameBuffer);
+	
+	file.setFrameBuffer(tile_exr_frameBuffer);
+	
+	file.readTiles(tx1, tx2, ty1, ty2, 0);
+	
+	
+	FrameBuffer region_view(frameBuffer, region);
+	
+	region_view.copyFromFrame(tile_frameBuffer);
+	
+	return true;
+}
+
+
 bool
 OpenEXRCodecInfo::canCompressType(PixelType pixelType) const
 {
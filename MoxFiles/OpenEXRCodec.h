@@ -13,6 +13,7 @@
 #include <MoxFiles/Codec.h>
 
 #include <ImfHeader.h>
+#include <ImfFrameBuffer.h>
 
 namespace MoxFiles
 {
@@ -26,12 +27,42 @@ namespace MoxFiles
 		virtual const MoxMxf::VideoDescriptor * getDescriptor() const { return &_descriptor; }
 		
 		virtual void compress(const FrameBuffer &frame);
+		virtual bool convertsInput() const { return true; }
 		virtual void decompress(const DataChunk &data);
+		virtual bool decompressInto(const DataChunk &data, FrameBuffer &frameBuffer);
+		virtual bool decompressReduced(const DataChunk &data, FrameBuffer &frameBuffer, int resolutionFactor);
+		virtual bool decompressRegion(const DataChunk &data, FrameBuffer &frameBuffer, const Box2i &region);
+		
+	  public:
+		// Encoder setting that goes in the Header.  Without it, lossless is PIZ and
+		// lossy is DWAB at the Header's quality.  ZIPS, RLE and B44(A) cost more
+		// space but decode much faster, which is what matters for playback.
+		// Stored in the descriptor, so readers get it back.
+		static Imf::Compression getCompression(const Header &header);
+		static void setCompression(Header &header, Imf::Compression compression);
+		
+		// Also for the Header: store frames as tiles this size (0, the default, for
+		// scanlines) with mipmap levels.  Region reads then only decompress the tiles
+		// they touch, and reduced reads get a level that's already been filtered.
+		// Levels round up like ReducedWindow().  Channels can't be subsampled.
+		static int getTileSize(const Header &header);
+		static void setTileSize(Header &header, int tileSize);
+		
+		// How many line blocks OpenEXR compresses or decompresses at once on the
+		// global thread pool, within one frame.  See CodecThreads in Thread.h.
+		static int threadCount();
+		static void setThreadCount(int count);
 		
 	  private:
+		bool decompressTiles(const DataChunk &data, FrameBuffer &frameBuffer, const Box2i &region);
+		bool subsampledWanted(const FrameBuffer &frameBuffer, const Imf::ChannelList &channels) const;
+		void stageChannels(const FrameBuffer &frameBuffer, const Imf::ChannelList &channels, FrameBuffer &staged, Imf::FrameBuffer &exr_frameBuffer, const V2i &offset = V2i(0, 0)) const;
+		
 		MoxMxf::RGBADescriptor _descriptor;
 		
 		Imf::Header *_exr_header;
+		
+		size_t _lastCompressedSize;
 	};
 	
 	
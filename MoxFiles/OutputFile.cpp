@@ -67,6 +67,13 @@ OutputFile::OutputFile(IOStream &outfile, const Header &header) :
 			if((codecCapabilities & Channels_RGBA) || (codecCapabilities & Channels_A))
 				rgba_list.push_back("A");
 			
+			if(codecCapabilities & Channels_YCbCr)
+			{
+				rgba_list.push_back("Y");
+				rgba_list.push_back("Cb");
+				rgba_list.push_back("Cr");
+			}
+			
 			ChannelList rgba_layer;
 			
 			for(std::list<std::string>::const_iterator s = rgba_list.begin(); s != rgba_list.end(); ++s)
@@ -223,47 +230,52 @@ OutputFile::pushFrame(const FrameBuffer &frame)
 				input_matches = false;
 		}
 		
+		// codecs that stage the frame themselves can convert on the way in
+		const bool use_temp = (!input_matches && !unit.codec->convertsInput());
 		
-		FrameBufferPtr temp_buffer;
-		
-		if(!input_matches)
+		if(use_temp)
 		{
-			temp_buffer = new FrameBuffer(frame.width(), frame.height());
-			
-			for(ChannelList::ConstIterator j = unit.channelList.begin(); j != unit.channelList.end(); ++j)
+			if(!unit.tempBuffer)
 			{
-				const char *name = j.name();
-				const Channel &encode_chan = j.channel();
-				
-				const size_t pix_size = PixelSize(encode_chan.type);
-				const size_t chan_rowbytes = pix_size * frame.width();
-				const size_t chan_data_size = chan_rowbytes * frame.height();
-			
-				DataChunkPtr chan_data = new DataChunk(chan_data_size);
+				unit.tempBuffer = new FrameBuffer(frame.width(), frame.height());
 				
-				temp_buffer->attachData(chan_data);
+				for(ChannelList::ConstIterator j = unit.channelList.begin(); j != unit.channelList.end(); ++j)
+				{
+					const char *name = j.name();
+					const Channel &encode_chan = j.channel();
+					
+					const size_t pix_size = PixelSize(encode_chan.type);
+					const size_t chan_rowbytes = pix_size * frame.width();
+					const size_t chan_data_size = chan_rowbytes * frame.height();
 				
-				temp_buffer->insert(name, Slice(encode_chan.type, (char *)chan_data->Data, pix_size, chan_rowbytes, 1, 1, 0));
+					DataChunkPtr chan_data = new PooledDataChunk(chan_data_size);
+					
+					unit.tempBuffer->attachData(chan_data);
+					
+					unit.tempBuffer->insert(name, Slice(encode_chan.type, (char *)chan_data->Data, pix_size, chan_rowbytes, 1, 1, 0));
+				}
 			}
 			
-			temp_buffer->copyFromFrame(frame);
+			unit.tempBuffer->copyFromFrame(frame);
 		}
 		
-		const FrameBuffer &frame_to_use = (!!temp_buffer ? *temp_buffer : frame);
+		const FrameBuffer &frame_to_use = (use_temp ? *unit.tempBuffer : frame);
 		
 		
 		unit.codec->compress(frame_to_use);
 		
 		
-		DataChunkPtr data = unit.codec->getNextData();
+		int keyOffset, temporalOffset, flags;
+		
+		DataChunkPtr data = unit.codec->getNextData(keyOffset, temporalOffset, flags);
 		
 		while(data)
 		{
-			_mxf_file->PushEssence(unit.trackNumber, data);
+			_mxf_file->PushEssence(unit.trackNumber, data, keyOffset, temporalOffset, flags);
 			
 			_stored_video_frames++;
 			
-			data = unit.codec->getNextData();
+			data = unit.codec->getNextData(keyOffset, temporalOffset, flags);
 		}
 	}
 	
@@ -283,26 +295,7 @@ OutputFile::pushAudio(const AudioBuffer &audio)
 	
 	while(in_buffer.remaining() > 0)
 	{
-		const bool uniform_audio_frames = (sample_rate.Numerator * frame_rate.Denominator) % (sample_rate.Denominator * frame_rate.Numerator) == 0;
-											
-		UInt64 samples_this_frame = 0;
-		
-		if(uniform_audio_frames)
-		{
-			samples_this_frame = (sample_rate.Numerator * frame_rate.Denominator) / (sample_rate.Denominator * frame_rate.Numerator);
-		}
-		else
-		{
-			const int current_frame = _audio_frames;
-		
-			const double samples_per_frame = (double)(sample_rate.Numerator * frame_rate.Denominator) / (double)(sample_rate.Denominator * frame_rate.Numerator);
-			
-			const UInt64 samples_so_far = ((double)current_frame * samples_per_frame) + 0.5;
-			
-			const UInt64 samples_post_frame = ((double)(current_frame + 1) * samples_per_frame) + 0.5;
-			
-			samples_this_frame = samples_post_frame - samples_so_far;
-		}
+		const UInt64 samples_this_frame = AudioSamplesInFrame(frame_rate, sample_rate, _audio_frames);
 		
 		
 		bool buffers_filled = true;
@@ -324,7 +317,7 @@ OutputFile::pushAudio(const AudioBuffer &audio)
 					const size_t sample_size = SampleSize(chan.type);
 					const size_t data_size = samples_this_frame * sample_size;
 					
-					DataChunkPtr data = new DataChunk(data_size);
+					DataChunkPtr data = new PooledDataChunk(data_size);
 					
 					unit.audioBuffer->insert(name, AudioSlice(chan.type, (char *)data->Data, sample_size));
 					
@@ -384,15 +377,17 @@ OutputFile::finalize()
 			{
 				unit.codec->end_of_stream();
 				
-				DataChunkPtr data = unit.codec->getNextData();
+				int keyOffset, temporalOffset, flags;
+				
+				DataChunkPtr data = unit.codec->getNextData(keyOffset, temporalOffset, flags);
 				
 				while(data)
 				{
-					_mxf_file->PushEssence(unit.trackNumber, data);
+					_mxf_file->PushEssence(unit.trackNumber, data, keyOffset, temporalOffset, flags);
 					
 					_stored_video_frames++;
 					
-					data = unit.codec->getNextData();
+					data = unit.codec->getNextData(keyOffset, temporalOffset, flags);
 				}
 			}
 		}
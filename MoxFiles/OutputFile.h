@@ -46,6 +46,7 @@ namespace MoxFiles
 			ChannelList channelList;
 			VideoCodec *codec;
 			MoxMxf::TrackNum trackNumber;
+			FrameBufferPtr tempBuffer; // for codecs that need their input converted, reused every frame
 			
 			VideoCodecUnit() : codec(NULL) {}
 			VideoCodecUnit(ChannelList ch, VideoCodec *co, MoxMxf::TrackNum tr) : channelList(ch), codec(co), trackNumber(tr) {}
@@ -10,17 +10,42 @@
 #include <MoxFiles/PNGCodec.h>
 
 #include <MoxFiles/MemoryFile.h>
+#include <MoxFiles/Thread.h>
+#include <MoxFiles/SIMD.h>
 
 #include "png.h"
+#include "zlib.h"
 
+#ifdef MOXFILES_USE_LIBDEFLATE
+#include "libdeflate.h"
+#endif
+
+#include <algorithm>
+
+#include <string.h>
+#include <stdlib.h>
 
 
 namespace MoxFiles
 {
 
+// PNG samples are big-endian, but 16-bit frames used to be stored in host
+// order.  New 16-bit frames get this coding variant, so the ones without
+// it (variant 0) are still read the old way.  8-bit frames don't care and
+// keep variant 0, so older readers can still open them.
+static const UInt8 PNGBigEndianVariant = 1;
+
+
 PNGCodec::PNGCodec(const Header &header, const ChannelList &channels) :
 	VideoCodec(header, channels),
-	_descriptor(header.frameRate(), header.width(), header.height(), MoxMxf::VideoDescriptor::VideoCodecPNG)
+	_descriptor(header.frameRate(), header.width(), header.height(), MoxMxf::VideoDescriptor::VideoCodecPNG),
+	_filter(getFilter(header)),
+	_compressionLevel(getCompressionLevel(header)),
+	_strategy(getStrategy(header)),
+	_parallelDeflate(getParallelDeflate(header)),
+	_bigEndian(true),
+	_inflater(NULL),
+	_decompressor(NULL)
 {
 	setWindows(_descriptor, header);
 
@@ -47,6 +72,9 @@ PNGCodec::PNGCodec(const Header &header, const ChannelList &channels) :
 	
 	const unsigned int bits_per_pixel = (_depth == PNG_16 ? 16 : 8);
 	
+	if(_depth == PNG_16)
+		_descriptor.setCodingVariant(PNGBigEndianVariant);
+	
 	
 	MoxMxf::RGBADescriptor::RGBALayout layout;
 	
@@ -77,7 +105,14 @@ PNGCodec::PNGCodec(const MoxMxf::VideoDescriptor &descriptor, Header &header, Ch
 	VideoCodec(descriptor, header, channels),
 	_descriptor(dynamic_cast<const MoxMxf::RGBADescriptor &>(descriptor)),
 	_depth(PNG_8),
-	_channels(PNG_RGB)
+	_channels(PNG_RGB),
+	_filter(FilterAdaptive),
+	_compressionLevel(6),
+	_strategy(StrategyDefault),
+	_parallelDeflate(false),
+	_bigEndian(_descriptor.getCodingVariant() == PNGBigEndianVariant),
+	_inflater(NULL),
+	_decompressor(NULL)
 {
 	bool haveR = false, haveA = false, haveY = false;
 	
@@ -129,232 +164,1315 @@ PNGCodec::PNGCodec(const MoxMxf::VideoDescriptor &descriptor, Header &header, Ch
 
 PNGCodec::~PNGCodec()
 {
+	if(_inflater != NULL)
+	{
+		inflateEnd(_inflater);
+		
+		delete _inflater;
+	}
 
+#ifdef MOXFILES_USE_LIBDEFLATE
+	if(_decompressor != NULL)
+		libdeflate_free_decompressor(_decompressor);
+#endif
 }
 
 
-static void png_replace_write_data(png_structp png_ptr, png_bytep data, png_size_t length)
+PNGCodec::Filter
+PNGCodec::getFilter(const Header &header)
 {
-	MemoryFile *file = (MemoryFile *)png_get_io_ptr(png_ptr);
+	const IntAttribute *filterAttr = header.findTypedAttribute<IntAttribute>("pngFilter");
 	
-	file->FileWrite(data, length);
+	return (filterAttr != NULL ? (Filter)filterAttr->value() : FilterAdaptive);
 }
 
-static void png_replace_flush(png_structp png_ptr)
+
+void
+PNGCodec::setFilter(Header &header, Filter filter)
 {
-	MemoryFile *file = (MemoryFile *)png_get_io_ptr(png_ptr);
+	if(filter < FilterNone || filter > FilterAdaptive)
+		throw MoxMxf::ArgExc("Invalid PNG filter");
 	
-	// nothing
+	header.insert("pngFilter", IntAttribute(filter));
 }
 
-void
-PNGCodec::compress(const FrameBuffer &frame)
+
+int
+PNGCodec::getCompressionLevel(const Header &header)
 {
-	const PixelType pixel_type = (_depth == PNG_16 ? MoxFiles::UINT16 : MoxFiles::UINT8);
-	const size_t bytes_per_subpixel = PixelSize(pixel_type);
-	const int bit_depth = (_depth == PNG_16 ? 16 : 8);
+	const IntAttribute *levelAttr = header.findTypedAttribute<IntAttribute>("pngCompressionLevel");
 	
-	const int num_channels = (_channels == PNG_RGB ? 3 :
-								_channels == PNG_RGBA ? 4 :
-								_channels == PNG_Y ? 1 :
-								_channels == PNG_YA ? 2 :
-								4);
+	return (levelAttr != NULL ? levelAttr->value() : 6);
+}
+
+
+void
+PNGCodec::setCompressionLevel(Header &header, int level)
+{
+	if(level < 0 || level > 9)
+		throw MoxMxf::ArgExc("PNG compression level must be 0-9");
 	
-	const Box2i dataW = dataWindow();
+	header.insert("pngCompressionLevel", IntAttribute(level));
+}
+
+
+PNGCodec::Strategy
+PNGCodec::getStrategy(const Header &header)
+{
+	const IntAttribute *strategyAttr = header.findTypedAttribute<IntAttribute>("pngStrategy");
 	
-	const int width = (dataW.max.x - dataW.min.x + 1);
-	const int height = (dataW.max.y - dataW.min.y + 1);
+	return (strategyAttr != NULL ? (Strategy)strategyAttr->value() : StrategyDefault);
+}
+
+
+void
+PNGCodec::setStrategy(Header &header, Strategy strategy)
+{
+	if(strategy < StrategyDefault || strategy > StrategyRLE)
+		throw MoxMxf::ArgExc("Invalid PNG strategy");
 	
-	const size_t bytes_per_pixel = bytes_per_subpixel * num_channels;
-	const size_t rowbytes = bytes_per_pixel * width;
-	const size_t buffer_size = rowbytes * height;
+	header.insert("pngStrategy", IntAttribute(strategy));
+}
+
+
+bool
+PNGCodec::getParallelDeflate(const Header &header)
+{
+	const IntAttribute *parallelAttr = header.findTypedAttribute<IntAttribute>("pngParallelDeflate");
 	
+	return (parallelAttr != NULL && parallelAttr->value() != 0);
+}
+
+
+void
+PNGCodec::setParallelDeflate(Header &header, bool parallel)
+{
+	header.insert("pngParallelDeflate", IntAttribute(parallel ? 1 : 0));
+}
+
+
+static int
+ZlibStrategy(PNGCodec::Strategy strategy)
+{
+	switch(strategy)
+	{
+		case PNGCodec::StrategyDefault:		return Z_DEFAULT_STRATEGY;
+		case PNGCodec::StrategyFiltered:	return Z_FILTERED;
+		case PNGCodec::StrategyHuffmanOnly:	return Z_HUFFMAN_ONLY;
+		case PNGCodec::StrategyRLE:			return Z_RLE;
+	}
 	
-	DataChunk data(buffer_size);
+	throw MoxMxf::ArgExc("Invalid PNG strategy");
+}
+
+
+static void png_replace_write_data(png_structp png_ptr, png_bytep data, png_size_t length)
+{
+	MemoryFile *file = (MemoryFile *)png_get_io_ptr(png_ptr);
 	
-	FrameBuffer frame_buffer(dataW);
-		
+	file->FileWrite(data, length);
+}
+
+static void png_replace_flush(png_structp png_ptr)
+{
+	MemoryFile *file = (MemoryFile *)png_get_io_ptr(png_ptr);
 	
-	char *origin = (char *)data.Data;
+	// nothing
+}
+
+static const unsigned char PNGSignature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+
+
+static bool
+LittleEndian()
+{
+	const unsigned short one = 1;
 	
-	if(_channels == PNG_RGB || _channels == PNG_RGBA)
+	return (*(const unsigned char *)&one == 1);
+}
+
+
+// in and out can be the same
+static void
+Swap16(unsigned char *out, const unsigned char *in, size_t samples)
+{
+	size_t i = 0;
+
+#ifdef MOXFILES_SSE2
+	for(; i + 8 <= samples; i += 8)
 	{
-		frame_buffer.insert("R", Slice(pixel_type, origin + (bytes_per_subpixel * 0), bytes_per_pixel, rowbytes));
-		frame_buffer.insert("G", Slice(pixel_type, origin + (bytes_per_subpixel * 1), bytes_per_pixel, rowbytes));
-		frame_buffer.insert("B", Slice(pixel_type, origin + (bytes_per_subpixel * 2), bytes_per_pixel, rowbytes));
+		const __m128i v = _mm_loadu_si128((const __m128i *)(in + (2 * i)));
 		
-		if(_channels == PNG_RGBA)
-			frame_buffer.insert("A", Slice(pixel_type, origin + (bytes_per_subpixel * 3), bytes_per_pixel, rowbytes));
+		_mm_storeu_si128((__m128i *)(out + (2 * i)), _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8)));
 	}
-	else
+#endif
+
+	for(; i < samples; i++)
 	{
-		frame_buffer.insert("Y", Slice(pixel_type, origin + (bytes_per_subpixel * 0), bytes_per_pixel, rowbytes));
+		const unsigned char a = in[(2 * i) + 0];
+		const unsigned char b = in[(2 * i) + 1];
 		
-		if(_channels == PNG_YA)
-			frame_buffer.insert("A", Slice(pixel_type, origin + (bytes_per_subpixel * 1), bytes_per_pixel, rowbytes));
+		out[(2 * i) + 0] = b;
+		out[(2 * i) + 1] = a;
 	}
+}
+
+
+static inline unsigned char
+Paeth(unsigned char a, unsigned char b, unsigned char c)
+{
+	const int p = (int)a + (int)b - (int)c;
+	const int pa = abs(p - (int)a);
+	const int pb = abs(p - (int)b);
+	const int pc = abs(p - (int)c);
 	
-	frame_buffer.copyFromFrame(frame);
+	return (pa <= pb && pa <= pc) ? a : (pb <= pc) ? b : c;
+}
+
+
+// Writes the filter type byte and the filtered row to out and returns the sum of
+// the filtered bytes taken as signed, which is how libpng picks adaptive filters.
+// prev is a row of zeros for the first row.
+static unsigned int
+FilterRow(unsigned char *out, const unsigned char *row, const unsigned char *prev, size_t rowbytes, size_t bpp, int filter)
+{
+	*out++ = filter;
 	
+	unsigned int sum = 0;
 	
-	MemoryFile file(buffer_size);
+	for(size_t i = 0; i < rowbytes; i++)
+	{
+		const unsigned char a = (i >= bpp ? row[i - bpp] : 0);
+		const unsigned char b = prev[i];
+		const unsigned char c = (i >= bpp ? prev[i - bpp] : 0);
+		
+		const unsigned char predictor = (filter == PNG_FILTER_VALUE_SUB ? a :
+											filter == PNG_FILTER_VALUE_UP ? b :
+											filter == PNG_FILTER_VALUE_AVG ? (unsigned char)(((int)a + (int)b) / 2) :
+											filter == PNG_FILTER_VALUE_PAETH ? Paeth(a, b, c) :
+											0);
+		
+		const unsigned char value = row[i] - predictor;
+		
+		out[i] = value;
+		
+		sum += (value < 128 ? value : 256 - value);
+	}
 	
-	png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	return sum;
+}
+
+
+// Filters a row the way the codec was asked to and returns where it ended up,
+// which is out or scratch (both rowbytes + 1 long).
+static const unsigned char *
+FilterRow(unsigned char *out, unsigned char *scratch, const unsigned char *row, const unsigned char *prev, size_t rowbytes, size_t bpp, PNGCodec::Filter filter)
+{
+	if(filter != PNGCodec::FilterAdaptive)
+	{
+		FilterRow(out, row, prev, rowbytes, bpp, filter);
 		
-	png_infop info_ptr = png_create_info_struct(png_ptr);
+		return out;
+	}
 	
-	png_set_write_fn(png_ptr, (void *)&file, png_replace_write_data, png_replace_flush);
+	unsigned int best_sum = FilterRow(out, row, prev, rowbytes, bpp, PNG_FILTER_VALUE_NONE);
 	
-	// this is how libpng handles errors
-#ifdef PNG_SETJMP_SUPPORTED
-	if(setjmp(png_jmpbuf(png_ptr)))
+	for(int f = PNG_FILTER_VALUE_SUB; f <= PNG_FILTER_VALUE_PAETH; f++)
 	{
-		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+		const unsigned int sum = FilterRow(scratch, row, prev, rowbytes, bpp, f);
 		
-		throw MoxMxf::IoExc("Problem writing PNG file");
+		if(sum < best_sum)
+		{
+			std::swap(out, scratch);
+			
+			best_sum = sum;
+		}
 	}
-#endif
+	
+	return out;
+}
 
-	const int color_type = (_channels == PNG_RGBA ? PNG_COLOR_TYPE_RGBA :
-							_channels == PNG_RGB ? PNG_COLOR_TYPE_RGB :
-							_channels == PNG_YA ? PNG_COLOR_TYPE_GA :
-							_channels == PNG_Y ? PNG_COLOR_TYPE_GRAY :
-							PNG_COLOR_TYPE_RGB);
 
-	png_set_IHDR(png_ptr, info_ptr, width, height, bit_depth, color_type,
-					PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
+// One horizontal stripe of the image, filtered and deflated on its own.  Every
+// stripe but the last ends with a sync flush, so they can be laid end to end as
+// one deflate stream.  The rows above it prime the dictionary, so little is lost
+// at the seams.
+struct PNGStripe
+{
+	int firstRow;
+	int rows;
 	
-	//png_set_filter(png_ptr, PNG_FILTER_TYPE_DEFAULT, gOptions.filter);
-	//png_set_compression_level(png_ptr, gOptions.compression);
-	//png_set_compression_strategy(png_ptr, gOptions.strategy);
+	DataChunkPtr deflated;
 	
-	png_write_info(png_ptr, info_ptr);
+	uLong adler;
+	size_t filteredSize;
 	
+	bool success;
 	
-	png_bytepp row_pointers = (png_bytepp)png_malloc(png_ptr, height * sizeof(png_bytep));
-					
-	for(int row = 0; row < height; row++)
+	PNGStripe(int f = 0, int r = 0) : firstRow(f), rows(r), adler(0), filteredSize(0), success(false) {}
+};
+
+
+class DeflateStripeTask : public Task
+{
+  public:
+	DeflateStripeTask(TaskGroup *group, PNGStripe &stripe, const unsigned char *origin, size_t rowbytes, size_t bpp,
+						PNGCodec::Filter filter, int level, int strategy, bool last);
+	~DeflateStripeTask() {}
+	
+	virtual void execute();
+
+  private:
+	PNGStripe &_stripe;
+	const unsigned char * const _origin;
+	const size_t _rowbytes;
+	const size_t _bpp;
+	const PNGCodec::Filter _filter;
+	const int _level;
+	const int _strategy;
+	const bool _last;
+};
+
+
+DeflateStripeTask::DeflateStripeTask(TaskGroup *group, PNGStripe &stripe, const unsigned char *origin, size_t rowbytes, size_t bpp,
+										PNGCodec::Filter filter, int level, int strategy, bool last) :
+	Task(group),
+	_stripe(stripe),
+	_origin(origin),
+	_rowbytes(rowbytes),
+	_bpp(bpp),
+	_filter(filter),
+	_level(level),
+	_strategy(strategy),
+	_last(last)
+{
+
+}
+
+
+void
+DeflateStripeTask::execute()
+{
+	z_stream strm;
+	
+	memset(&strm, 0, sizeof(strm));
+	
+	// raw deflate, the zlib header and Adler-32 go around the whole stream
+	if(deflateInit2(&strm, _level, Z_DEFLATED, -15, 8, _strategy) != Z_OK)
+		return;
+	
+	const size_t filtered_rowbytes = _rowbytes + 1;
+	
+	std::vector<unsigned char> zeros(_rowbytes, 0);
+	std::vector<unsigned char> buffer(2 * filtered_rowbytes);
+	
+	unsigned char * const out = &buffer[0];
+	unsigned char * const scratch = &buffer[filtered_rowbytes];
+	
+	
+	// Filter the rows just above the stripe again, exactly as the stripe before
+	// did, for the last 32K of what it deflated.
+	const int dictionary_rows = std::min<int>(_stripe.firstRow, (32768 + filtered_rowbytes - 1) / filtered_rowbytes);
+	
+	if(dictionary_rows > 0)
 	{
-		row_pointers[row] = (png_bytep)( origin + (row * rowbytes) );
+		std::vector<unsigned char> dictionary(dictionary_rows * filtered_rowbytes);
+		
+		for(int i = 0; i < dictionary_rows; i++)
+		{
+			const int y = _stripe.firstRow - dictionary_rows + i;
+			
+			const unsigned char *row = _origin + (y * _rowbytes);
+			const unsigned char *prev = (y > 0 ? row - _rowbytes : &zeros[0]);
+			
+			const unsigned char *filtered = FilterRow(out, scratch, row, prev, _rowbytes, _bpp, _filter);
+			
+			memcpy(&dictionary[i * filtered_rowbytes], filtered, filtered_rowbytes);
+		}
+		
+		const size_t dictionary_size = std::min<size_t>(dictionary.size(), 32768);
+		
+		deflateSetDictionary(&strm, &dictionary[dictionary.size() - dictionary_size], dictionary_size);
 	}
 	
-	png_write_image(png_ptr, row_pointers);
 	
+	_stripe.filteredSize = _stripe.rows * filtered_rowbytes;
 	
-	png_free(png_ptr, (void *)row_pointers);
+	// room for everything to be stored, plus the flush
+	const size_t bound = deflateBound(&strm, _stripe.filteredSize) + 64;
 	
-	png_write_end(png_ptr, info_ptr);
+	PooledDataChunk *chunk = new PooledDataChunk(bound);
 	
-	png_destroy_write_struct(&png_ptr, &info_ptr);
+	_stripe.deflated = chunk;
 	
+	strm.next_out = chunk->Data;
+	strm.avail_out = bound;
 	
-	storeData( file.getDataChunk() );
+	uLong adler = adler32(0, NULL, 0);
+	
+	int err = Z_OK;
+	
+	for(int i = 0; i < _stripe.rows && err == Z_OK; i++)
+	{
+		const int y = _stripe.firstRow + i;
+		
+		const unsigned char *row = _origin + (y * _rowbytes);
+		const unsigned char *prev = (y > 0 ? row - _rowbytes : &zeros[0]);
+		
+		const unsigned char *filtered = FilterRow(out, scratch, row, prev, _rowbytes, _bpp, _filter);
+		
+		adler = adler32(adler, filtered, filtered_rowbytes);
+		
+		strm.next_in = (Bytef *)filtered;
+		strm.avail_in = filtered_rowbytes;
+		
+		err = deflate(&strm, Z_NO_FLUSH);
+		
+		if(strm.avail_in != 0)
+			err = Z_BUF_ERROR;
+	}
+	
+	if(err == Z_OK)
+	{
+		err = deflate(&strm, _last ? Z_FINISH : Z_SYNC_FLUSH);
+		
+		if(err == (_last ? Z_STREAM_END : Z_OK))
+		{
+			chunk->Size = strm.total_out;
+			
+			_stripe.adler = adler;
+			
+			_stripe.success = true;
+		}
+	}
+	
+	deflateEnd(&strm);
 }
 
 
-static void png_replace_read_data(png_structp png_ptr, png_bytep data, png_size_t length)
+static void
+WriteUInt32(MemoryFile &file, unsigned int value)
 {
-	MemoryFile *file = (MemoryFile *)png_get_io_ptr(png_ptr);
+	const unsigned char bytes[4] = { (unsigned char)(value >> 24), (unsigned char)(value >> 16),
+										(unsigned char)(value >> 8), (unsigned char)value };
 	
-	file->FileRead(data, length);
+	file.FileWrite(bytes, 4);
 }
 
 
-void
-PNGCodec::decompress(const DataChunk &data)
+// length, type, data and CRC, with the data in up to two pieces
+static void
+WriteChunk(MemoryFile &file, const char *type, const unsigned char *data, size_t size,
+			const unsigned char *more = NULL, size_t moreSize = 0)
 {
-	MemoryFile file(data);
+	WriteUInt32(file, size + moreSize);
 	
-	png_structp png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	file.FileWrite((const unsigned char *)type, 4);
 	
-	png_infop info_ptr = png_create_info_struct(png_ptr);
+	uLong crc = crc32(0, (const Bytef *)type, 4);
 	
-	png_set_read_fn(png_ptr, &file, png_replace_read_data);
+	if(size > 0)
+	{
+		file.FileWrite(data, size);
+		
+		crc = crc32(crc, data, size);
+	}
 	
-	// this is how libpng handles errors
-#ifdef PNG_SETJMP_SUPPORTED
-	if(setjmp(png_jmpbuf(png_ptr)))
+	if(moreSize > 0)
 	{
-		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+		file.FileWrite(more, moreSize);
 		
-		throw MoxMxf::IoExc("Problem reading PNG file");
+		crc = crc32(crc, more, moreSize);
 	}
-#endif
-
-	png_read_info(png_ptr, info_ptr);
 	
-	int color_type, bit_depth, interlace_type;
-	png_uint_32 width, height;
-
-	png_get_IHDR(png_ptr, info_ptr, &width, &height, &bit_depth, &color_type,
-		&interlace_type, NULL, NULL);
+	WriteUInt32(file, crc);
+}
 
 
-	const PixelType pixel_type = (bit_depth > 8 ? MoxFiles::UINT16 : MoxFiles::UINT8);
-	const size_t bytes_per_subpixel = PixelSize(pixel_type);
-	
-	const int num_channels = (color_type & PNG_COLOR_MASK_COLOR) ?
-								((color_type & PNG_COLOR_MASK_ALPHA) ? 4 : 3) :
-								((color_type & PNG_COLOR_MASK_ALPHA) ? 2 : 1);
-	
-	const size_t bytes_per_pixel = bytes_per_subpixel * num_channels;
-	const size_t rowbytes = bytes_per_pixel * width;
-	const size_t buffer_size = rowbytes * height;
-	
-	
+void
+PNGCodec::compressStripes(const char *origin, size_t rowbytes, size_t bytes_per_pixel, int color_type, int bit_depth)
+{
 	const Box2i dataW = dataWindow();
 	
-	if(width != (dataW.max.x - dataW.min.x + 1))
-		throw MoxMxf::InputExc("Stored data is wrong width");
-
-	if(height != (dataW.max.y - dataW.min.y + 1))
-		throw MoxMxf::InputExc("Stored data is wrong height");
-
-	DataChunkPtr frame_data = new DataChunk(buffer_size);
+	const int width = (dataW.max.x - dataW.min.x + 1);
+	const int height = (dataW.max.y - dataW.min.y + 1);
 	
-	FrameBufferPtr frame_buffer = new FrameBuffer(dataW);
+	// a couple of stripes per thread to even things out, but not so
+	// small that the flushes and dictionaries start to add up
+	const int threads = ThreadPool::globalThreadPool().numThreads();
 	
-	frame_buffer->attachData(frame_data);
+	const int min_rows = std::max<int>(1, 131072 / rowbytes);
+	const int rows_per_stripe = std::max<int>(min_rows, (height + (2 * threads) - 1) / std::max(1, 2 * threads));
 	
+	std::vector<PNGStripe> stripes;
 	
-	char *origin = (char *)frame_data->Data;
+	for(int y = 0; y < height; y += rows_per_stripe)
+		stripes.push_back(PNGStripe(y, std::min(rows_per_stripe, height - y)));
 	
-	if( (color_type & PNG_COLOR_MASK_COLOR) )
 	{
-		frame_buffer->insert("R", Slice(pixel_type, origin + (bytes_per_subpixel * 0), bytes_per_pixel, rowbytes));
-		frame_buffer->insert("G", Slice(pixel_type, origin + (bytes_per_subpixel * 1), bytes_per_pixel, rowbytes));
-		frame_buffer->insert("B", Slice(pixel_type, origin + (bytes_per_subpixel * 2), bytes_per_pixel, rowbytes));
+		TaskGroup taskGroup;
 		
-		if( (color_type & PNG_COLOR_MASK_ALPHA) )
-			frame_buffer->insert("A", Slice(pixel_type, origin + (bytes_per_subpixel * 3), bytes_per_pixel, rowbytes));
+		for(int i = 0; i < stripes.size(); i++)
+		{
+			ThreadPool::addGlobalTask(new DeflateStripeTask(&taskGroup, stripes[i], (const unsigned char *)origin, rowbytes, bytes_per_pixel,
+															_filter, _compressionLevel, ZlibStrategy(_strategy), (i == stripes.size() - 1)));
+		}
 	}
-	else
+	
+	size_t deflated_size = 0;
+	
+	for(int i = 0; i < stripes.size(); i++)
 	{
-		frame_buffer->insert("Y", Slice(pixel_type, origin + (bytes_per_subpixel * 0), bytes_per_pixel, rowbytes));
+		if(!stripes[i].success)
+			throw MoxMxf::IoExc("Problem deflating PNG stripe");
 		
-		if( (color_type & PNG_COLOR_MASK_ALPHA) )
-			frame_buffer->insert("A", Slice(pixel_type, origin + (bytes_per_subpixel * 1), bytes_per_pixel, rowbytes));
+		deflated_size += stripes[i].deflated->Size;
 	}
 	
 	
-	png_bytepp row_pointers = (png_bytepp)png_malloc(png_ptr, height * sizeof(png_bytep));
+	MemoryFile file(deflated_size + (12 * (stripes.size() + 4)) + 64);
 	
-	for(int row = 0; row < height; row++)
-	{
-		row_pointers[row] = (png_bytep)( origin + (row * rowbytes) );
-	}
+	file.FileWrite(PNGSignature, 8);
 	
+	const unsigned char ihdr[13] = { (unsigned char)(width >> 24), (unsigned char)(width >> 16), (unsigned char)(width >> 8), (unsigned char)width,
+										(unsigned char)(height >> 24), (unsigned char)(height >> 16), (unsigned char)(height >> 8), (unsigned char)height,
+										(unsigned char)bit_depth, (unsigned char)color_type,
+										PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE, PNG_INTERLACE_NONE };
 	
-	png_read_image(png_ptr, row_pointers);
+	WriteChunk(file, "IHDR", ihdr, 13);
 	
 	
-	png_free(png_ptr, (void *)row_pointers);
+	// zlib header for a 32K window, with the level hint
+	const unsigned char flevel = (_compressionLevel < 2 ? 0 : _compressionLevel < 6 ? 1 : _compressionLevel == 6 ? 2 : 3);
 	
-	png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+	unsigned char zlib_header[2] = { 0x78, (unsigned char)(flevel << 6) };
 	
+	const int check = ((zlib_header[0] << 8) | zlib_header[1]) % 31;
 	
-	storeFrame(frame_buffer);
+	if(check != 0)
+		zlib_header[1] += (31 - check);
+	
+	uLong adler = adler32(0, NULL, 0);
+	
+	for(int i = 0; i < stripes.size(); i++)
+	{
+		const PNGStripe &stripe = stripes[i];
+		
+		adler = adler32_combine(adler, stripe.adler, stripe.filteredSize);
+		
+		if(i == 0)
+			WriteChunk(file, "IDAT", zlib_header, 2, stripe.deflated->Data, stripe.deflated->Size);
+		else
+			WriteChunk(file, "IDAT", stripe.deflated->Data, stripe.deflated->Size);
+	}
+	
+	// IDAT can be split anywhere, so the Adler-32 gets one of its own
+	const unsigned char trailer[4] = { (unsigned char)(adler >> 24), (unsigned char)(adler >> 16), (unsigned char)(adler >> 8), (unsigned char)adler };
+	
+	WriteChunk(file, "IDAT", trailer, 4);
+	
+	WriteChunk(file, "IEND", NULL, 0);
+	
+	
+	storeData( file.getDataChunk() );
+}
+
+
+void
+PNGCodec::compress(const FrameBuffer &frame)
+{
+	const PixelType pixel_type = (_depth == PNG_16 ? MoxFiles::UINT16 : MoxFiles::UINT8);
+	const size_t bytes_per_subpixel = PixelSize(pixel_type);
+	const int bit_depth = (_depth == PNG_16 ? 16 : 8);
+	
+	const int num_channels = (_channels == PNG_RGB ? 3 :
+								_channels == PNG_RGBA ? 4 :
+								_channels == PNG_Y ? 1 :
+								_channels == PNG_YA ? 2 :
+								4);
+	
+	const Box2i dataW = dataWindow();
+	
+	const int width = (dataW.max.x - dataW.min.x + 1);
+	const int height = (dataW.max.y - dataW.min.y + 1);
+	
+	const size_t bytes_per_pixel = bytes_per_subpixel * num_channels;
+	const size_t rowbytes = bytes_per_pixel * width;
+	const size_t buffer_size = rowbytes * height;
+	
+	
+	char *origin = stagingBuffer(buffer_size);
+	
+	FrameBuffer frame_buffer(dataW);
+	
+	if(_channels == PNG_RGB || _channels == PNG_RGBA)
+	{
+		frame_buffer.insert("R", Slice(pixel_type, origin + (bytes_per_subpixel * 0), bytes_per_pixel, rowbytes));
+		frame_buffer.insert("G", Slice(pixel_type, origin + (bytes_per_subpixel * 1), bytes_per_pixel, rowbytes));
+		frame_buffer.insert("B", Slice(pixel_type, origin + (bytes_per_subpixel * 2), bytes_per_pixel, rowbytes));
+		
+		if(_channels == PNG_RGBA)
+			frame_buffer.insert("A", Slice(pixel_type, origin + (bytes_per_subpixel * 3), bytes_per_pixel, rowbytes));
+	}
+	else
+	{
+		frame_buffer.insert("Y", Slice(pixel_type, origin + (bytes_per_subpixel * 0), bytes_per_pixel, rowbytes));
+		
+		if(_channels == PNG_YA)
+			frame_buffer.insert("A", Slice(pixel_type, origin + (bytes_per_subpixel * 1), bytes_per_pixel, rowbytes));
+	}
+	
+	frame_buffer.copyFromFrame(frame);
+	
+	if(_depth == PNG_16 && _bigEndian && LittleEndian())
+		Swap16((unsigned char *)origin, (const unsigned char *)origin, buffer_size / 2);
+	
+	const int color_type = (_channels == PNG_RGBA ? PNG_COLOR_TYPE_RGBA :
+							_channels == PNG_RGB ? PNG_COLOR_TYPE_RGB :
+							_channels == PNG_YA ? PNG_COLOR_TYPE_GA :
+							_channels == PNG_Y ? PNG_COLOR_TYPE_GRAY :
+							PNG_COLOR_TYPE_RGB);
+	
+	if(_parallelDeflate)
+	{
+		compressStripes(origin, rowbytes, bytes_per_pixel, color_type, bit_depth);
+		
+		return;
+	}
+	
+	
+	MemoryFile file(buffer_size);
+	
+	png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+		
+	png_infop info_ptr = png_create_info_struct(png_ptr);
+	
+	png_set_write_fn(png_ptr, (void *)&file, png_replace_write_data, png_replace_flush);
+	
+	// this is how libpng handles errors
+#ifdef PNG_SETJMP_SUPPORTED
+	if(setjmp(png_jmpbuf(png_ptr)))
+	{
+		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+		
+		throw MoxMxf::IoExc("Problem writing PNG file");
+	}
+#endif
+
+	png_set_IHDR(png_ptr, info_ptr, width, height, bit_depth, color_type,
+					PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
+	
+	const int filters = (_filter == FilterNone ? PNG_FILTER_NONE :
+							_filter == FilterSub ? PNG_FILTER_SUB :
+							_filter == FilterUp ? PNG_FILTER_UP :
+							_filter == FilterAverage ? PNG_FILTER_AVG :
+							_filter == FilterPaeth ? PNG_FILTER_PAETH :
+							PNG_ALL_FILTERS);
+	
+	png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, filters);
+	png_set_compression_level(png_ptr, _compressionLevel);
+	png_set_compression_strategy(png_ptr, ZlibStrategy(_strategy));
+	
+	png_write_info(png_ptr, info_ptr);
+	
+	
+	png_bytepp row_pointers = (png_bytepp)png_malloc(png_ptr, height * sizeof(png_bytep));
+					
+	for(int row = 0; row < height; row++)
+	{
+		row_pointers[row] = (png_bytep)( origin + (row * rowbytes) );
+	}
+	
+	png_write_image(png_ptr, row_pointers);
+	
+	
+	png_free(png_ptr, (void *)row_pointers);
+	
+	png_write_end(png_ptr, info_ptr);
+	
+	png_destroy_write_struct(&png_ptr, &info_ptr);
+	
+	
+	storeData( file.getDataChunk() );
+}
+
+
+// libpng reads straight out of the DataChunk
+struct PNGSource
+{
+	const unsigned char *data;
+	size_t size;
+	size_t pos;
+};
+
+
+static void png_replace_read_data(png_structp png_ptr, png_bytep data, png_size_t length)
+{
+	PNGSource *source = (PNGSource *)png_get_io_ptr(png_ptr);
+	
+	if(length > source->size - source->pos)
+		png_error(png_ptr, "Read past end of PNG data");
+	
+	memcpy(data, source->data + source->pos, length);
+	
+	source->pos += length;
+}
+
+
+#ifdef MOXFILES_SSE2
+// One pixel's worth of bytes, without touching anything past it, and without
+// bouncing odd sizes through memory.
+template <size_t BPP>
+static inline __m128i
+LoadPixel(const unsigned char *p);
+
+template <>
+inline __m128i
+LoadPixel<3>(const unsigned char *p)
+{
+	unsigned short lo;
+	
+	memcpy(&lo, p, 2);
+	
+	return _mm_cvtsi32_si128(lo | (p[2] << 16));
+}
+
+template <>
+inline __m128i
+LoadPixel<4>(const unsigned char *p)
+{
+	int v;
+	
+	memcpy(&v, p, 4);
+	
+	return _mm_cvtsi32_si128(v);
+}
+
+template <>
+inline __m128i
+LoadPixel<6>(const unsigned char *p)
+{
+	int lo;
+	unsigned short hi;
+	
+	memcpy(&lo, p, 4);
+	memcpy(&hi, p + 4, 2);
+	
+	return _mm_insert_epi16(_mm_cvtsi32_si128(lo), hi, 2);
+}
+
+template <>
+inline __m128i
+LoadPixel<8>(const unsigned char *p)
+{
+	return _mm_loadl_epi64((const __m128i *)p);
+}
+
+
+template <size_t BPP>
+static inline void
+StorePixel(unsigned char *p, __m128i x);
+
+template <>
+inline void
+StorePixel<3>(unsigned char *p, __m128i x)
+{
+	const int v = _mm_cvtsi128_si32(x);
+	
+	memcpy(p, &v, 2);
+	
+	p[2] = (v >> 16);
+}
+
+template <>
+inline void
+StorePixel<4>(unsigned char *p, __m128i x)
+{
+	const int v = _mm_cvtsi128_si32(x);
+	
+	memcpy(p, &v, 4);
+}
+
+template <>
+inline void
+StorePixel<6>(unsigned char *p, __m128i x)
+{
+	const int lo = _mm_cvtsi128_si32(x);
+	const unsigned short hi = _mm_extract_epi16(x, 2);
+	
+	memcpy(p, &lo, 4);
+	memcpy(p + 4, &hi, 2);
+}
+
+template <>
+inline void
+StorePixel<8>(unsigned char *p, __m128i x)
+{
+	_mm_storel_epi64((__m128i *)p, x);
+}
+
+
+static inline __m128i
+Abs16(__m128i x)
+{
+	return _mm_max_epi16(x, _mm_sub_epi16(_mm_setzero_si128(), x));
+}
+
+
+static inline __m128i
+Select(__m128i mask, __m128i a, __m128i b)
+{
+	return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+
+// Sub, Average and Paeth depend on the pixel to the left, so these go a pixel
+// at a time, with all of its bytes at once.
+template <size_t BPP>
+static void
+UnfilterPixels(unsigned char *row, const unsigned char *prev, size_t rowbytes, int filter)
+{
+	const __m128i zero = _mm_setzero_si128();
+	
+	__m128i a = zero;
+	
+	if(filter == PNG_FILTER_VALUE_SUB)
+	{
+		for(size_t i = 0; i < rowbytes; i += BPP)
+		{
+			a = _mm_add_epi8(LoadPixel<BPP>(row + i), a);
+			
+			StorePixel<BPP>(row + i, a);
+		}
+	}
+	else if(filter == PNG_FILTER_VALUE_AVG)
+	{
+		const __m128i one = _mm_set1_epi8(1);
+		
+		for(size_t i = 0; i < rowbytes; i += BPP)
+		{
+			const __m128i b = LoadPixel<BPP>(prev + i);
+			
+			// _mm_avg_epu8 rounds up, PNG rounds down
+			const __m128i avg = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+			
+			a = _mm_add_epi8(LoadPixel<BPP>(row + i), avg);
+			
+			StorePixel<BPP>(row + i, a);
+		}
+	}
+	else if(filter == PNG_FILTER_VALUE_PAETH)
+	{
+		__m128i c = zero;
+		
+		for(size_t i = 0; i < rowbytes; i += BPP)
+		{
+			const __m128i b = _mm_unpacklo_epi8(LoadPixel<BPP>(prev + i), zero);
+			
+			// p = a + b - c, so |p - a| = |b - c|, |p - b| = |a - c|, and |p - c| is |sum of those|
+			const __m128i pa_signed = _mm_sub_epi16(b, c);
+			const __m128i pb_signed = _mm_sub_epi16(a, c);
+			
+			const __m128i pa = Abs16(pa_signed);
+			const __m128i pb = Abs16(pb_signed);
+			const __m128i pc = Abs16(_mm_add_epi16(pa_signed, pb_signed));
+			
+			const __m128i smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+			
+			const __m128i predictor = Select(_mm_cmpeq_epi16(pa, smallest), a,
+												Select(_mm_cmpeq_epi16(pb, smallest), b, c));
+			
+			const __m128i x = _mm_add_epi8(LoadPixel<BPP>(row + i), _mm_packus_epi16(predictor, predictor));
+			
+			StorePixel<BPP>(row + i, x);
+			
+			a = _mm_unpacklo_epi8(x, zero);
+			c = b;
+		}
+	}
+}
+#endif // MOXFILES_SSE2
+
+
+// Undoes the filter on a row in place.  prev is the row above, already
+// unfiltered, or zeros for the first row.
+static void
+UnfilterRow(unsigned char *row, const unsigned char *prev, size_t rowbytes, size_t bpp, int filter)
+{
+	if(filter < PNG_FILTER_VALUE_NONE || filter > PNG_FILTER_VALUE_PAETH)
+		throw MoxMxf::InputExc("Unknown PNG filter");
+	
+	if(filter == PNG_FILTER_VALUE_NONE)
+		return;
+	
+	if(filter == PNG_FILTER_VALUE_UP)
+	{
+		size_t i = 0;
+	
+	#ifdef MOXFILES_SSE2
+		for(; i + 16 <= rowbytes; i += 16)
+		{
+			const __m128i x = _mm_loadu_si128((const __m128i *)(row + i));
+			const __m128i b = _mm_loadu_si128((const __m128i *)(prev + i));
+			
+			_mm_storeu_si128((__m128i *)(row + i), _mm_add_epi8(x, b));
+		}
+	#endif
+	
+		for(; i < rowbytes; i++)
+			row[i] += prev[i];
+		
+		return;
+	}
+
+#ifdef MOXFILES_SSE2
+	switch(bpp)
+	{
+		case 3:	UnfilterPixels<3>(row, prev, rowbytes, filter);	return;
+		case 4:	UnfilterPixels<4>(row, prev, rowbytes, filter);	return;
+		case 6:	UnfilterPixels<6>(row, prev, rowbytes, filter);	return;
+		case 8:	UnfilterPixels<8>(row, prev, rowbytes, filter);	return;
+	}
+#endif
+
+	if(filter == PNG_FILTER_VALUE_SUB)
+	{
+		for(size_t i = bpp; i < rowbytes; i++)
+			row[i] += row[i - bpp];
+	}
+	else if(filter == PNG_FILTER_VALUE_AVG)
+	{
+		for(size_t i = 0; i < bpp; i++)
+			row[i] += prev[i] / 2;
+		
+		for(size_t i = bpp; i < rowbytes; i++)
+			row[i] += ((int)row[i - bpp] + (int)prev[i]) / 2;
+	}
+	else if(filter == PNG_FILTER_VALUE_PAETH)
+	{
+		for(size_t i = 0; i < bpp; i++)
+			row[i] += prev[i];
+		
+		for(size_t i = bpp; i < rowbytes; i++)
+			row[i] += Paeth(row[i - bpp], prev[i], prev[i - bpp]);
+	}
+}
+
+
+static inline png_uint_32
+ReadUInt32(const unsigned char *bytes)
+{
+	return (((png_uint_32)bytes[0] << 24) | ((png_uint_32)bytes[1] << 16) | ((png_uint_32)bytes[2] << 8) | (png_uint_32)bytes[3]);
+}
+
+
+// where an IDAT chunk's data is in the file
+struct PNGData
+{
+	const unsigned char *data;
+	size_t size;
+	
+	PNGData(const unsigned char *d = NULL, size_t s = 0) : data(d), size(s) {}
+};
+
+
+#ifndef MOXFILES_USE_LIBDEFLATE
+// Inflates exactly size bytes into out, moving on to the next IDAT chunk
+// whenever the one before runs out.
+static void
+InflateBytes(z_stream &strm, unsigned char *out, size_t size, const std::vector<PNGData> &idat, size_t &nextIDAT)
+{
+	strm.next_out = out;
+	strm.avail_out = size;
+	
+	while(strm.avail_out > 0)
+	{
+		if(strm.avail_in == 0)
+		{
+			if(nextIDAT >= idat.size())
+				throw MoxMxf::InputExc("PNG data ends early");
+			
+			strm.next_in = (Bytef *)idat[nextIDAT].data;
+			strm.avail_in = idat[nextIDAT].size;
+			
+			nextIDAT++;
+		}
+		else
+		{
+			const int err = inflate(&strm, Z_NO_FLUSH);
+			
+			if(err == Z_STREAM_END && strm.avail_out > 0)
+				throw MoxMxf::InputExc("PNG data ends early");
+			else if(err != Z_OK && err != Z_STREAM_END)
+				throw MoxMxf::InputExc("Problem inflating PNG data");
+		}
+	}
+}
+#endif // MOXFILES_USE_LIBDEFLATE
+
+
+std::vector<std::string>
+PNGCodec::channelNames() const
+{
+	std::vector<std::string> names;
+	
+	if(_channels == PNG_RGB || _channels == PNG_RGBA)
+	{
+		names.push_back("R");
+		names.push_back("G");
+		names.push_back("B");
+	}
+	else
+		names.push_back("Y");
+	
+	if(_channels == PNG_RGBA || _channels == PNG_YA)
+		names.push_back("A");
+	
+	return names;
+}
+
+
+void
+PNGCodec::decompress(const DataChunk &data)
+{
+	const Box2i dataW = dataWindow();
+	
+	const int width = (dataW.max.x - dataW.min.x + 1);
+	const int height = (dataW.max.y - dataW.min.y + 1);
+	
+	const PixelType pixel_type = (_depth == PNG_16 ? MoxFiles::UINT16 : MoxFiles::UINT8);
+	const size_t bytes_per_subpixel = PixelSize(pixel_type);
+	
+	const std::vector<std::string> names = channelNames();
+	
+	const size_t bytes_per_pixel = bytes_per_subpixel * names.size();
+	const size_t rowbytes = bytes_per_pixel * width;
+	const size_t buffer_size = rowbytes * height;
+	
+	DataChunkPtr frame_data = new PooledDataChunk(buffer_size);
+	
+	FrameBufferPtr frame_buffer = new FrameBuffer(dataW);
+	
+	frame_buffer->attachData(frame_data);
+	
+	
+	char *origin = (char *)frame_data->Data;
+	
+	for(int i = 0; i < names.size(); i++)
+	{
+		frame_buffer->insert(names[i], Slice(pixel_type, origin + (bytes_per_subpixel * i), bytes_per_pixel, rowbytes));
+	}
+	
+	decompressRows(data, origin, rowbytes);
+	
+	storeFrame(frame_buffer);
+}
+
+
+bool
+PNGCodec::decompressInto(const DataChunk &data, FrameBuffer &frameBuffer)
+{
+	const PixelType pixel_type = (_depth == PNG_16 ? MoxFiles::UINT16 : MoxFiles::UINT8);
+	
+	ptrdiff_t rowbytes = 0;
+	
+	char *origin = interleavedRows(frameBuffer, channelNames(), pixel_type, rowbytes);
+	
+	if(origin == NULL)
+		return VideoCodec::decompressInto(data, frameBuffer);
+	
+	// libpng gets row pointers into the caller's buffer
+	decompressRows(data, origin, rowbytes);
+	
+	return true;
+}
+
+
+const char *
+PNGCodec::checkStored(unsigned int width, unsigned int height, int color_type, int bit_depth) const
+{
+	const Box2i dataW = dataWindow();
+	
+	const PNG_Channels stored_channels = (color_type & PNG_COLOR_MASK_COLOR) ?
+											((color_type & PNG_COLOR_MASK_ALPHA) ? PNG_RGBA : PNG_RGB) :
+											((color_type & PNG_COLOR_MASK_ALPHA) ? PNG_YA : PNG_Y);
+	
+	const PNG_Depth stored_depth = (bit_depth > 8 ? PNG_16 : PNG_8);
+	
+	if(width != (dataW.max.x - dataW.min.x + 1))
+		return "Stored data is wrong width";
+	else if(height != (dataW.max.y - dataW.min.y + 1))
+		return "Stored data is wrong height";
+	else if(stored_channels != _channels || stored_depth != _depth)
+		return "Stored data doesn't match descriptor";
+	
+	return NULL;
+}
+
+
+void
+PNGCodec::decompressRows(const DataChunk &data, char *origin, ptrdiff_t rowbytes)
+{
+	if(decompressDirect(data, origin, rowbytes))
+		return;
+	
+	
+	PNGSource source = { data.Data, data.Size, 0 };
+	
+	png_structp png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	
+	png_infop info_ptr = png_create_info_struct(png_ptr);
+	
+	png_set_read_fn(png_ptr, &source, png_replace_read_data);
+	
+	// this is how libpng handles errors
+#ifdef PNG_SETJMP_SUPPORTED
+	if(setjmp(png_jmpbuf(png_ptr)))
+	{
+		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+		
+		throw MoxMxf::IoExc("Problem reading PNG file");
+	}
+#endif
+
+	png_read_info(png_ptr, info_ptr);
+	
+	int color_type, bit_depth, interlace_type;
+	png_uint_32 width, height;
+
+	png_get_IHDR(png_ptr, info_ptr, &width, &height, &bit_depth, &color_type,
+		&interlace_type, NULL, NULL);
+
+
+	const char *error = checkStored(width, height, color_type, bit_depth);
+	
+	if(error != NULL)
+	{
+		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+		
+		throw MoxMxf::InputExc(error);
+	}
+	
+	const size_t samples = png_get_channels(png_ptr, info_ptr) * width;
+	
+	
+	png_bytepp row_pointers = (png_bytepp)png_malloc(png_ptr, height * sizeof(png_bytep));
+	
+	for(int row = 0; row < height; row++)
+	{
+		row_pointers[row] = (png_bytep)( origin + (row * rowbytes) );
+	}
+	
+	
+	png_read_image(png_ptr, row_pointers);
+	
+	
+	png_free(png_ptr, (void *)row_pointers);
+	
+	png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+	
+	
+	if(bit_depth == 16 && _bigEndian && LittleEndian())
+	{
+		for(int row = 0; row < height; row++)
+		{
+			unsigned char *samples_row = (unsigned char *)( origin + (row * rowbytes) );
+			
+			Swap16(samples_row, samples_row, samples);
+		}
+	}
+}
+
+
+bool
+PNGCodec::decompressDirect(const DataChunk &data, char *origin, ptrdiff_t rowbytes)
+{
+	const unsigned char *file = data.Data;
+	const size_t size = data.Size;
+	
+	if(size < 8 || memcmp(file, PNGSignature, 8) != 0)
+		return false;
+	
+	
+	png_uint_32 width = 0, height = 0;
+	int bit_depth = 0, color_type = -1, interlace_type = -1;
+	
+	std::vector<PNGData> idat;
+	
+	bool ended = false;
+	
+	size_t pos = 8;
+	
+	while(!ended && pos + 12 <= size)
+	{
+		const png_uint_32 length = ReadUInt32(file + pos);
+		const unsigned char *type = file + pos + 4;
+		const unsigned char *chunk = file + pos + 8;
+		
+		if(length > size - pos - 12)
+			return false;
+		
+		if(pos == 8)
+		{
+			if(memcmp(type, "IHDR", 4) != 0 || length != 13)
+				return false;
+			
+			width = ReadUInt32(chunk);
+			height = ReadUInt32(chunk + 4);
+			bit_depth = chunk[8];
+			color_type = chunk[9];
+			interlace_type = chunk[12];
+		}
+		else if(memcmp(type, "IDAT", 4) == 0)
+			idat.push_back(PNGData(chunk, length));
+		else if(memcmp(type, "IEND", 4) == 0)
+			ended = true;
+		else if(!(type[0] & 0x20))
+			return false; // a critical chunk, like PLTE
+		
+		pos += 12 + length;
+	}
+	
+	// anything else is for libpng
+	if(!ended || idat.empty() || interlace_type != PNG_INTERLACE_NONE || (bit_depth != 8 && bit_depth != 16) ||
+		(color_type != PNG_COLOR_TYPE_GRAY && color_type != PNG_COLOR_TYPE_GA && color_type != PNG_COLOR_TYPE_RGB && color_type != PNG_COLOR_TYPE_RGBA))
+	{
+		return false;
+	}
+	
+	const char *error = checkStored(width, height, color_type, bit_depth);
+	
+	if(error != NULL)
+		throw MoxMxf::InputExc(error);
+	
+	
+	const size_t samples_per_pixel = (color_type == PNG_COLOR_TYPE_RGBA ? 4 :
+										color_type == PNG_COLOR_TYPE_RGB ? 3 :
+										color_type == PNG_COLOR_TYPE_GA ? 2 :
+										1);
+	
+	const size_t bytes_per_pixel = samples_per_pixel * (bit_depth / 8);
+	const size_t png_rowbytes = bytes_per_pixel * width;
+	
+	// Rows are unfiltered right where they're going, using the one above as
+	// the previous row.  Big-endian 16-bit samples have to be swapped afterwards
+	// on this end, so those are unfiltered in a pair of rows that stay big-endian.
+	const bool swap = (bit_depth == 16 && _bigEndian && LittleEndian());
+	
+	unsigned char *zeros = (unsigned char *)stagingBuffer(3 * png_rowbytes);
+	
+	memset(zeros, 0, png_rowbytes);
+	
+	unsigned char * const row_buffers[2] = { zeros + png_rowbytes, zeros + (2 * png_rowbytes) };
+
+
+#ifdef MOXFILES_USE_LIBDEFLATE
+	// libdeflate does the whole frame in one go, so the IDAT chunks have to be
+	// put together if there's more than one.
+	const size_t filtered_size = (png_rowbytes + 1) * height;
+	
+	unsigned char *filtered = (unsigned char *)stagingBuffer(filtered_size, 1);
+	
+	const unsigned char *deflated = idat[0].data;
+	size_t deflated_size = idat[0].size;
+	
+	if(idat.size() > 1)
+	{
+		deflated_size = 0;
+		
+		for(int i = 0; i < idat.size(); i++)
+			deflated_size += idat[i].size;
+		
+		unsigned char *gathered = (unsigned char *)stagingBuffer(deflated_size, 2);
+		
+		size_t offset = 0;
+		
+		for(int i = 0; i < idat.size(); i++)
+		{
+			memcpy(gathered + offset, idat[i].data, idat[i].size);
+			
+			offset += idat[i].size;
+		}
+		
+		deflated = gathered;
+	}
+	
+	if(_decompressor == NULL)
+	{
+		_decompressor = libdeflate_alloc_decompressor();
+		
+		if(_decompressor == NULL)
+			throw MoxMxf::NullExc("Problem creating libdeflate decompressor");
+	}
+	
+	if(libdeflate_zlib_decompress(_decompressor, deflated, deflated_size, filtered, filtered_size, NULL) != LIBDEFLATE_SUCCESS)
+		throw MoxMxf::InputExc("Problem inflating PNG data");
+#else
+	z_stream &strm = inflater();
+	
+	size_t nextIDAT = 0;
+#endif
+
+	const unsigned char *prev = zeros;
+	
+	for(int y = 0; y < height; y++)
+	{
+		unsigned char *out = (unsigned char *)origin + (y * rowbytes);
+		unsigned char *row = (swap ? row_buffers[y % 2] : out);
+	
+	#ifdef MOXFILES_USE_LIBDEFLATE
+		const unsigned char *filtered_row = filtered + (y * (png_rowbytes + 1));
+		
+		const unsigned char filter = filtered_row[0];
+		
+		memcpy(row, filtered_row + 1, png_rowbytes);
+	#else
+		unsigned char filter;
+		
+		InflateBytes(strm, &filter, 1, idat, nextIDAT);
+		InflateBytes(strm, row, png_rowbytes, idat, nextIDAT);
+	#endif
+	
+		UnfilterRow(row, prev, png_rowbytes, bytes_per_pixel, filter);
+		
+		if(swap)
+			Swap16(out, row, png_rowbytes / 2);
+		
+		prev = row;
+	}
+	
+	return true;
+}
+
+
+#ifndef MOXFILES_USE_LIBDEFLATE
+z_stream &
+PNGCodec::inflater()
+{
+	if(_inflater == NULL)
+	{
+		_inflater = new z_stream;
+		
+		memset(_inflater, 0, sizeof(z_stream));
+		
+		if(inflateInit(_inflater) != Z_OK)
+		{
+			delete _inflater;
+			
+			_inflater = NULL;
+			
+			throw MoxMxf::NullExc("Problem initializing zlib");
+		}
+	}
+	else
+		inflateReset(_inflater);
+	
+	_inflater->next_in = NULL;
+	_inflater->avail_in = 0;
+	
+	return *_inflater;
 }
+#endif // MOXFILES_USE_LIBDEFLATE
 
 
 bool
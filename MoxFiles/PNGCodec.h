@@ -12,6 +12,9 @@
 
 #include <MoxFiles/Codec.h>
 
+struct z_stream_s;
+struct libdeflate_decompressor;
+
 namespace MoxFiles
 {
 	class PNGCodec : public VideoCodec
@@ -24,8 +27,46 @@ namespace MoxFiles
 		virtual const MoxMxf::VideoDescriptor * getDescriptor() const { return &_descriptor; }
 		
 		virtual void compress(const FrameBuffer &frame);
+		virtual bool convertsInput() const { return true; }
 		virtual void decompress(const DataChunk &data);
+		virtual bool decompressInto(const DataChunk &data, FrameBuffer &frameBuffer);
+		
+	  public:
+		// Encoder settings that go in the Header.
+		enum Filter
+		{
+			FilterNone = 0,
+			FilterSub,
+			FilterUp,
+			FilterAverage,
+			FilterPaeth,
+			FilterAdaptive	// best one for each row, the default
+		};
+		
+		static Filter getFilter(const Header &header);
+		static void setFilter(Header &header, Filter filter);
+		
+		// zlib's 0-9, default 6
+		static int getCompressionLevel(const Header &header);
+		static void setCompressionLevel(Header &header, int level);
+		
+		enum Strategy
+		{
+			StrategyDefault = 0,
+			StrategyFiltered,
+			StrategyHuffmanOnly,
+			StrategyRLE
+		};
 		
+		static Strategy getStrategy(const Header &header);
+		static void setStrategy(Header &header, Strategy strategy);
+		
+		// Filter and deflate horizontal stripes of the frame on the global thread pool
+		// instead of running libpng on one.  The stripes are sync flushed and laid end
+		// to end as a single zlib stream, so any PNG reader can still read the frames.
+		static bool getParallelDeflate(const Header &header);
+		static void setParallelDeflate(Header &header, bool parallel);
+	
 	  private:
 		MoxMxf::RGBADescriptor _descriptor;
 		
@@ -44,6 +85,30 @@ namespace MoxFiles
 		};
 		
 		PNG_Depth _depth;
+		
+		Filter _filter;
+		int _compressionLevel;
+		Strategy _strategy;
+		bool _parallelDeflate;
+		
+		bool _bigEndian; // 16-bit samples, see PNGCodec.cpp
+		
+		std::vector<std::string> channelNames() const;
+		const char * checkStored(unsigned int width, unsigned int height, int color_type, int bit_depth) const;
+		void compressStripes(const char *origin, size_t rowbytes, size_t bytes_per_pixel, int color_type, int bit_depth);
+		void decompressRows(const DataChunk &data, char *origin, ptrdiff_t rowbytes);
+		
+		// Plain 8 and 16-bit frames, which is everything we write, are inflated and
+		// unfiltered here straight from the DataChunk into the rows, without libpng.
+		// Returns false for anything else.  Inflating is done with libdeflate
+		// when built with MOXFILES_USE_LIBDEFLATE.
+		bool decompressDirect(const DataChunk &data, char *origin, ptrdiff_t rowbytes);
+		
+		// kept from frame to frame
+		struct z_stream_s *_inflater;
+		struct libdeflate_decompressor *_decompressor;
+		
+		struct z_stream_s & inflater();
 	};
 	
 	
@@ -0,0 +1,1223 @@
+/*
+ *  PlanarCodec.cpp
+ *  MoxFiles
+ *
+ *  Created by agent on 10/18/26.
+ *  Copyright 2026 fnord. All rights reserved.
+ *
+ */
+
+#include <MoxFiles/PlanarCodec.h>
+
+#include <MoxFiles/Thread.h>
+#include <MoxFiles/SIMD.h>
+
+#include "zstd.h"
+
+#ifdef MOXFILES_USE_LZ4
+#include "lz4.h"
+#endif
+
+#include <algorithm>
+
+#include <string.h>
+
+namespace MoxFiles
+{
+
+// Every frame starts with a header, all little-endian:
+//
+//   "MXPL", version (1), compressor, channel count (UInt16),
+//   width, height, rows per stripe, stripe count (UInt32s),
+//   each stripe's size (UInt32, high bit set if it was stored as is)
+//
+// followed by the stripes.  Uncompressed, a stripe is its rows of each channel
+// in turn, in the order of the descriptor's palette.  Each row is the difference
+// from the sample to the left (as unsigned integers, even HALF and FLOAT) split
+// into byte planes, lowest byte first.
+
+static const unsigned char PlanarMagic[4] = { 'M', 'X', 'P', 'L' };
+static const UInt8 PlanarVersion = 1;
+static const size_t PlanarHeaderSize = 24;
+static const UInt32 StoredStripe = 0x80000000;
+
+// about this many bytes of samples in a stripe
+static const size_t PlanarStripeSize = (1024 * 1024);
+
+
+static inline void
+PutUInt16(unsigned char *p, UInt16 value)
+{
+	p[0] = (value & 0xff);
+	p[1] = ((value >> 8) & 0xff);
+}
+
+
+static inline void
+PutUInt32(unsigned char *p, UInt32 value)
+{
+	p[0] = (value & 0xff);
+	p[1] = ((value >> 8) & 0xff);
+	p[2] = ((value >> 16) & 0xff);
+	p[3] = ((value >> 24) & 0xff);
+}
+
+
+static inline UInt16
+GetUInt16(const unsigned char *p)
+{
+	return (p[0] | (p[1] << 8));
+}
+
+
+static inline UInt32
+GetUInt32(const unsigned char *p)
+{
+	return ((UInt32)p[0] | ((UInt32)p[1] << 8) | ((UInt32)p[2] << 16) | ((UInt32)p[3] << 24));
+}
+
+
+static unsigned int
+PixelLayoutDepth(PixelType type)
+{
+	// see SMPTE 377M E.2.46
+	switch(type)
+	{
+		case MoxFiles::UINT8:
+			return 8;
+		
+		case MoxFiles::UINT10:
+			return 10;
+		
+		case MoxFiles::UINT12:
+			return 12;
+		
+		case MoxFiles::UINT16:
+		case MoxFiles::UINT16A:
+			return 16;
+		
+		case MoxFiles::UINT32:
+			return 32;
+		
+		case MoxFiles::HALF:
+			return 253;
+		
+		case MoxFiles::FLOAT:
+			return 254;
+	}
+	
+	throw MoxMxf::ArgExc("Unknown pixel type");
+}
+
+
+static PixelType
+PixelTypeFromLayoutDepth(UInt8 depth)
+{
+	switch(depth)
+	{
+		case 8:
+			return MoxFiles::UINT8;
+		
+		case 10:
+			return MoxFiles::UINT10;
+		
+		case 12:
+			return MoxFiles::UINT12;
+		
+		case 16:
+			return MoxFiles::UINT16;
+		
+		case 32:
+			return MoxFiles::UINT32;
+		
+		case 253:
+			return MoxFiles::HALF;
+		
+		case 254:
+			return MoxFiles::FLOAT;
+	}
+	
+	throw MoxMxf::InputExc("Bad planar channel type");
+}
+
+
+PlanarCodec::PlanarCodec(const Header &header, const ChannelList &channels) :
+	VideoCodec(header, channels),
+	_descriptor(header.frameRate(), header.width(), header.height(), MoxMxf::VideoDescriptor::VideoCodecPlanar),
+	_compressor(getCompressor(header)),
+	_compressionLevel(getCompressionLevel(header))
+{
+#ifndef MOXFILES_USE_LZ4
+	if(_compressor == CompressorLZ4)
+		throw MoxMxf::NoImplExc("Planar LZ4 needs MOXFILES_USE_LZ4");
+#endif
+
+	setWindows(_descriptor, header);
+	
+	// see VideoDescriptor::setCodingVariant()
+	_descriptor.setCodingVariant(_compressor + 1);
+	
+	// The layout only has room for eight one-byte codes, and channel names
+	// don't map to them, so it gets a fill entry of the right depth for each
+	// of the first eight channels.  The palette has the real list: each
+	// channel's depth code (as in the layout), then its name and a 0.
+	MoxMxf::RGBADescriptor::RGBALayout layout;
+	MoxMxf::RGBADescriptor::Palette palette;
+	
+	for(ChannelList::ConstIterator i = channels.begin(); i != channels.end(); ++i)
+	{
+		const std::string name = i.name();
+		const Channel &chan = i.channel();
+		
+		if(chan.xSampling != 1 || chan.ySampling != 1)
+			throw MoxMxf::ArgExc("Planar channels can't be subsampled");
+		
+		if(chan.type == MoxFiles::UINT16A)
+			throw MoxMxf::ArgExc("Planar can't store UINT16A");
+		
+		_planes.push_back(PlaneInfo(name, chan.type));
+		
+		if(layout.size() < 8)
+			layout.push_back(MoxMxf::RGBADescriptor::RGBALayoutItem('F', PixelLayoutDepth(chan.type)));
+		
+		palette.push_back(PixelLayoutDepth(chan.type));
+		palette.insert(palette.end(), name.begin(), name.end());
+		palette.push_back(0);
+	}
+	
+	if(_planes.empty() || _planes.size() > 0xffff)
+		throw MoxMxf::ArgExc("Bad number of planar channels");
+	
+	_descriptor.setPixelLayout(layout);
+	_descriptor.setPalette(palette);
+}
+
+
+PlanarCodec::PlanarCodec(const MoxMxf::VideoDescriptor &descriptor, Header &header, ChannelList &channels) :
+	VideoCodec(descriptor, header, channels),
+	_descriptor(dynamic_cast<const MoxMxf::RGBADescriptor &>(descriptor)),
+	_compressor(CompressorZstd),
+	_compressionLevel(1)
+{
+	const MoxMxf::RGBADescriptor::Palette &palette = _descriptor.getPalette();
+	
+	size_t pos = 0;
+	
+	while(pos < palette.size())
+	{
+		const PixelType type = PixelTypeFromLayoutDepth(palette[pos++]);
+		
+		const size_t name_start = pos;
+		
+		while(pos < palette.size() && palette[pos] != 0)
+			pos++;
+		
+		if(pos == palette.size() || pos == name_start)
+			throw MoxMxf::InputExc("Bad planar channel list");
+		
+		const std::string name(palette.begin() + name_start, palette.begin() + pos);
+		
+		pos++;
+		
+		_planes.push_back(PlaneInfo(name, type));
+		
+		channels.insert(name, Channel(type));
+	}
+	
+	if(_planes.empty())
+		throw MoxMxf::InputExc("No planar channels");
+	
+	const unsigned int variant = _descriptor.getCodingVariant();
+	
+	if(variant > 0 && variant <= (CompressorLZ4 + 1))
+		setCompressor(header, (Compressor)(variant - 1));
+}
+
+
+PlanarCodec::~PlanarCodec()
+{
+	for(int i = 0; i < _compressors.size(); i++)
+		ZSTD_freeCCtx(_compressors[i]);
+	
+	for(int i = 0; i < _decompressors.size(); i++)
+		ZSTD_freeDCtx(_decompressors[i]);
+}
+
+
+PlanarCodec::Compressor
+PlanarCodec::getCompressor(const Header &header)
+{
+	const IntAttribute *compressorAttr = header.findTypedAttribute<IntAttribute>("planarCompressor");
+	
+	return (compressorAttr != NULL ? (Compressor)compressorAttr->value() : CompressorZstd);
+}
+
+
+void
+PlanarCodec::setCompressor(Header &header, Compressor compressor)
+{
+	if(compressor < CompressorZstd || compressor > CompressorLZ4)
+		throw MoxMxf::ArgExc("Invalid planar compressor");
+	
+	header.insert("planarCompressor", IntAttribute(compressor));
+}
+
+
+int
+PlanarCodec::getCompressionLevel(const Header &header)
+{
+	const IntAttribute *levelAttr = header.findTypedAttribute<IntAttribute>("planarCompressionLevel");
+	
+	return (levelAttr != NULL ? levelAttr->value() : 1);
+}
+
+
+void
+PlanarCodec::setCompressionLevel(Header &header, int level)
+{
+	if(level < 1 || level > 19)
+		throw MoxMxf::ArgExc("Invalid planar compression level");
+	
+	header.insert("planarCompressionLevel", IntAttribute(level));
+}
+
+
+static CodecThreads gPlanarThreads("planar");
+
+
+int
+PlanarCodec::threadCount()
+{
+	return gPlanarThreads.count();
+}
+
+
+void
+PlanarCodec::setThreadCount(int count)
+{
+	gPlanarThreads.setCount(count);
+}
+
+
+namespace
+{
+
+// one channel, as found in the frame we're reading or writing
+struct PlanarPlane
+{
+	PixelType type;
+	char *origin; // first pixel of the data window, NULL to skip
+	ptrdiff_t xStride;
+	ptrdiff_t yStride;
+	
+	PlanarPlane(PixelType t = UINT8, char *o = NULL, ptrdiff_t xs = 0, ptrdiff_t ys = 0) : type(t), origin(o), xStride(xs), yStride(ys) {}
+};
+
+
+#ifdef MOXFILES_SSE2
+// Contiguous rows, 16 samples at a time.  They return how many samples they
+// did and leave prev at the last of those for the plain loop to finish from.
+
+static int
+EncodeRowSSE2(unsigned char *out, const UInt8 *in, int width, UInt8 &prev)
+{
+	int x = 0;
+	
+	for(; x + 16 <= width; x += 16)
+	{
+		const __m128i c = _mm_loadu_si128((const __m128i *)(in + x));
+		const __m128i p = _mm_or_si128(_mm_slli_si128(c, 1), _mm_cvtsi32_si128(prev));
+		
+		_mm_storeu_si128((__m128i *)(out + x), _mm_sub_epi8(c, p));
+		
+		prev = in[x + 15];
+	}
+	
+	return x;
+}
+
+
+static int
+EncodeRowSSE2(unsigned char *out, const UInt16 *in, int width, UInt16 &prev)
+{
+	const __m128i low_byte = _mm_set1_epi16(0x00ff);
+	
+	int x = 0;
+	
+	for(; x + 16 <= width; x += 16)
+	{
+		const __m128i c0 = _mm_loadu_si128((const __m128i *)(in + x));
+		const __m128i c1 = _mm_loadu_si128((const __m128i *)(in + x + 8));
+		
+		const __m128i p0 = _mm_or_si128(_mm_slli_si128(c0, 2), _mm_cvtsi32_si128(prev));
+		const __m128i p1 = _mm_or_si128(_mm_slli_si128(c1, 2), _mm_srli_si128(c0, 14));
+		
+		const __m128i d0 = _mm_sub_epi16(c0, p0);
+		const __m128i d1 = _mm_sub_epi16(c1, p1);
+		
+		_mm_storeu_si128((__m128i *)(out + x), _mm_packus_epi16(_mm_and_si128(d0, low_byte), _mm_and_si128(d1, low_byte)));
+		_mm_storeu_si128((__m128i *)(out + width + x), _mm_packus_epi16(_mm_srli_epi16(d0, 8), _mm_srli_epi16(d1, 8)));
+		
+		prev = in[x + 15];
+	}
+	
+	return x;
+}
+
+
+static int
+EncodeRowSSE2(unsigned char *out, const UInt32 *in, int width, UInt32 &prev)
+{
+	const __m128i low_byte = _mm_set1_epi32(0x000000ff);
+	
+	int x = 0;
+	
+	for(; x + 16 <= width; x += 16)
+	{
+		const __m128i c0 = _mm_loadu_si128((const __m128i *)(in + x));
+		const __m128i c1 = _mm_loadu_si128((const __m128i *)(in + x + 4));
+		const __m128i c2 = _mm_loadu_si128((const __m128i *)(in + x + 8));
+		const __m128i c3 = _mm_loadu_si128((const __m128i *)(in + x + 12));
+		
+		const __m128i d0 = _mm_sub_epi32(c0, _mm_or_si128(_mm_slli_si128(c0, 4), _mm_cvtsi32_si128(prev)));
+		const __m128i d1 = _mm_sub_epi32(c1, _mm_or_si128(_mm_slli_si128(c1, 4), _mm_srli_si128(c0, 12)));
+		const __m128i d2 = _mm_sub_epi32(c2, _mm_or_si128(_mm_slli_si128(c2, 4), _mm_srli_si128(c1, 12)));
+		const __m128i d3 = _mm_sub_epi32(c3, _mm_or_si128(_mm_slli_si128(c3, 4), _mm_srli_si128(c2, 12)));
+		
+		// each byte masked down to 0-255, so the saturating packs don't touch it
+		for(int b = 0; b < 4; b++)
+		{
+			const __m128i shift = _mm_cvtsi32_si128(8 * b);
+			
+			const __m128i b01 = _mm_packs_epi32(_mm_and_si128(_mm_srl_epi32(d0, shift), low_byte), _mm_and_si128(_mm_srl_epi32(d1, shift), low_byte));
+			const __m128i b23 = _mm_packs_epi32(_mm_and_si128(_mm_srl_epi32(d2, shift), low_byte), _mm_and_si128(_mm_srl_epi32(d3, shift), low_byte));
+			
+			_mm_storeu_si128((__m128i *)(out + (b * width) + x), _mm_packus_epi16(b01, b23));
+		}
+		
+		prev = in[x + 15];
+	}
+	
+	return x;
+}
+
+
+// The running sum inside each vector is a few shifted adds, and
+// the carry from the vector before gets added to every lane.
+
+static int
+DecodeRowSSE2(UInt8 *out, const unsigned char *in, int width, UInt8 &value)
+{
+	int x = 0;
+	
+	for(; x + 16 <= width; x += 16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *)(in + x));
+		
+		v = _mm_add_epi8(v, _mm_slli_si128(v, 1));
+		v = _mm_add_epi8(v, _mm_slli_si128(v, 2));
+		v = _mm_add_epi8(v, _mm_slli_si128(v, 4));
+		v = _mm_add_epi8(v, _mm_slli_si128(v, 8));
+		v = _mm_add_epi8(v, _mm_set1_epi8(value));
+		
+		_mm_storeu_si128((__m128i *)(out + x), v);
+		
+		value = out[x + 15];
+	}
+	
+	return x;
+}
+
+
+static inline __m128i
+RunningSum16(__m128i v, UInt16 carry)
+{
+	v = _mm_add_epi16(v, _mm_slli_si128(v, 2));
+	v = _mm_add_epi16(v, _mm_slli_si128(v, 4));
+	v = _mm_add_epi16(v, _mm_slli_si128(v, 8));
+	
+	return _mm_add_epi16(v, _mm_set1_epi16(carry));
+}
+
+
+static int
+DecodeRowSSE2(UInt16 *out, const unsigned char *in, int width, UInt16 &value)
+{
+	int x = 0;
+	
+	for(; x + 16 <= width; x += 16)
+	{
+		const __m128i lo = _mm_loadu_si128((const __m128i *)(in + x));
+		const __m128i hi = _mm_loadu_si128((const __m128i *)(in + width + x));
+		
+		const __m128i v0 = RunningSum16(_mm_unpacklo_epi8(lo, hi), value);
+		const __m128i v1 = RunningSum16(_mm_unpackhi_epi8(lo, hi), _mm_extract_epi16(v0, 7));
+		
+		_mm_storeu_si128((__m128i *)(out + x), v0);
+		_mm_storeu_si128((__m128i *)(out + x + 8), v1);
+		
+		value = out[x + 15];
+	}
+	
+	return x;
+}
+
+
+static inline __m128i
+RunningSum32(__m128i v, __m128i carry)
+{
+	v = _mm_add_epi32(v, _mm_slli_si128(v, 4));
+	v = _mm_add_epi32(v, _mm_slli_si128(v, 8));
+	
+	return _mm_add_epi32(v, carry);
+}
+
+
+static int
+DecodeRowSSE2(UInt32 *out, const unsigned char *in, int width, UInt32 &value)
+{
+	int x = 0;
+	
+	for(; x + 16 <= width; x += 16)
+	{
+		const __m128i b0 = _mm_loadu_si128((const __m128i *)(in + x));
+		const __m128i b1 = _mm_loadu_si128((const __m128i *)(in + width + x));
+		const __m128i b2 = _mm_loadu_si128((const __m128i *)(in + (2 * width) + x));
+		const __m128i b3 = _mm_loadu_si128((const __m128i *)(in + (3 * width) + x));
+		
+		const __m128i lo01 = _mm_unpacklo_epi8(b0, b1);
+		const __m128i hi01 = _mm_unpackhi_epi8(b0, b1);
+		const __m128i lo23 = _mm_unpacklo_epi8(b2, b3);
+		const __m128i hi23 = _mm_unpackhi_epi8(b2, b3);
+		
+		const __m128i v0 = RunningSum32(_mm_unpacklo_epi16(lo01, lo23), _mm_set1_epi32(value));
+		const __m128i v1 = RunningSum32(_mm_unpackhi_epi16(lo01, lo23), _mm_shuffle_epi32(v0, 0xff));
+		const __m128i v2 = RunningSum32(_mm_unpacklo_epi16(hi01, hi23), _mm_shuffle_epi32(v1, 0xff));
+		const __m128i v3 = RunningSum32(_mm_unpackhi_epi16(hi01, hi23), _mm_shuffle_epi32(v2, 0xff));
+		
+		_mm_storeu_si128((__m128i *)(out + x), v0);
+		_mm_storeu_si128((__m128i *)(out + x + 4), v1);
+		_mm_storeu_si128((__m128i *)(out + x + 8), v2);
+		_mm_storeu_si128((__m128i *)(out + x + 12), v3);
+		
+		value = out[x + 15];
+	}
+	
+	return x;
+}
+#endif // MOXFILES_SSE2
+
+
+template <typename T>
+static void
+EncodeRow(unsigned char *out, const char *in, ptrdiff_t xStride, int width)
+{
+	T prev = 0;
+	
+	int x = 0;
+	
+#ifdef MOXFILES_SSE2
+	if(xStride == sizeof(T) && ((size_t)in % sizeof(T)) == 0)
+		x = EncodeRowSSE2(out, (const T *)in, width, prev);
+#endif
+	
+	for(; x < width; x++)
+	{
+		T value;
+		
+		memcpy(&value, in + (x * xStride), sizeof(T));
+		
+		const T delta = (T)(value - prev);
+		
+		prev = value;
+		
+		for(int b = 0; b < sizeof(T); b++)
+			out[(b * width) + x] = ((delta >> (8 * b)) & 0xff);
+	}
+}
+
+
+template <typename T>
+static void
+DecodeRow(char *out, ptrdiff_t xStride, const unsigned char *in, int width)
+{
+	T value = 0;
+	
+	int x = 0;
+	
+#ifdef MOXFILES_SSE2
+	if(xStride == sizeof(T) && ((size_t)out % sizeof(T)) == 0)
+		x = DecodeRowSSE2((T *)out, in, width, value);
+#endif
+	
+	for(; x < width; x++)
+	{
+		T delta = 0;
+		
+		for(int b = 0; b < sizeof(T); b++)
+			delta |= ((T)in[(b * width) + x] << (8 * b));
+		
+		value += delta;
+		
+		memcpy(out + (x * xStride), &value, sizeof(T));
+	}
+}
+
+
+static size_t
+StripeRawSize(const std::vector<PlanarPlane> &planes, int width, int rows)
+{
+	size_t size = 0;
+	
+	for(int i = 0; i < planes.size(); i++)
+		size += PixelSize(planes[i].type) * width * rows;
+	
+	return size;
+}
+
+
+struct PlanarStripe
+{
+	int firstRow;
+	int rows;
+	
+	DataChunkPtr data;
+	const unsigned char *buf; // for reading, in the frame's DataChunk
+	size_t size;
+	bool stored;
+	
+	bool success;
+	
+	PlanarStripe(int f = 0, int r = 0) : firstRow(f), rows(r), buf(NULL), size(0), stored(false), success(false) {}
+};
+
+
+class PlanarEncodeTask : public Task
+{
+  public:
+	PlanarEncodeTask(TaskGroup *group, PlanarStripe &stripe, const std::vector<PlanarPlane> &planes, int width,
+						PlanarCodec::Compressor compressor, int level, ZSTD_CCtx *cctx);
+	~PlanarEncodeTask() {}
+	
+	virtual void execute();
+
+  private:
+	PlanarStripe &_stripe;
+	const std::vector<PlanarPlane> &_planes;
+	const int _width;
+	const PlanarCodec::Compressor _compressor;
+	const int _level;
+	ZSTD_CCtx * const _cctx;
+};
+
+
+PlanarEncodeTask::PlanarEncodeTask(TaskGroup *group, PlanarStripe &stripe, const std::vector<PlanarPlane> &planes, int width,
+									PlanarCodec::Compressor compressor, int level, ZSTD_CCtx *cctx) :
+	Task(group),
+	_stripe(stripe),
+	_planes(planes),
+	_width(width),
+	_compressor(compressor),
+	_level(level),
+	_cctx(cctx)
+{
+
+}
+
+
+void
+PlanarEncodeTask::execute()
+{
+	const size_t raw_size = StripeRawSize(_planes, _width, _stripe.rows);
+	
+	DataChunkPtr raw = new PooledDataChunk(raw_size);
+	
+	unsigned char *out = raw->Data;
+	
+	for(int i = 0; i < _planes.size(); i++)
+	{
+		const PlanarPlane &plane = _planes[i];
+		
+		const size_t sample_size = PixelSize(plane.type);
+		
+		for(int y = _stripe.firstRow; y < (_stripe.firstRow + _stripe.rows); y++)
+		{
+			const char *in = plane.origin + (y * plane.yStride);
+			
+			if(sample_size == 4)
+				EncodeRow<UInt32>(out, in, plane.xStride, _width);
+			else if(sample_size == 2)
+				EncodeRow<UInt16>(out, in, plane.xStride, _width);
+			else
+				EncodeRow<UInt8>(out, in, plane.xStride, _width);
+			
+			out += (sample_size * _width);
+		}
+	}
+	
+	assert(out == raw->Data + raw_size);
+	
+	
+	size_t compressed_size = 0;
+	
+	DataChunkPtr compressed;
+	
+	if(_compressor == PlanarCodec::CompressorZstd)
+	{
+		const size_t bound = ZSTD_compressBound(raw_size);
+		
+		compressed = new PooledDataChunk(bound);
+		
+		const size_t result = ZSTD_compressCCtx(_cctx, compressed->Data, bound, raw->Data, raw_size, _level);
+		
+		if( ZSTD_isError(result) )
+			return;
+		
+		compressed_size = result;
+	}
+#ifdef MOXFILES_USE_LZ4
+	else if(_compressor == PlanarCodec::CompressorLZ4)
+	{
+		const int bound = LZ4_compressBound(raw_size);
+		
+		compressed = new PooledDataChunk(bound);
+		
+		const int result = LZ4_compress_default((const char *)raw->Data, (char *)compressed->Data, raw_size, bound);
+		
+		if(result <= 0)
+			return;
+		
+		compressed_size = result;
+	}
+#endif
+	else
+		return;
+	
+	// noise doesn't compress, and reading it as is is faster anyway
+	if(compressed_size < raw_size)
+	{
+		compressed->Size = compressed_size;
+		
+		_stripe.data = compressed;
+		_stripe.stored = false;
+	}
+	else
+	{
+		_stripe.data = raw;
+		_stripe.stored = true;
+	}
+	
+	_stripe.size = _stripe.data->Size;
+	
+	_stripe.success = true;
+}
+
+
+class PlanarDecodeTask : public Task
+{
+  public:
+	PlanarDecodeTask(TaskGroup *group, PlanarStripe &stripe, const std::vector<PlanarPlane> &planes, int width,
+						int firstRow, int lastRow, PlanarCodec::Compressor compressor, ZSTD_DCtx *dctx);
+	~PlanarDecodeTask() {}
+	
+	virtual void execute();
+
+  private:
+	PlanarStripe &_stripe;
+	const std::vector<PlanarPlane> &_planes;
+	const int _width;
+	const int _firstRow;
+	const int _lastRow;
+	const PlanarCodec::Compressor _compressor;
+	ZSTD_DCtx * const _dctx;
+};
+
+
+PlanarDecodeTask::PlanarDecodeTask(TaskGroup *group, PlanarStripe &stripe, const std::vector<PlanarPlane> &planes, int width,
+									int firstRow, int lastRow, PlanarCodec::Compressor compressor, ZSTD_DCtx *dctx) :
+	Task(group),
+	_stripe(stripe),
+	_planes(planes),
+	_width(width),
+	_firstRow(firstRow),
+	_lastRow(lastRow),
+	_compressor(compressor),
+	_dctx(dctx)
+{
+
+}
+
+
+void
+PlanarDecodeTask::execute()
+{
+	const size_t raw_size = StripeRawSize(_planes, _width, _stripe.rows);
+	
+	const unsigned char *in = _stripe.buf;
+	
+	DataChunkPtr raw;
+	
+	if(_stripe.stored)
+	{
+		if(_stripe.size != raw_size)
+			return;
+	}
+	else if(_compressor == PlanarCodec::CompressorZstd)
+	{
+		raw = new PooledDataChunk(raw_size);
+		
+		const size_t result = ZSTD_decompressDCtx(_dctx, raw->Data, raw_size, _stripe.buf, _stripe.size);
+		
+		if(ZSTD_isError(result) || result != raw_size)
+			return;
+		
+		in = raw->Data;
+	}
+#ifdef MOXFILES_USE_LZ4
+	else if(_compressor == PlanarCodec::CompressorLZ4)
+	{
+		raw = new PooledDataChunk(raw_size);
+		
+		const int result = LZ4_decompress_safe((const char *)_stripe.buf, (char *)raw->Data, _stripe.size, raw_size);
+		
+		if(result < 0 || result != raw_size)
+			return;
+		
+		in = raw->Data;
+	}
+#endif
+	else
+		return;
+	
+	
+	for(int i = 0; i < _planes.size(); i++)
+	{
+		const PlanarPlane &plane = _planes[i];
+		
+		const size_t sample_size = PixelSize(plane.type);
+		
+		for(int y = _stripe.firstRow; y < (_stripe.firstRow + _stripe.rows); y++)
+		{
+			if(plane.origin != NULL && y >= _firstRow && y <= _lastRow)
+			{
+				char *out = plane.origin + (y * plane.yStride);
+				
+				if(sample_size == 4)
+					DecodeRow<UInt32>(out, plane.xStride, in, _width);
+				else if(sample_size == 2)
+					DecodeRow<UInt16>(out, plane.xStride, in, _width);
+				else
+					DecodeRow<UInt8>(out, plane.xStride, in, _width);
+			}
+			
+			in += (sample_size * _width);
+		}
+	}
+	
+	_stripe.success = true;
+}
+
+} // namespace
+
+
+void
+PlanarCodec::compress(const FrameBuffer &frame)
+{
+	const Box2i dataW = dataWindow();
+	
+	const int width = (dataW.max.x - dataW.min.x + 1);
+	const int height = (dataW.max.y - dataW.min.y + 1);
+	
+	// the caller's slices can be read as they are if they're our types
+	bool input_matches = (frame.dataWindow() == dataW);
+	
+	for(int i = 0; i < _planes.size() && input_matches; i++)
+	{
+		const Slice *slice = frame.findSlice(_planes[i].name);
+		
+		if(slice == NULL || slice->type != _planes[i].type || slice->xSampling != 1 || slice->ySampling != 1)
+			input_matches = false;
+	}
+	
+	
+	std::vector<PlanarPlane> planes;
+	
+	FrameBuffer staged_frame(dataW);
+	
+	for(int i = 0; i < _planes.size(); i++)
+	{
+		const PixelType type = _planes[i].type;
+		
+		if(input_matches)
+		{
+			const Slice &slice = frame[_planes[i].name];
+			
+			char *origin = slice.base + (dataW.min.x * slice.xStride) + (dataW.min.y * slice.yStride);
+			
+			planes.push_back(PlanarPlane(type, origin, slice.xStride, slice.yStride));
+		}
+		else
+		{
+			const size_t sample_size = PixelSize(type);
+			const size_t rowbytes = sample_size * width;
+			
+			char *origin = stagingBuffer(rowbytes * height, i);
+			
+			staged_frame.insert(_planes[i].name, Slice(type, origin - (dataW.min.x * sample_size) - (dataW.min.y * rowbytes), sample_size, rowbytes));
+			
+			planes.push_back(PlanarPlane(type, origin, sample_size, rowbytes));
+		}
+	}
+	
+	if(!input_matches)
+		staged_frame.copyFromFrame(frame);
+	
+	
+	// Stripes are sized by bytes, not threads, so files written on a small
+	// machine still decode in parallel on a big one.
+	const size_t pixel_size = StripeRawSize(planes, 1, 1);
+	
+	const int rows_per_stripe = std::max<int>(1, std::min<size_t>(height, PlanarStripeSize / (pixel_size * width)));
+	
+	std::vector<PlanarStripe> stripes;
+	
+	for(int y = 0; y < height; y += rows_per_stripe)
+		stripes.push_back(PlanarStripe(y, std::min(rows_per_stripe, height - y)));
+	
+	if(_compressor == CompressorZstd)
+	{
+		while(_compressors.size() < stripes.size())
+		{
+			ZSTD_CCtx *cctx = ZSTD_createCCtx();
+			
+			if(cctx == NULL)
+				throw MoxMxf::NullExc("Error creating zstd context");
+			
+			_compressors.push_back(cctx);
+		}
+	}
+	
+	const bool threaded = (threadCount() != 0 && stripes.size() > 1);
+	
+	{
+		TaskGroup taskGroup;
+		
+		for(int i = 0; i < stripes.size(); i++)
+		{
+			ZSTD_CCtx *cctx = (_compressor == CompressorZstd ? _compressors[i] : NULL);
+			
+			runTask(new PlanarEncodeTask(&taskGroup, stripes[i], planes, width, _compressor, _compressionLevel, cctx), threaded);
+		}
+	}
+	
+	size_t data_size = PlanarHeaderSize + (4 * stripes.size());
+	
+	for(int i = 0; i < stripes.size(); i++)
+	{
+		if(!stripes[i].success)
+			throw MoxMxf::IoExc("Problem compressing planar stripe");
+		
+		data_size += stripes[i].size;
+	}
+	
+	
+	DataChunkPtr data = new PooledDataChunk(data_size);
+	
+	unsigned char *p = data->Data;
+	
+	memcpy(p, PlanarMagic, 4);
+	
+	p[4] = PlanarVersion;
+	p[5] = _compressor;
+	
+	PutUInt16(p + 6, _planes.size());
+	PutUInt32(p + 8, width);
+	PutUInt32(p + 12, height);
+	PutUInt32(p + 16, rows_per_stripe);
+	PutUInt32(p + 20, stripes.size());
+	
+	p += PlanarHeaderSize;
+	
+	for(int i = 0; i < stripes.size(); i++)
+	{
+		PutUInt32(p, stripes[i].size | (stripes[i].stored ? StoredStripe : 0));
+		
+		p += 4;
+	}
+	
+	for(int i = 0; i < stripes.size(); i++)
+	{
+		memcpy(p, stripes[i].data->Data, stripes[i].size);
+		
+		p += stripes[i].size;
+	}
+	
+	assert(p == data->Data + data_size);
+	
+	storeData(data);
+}
+
+
+// Decodes rows firstRow to lastRow (counting from the top of the data window)
+// of the channels frameBuffer has, which have to be our types.
+void
+PlanarCodec::decodeRows(const DataChunk &data, FrameBuffer &frameBuffer, int firstRow, int lastRow)
+{
+	const Box2i dataW = dataWindow();
+	
+	const int width = (dataW.max.x - dataW.min.x + 1);
+	const int height = (dataW.max.y - dataW.min.y + 1);
+	
+	const unsigned char *p = data.Data;
+	
+	if(data.Size < PlanarHeaderSize || memcmp(p, PlanarMagic, 4) != 0 || p[4] != PlanarVersion)
+		throw MoxMxf::InputExc("Not a planar frame");
+	
+	const Compressor compressor = (Compressor)p[5];
+	
+	const UInt16 channel_count = GetUInt16(p + 6);
+	const UInt32 frame_width = GetUInt32(p + 8);
+	const UInt32 frame_height = GetUInt32(p + 12);
+	const UInt32 rows_per_stripe = GetUInt32(p + 16);
+	const UInt32 stripe_count = GetUInt32(p + 20);
+	
+	if(channel_count != _planes.size() || frame_width != width || frame_height != height ||
+		rows_per_stripe == 0 || stripe_count != ((height + rows_per_stripe - 1) / rows_per_stripe) ||
+		data.Size < PlanarHeaderSize + (4 * (size_t)stripe_count))
+	{
+		throw MoxMxf::InputExc("Planar frame doesn't match the descriptor");
+	}
+
+#ifdef MOXFILES_USE_LZ4
+	if(compressor != CompressorZstd && compressor != CompressorLZ4)
+#else
+	if(compressor != CompressorZstd)
+#endif
+		throw MoxMxf::NoImplExc("Unknown planar compressor");
+	
+	
+	std::vector<PlanarStripe> stripes;
+	
+	const unsigned char *stripe_sizes = p + PlanarHeaderSize;
+	const unsigned char *buf = stripe_sizes + (4 * stripe_count);
+	
+	for(int i = 0; i < stripe_count; i++)
+	{
+		const UInt32 stored_size = GetUInt32(stripe_sizes + (4 * i));
+		
+		PlanarStripe stripe(i * rows_per_stripe, std::min<int>(rows_per_stripe, height - (i * rows_per_stripe)));
+		
+		stripe.buf = buf;
+		stripe.size = (stored_size & ~StoredStripe);
+		stripe.stored = !!(stored_size & StoredStripe);
+		
+		if(stripe.size > (size_t)((data.Data + data.Size) - buf))
+			throw MoxMxf::InputExc("Planar frame is cut short");
+		
+		buf += stripe.size;
+		
+		stripes.push_back(stripe);
+	}
+	
+	
+	std::vector<PlanarPlane> planes;
+	
+	for(int i = 0; i < _planes.size(); i++)
+	{
+		const Slice *slice = frameBuffer.findSlice(_planes[i].name);
+		
+		if(slice != NULL)
+		{
+			assert(slice->type == _planes[i].type && slice->xSampling == 1 && slice->ySampling == 1);
+			
+			char *origin = slice->base + (dataW.min.x * slice->xStride) + (dataW.min.y * slice->yStride);
+			
+			planes.push_back(PlanarPlane(_planes[i].type, origin, slice->xStride, slice->yStride));
+		}
+		else
+			planes.push_back(PlanarPlane(_planes[i].type));
+	}
+	
+	if(compressor == CompressorZstd)
+	{
+		while(_decompressors.size() < stripes.size())
+		{
+			ZSTD_DCtx *dctx = ZSTD_createDCtx();
+			
+			if(dctx == NULL)
+				throw MoxMxf::NullExc("Error creating zstd context");
+			
+			_decompressors.push_back(dctx);
+		}
+	}
+	
+	// only the stripes holding the rows we want
+	const int first_stripe = (firstRow / rows_per_stripe);
+	const int last_stripe = (lastRow / rows_per_stripe);
+	
+	const bool threaded = (threadCount() != 0 && last_stripe > first_stripe);
+	
+	{
+		TaskGroup taskGroup;
+		
+		for(int i = first_stripe; i <= last_stripe; i++)
+		{
+			ZSTD_DCtx *dctx = (compressor == CompressorZstd ? _decompressors[i] : NULL);
+			
+			runTask(new PlanarDecodeTask(&taskGroup, stripes[i], planes, width, firstRow, lastRow, compressor, dctx), threaded);
+		}
+	}
+	
+	for(int i = first_stripe; i <= last_stripe; i++)
+	{
+		if(!stripes[i].success)
+			throw MoxMxf::InputExc("Problem decompressing planar stripe");
+	}
+}
+
+
+void
+PlanarCodec::decompress(const DataChunk &data)
+{
+	const Box2i dataW = dataWindow();
+	
+	const int width = (dataW.max.x - dataW.min.x + 1);
+	const int height = (dataW.max.y - dataW.min.y + 1);
+	
+	FrameBufferPtr frameBuffer = new FrameBuffer(dataW);
+	
+	for(int i = 0; i < _planes.size(); i++)
+	{
+		const PixelType type = _planes[i].type;
+		
+		const size_t sample_size = PixelSize(type);
+		const size_t rowbytes = sample_size * width;
+		
+		DataChunkPtr chan_buffer = new PooledDataChunk(rowbytes * height);
+		
+		frameBuffer->attachData(chan_buffer);
+		
+		char *origin = (char *)chan_buffer->Data - (dataW.min.x * sample_size) - (dataW.min.y * rowbytes);
+		
+		frameBuffer->insert(_planes[i].name, Slice(type, origin, sample_size, rowbytes));
+	}
+	
+	decodeRows(data, *frameBuffer, 0, height - 1);
+	
+	storeFrame(frameBuffer);
+}
+
+
+bool
+PlanarCodec::decompressInto(const DataChunk &data, FrameBuffer &frameBuffer)
+{
+	if(frameBuffer.dataWindow() != dataWindow())
+		return VideoCodec::decompressInto(data, frameBuffer);
+	
+	return decompressRegion(data, frameBuffer, dataWindow());
+}
+
+
+bool
+PlanarCodec::decompressRegion(const DataChunk &data, FrameBuffer &frameBuffer, const Box2i &region)
+{
+	const Box2i dataW = dataWindow();
+	
+	// We write whole rows, so the caller's memory can only be used if the region
+	// goes all the way across and every slice is one of our channels as is.
+	bool direct = (region.min.x == dataW.min.x && region.max.x == dataW.max.x);
+	
+	for(FrameBuffer::ConstIterator i = frameBuffer.begin(); i != frameBuffer.end() && direct; ++i)
+	{
+		const Slice &slice = i.slice();
+		
+		bool found = false;
+		
+		for(int p = 0; p < _planes.size() && !found; p++)
+		{
+			if(_planes[p].name == i.name() && _planes[p].type == slice.type && slice.xSampling == 1 && slice.ySampling == 1)
+				found = true;
+		}
+		
+		if(!found)
+			direct = false;
+	}
+	
+	const int firstRow = (region.min.y - dataW.min.y);
+	const int lastRow = (region.max.y - dataW.min.y);
+	
+	if(direct)
+	{
+		decodeRows(data, frameBuffer, firstRow, lastRow);
+		
+		return true;
+	}
+	
+	
+	// otherwise decode the band of rows and the channels we need into our own
+	// buffers, then copy the region out
+	const Box2i band(V2i(dataW.min.x, region.min.y), V2i(dataW.max.x, region.max.y));
+	
+	const int width = (band.max.x - band.min.x + 1);
+	const int height = (band.max.y - band.min.y + 1);
+	
+	FrameBuffer band_frameBuffer(band);
+	
+	for(int i = 0; i < _planes.size(); i++)
+	{
+		if( !channelWanted(frameBuffer, _planes[i].name) )
+			continue;
+		
+		const PixelType type = _planes[i].type;
+		
+		const size_t sample_size = PixelSize(type);
+		const size_t rowbytes = sample_size * width;
+		
+		DataChunkPtr chan_buffer = new PooledDataChunk(rowbytes * height);
+		
+		band_frameBuffer.attachData(chan_buffer);
+		
+		char *origin = (char *)chan_buffer->Data - (band.min.x * sample_size) - (band.min.y * rowbytes);
+		
+		band_frameBuffer.insert(_planes[i].name, Slice(type, origin, sample_size, rowbytes));
+	}
+	
+	decodeRows(data, band_frameBuffer, firstRow, lastRow);
+	
+	FrameBuffer region_view(frameBuffer, region);
+	
+	region_view.copyFromFrame(band_frameBuffer);
+	
+	return true;
+}
+
+
+bool
+PlanarCodecInfo::canCompressType(PixelType pixelType) const
+{
+	return (pixelType != MoxFiles::UINT16A);
+}
+
+
+ChannelCapabilities
+PlanarCodecInfo::getChannelCapabilites() const
+{
+	return Channels_All;
+}
+
+
+VideoCodec *
+PlanarCodecInfo::createCodec(const Header &header, const ChannelList &channels) const
+{
+	return new PlanarCodec(header, channels);
+}
+
+
+VideoCodec *
+PlanarCodecInfo::createCodec(const MoxMxf::VideoDescriptor &descriptor, Header &header, ChannelList &channels) const
+{
+	return new PlanarCodec(descriptor, header, channels);
+}
+
+
+} // namespace
@@ -0,0 +1,101 @@
+/*
+ *  PlanarCodec.h
+ *  MoxFiles
+ *
+ *  Created by agent on 10/18/26.
+ *  Copyright 2026 fnord. All rights reserved.
+ *
+ */
+
+#ifndef MOXFILES_PLANARCODEC_H
+#define MOXFILES_PLANARCODEC_H
+
+#include <MoxFiles/Codec.h>
+
+struct ZSTD_CCtx_s;
+struct ZSTD_DCtx_s;
+
+namespace MoxFiles
+{
+	// Lossless and built for speed.  Each channel is stored as its own plane,
+	// every row run through a horizontal delta and split into byte planes, and
+	// the frame is cut into stripes that are compressed independently with zstd
+	// (or LZ4), so both ways run on the global thread pool.  Any channel names
+	// and any pixel type except UINT16A.
+	class PlanarCodec : public VideoCodec
+	{
+	  public:
+		PlanarCodec(const Header &header, const ChannelList &channels);
+		PlanarCodec(const MoxMxf::VideoDescriptor &descriptor, Header &header, ChannelList &channels);
+		virtual ~PlanarCodec();
+		
+		virtual const MoxMxf::VideoDescriptor * getDescriptor() const { return &_descriptor; }
+		
+		virtual void compress(const FrameBuffer &frame);
+		virtual bool convertsInput() const { return true; }
+		virtual void decompress(const DataChunk &data);
+		virtual bool decompressInto(const DataChunk &data, FrameBuffer &frameBuffer);
+		virtual bool decompressRegion(const DataChunk &data, FrameBuffer &frameBuffer, const Box2i &region);
+	
+	  public:
+		// Encoder settings that go in the Header.  LZ4 needs MoxFiles built
+		// with MOXFILES_USE_LZ4, for reading too.
+		enum Compressor
+		{
+			CompressorZstd = 0,	// the default
+			CompressorLZ4
+		};
+		
+		static Compressor getCompressor(const Header &header);
+		static void setCompressor(Header &header, Compressor compressor);
+		
+		// zstd's 1-19, default 1.  Higher levels get smaller slowly and decode
+		// just as fast.  LZ4 ignores it.
+		static int getCompressionLevel(const Header &header);
+		static void setCompressionLevel(Header &header, int level);
+		
+		// Whether the stripes go on the global pool, see CodecThreads in Thread.h.
+		static int threadCount();
+		static void setThreadCount(int count);
+	
+	  private:
+		MoxMxf::RGBADescriptor _descriptor;
+		
+		struct PlaneInfo
+		{
+			std::string name;
+			PixelType type;
+			
+			PlaneInfo(const std::string &n = "", PixelType t = UINT8) : name(n), type(t) {}
+		};
+		
+		std::vector<PlaneInfo> _planes;
+		
+		Compressor _compressor;
+		int _compressionLevel;
+		
+		void decodeRows(const DataChunk &data, FrameBuffer &frameBuffer, int firstRow, int lastRow);
+		
+		// kept from frame to frame, one for each stripe
+		std::vector<struct ZSTD_CCtx_s *> _compressors;
+		std::vector<struct ZSTD_DCtx_s *> _decompressors;
+	};
+	
+	
+	class PlanarCodecInfo : public VideoCodecInfo
+	{
+	  public:
+		PlanarCodecInfo() {}
+		virtual ~PlanarCodecInfo() {}
+		
+		virtual bool canCompressType(PixelType pixelType) const;
+		
+		virtual ChannelCapabilities getChannelCapabilites() const;
+		
+		virtual VideoCodec * createCodec(const Header &header, const ChannelList &channels) const;
+		virtual VideoCodec * createCodec(const MoxMxf::VideoDescriptor &descriptor, Header &header, ChannelList &channels) const;
+	};
+
+} // namespace
+
+#endif // MOXFILES_PLANARCODEC_H
@@ -0,0 +1,26 @@
+/*
+ *  SIMD.h
+ *  MoxFiles
+ *
+ *  Created by agent on 10/18/26.
+ *  Copyright 2026 fnord. All rights reserved.
+ *
+ */
+
+#ifndef MOXFILES_SIMD_H
+#define MOXFILES_SIMD_H
+
+// Which vector instruction sets the pixel packing code can count on.
+// Anything we use must also have a plain C++ version for everybody else.
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MOXFILES_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(MOXFILES_SSE2) && defined(__SSSE3__)
+#define MOXFILES_SSSE3 1
+#include <tmmintrin.h>
+#endif
+
+#endif // MOXFILES_SIMD_H
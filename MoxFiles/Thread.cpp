@@ -9,3 +9,61 @@
 
 #include <MoxFiles/Thread.h>
 
+#include <MoxMxf/Exception.h>
+
+#include <string>
+
+
+namespace MoxFiles
+{
+
+static int gCodecThreadCount = -1;
+
+
+int
+codecThreadCount()
+{
+	return (gCodecThreadCount >= 0 ? gCodecThreadCount : ThreadPool::globalThreadPool().numThreads());
+}
+
+
+void
+setCodecThreadCount(int count)
+{
+	gCodecThreadCount = count;
+}
+
+
+int
+CodecThreads::count() const
+{
+	return (_count >= 0 ? _count : codecThreadCount());
+}
+
+
+void
+CodecThreads::setCount(int count)
+{
+	if(count < -1)
+		throw MoxMxf::ArgExc(std::string("Invalid ") + _name + " thread count");
+	
+	_count = count;
+}
+
+
+void
+runTask(Task *task, bool threaded)
+{
+	if(threaded)
+	{
+		ThreadPool::addGlobalTask(task);
+	}
+	else
+	{
+		task->execute();
+		
+		delete task;
+	}
+}
+
+} // namespace
@@ -26,6 +26,35 @@ namespace MoxFiles
 	
 	using IlmThread::supportsThreads;
 	using Imf::setGlobalThreadCount;
+	
+	// Threads for libraries that bring their own pool (OpenJPEG and the like).
+	// Normally the same as the global pool, but a program that's already decoding
+	// several frames at once on its own threads should set this to 0 so the
+	// two kinds of parallelism don't pile on top of each other.  -1 goes back
+	// to following the global pool.
+	int codecThreadCount();
+	void setCodecThreadCount(int count);
+	
+	// The thread count setting behind each codec's threadCount() and
+	// setThreadCount().  -1 (the default) follows codecThreadCount(), 0 keeps
+	// the codec's work on the calling thread, anything else is up to the codec:
+	// a count for its library's own threads, or permission to use the global pool.
+	class CodecThreads
+	{
+	  public:
+		CodecThreads(const char *codecName) : _name(codecName), _count(-1) {}
+		
+		int count() const;
+		void setCount(int count);
+		
+	  private:
+		const char * const _name;
+		int _count;
+	};
+	
+	// Put a task on the global pool, or run it (and delete it) right now
+	// when not threaded.  The TaskGroup waits for both the same way.
+	void runTask(Task *task, bool threaded);
 
 } // namespace
 
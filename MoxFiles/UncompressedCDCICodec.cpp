@@ -0,0 +1,881 @@
+/*
+ *  UncompressedCDCICodec.cpp
+ *  MoxFiles
+ *
+ *  Created by agent on 10/18/26.
+ *  Copyright 2026 fnord. All rights reserved.
+ *
+ */
+
+#include <MoxFiles/UncompressedCDCICodec.h>
+
+#include <MoxFiles/Thread.h>
+#include <MoxFiles/SIMD.h>
+
+#include <vector>
+
+#include <assert.h>
+#include <string.h>
+
+namespace MoxFiles
+{
+
+// v210 puts six 4:2:2 pixels in each 16-byte block, as four
+// little-endian words holding three 10-bit samples apiece:
+//
+//   word 0:  Cb0  Y0   Cr0
+//   word 1:  Y1   Cb1  Y2
+//   word 2:  Cr1  Y3   Cb2
+//   word 3:  Y4   Cr2  Y5
+//
+// Rows are padded out to a multiple of 48 pixels (128 bytes).
+//
+// UYVY is the 8-bit version, one byte per sample: Cb0 Y0 Cr0 Y1
+
+static inline void
+WriteLE32(UInt8 *out, UInt32 val)
+{
+	out[0] = (val >> 0) & 0xff;
+	out[1] = (val >> 8) & 0xff;
+	out[2] = (val >> 16) & 0xff;
+	out[3] = (val >> 24) & 0xff;
+}
+
+static inline UInt32
+ReadLE32(const UInt8 *in)
+{
+	return (in[0] << 0) | (in[1] << 8) | (in[2] << 16) | ((UInt32)in[3] << 24);
+}
+
+static inline UInt32
+V210Word(unsigned int a, unsigned int b, unsigned int c)
+{
+	return ((a & 0x3ff) << 0) | ((b & 0x3ff) << 10) | ((c & 0x3ff) << 20);
+}
+
+static inline void
+PackV210Block(UInt8 *out, const UInt16 *y, const UInt16 *cb, const UInt16 *cr)
+{
+	WriteLE32(out +  0, V210Word(cb[0], y[0], cr[0]));
+	WriteLE32(out +  4, V210Word(y[1], cb[1], y[2]));
+	WriteLE32(out +  8, V210Word(cr[1], y[3], cb[2]));
+	WriteLE32(out + 12, V210Word(y[4], cr[2], y[5]));
+}
+
+static inline void
+UnpackV210Block(UInt16 *y, UInt16 *cb, UInt16 *cr, const UInt8 *in)
+{
+	const UInt32 w0 = ReadLE32(in +  0);
+	const UInt32 w1 = ReadLE32(in +  4);
+	const UInt32 w2 = ReadLE32(in +  8);
+	const UInt32 w3 = ReadLE32(in + 12);
+
+	cb[0] = (w0 >>  0) & 0x3ff;
+	y[0]  = (w0 >> 10) & 0x3ff;
+	cr[0] = (w0 >> 20) & 0x3ff;
+	y[1]  = (w1 >>  0) & 0x3ff;
+	cb[1] = (w1 >> 10) & 0x3ff;
+	y[2]  = (w1 >> 20) & 0x3ff;
+	cr[1] = (w2 >>  0) & 0x3ff;
+	y[3]  = (w2 >> 10) & 0x3ff;
+	cb[2] = (w2 >> 20) & 0x3ff;
+	y[4]  = (w3 >>  0) & 0x3ff;
+	cr[2] = (w3 >> 10) & 0x3ff;
+	y[5]  = (w3 >> 20) & 0x3ff;
+}
+
+
+// The row functions work on contiguous sample arrays.  Because the vector
+// versions move whole registers, the v210 ones need a little slack at the end:
+// y must have room for (6 * blocks) + 2 samples, cb and cr for (3 * blocks) + 1.
+
+static void
+PackV210Row(UInt8 *out, const UInt16 *y, const UInt16 *cb, const UInt16 *cr, int blocks)
+{
+	int b = 0;
+
+#ifdef MOXFILES_SSSE3
+	const __m128i mask10 = _mm_set1_epi32(0x3ff);
+
+	// gather the samples that go in the low, middle and high 10 bits of each word
+	const __m128i a_y = _mm_setr_epi8(-1, -1, -1, -1, 2, 3, -1, -1, -1, -1, -1, -1, 8, 9, -1, -1);
+	const __m128i a_c = _mm_setr_epi8(0, 1, -1, -1, -1, -1, -1, -1, 10, 11, -1, -1, -1, -1, -1, -1);
+	const __m128i b_y = _mm_setr_epi8(0, 1, -1, -1, -1, -1, -1, -1, 6, 7, -1, -1, -1, -1, -1, -1);
+	const __m128i b_c = _mm_setr_epi8(-1, -1, -1, -1, 2, 3, -1, -1, -1, -1, -1, -1, 12, 13, -1, -1);
+	const __m128i c_y = _mm_setr_epi8(-1, -1, -1, -1, 4, 5, -1, -1, -1, -1, -1, -1, 10, 11, -1, -1);
+	const __m128i c_c = _mm_setr_epi8(8, 9, -1, -1, -1, -1, -1, -1, 4, 5, -1, -1, -1, -1, -1, -1);
+
+	for(; b < blocks; b++)
+	{
+		const __m128i yv = _mm_loadu_si128((const __m128i *)(y + (6 * b)));
+		const __m128i cv = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)(cb + (3 * b))),
+												_mm_loadl_epi64((const __m128i *)(cr + (3 * b))));
+
+		const __m128i lo = _mm_and_si128(_mm_or_si128(_mm_shuffle_epi8(yv, a_y), _mm_shuffle_epi8(cv, a_c)), mask10);
+		const __m128i mid = _mm_and_si128(_mm_or_si128(_mm_shuffle_epi8(yv, b_y), _mm_shuffle_epi8(cv, b_c)), mask10);
+		const __m128i hi = _mm_and_si128(_mm_or_si128(_mm_shuffle_epi8(yv, c_y), _mm_shuffle_epi8(cv, c_c)), mask10);
+
+		const __m128i words = _mm_or_si128(lo, _mm_or_si128(_mm_slli_epi32(mid, 10), _mm_slli_epi32(hi, 20)));
+
+		_mm_storeu_si128((__m128i *)(out + (16 * b)), words);
+	}
+#endif
+
+	for(; b < blocks; b++)
+	{
+		PackV210Block(out + (16 * b), y + (6 * b), cb + (3 * b), cr + (3 * b));
+	}
+}
+
+static void
+UnpackV210Row(UInt16 *y, UInt16 *cb, UInt16 *cr, const UInt8 *in, int blocks)
+{
+	int b = 0;
+
+#ifdef MOXFILES_SSSE3
+	const __m128i mask10 = _mm_set1_epi32(0x3ff);
+
+	// ab holds 16-bit Cb0 Y1 Cr1 Y4 Y0 Cb1 Y3 Cr2, cc holds Cr0 Y2 Cb2 Y5
+	const __m128i y_ab = _mm_setr_epi8(8, 9, 2, 3, -1, -1, 12, 13, 6, 7, -1, -1, -1, -1, -1, -1);
+	const __m128i y_cc = _mm_setr_epi8(-1, -1, -1, -1, 2, 3, -1, -1, -1, -1, 6, 7, -1, -1, -1, -1);
+	const __m128i c_ab = _mm_setr_epi8(0, 1, 10, 11, -1, -1, -1, -1, -1, -1, 4, 5, 14, 15, -1, -1);
+	const __m128i c_cc = _mm_setr_epi8(-1, -1, -1, -1, 4, 5, -1, -1, 0, 1, -1, -1, -1, -1, -1, -1);
+
+	for(; b < blocks; b++)
+	{
+		const __m128i words = _mm_loadu_si128((const __m128i *)(in + (16 * b)));
+
+		const __m128i lo = _mm_and_si128(words, mask10);
+		const __m128i mid = _mm_and_si128(_mm_srli_epi32(words, 10), mask10);
+		const __m128i hi = _mm_and_si128(_mm_srli_epi32(words, 20), mask10);
+
+		const __m128i ab = _mm_packs_epi32(lo, mid);
+		const __m128i cc = _mm_packs_epi32(hi, hi);
+
+		const __m128i yv = _mm_or_si128(_mm_shuffle_epi8(ab, y_ab), _mm_shuffle_epi8(cc, y_cc));
+		const __m128i cv = _mm_or_si128(_mm_shuffle_epi8(ab, c_ab), _mm_shuffle_epi8(cc, c_cc)); // Cb0 Cb1 Cb2 - Cr0 Cr1 Cr2 -
+
+		_mm_storeu_si128((__m128i *)(y + (6 * b)), yv);
+		_mm_storel_epi64((__m128i *)(cb + (3 * b)), cv);
+		_mm_storel_epi64((__m128i *)(cr + (3 * b)), _mm_srli_si128(cv, 8));
+	}
+#endif
+
+	for(; b < blocks; b++)
+	{
+		UnpackV210Block(y + (6 * b), cb + (3 * b), cr + (3 * b), in + (16 * b));
+	}
+}
+
+
+static void
+PackUYVYRow(UInt8 *out, const UInt8 *y, const UInt8 *cb, const UInt8 *cr, int pairs)
+{
+	int p = 0;
+
+#ifdef MOXFILES_SSE2
+	for(; p + 8 <= pairs; p += 8)
+	{
+		const __m128i yv = _mm_loadu_si128((const __m128i *)(y + (2 * p)));
+		const __m128i cv = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(cb + p)),
+												_mm_loadl_epi64((const __m128i *)(cr + p)));
+
+		_mm_storeu_si128((__m128i *)(out + (4 * p)), _mm_unpacklo_epi8(cv, yv));
+		_mm_storeu_si128((__m128i *)(out + (4 * p) + 16), _mm_unpackhi_epi8(cv, yv));
+	}
+#endif
+
+	for(; p < pairs; p++)
+	{
+		out[(4 * p) + 0] = cb[p];
+		out[(4 * p) + 1] = y[(2 * p) + 0];
+		out[(4 * p) + 2] = cr[p];
+		out[(4 * p) + 3] = y[(2 * p) + 1];
+	}
+}
+
+static void
+UnpackUYVYRow(UInt8 *y, UInt8 *cb, UInt8 *cr, const UInt8 *in, int pairs)
+{
+	int p = 0;
+
+#ifdef MOXFILES_SSE2
+	const __m128i low_bytes = _mm_set1_epi16(0x00ff);
+	const __m128i low_words = _mm_set1_epi32(0x0000ffff);
+
+	for(; p + 8 <= pairs; p += 8)
+	{
+		const __m128i v0 = _mm_loadu_si128((const __m128i *)(in + (4 * p)));
+		const __m128i v1 = _mm_loadu_si128((const __m128i *)(in + (4 * p) + 16));
+
+		const __m128i yv = _mm_packus_epi16(_mm_srli_epi16(v0, 8), _mm_srli_epi16(v1, 8));
+
+		const __m128i c0 = _mm_and_si128(v0, low_bytes); // 16-bit Cb Cr Cb Cr...
+		const __m128i c1 = _mm_and_si128(v1, low_bytes);
+
+		const __m128i cbw = _mm_packs_epi32(_mm_and_si128(c0, low_words), _mm_and_si128(c1, low_words));
+		const __m128i crw = _mm_packs_epi32(_mm_srli_epi32(c0, 16), _mm_srli_epi32(c1, 16));
+
+		const __m128i cv = _mm_packus_epi16(cbw, crw);
+
+		_mm_storeu_si128((__m128i *)(y + (2 * p)), yv);
+		_mm_storel_epi64((__m128i *)(cb + p), cv);
+		_mm_storel_epi64((__m128i *)(cr + p), _mm_srli_si128(cv, 8));
+	}
+#endif
+
+	for(; p < pairs; p++)
+	{
+		cb[p] = in[(4 * p) + 0];
+		y[(2 * p) + 0] = in[(4 * p) + 1];
+		cr[p] = in[(4 * p) + 2];
+		y[(2 * p) + 1] = in[(4 * p) + 3];
+	}
+}
+
+
+// Chroma is co-sited with the even luma samples.  Going down we use a 1-2-1
+// filter centered on them, going up the odd samples are interpolated.
+
+template <typename T>
+static inline T
+CoSitedSample(const T *in, int x, int width)
+{
+	const int left = in[x > 0 ? x - 1 : x];
+	const int right = in[x + 1 < width ? x + 1 : x];
+
+	return (left + (2 * in[x]) + right + 2) >> 2;
+}
+
+template <typename T>
+static inline T
+InterpolatedSample(const T *in, int i, int n)
+{
+	const int next = in[i + 1 < n ? i + 1 : i];
+
+	return (in[i] + next + 1) >> 1;
+}
+
+
+static void
+DownsampleChroma(UInt8 *out, const UInt8 *in, int width)
+{
+	const int n = (width + 1) / 2;
+
+	int i = 0;
+
+	out[i] = CoSitedSample(in, 2 * i, width);
+	i++;
+
+#ifdef MOXFILES_SSE2
+	const __m128i low_bytes = _mm_set1_epi16(0x00ff);
+	const __m128i two = _mm_set1_epi16(2);
+
+	for(; (2 * i) + 16 <= width; i += 8)
+	{
+		const __m128i v = _mm_loadu_si128((const __m128i *)(in + (2 * i)));
+		const __m128i p = _mm_loadu_si128((const __m128i *)(in + (2 * i) - 2));
+
+		const __m128i center = _mm_and_si128(v, low_bytes);
+		const __m128i right = _mm_srli_epi16(v, 8);
+		const __m128i left = _mm_srli_epi16(p, 8);
+
+		const __m128i sum = _mm_add_epi16(_mm_add_epi16(left, right), _mm_add_epi16(_mm_slli_epi16(center, 1), two));
+		const __m128i result = _mm_srli_epi16(sum, 2);
+
+		_mm_storel_epi64((__m128i *)(out + i), _mm_packus_epi16(result, result));
+	}
+#endif
+
+	for(; i < n; i++)
+	{
+		out[i] = CoSitedSample(in, 2 * i, width);
+	}
+}
+
+static void
+DownsampleChroma(UInt16 *out, const UInt16 *in, int width)
+{
+	// vector version is good for samples up to 12 bits
+	const int n = (width + 1) / 2;
+
+	int i = 0;
+
+	out[i] = CoSitedSample(in, 2 * i, width);
+	i++;
+
+#ifdef MOXFILES_SSE2
+	const __m128i low_words = _mm_set1_epi32(0x0000ffff);
+	const __m128i two = _mm_set1_epi16(2);
+
+	for(; (2 * i) + 16 <= width; i += 8)
+	{
+		const __m128i v0 = _mm_loadu_si128((const __m128i *)(in + (2 * i)));
+		const __m128i v1 = _mm_loadu_si128((const __m128i *)(in + (2 * i) + 8));
+		const __m128i p0 = _mm_loadu_si128((const __m128i *)(in + (2 * i) - 2));
+		const __m128i p1 = _mm_loadu_si128((const __m128i *)(in + (2 * i) + 6));
+
+		const __m128i center = _mm_packs_epi32(_mm_and_si128(v0, low_words), _mm_and_si128(v1, low_words));
+		const __m128i right = _mm_packs_epi32(_mm_srli_epi32(v0, 16), _mm_srli_epi32(v1, 16));
+		const __m128i left = _mm_packs_epi32(_mm_srli_epi32(p0, 16), _mm_srli_epi32(p1, 16));
+
+		const __m128i sum = _mm_add_epi16(_mm_add_epi16(left, right), _mm_add_epi16(_mm_slli_epi16(center, 1), two));
+
+		_mm_storeu_si128((__m128i *)(out + i), _mm_srli_epi16(sum, 2));
+	}
+#endif
+
+	for(; i < n; i++)
+	{
+		out[i] = CoSitedSample(in, 2 * i, width);
+	}
+}
+
+
+static void
+UpsampleChroma(UInt8 *out, const UInt8 *in, int width)
+{
+	const int n = (width + 1) / 2;
+
+	int i = 0;
+
+#ifdef MOXFILES_SSE2
+	for(; (i + 9 <= n) && ((2 * i) + 16 <= width); i += 8)
+	{
+		const __m128i a = _mm_loadl_epi64((const __m128i *)(in + i));
+		const __m128i b = _mm_loadl_epi64((const __m128i *)(in + i + 1));
+
+		_mm_storeu_si128((__m128i *)(out + (2 * i)), _mm_unpacklo_epi8(a, _mm_avg_epu8(a, b)));
+	}
+#endif
+
+	for(int x = (2 * i); x < width; x++)
+	{
+		out[x] = (x & 1) ? InterpolatedSample(in, x / 2, n) : in[x / 2];
+	}
+}
+
+static void
+UpsampleChroma(UInt16 *out, const UInt16 *in, int width)
+{
+	const int n = (width + 1) / 2;
+
+	int i = 0;
+
+#ifdef MOXFILES_SSE2
+	for(; (i + 9 <= n) && ((2 * i) + 16 <= width); i += 8)
+	{
+		const __m128i a = _mm_loadu_si128((const __m128i *)(in + i));
+		const __m128i b = _mm_loadu_si128((const __m128i *)(in + i + 1));
+		const __m128i m = _mm_avg_epu16(a, b);
+
+		_mm_storeu_si128((__m128i *)(out + (2 * i)), _mm_unpacklo_epi16(a, m));
+		_mm_storeu_si128((__m128i *)(out + (2 * i) + 8), _mm_unpackhi_epi16(a, m));
+	}
+#endif
+
+	for(int x = (2 * i); x < width; x++)
+	{
+		out[x] = (x & 1) ? InterpolatedSample(in, x / 2, n) : in[x / 2];
+	}
+}
+
+
+template <typename T>
+static void
+LoadRow(T *out, const Slice &slice, const Box2i &dw, int y)
+{
+	const int width = (dw.max.x - dw.min.x + 1);
+
+	const char *in = slice.base + (y * slice.yStride) + (dw.min.x * slice.xStride);
+
+	if(slice.xStride == sizeof(T))
+	{
+		memcpy(out, in, width * sizeof(T));
+	}
+	else
+	{
+		for(int x = 0; x < width; x++)
+		{
+			out[x] = *(const T *)in;
+
+			in += slice.xStride;
+		}
+	}
+}
+
+template <typename T>
+static void
+StoreRow(const Slice &slice, const Box2i &dw, int y, const T *in)
+{
+	const int width = (dw.max.x - dw.min.x + 1);
+
+	char *out = slice.base + (y * slice.yStride) + (dw.min.x * slice.xStride);
+
+	if(slice.xStride == sizeof(T))
+	{
+		memcpy(out, in, width * sizeof(T));
+	}
+	else
+	{
+		for(int x = 0; x < width; x++)
+		{
+			*(T *)out = in[x];
+
+			out += slice.xStride;
+		}
+	}
+}
+
+
+static size_t
+CDCIRowBytes(int width, bool ten_bit)
+{
+	return (ten_bit ? (((width + 47) / 48) * 128) : (((width + 1) / 2) * 4));
+}
+
+
+UncompressedCDCICodec::UncompressedCDCICodec(const Header &header, const ChannelList &channels) :
+	VideoCodec(header, channels),
+	_descriptor(header.frameRate(), header.width(), header.height(), MoxMxf::VideoDescriptor::VideoCodecUncompressedCDCI)
+{
+	setWindows(_descriptor, header);
+
+	const Channel *y_channel = channels.findChannel("Y");
+	const Channel *r_channel = channels.findChannel("R");
+
+	const Channel *channel = (y_channel != NULL ? y_channel : r_channel);
+
+	if(channel == NULL)
+		throw MoxMxf::ArgExc("Expected Y'CbCr or RGB channels");
+
+	_depth = (PixelBits(channel->type) > 8 ? CDCI_10 : CDCI_8);
+
+	_coefficients = (header.height() > 576 ? FrameBuffer::Rec709 : FrameBuffer::Rec601);
+
+
+	_descriptor.setComponentDepth(_depth == CDCI_10 ? 10 : 8);
+	_descriptor.setHorizontalSubsampling(2);
+	_descriptor.setVerticalSubsampling(1);
+	_descriptor.setColorSiting(MoxMxf::CDCIDescriptor::ColorSiting_CoSiting);
+
+	if(_depth == CDCI_10)
+	{
+		_descriptor.setBlackRefLevel(64);
+		_descriptor.setWhiteRefLevel(940);
+		_descriptor.setColorRange(897);
+	}
+	else
+	{
+		_descriptor.setBlackRefLevel(16);
+		_descriptor.setWhiteRefLevel(235);
+		_descriptor.setColorRange(225);
+	}
+}
+
+
+UncompressedCDCICodec::UncompressedCDCICodec(const MoxMxf::VideoDescriptor &descriptor, Header &header, ChannelList &channels) :
+	VideoCodec(descriptor, header, channels),
+	_descriptor(dynamic_cast<const MoxMxf::CDCIDescriptor &>(descriptor)),
+	_depth(CDCI_8)
+{
+	assert(_descriptor.getVideoCodec() == MoxMxf::VideoDescriptor::VideoCodecUncompressedCDCI);
+
+	if(_descriptor.getComponentDepth() == 8)
+		_depth = CDCI_8;
+	else if(_descriptor.getComponentDepth() == 10)
+		_depth = CDCI_10;
+	else
+		throw MoxMxf::InputExc("Unexpected bit depth");
+
+	if(_descriptor.getHorizontalSubsampling() != 2 || _descriptor.getVerticalSubsampling() != 1)
+		throw MoxMxf::NoImplExc("Only handling 4:2:2");
+
+	const bool full_range = (_descriptor.getBlackRefLevel() == 0);
+
+	if(_descriptor.getStoredHeight() > 576)
+		_coefficients = (full_range ? FrameBuffer::Rec709_FullRange : FrameBuffer::Rec709);
+	else
+		_coefficients = (full_range ? FrameBuffer::Rec601_FullRange : FrameBuffer::Rec601);
+
+
+	const PixelType pixel_type = (_depth == CDCI_10 ? UINT10 : UINT8);
+
+	channels.insert("Y", Channel(pixel_type));
+	channels.insert("Cb", Channel(pixel_type));
+	channels.insert("Cr", Channel(pixel_type));
+}
+
+
+UncompressedCDCICodec::~UncompressedCDCICodec()
+{
+
+}
+
+
+size_t
+UncompressedCDCICodec::rowBytes() const
+{
+	return CDCIRowBytes(_descriptor.getStoredWidth(), (_depth == CDCI_10));
+}
+
+
+class CompressCDCIRow : public Task
+{
+  public:
+	CompressCDCIRow(TaskGroup *group, char *row, size_t rowbytes, const FrameBuffer &frame, bool ten_bit, int y);
+	virtual ~CompressCDCIRow() {}
+
+	virtual void execute();
+
+  private:
+	char * const _row;
+	const size_t _rowbytes;
+	const FrameBuffer &_frame;
+	const bool _ten_bit;
+	const int _y;
+};
+
+CompressCDCIRow::CompressCDCIRow(TaskGroup *group, char *row, size_t rowbytes, const FrameBuffer &frame, bool ten_bit, int y) :
+	Task(group),
+	_row(row),
+	_rowbytes(rowbytes),
+	_frame(frame),
+	_ten_bit(ten_bit),
+	_y(y)
+{
+
+}
+
+void
+CompressCDCIRow::execute()
+{
+	const Box2i &dw = _frame.dataWindow();
+	const int width = (dw.max.x - dw.min.x + 1);
+
+	const Slice &y_slice = _frame["Y"];
+	const Slice &cb_slice = _frame["Cb"];
+	const Slice &cr_slice = _frame["Cr"];
+
+	UInt8 *out = (UInt8 *)_row;
+
+	if(_ten_bit)
+	{
+		const int blocks = (width + 5) / 6;
+		const int luma_len = (6 * blocks) + 8;
+		const int chroma_len = (3 * blocks) + 8;
+
+		std::vector<UInt16> buf((3 * luma_len) + (2 * chroma_len));
+
+		UInt16 *y = &buf[0];
+		UInt16 *cb_full = y + luma_len;
+		UInt16 *cr_full = cb_full + luma_len;
+		UInt16 *cb = cr_full + luma_len;
+		UInt16 *cr = cb + chroma_len;
+
+		LoadRow(y, y_slice, dw, _y);
+		LoadRow(cb_full, cb_slice, dw, _y);
+		LoadRow(cr_full, cr_slice, dw, _y);
+
+		DownsampleChroma(cb, cb_full, width);
+		DownsampleChroma(cr, cr_full, width);
+
+		// repeat the last pixel into the partial block
+		for(int x = width; x < (6 * blocks); x++)
+			y[x] = y[width - 1];
+
+		for(int i = (width + 1) / 2; i < (3 * blocks); i++)
+		{
+			cb[i] = cb[i - 1];
+			cr[i] = cr[i - 1];
+		}
+
+		PackV210Row(out, y, cb, cr, blocks);
+
+		memset(out + (16 * blocks), 0, _rowbytes - (16 * blocks));
+	}
+	else
+	{
+		const int pairs = (width + 1) / 2;
+
+		std::vector<UInt8> buf((3 * 2 * pairs) + (2 * pairs));
+
+		UInt8 *y = &buf[0];
+		UInt8 *cb_full = y + (2 * pairs);
+		UInt8 *cr_full = cb_full + (2 * pairs);
+		UInt8 *cb = cr_full + (2 * pairs);
+		UInt8 *cr = cb + pairs;
+
+		LoadRow(y, y_slice, dw, _y);
+		LoadRow(cb_full, cb_slice, dw, _y);
+		LoadRow(cr_full, cr_slice, dw, _y);
+
+		DownsampleChroma(cb, cb_full, width);
+		DownsampleChroma(cr, cr_full, width);
+
+		if(width & 1)
+			y[width] = y[width - 1];
+
+		PackUYVYRow(out, y, cb, cr, pairs);
+
+		assert(_rowbytes == (4 * pairs));
+	}
+}
+
+
+void
+UncompressedCDCICodec::compress(const FrameBuffer &frame)
+{
+	const Box2i dataW = dataWindow();
+
+	const PixelType pixel_type = (_depth == CDCI_10 ? UINT10 : UINT8);
+
+	bool input_matches = (frame.dataWindow() == dataW && frame.coefficients() == _coefficients);
+
+	const char *chanNames[3] = { "Y", "Cb", "Cr" };
+
+	for(int i=0; i < 3; i++)
+	{
+		const Slice *slice = frame.findSlice(chanNames[i]);
+
+		if(slice == NULL || slice->type != pixel_type || slice->xSampling != 1 || slice->ySampling != 1)
+			input_matches = false;
+	}
+
+
+	FrameBuffer temp_buffer(dataW);
+
+	if(!input_matches)
+	{
+		const int width = (dataW.max.x - dataW.min.x + 1);
+		const int height = (dataW.max.y - dataW.min.y + 1);
+
+		const size_t pix_size = PixelSize(pixel_type);
+		const size_t rowbytes = pix_size * width;
+		const size_t data_size = rowbytes * height;
+
+		temp_buffer.coefficients() = _coefficients;
+
+		for(int i=0; i < 3; i++)
+		{
+			char *origin = stagingBuffer(data_size, i) - (dataW.min.x * pix_size) - (dataW.min.y * rowbytes);
+
+			temp_buffer.insert(chanNames[i], Slice(pixel_type, origin, pix_size, rowbytes));
+		}
+
+		temp_buffer.copyFromFrame(frame);
+	}
+
+	const FrameBuffer &frame_to_use = (input_matches ? frame : temp_buffer);
+
+
+	const size_t rowbytes = rowBytes();
+	const size_t data_size = rowbytes * _descriptor.getStoredHeight();
+
+	DataChunkPtr data = new PooledDataChunk(data_size);
+
+	{
+		TaskGroup taskGroup;
+
+		for(int y = dataW.min.y; y <= dataW.max.y; y++)
+		{
+			char *row = (char *)data->Data + ((y - dataW.min.y) * rowbytes);
+
+			ThreadPool::addGlobalTask(new CompressCDCIRow(&taskGroup, row, rowbytes, frame_to_use, (_depth == CDCI_10), y));
+		}
+	}
+
+	storeData(data);
+}
+
+
+class DecompressCDCIRow : public Task
+{
+  public:
+	DecompressCDCIRow(TaskGroup *group, const FrameBuffer &frame, const char *row, bool ten_bit, int y);
+	virtual ~DecompressCDCIRow() {}
+
+	virtual void execute();
+
+  private:
+	const FrameBuffer &_frame;
+	const char * const _row;
+	const bool _ten_bit;
+	const int _y;
+};
+
+DecompressCDCIRow::DecompressCDCIRow(TaskGroup *group, const FrameBuffer &frame, const char *row, bool ten_bit, int y) :
+	Task(group),
+	_frame(frame),
+	_row(row),
+	_ten_bit(ten_bit),
+	_y(y)
+{
+
+}
+
+void
+DecompressCDCIRow::execute()
+{
+	const Box2i &dw = _frame.dataWindow();
+	const int width = (dw.max.x - dw.min.x + 1);
+
+	const Slice &y_slice = _frame["Y"];
+	const Slice &cb_slice = _frame["Cb"];
+	const Slice &cr_slice = _frame["Cr"];
+
+	const UInt8 *in = (const UInt8 *)_row;
+
+	if(_ten_bit)
+	{
+		const int blocks = (width + 5) / 6;
+		const int luma_len = (6 * blocks) + 8;
+		const int chroma_len = (3 * blocks) + 8;
+
+		std::vector<UInt16> buf((3 * luma_len) + (2 * chroma_len));
+
+		UInt16 *y = &buf[0];
+		UInt16 *cb_full = y + luma_len;
+		UInt16 *cr_full = cb_full + luma_len;
+		UInt16 *cb = cr_full + luma_len;
+		UInt16 *cr = cb + chroma_len;
+
+		UnpackV210Row(y, cb, cr, in, blocks);
+
+		UpsampleChroma(cb_full, cb, width);
+		UpsampleChroma(cr_full, cr, width);
+
+		StoreRow(y_slice, dw, _y, y);
+		StoreRow(cb_slice, dw, _y, cb_full);
+		StoreRow(cr_slice, dw, _y, cr_full);
+	}
+	else
+	{
+		const int pairs = (width + 1) / 2;
+
+		std::vector<UInt8> buf((3 * 2 * pairs) + (2 * pairs));
+
+		UInt8 *y = &buf[0];
+		UInt8 *cb_full = y + (2 * pairs);
+		UInt8 *cr_full = cb_full + (2 * pairs);
+		UInt8 *cb = cr_full + (2 * pairs);
+		UInt8 *cr = cb + pairs;
+
+		UnpackUYVYRow(y, cb, cr, in, pairs);
+
+		UpsampleChroma(cb_full, cb, width);
+		UpsampleChroma(cr_full, cr, width);
+
+		StoreRow(y_slice, dw, _y, y);
+		StoreRow(cb_slice, dw, _y, cb_full);
+		StoreRow(cr_slice, dw, _y, cr_full);
+	}
+}
+
+
+void
+UncompressedCDCICodec::decompress(const DataChunk &data)
+{
+	const Box2i dataW = dataWindow();
+
+	const int width = (dataW.max.x - dataW.min.x + 1);
+	const int height = (dataW.max.y - dataW.min.y + 1);
+
+	const PixelType pixel_type = (_depth == CDCI_10 ? UINT10 : UINT8);
+	const size_t pix_size = PixelSize(pixel_type);
+	const size_t chan_rowbytes = pix_size * width;
+	const size_t chan_size = chan_rowbytes * height;
+
+	FrameBufferPtr frame_buffer = new FrameBuffer(dataW);
+
+	frame_buffer->coefficients() = _coefficients;
+
+	const char *chanNames[3] = { "Y", "Cb", "Cr" };
+
+	for(int i=0; i < 3; i++)
+	{
+		DataChunkPtr chan_data = new PooledDataChunk(chan_size);
+
+		char *origin = (char *)chan_data->Data - (dataW.min.x * pix_size) - (dataW.min.y * chan_rowbytes);
+
+		frame_buffer->insert(chanNames[i], Slice(pixel_type, origin, pix_size, chan_rowbytes));
+
+		frame_buffer->attachData(chan_data);
+	}
+
+	decompressFrame(data, *frame_buffer);
+
+	storeFrame(frame_buffer);
+}
+
+
+bool
+UncompressedCDCICodec::decompressInto(const DataChunk &data, FrameBuffer &frameBuffer)
+{
+	const PixelType pixel_type = (_depth == CDCI_10 ? UINT10 : UINT8);
+
+	ChannelList channels;
+
+	channels.insert("Y", Channel(pixel_type));
+	channels.insert("Cb", Channel(pixel_type));
+	channels.insert("Cr", Channel(pixel_type));
+
+	if( !canFillFrame(frameBuffer, channels) )
+		return VideoCodec::decompressInto(data, frameBuffer);
+
+	decompressFrame(data, frameBuffer);
+
+	return true;
+}
+
+
+void
+UncompressedCDCICodec::decompressFrame(const DataChunk &data, const FrameBuffer &frameBuffer)
+{
+	const Box2i dataW = dataWindow();
+
+	const size_t rowbytes = rowBytes();
+	const size_t data_size = rowbytes * _descriptor.getStoredHeight();
+
+	if(data.Size < data_size)
+		throw MoxMxf::InputExc("Stored data is too small");
+
+	TaskGroup taskGroup;
+
+	for(int y = dataW.min.y; y <= dataW.max.y; y++)
+	{
+		const char *row = (const char *)data.Data + ((y - dataW.min.y) * rowbytes);
+
+		ThreadPool::addGlobalTask(new DecompressCDCIRow(&taskGroup, frameBuffer, row, (_depth == CDCI_10), y));
+	}
+}
+
+
+bool
+UncompressedCDCICodecInfo::canCompressType(PixelType pixelType) const
+{
+	return (pixelType == UINT8 || pixelType == UINT10);
+}
+
+
+ChannelCapabilities
+UncompressedCDCICodecInfo::getChannelCapabilites() const
+{
+	return (Channels_RGB | Channels_YCbCr);
+}
+
+
+VideoCodec *
+UncompressedCDCICodecInfo::createCodec(const Header &header, const ChannelList &channels) const
+{
+	return new UncompressedCDCICodec(header, channels);
+}
+
+VideoCodec *
+UncompressedCDCICodecInfo::createCodec(const MoxMxf::VideoDescriptor &descriptor, Header &header, ChannelList &channels) const
+{
+	return new UncompressedCDCICodec(descriptor, header, channels);
+}
+
+
+} // namespace
@@ -0,0 +1,71 @@
+/*
+ *  UncompressedCDCICodec.h
+ *  MoxFiles
+ *
+ *  Created by agent on 10/18/26.
+ *  Copyright 2026 fnord. All rights reserved.
+ *
+ */
+
+#ifndef MOXFILES_UNCOMPRESSEDCDCICODEC_H
+#define MOXFILES_UNCOMPRESSEDCDCICODEC_H
+
+#include <MoxFiles/Codec.h>
+
+namespace MoxFiles
+{
+	// 4:2:2 Y'CbCr, stored as 8-bit UYVY or 10-bit v210
+	//
+	// Frames come in and go out as full-resolution planar "Y", "Cb", "Cr" slices.
+	// The codec does the chroma subsampling itself (co-sited, 1-2-1 filter)
+	// and interpolates it back up on the way out.
+
+	class UncompressedCDCICodec : public VideoCodec
+	{
+	  public:
+		UncompressedCDCICodec(const Header &header, const ChannelList &channels);
+		UncompressedCDCICodec(const MoxMxf::VideoDescriptor &descriptor, Header &header, ChannelList &channels);
+		virtual ~UncompressedCDCICodec();
+
+		virtual const MoxMxf::VideoDescriptor * getDescriptor() const { return &_descriptor; }
+
+		virtual void compress(const FrameBuffer &frame);
+		virtual bool convertsInput() const { return true; }
+		virtual void decompress(const DataChunk &data);
+		virtual bool decompressInto(const DataChunk &data, FrameBuffer &frameBuffer);
+
+	  private:
+		MoxMxf::CDCIDescriptor _descriptor;
+
+		enum CDCI_Depth {
+			CDCI_8,		// UYVY
+			CDCI_10		// v210
+		};
+
+		CDCI_Depth _depth;
+
+		FrameBuffer::Coefficients _coefficients;
+
+		size_t rowBytes() const;
+		
+		void decompressFrame(const DataChunk &data, const FrameBuffer &frameBuffer);
+	};
+
+
+	class UncompressedCDCICodecInfo : public VideoCodecInfo
+	{
+	  public:
+		UncompressedCDCICodecInfo() {}
+		virtual ~UncompressedCDCICodecInfo() {}
+
+		virtual bool canCompressType(PixelType pixelType) const;
+
+		virtual ChannelCapabilities getChannelCapabilites() const;
+
+		virtual VideoCodec * createCodec(const Header &header, const ChannelList &channels) const;
+		virtual VideoCodec * createCodec(const MoxMxf::VideoDescriptor &descriptor, Header &header, ChannelList &channels) const;
+	};
+
+} // namespace
+
+#endif // MOXFILES_UNCOMPRESSEDCDCICODEC_H
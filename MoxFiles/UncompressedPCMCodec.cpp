@@ -10,6 +10,11 @@
 #include <MoxFiles/UncompressedPCMCodec.h>
 
 #include <MoxFiles/Thread.h>
+#include <MoxFiles/SIMD.h>
+
+#include <algorithm>
+
+#include <string.h>
 
 namespace MoxFiles
 {
@@ -31,44 +36,272 @@ UncompressedPCMCodec::UncompressedPCMCodec(const MoxMxf::AudioDescriptor &descri
 {
 	assert(header.sampleRate() == _descriptor.getAudioSamplingRate());
 
-	const UInt32 bit_depth = _descriptor.getBitDepth();
+	const SampleType type = sampleType();
 	const UInt32 num_channels = _descriptor.getChannelCount();
 	
 	
-	SampleType sampleType;
+	std::vector<Name> channel_list = StandardAudioChannelList(num_channels);
 	
-	switch(bit_depth)
+	for(int i = 0; i < channel_list.size(); i++)
+	{
+		channels.insert(channel_list[i].text(), AudioChannel(type));
+	}
+}
+
+
+SampleType
+UncompressedPCMCodec::sampleType() const
+{
+	switch(_descriptor.getBitDepth())
 	{
 		case 8:
-			sampleType = UNSIGNED8;
-		break;
+			return UNSIGNED8;
 		
 		case 16:
-			sampleType = SIGNED16;
-		break;
-
+			return SIGNED16;
+		
 		case 24:
-			sampleType = SIGNED24;
-		break;
-
+			return SIGNED24;
+		
 		case 32:
-			sampleType = SIGNED32;
-		break;
+			return SIGNED32;
+	}
+	
+	throw MoxMxf::LogicExc("Not handling the provided bit depth");
+}
+
+
+// The essence is little-endian samples packed into (bit_depth + 7) / 8 bytes,
+// the channels interleaved in StandardAudioChannelList() order.
+
+static bool
+LittleEndian()
+{
+	const unsigned short one = 1;
+	
+	return (*(const unsigned char *)&one == 1);
+}
+
+
+// sign-extended, except 8-bit which is unsigned
+static inline Int32
+ReadPacked(const UInt8 *in, UInt32 bit_depth)
+{
+	switch(bit_depth)
+	{
+		case 8:
+			return in[0];
+		
+		case 16:
+			return (Int16)(in[0] | (in[1] << 8));
+		
+		case 24:
+			return (Int32)(((UInt32)in[0] << 8) | ((UInt32)in[1] << 16) | ((UInt32)in[2] << 24)) >> 8;
 		
 		default:
-			throw MoxMxf::LogicExc("Not handling the provided bit depth");
+			return (Int32)((UInt32)in[0] | ((UInt32)in[1] << 8) | ((UInt32)in[2] << 16) | ((UInt32)in[3] << 24));
+	}
+}
+
+
+// same math as AudioBuffer's conversion to float
+static inline float
+PackedToFloat(Int32 val, UInt32 bit_depth)
+{
+	if(bit_depth == 8)
+		return ((double)val - 128.0) / 127.0;
+	else
+		return (double)val / (double)((1U << (bit_depth - 1)) - 1);
+}
+
+
+// Any layout, so one channel at a time.  type is our type or AFLOAT.
+static void
+UnpackStrided(char *out, ptrdiff_t out_stride, SampleType type, const UInt8 *in, ptrdiff_t in_stride, UInt32 bit_depth, UInt64 length)
+{
+	for(UInt64 i = 0; i < length; i++)
+	{
+		const Int32 val = ReadPacked(in, bit_depth);
+		
+		switch(type)
+		{
+			case UNSIGNED8:
+				*(UInt8 *)out = val;
+			break;
+			
+			case SIGNED16:
+				*(Int16 *)out = val;
+			break;
+			
+			case SIGNED24:
+			case SIGNED32:
+				*(Int32 *)out = val;
+			break;
+			
+			case AFLOAT:
+				*(float *)out = PackedToFloat(val, bit_depth);
+			break;
+		}
+		
+		out += out_stride;
+		in += in_stride;
+	}
+}
+
+
+// The rest work on contiguous runs, for when the caller's channels are
+// interleaved just like ours.  The 16-byte loads and stores stop while
+// there are still a few samples left, so they never leave the buffers.
+// Dividing in float gives the same answer as PackedToFloat() because
+// the samples and the divisors are all exact in a float.
+
+static void
+Unpack24(Int32 *out, const UInt8 *in, size_t count)
+{
+	size_t i = 0;
+
+#ifdef MOXFILES_SSSE3
+	// 4 packed samples into the top of 32-bit lanes, to be shifted down
+	const __m128i shuffle = _mm_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+	
+	for(; i + 6 <= count; i += 4)
+	{
+		const __m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(in + (3 * i))), shuffle);
+		
+		_mm_storeu_si128((__m128i *)(out + i), _mm_srai_epi32(v, 8));
+	}
+#endif
+
+	for(; i < count; i++)
+	{
+		out[i] = ReadPacked(in + (3 * i), 24);
 	}
+}
+
+
+static void
+Unpack24ToFloat(float *out, const UInt8 *in, size_t count)
+{
+	size_t i = 0;
+
+#ifdef MOXFILES_SSSE3
+	const __m128i shuffle = _mm_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+	const __m128 max = _mm_set1_ps(8388607.0f);
 	
+	for(; i + 6 <= count; i += 4)
+	{
+		const __m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(in + (3 * i))), shuffle);
+		
+		_mm_storeu_ps(out + i, _mm_div_ps(_mm_cvtepi32_ps(_mm_srai_epi32(v, 8)), max));
+	}
+#endif
+
+	for(; i < count; i++)
+	{
+		out[i] = PackedToFloat(ReadPacked(in + (3 * i), 24), 24);
+	}
+}
+
+
+static void
+Unpack16ToFloat(float *out, const UInt8 *in, size_t count)
+{
+	size_t i = 0;
+
+#ifdef MOXFILES_SSE2
+	const __m128 max = _mm_set1_ps(32767.0f);
 	
-	std::vector<Name> channel_list = StandardAudioChannelList(num_channels);
+	for(; i + 8 <= count; i += 8)
+	{
+		const __m128i v = _mm_loadu_si128((const __m128i *)(in + (2 * i)));
+		
+		// doubling the samples up and shifting back sign-extends them
+		const __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+		const __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+		
+		_mm_storeu_ps(out + i + 0, _mm_div_ps(_mm_cvtepi32_ps(lo), max));
+		_mm_storeu_ps(out + i + 4, _mm_div_ps(_mm_cvtepi32_ps(hi), max));
+	}
+#endif
+
+	for(; i < count; i++)
+	{
+		out[i] = PackedToFloat(ReadPacked(in + (2 * i), 16), 16);
+	}
+}
+
+
+static void
+Pack24(UInt8 *out, const Int32 *in, size_t count)
+{
+	size_t i = 0;
+
+#ifdef MOXFILES_SSSE3
+	// the low 3 bytes of each lane, the last 4 bytes get written over by the next 4 samples
+	const __m128i shuffle = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
 	
-	for(int i = 0; i < channel_list.size(); i++)
+	for(; i + 6 <= count; i += 4)
 	{
-		channels.insert(channel_list[i].text(), AudioChannel(sampleType));
+		const __m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+		
+		_mm_storeu_si128((__m128i *)(out + (3 * i)), _mm_shuffle_epi8(v, shuffle));
+	}
+#endif
+
+	for(; i < count; i++)
+	{
+		out[(3 * i) + 0] = (in[i] >> 0) & 0xff;
+		out[(3 * i) + 1] = (in[i] >> 8) & 0xff;
+		out[(3 * i) + 2] = (in[i] >> 16) & 0xff;
 	}
 }
 
 
+// type is our type or AFLOAT
+static void
+UnpackRun(char *out, SampleType type, const UInt8 *in, UInt32 bit_depth, size_t count)
+{
+	if(type == SIGNED24)
+	{
+		Unpack24((Int32 *)out, in, count);
+	}
+	else if(type == AFLOAT && bit_depth == 24)
+	{
+		Unpack24ToFloat((float *)out, in, count);
+	}
+	else if(type == AFLOAT && bit_depth == 16)
+	{
+		Unpack16ToFloat((float *)out, in, count);
+	}
+	else if(type != AFLOAT && LittleEndian())
+	{
+		memcpy(out, in, count * (bit_depth / 8));
+	}
+	else
+		UnpackStrided(out, SampleSize(type), type, in, (bit_depth + 7) / 8, bit_depth, count);
+}
+
+
+// Are these slices (in our channel order) one interleaved run of type,
+// so a whole frame converts in one go?
+static bool
+Interleaved(const std::vector<AudioSlice> &slices, SampleType type)
+{
+	const ptrdiff_t sample_size = SampleSize(type);
+	const ptrdiff_t stride = sample_size * slices.size();
+	
+	for(int i = 0; i < slices.size(); i++)
+	{
+		const AudioSlice &slice = slices[i];
+		
+		if(slice.type != type || slice.stride != stride || slice.base != slices[0].base + (sample_size * i))
+			return false;
+	}
+	
+	return true;
+}
+
+
 class CompressPCMTask : public Task
 {
   public:
@@ -189,29 +422,7 @@ UncompressedPCMCodec::compress(const AudioBuffer &audio)
 {
 	const UInt32 bit_depth = _descriptor.getBitDepth();
 	
-	SampleType sampleType;
-	
-	switch(bit_depth)
-	{
-		case 8:
-			sampleType = UNSIGNED8;
-		break;
-		
-		case 16:
-			sampleType = SIGNED16;
-		break;
-
-		case 24:
-			sampleType = SIGNED24;
-		break;
-
-		case 32:
-			sampleType = SIGNED32;
-		break;
-		
-		default:
-			throw MoxMxf::LogicExc("Bad bit depth");
-	}
+	const SampleType type = sampleType();
 	
 	bool input_matches = true;
 	
@@ -219,7 +430,7 @@ UncompressedPCMCodec::compress(const AudioBuffer &audio)
 	{
 		const AudioSlice &slice = i.slice();
 		
-		if(slice.type != sampleType)
+		if(slice.type != type)
 			input_matches = false;
 	}
 	
@@ -229,7 +440,7 @@ UncompressedPCMCodec::compress(const AudioBuffer &audio)
 	
 	if(!input_matches)
 	{
-		converted_audio = MakeAudioBufferType(audio, sampleType);
+		converted_audio = MakeAudioBufferType(audio, type);
 	}
 	
 	const AudioBuffer &audio_buf = (input_matches ? audio : *converted_audio);
@@ -253,11 +464,30 @@ UncompressedPCMCodec::compress(const AudioBuffer &audio)
 	const size_t stride = bytes_per_sample * channels;
 	const size_t data_size = samples * bytes_per_sample;
 	
-	DataChunkPtr data = new DataChunk(data_size);
+	DataChunkPtr data = new PooledDataChunk(data_size);
 	
 	
 	std::vector<Name> channel_list = StandardAudioChannelList(channels);
 	
+	std::vector<AudioSlice> slices;
+	
+	for(int i = 0; i < channel_list.size(); i++)
+	{
+		const AudioSlice *slice = audio_buf.findSlice(channel_list[i].text());
+		
+		if(slice)
+			slices.push_back(*slice);
+	}
+	
+	if(slices.size() == channels && Interleaved(slices, type) && (bit_depth == 24 || LittleEndian()))
+	{
+		// already laid out like the essence
+		if(bit_depth == 24)
+			Pack24((UInt8 *)data->Data, (const Int32 *)slices[0].base, samples);
+		else
+			memcpy(data->Data, slices[0].base, data_size);
+	}
+	else
 	{
 		TaskGroup taskGroup;
 		
@@ -285,7 +515,7 @@ UncompressedPCMCodec::compress(const AudioBuffer &audio)
 
 
 UInt64
-UncompressedPCMCodec::samplesInFrame(size_t frame_size)
+UncompressedPCMCodec::samplesInFrame(UInt64 frame, size_t frame_size)
 {
 	const UInt32 bit_depth = _descriptor.getBitDepth();
 	const size_t bytes_per_sample = (bit_depth + 7) / 8;
@@ -318,37 +548,11 @@ UncompressedPCMCodec::decompress(const DataChunk &data)
 	
 	//assert(samples == (channels * audio_sampling_rate.Numerator * sample_rate.Denominator) / (sample_rate.Numerator * audio_sampling_rate.Denominator));
 	
-	SampleType sampleType;
-	size_t decoded_sample_size;
-	
-	switch(bit_depth)
-	{
-		case 8:
-			sampleType = UNSIGNED8;
-			decoded_sample_size = sizeof(unsigned char);
-		break;
-		
-		case 16:
-			sampleType = SIGNED16;
-			decoded_sample_size = sizeof(short);
-		break;
-
-		case 24:
-			sampleType = SIGNED24;
-			decoded_sample_size = sizeof(int);
-		break;
-
-		case 32:
-			sampleType = SIGNED32;
-			decoded_sample_size = sizeof(int);
-		break;
-		
-		default:
-			throw MoxMxf::LogicExc("Not handling the provided bit depth");
-	}
+	const SampleType type = sampleType();
+	const size_t decoded_sample_size = SampleSize(type);
 	
 	
-	DataChunkPtr buf_data = new DataChunk(decoded_sample_size * samples);
+	DataChunkPtr buf_data = new PooledDataChunk(decoded_sample_size * samples);
 	
 	char *buf_origin = (char *)buf_data->Data;
 	
@@ -363,97 +567,120 @@ UncompressedPCMCodec::decompress(const DataChunk &data)
 	
 	for(int i = 0; i < channel_list.size(); i++)
 	{
-		buf->insert(channel_list[i].text(), AudioSlice(sampleType, buf_origin + (decoded_sample_size * i), stride));
+		buf->insert(channel_list[i].text(), AudioSlice(type, buf_origin + (decoded_sample_size * i), stride));
 	}
 		
 	buf->attachData(buf_data);
 	
 	
-	if(bit_depth == 8)
+	UnpackRun(buf_origin, type, (const UInt8 *)data.Data, bit_depth, samples);
+	
+	
+	storeBuffer(buf);
+}
+
+
+class DecompressPCMTask : public Task
+{
+  public:
+	DecompressPCMTask(TaskGroup *group, const AudioSlice &dest_slice, const UInt8 *source_origin, ptrdiff_t source_stride, UInt32 bit_depth, UInt64 length);
+	~DecompressPCMTask() {}
+	
+	virtual void execute();
+
+  private:
+	const AudioSlice _dest_slice;
+	const UInt8 * const _source_origin;
+	const ptrdiff_t _source_stride;
+	const UInt32 _bit_depth;
+	const UInt64 _length;
+};
+
+DecompressPCMTask::DecompressPCMTask(TaskGroup *group, const AudioSlice &dest_slice, const UInt8 *source_origin, ptrdiff_t source_stride, UInt32 bit_depth, UInt64 length) :
+	Task(group),
+	_dest_slice(dest_slice),
+	_source_origin(source_origin),
+	_source_stride(source_stride),
+	_bit_depth(bit_depth),
+	_length(length)
+{
+
+}
+
+void
+DecompressPCMTask::execute()
+{
+	UnpackStrided(_dest_slice.base, _dest_slice.stride, _dest_slice.type, _source_origin, _source_stride, _bit_depth, _length);
+}
+
+
+bool
+UncompressedPCMCodec::decompressInto(const DataChunk &data, AudioBuffer &audioBuffer, UInt64 start, UInt64 samples)
+{
+	const SampleType type = sampleType();
+	
+	// we go straight to our own type or float, AudioBuffer does the rest
+	for(AudioBuffer::ConstIterator i = audioBuffer.begin(); i != audioBuffer.end(); ++i)
 	{
-		UInt8 *in = (UInt8 *)data.Data;
-		
-		UInt8 *out = (UInt8 *)buf_origin;
+		const AudioSlice &slice = i.slice();
 		
-		for(int i = 0; i < samples; i++)
-		{
-			*out++ = *in++;
-		}
+		if(slice.type != type && slice.type != AFLOAT)
+			return AudioCodec::decompressInto(data, audioBuffer, start, samples);
 	}
-	else if(bit_depth == 16)
+	
+	
+	const UInt32 bit_depth = _descriptor.getBitDepth();
+	const UInt32 channels = _descriptor.getChannelCount();
+	
+	const size_t bytes_per_sample = (bit_depth + 7) / 8;
+	const ptrdiff_t source_stride = bytes_per_sample * channels;
+	
+	assert(data.Size % source_stride == 0);
+	
+	const UInt64 length = data.Size / source_stride;
+	
+	if(start > length)
+		throw MoxMxf::ArgExc("Reading past the end of the frame");
+	
+	const UInt64 copy_len = std::min(std::min(samples, length - start), audioBuffer.remaining());
+	
+	const UInt8 *source_origin = (const UInt8 *)data.Data + (source_stride * start);
+	
+	
+	std::vector<Name> channel_list = StandardAudioChannelList(channels);
+	
+	std::vector<AudioSlice> slices;
+	
+	for(int i = 0; i < channel_list.size(); i++)
 	{
-		UInt8 *in = (UInt8 *)data.Data;
+		const char *name = channel_list[i].text();
 		
-		Int16 *out = (Int16 *)buf_origin;
-		
-		for(int i = 0; i < samples; i++)
-		{
-			// fill (unsigned) 16-bit space with 16 bits
-			const UInt16 uval =	(in[0] << 0) |
-								(in[1] << 8);
-			
-			// cast as signed 32-bit
-			const Int16 *val = (Int16 *)&uval;
-			
-			// put back down to 24-bit values
-			*out = *val;
-			
-			in += 2;
-			out++;
-		}
+		if(audioBuffer.findSlice(name) != NULL)
+			slices.push_back(audioBuffer.playheadSlice(name));
 	}
-	else if(bit_depth == 24)
+	
+	if(slices.size() == channels && Interleaved(slices, slices[0].type))
 	{
-		UInt8 *in = (UInt8 *)data.Data;
-		
-		Int32 *out = (Int32 *)buf_origin;
-		
-		for(int i = 0; i < samples; i++)
-		{
-			// fill (unsigned) 32-bit space with 24 bits
-			const UInt32 uval =	(in[0] << 8) |   // *in++, *in++, *in++ does not work for some reason
-								(in[1] << 16) |
-								(in[2] << 24);
-			
-			// cast as signed 32-bit
-			const Int32 *val = (Int32 *)&uval;
-			
-			// put back down to 24-bit values
-			*out = (*val >> 8);
-			
-			in += 3;
-			out++;
-		}
+		UnpackRun(slices[0].base, slices[0].type, source_origin, bit_depth, copy_len * channels);
 	}
-	else if(bit_depth == 32)
+	else
 	{
-		UInt8 *in = (UInt8 *)data.Data;
-		
-		Int32 *out = (Int32 *)buf_origin;
+		TaskGroup taskGroup;
 		
-		for(int i = 0; i < samples; i++)
+		for(int i = 0; i < channel_list.size(); i++)
 		{
-			// fill (unsigned) 32-bit space with 24 bits
-			const UInt32 uval =	(in[0] << 0) |
-								(in[1] << 8) |
-								(in[2] << 16) |
-								(in[3] << 24);
-			
-			// cast as signed 32-bit
-			const Int32 *val = (Int32 *)&uval;
-			
-			// put back down to 24-bit values
-			*out = *val;
+			const char *name = channel_list[i].text();
 			
-			in += 4;
-			out++;
+			if(audioBuffer.findSlice(name) != NULL)
+			{
+				ThreadPool::addGlobalTask(new DecompressPCMTask(&taskGroup, audioBuffer.playheadSlice(name), source_origin + (bytes_per_sample * i), source_stride, bit_depth, copy_len));
+			}
 		}
 	}
-	else
-		throw MoxMxf::NoImplExc("Not handling this bit depth");
 	
+	audioBuffer.fastForward(copy_len);
 	
-	storeBuffer(buf);
+	return true;
 }
 
 
@@ -26,11 +26,14 @@ namespace MoxFiles
 		
 		virtual void compress(const AudioBuffer &audio);
 		
-		virtual UInt64 samplesInFrame(size_t frame_size);
+		virtual UInt64 samplesInFrame(UInt64 frame, size_t frame_size);
 		virtual void decompress(const DataChunk &data);
+		virtual bool decompressInto(const DataChunk &data, AudioBuffer &audioBuffer, UInt64 start, UInt64 samples);
 
 	  private:
 		MoxMxf::WaveAudioDescriptor _descriptor;
+		
+		SampleType sampleType() const;
 	};
 	
 	
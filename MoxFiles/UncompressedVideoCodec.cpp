@@ -10,6 +10,9 @@
 #include <MoxFiles/UncompressedVideoCodec.h>
 
 #include <MoxFiles/Thread.h>
+#include <MoxFiles/SIMD.h>
+
+#include <string.h>
 
 namespace MoxFiles
 {
@@ -24,11 +27,9 @@ PixelLayoutDepth(PixelType type)
 			return 8;
 		
 		case MoxFiles::UINT10:
-			assert(false); // not yet
 			return 10;
 			
 		case MoxFiles::UINT12:
-			assert(false); // not yet
 			return 12;
 			
 		case MoxFiles::UINT16:
@@ -154,14 +155,14 @@ UncompressedVideoCodec::UncompressedVideoCodec(const Header &header, const Chann
 	
 	if(bits_per_pixel % 8 != 0)
 	{
-		assert(false); // not really expecting this yet
-	
 		_padding = 8 - (bits_per_pixel % 8);
 	
 		layout.push_back( MoxMxf::RGBADescriptor::RGBALayoutItem('F', _padding) ); // fill
 	}
 	
 	_descriptor.setPixelLayout(layout);
+	
+	_packMode = choosePackMode();
 }
 
 
@@ -176,7 +177,7 @@ UncompressedVideoCodec::UncompressedVideoCodec(const MoxMxf::VideoDescriptor &de
 	
 	for(int i = 0; i < num_channels; i++)
 	{
-		assert(pixelLayout[i].code == 'R' || pixelLayout[i].code == 'G' || pixelLayout[i].code == 'B' || pixelLayout[i].code == 'A');
+		assert(pixelLayout[i].code == 'R' || pixelLayout[i].code == 'G' || pixelLayout[i].code == 'B' || pixelLayout[i].code == 'A' || pixelLayout[i].code == 'F');
 		
 		if(pixelLayout[i].code == 'F')
 		{
@@ -195,6 +196,8 @@ UncompressedVideoCodec::UncompressedVideoCodec(const MoxMxf::VideoDescriptor &de
 			channels.insert(chan_name, Channel(pixelType));
 		}
 	}
+	
+	_packMode = choosePackMode();
 }
 
 UncompressedVideoCodec::~UncompressedVideoCodec()
@@ -202,6 +205,48 @@ UncompressedVideoCodec::~UncompressedVideoCodec()
 
 }
 
+
+UncompressedVideoCodec::PackMode
+UncompressedVideoCodec::choosePackMode() const
+{
+	bool whole_bytes = (_padding == 0);
+	
+	for(std::vector<ChannelBits>::const_iterator i = _channelVec.begin(); i != _channelVec.end(); ++i)
+	{
+		if(PixelLayoutBits(i->type) % 8 != 0)
+			whole_bytes = false;
+	}
+	
+	if(whole_bytes)
+		return PACK_BYTES;
+	
+	if(_channelVec.size() == 3 && _padding == 2 &&
+		_channelVec[0].code == 'R' && _channelVec[0].type == UINT10 &&
+		_channelVec[1].code == 'G' && _channelVec[1].type == UINT10 &&
+		_channelVec[2].code == 'B' && _channelVec[2].type == UINT10)
+	{
+		return PACK_RGB10;
+	}
+	
+	return PACK_GENERIC;
+}
+
+
+size_t
+UncompressedVideoCodec::pixelSize() const
+{
+	unsigned int bits_per_pixel = _padding;
+	
+	for(std::vector<ChannelBits>::const_iterator i = _channelVec.begin(); i != _channelVec.end(); ++i)
+	{
+		bits_per_pixel += PixelLayoutBits(i->type);
+	}
+	
+	assert(bits_per_pixel % 8 == 0);
+	
+	return (bits_per_pixel >> 3);
+}
+
 /*
 class CompressUncompressedRGBRowTask : public Task
 {
@@ -272,10 +317,430 @@ EncodeChannel(TaskGroup *taskGroup, char *dest_origin, ptrdiff_t stride, ptrdiff
 }
 */
 
+// Byte-aligned samples are stored big-endian, so 16-bit and float rows
+// get swapped on the way in and out.
+
+static void
+Swap16Row(UInt8 *out, const UInt8 *in, size_t samples)
+{
+	size_t i = 0;
+
+#ifdef MOXFILES_SSE2
+	for(; i + 8 <= samples; i += 8)
+	{
+		const __m128i v = _mm_loadu_si128((const __m128i *)(in + (2 * i)));
+
+		_mm_storeu_si128((__m128i *)(out + (2 * i)), _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8)));
+	}
+#endif
+
+	for(; i < samples; i++)
+	{
+		const UInt8 a = in[(2 * i) + 0];
+		const UInt8 b = in[(2 * i) + 1];
+
+		out[(2 * i) + 0] = b;
+		out[(2 * i) + 1] = a;
+	}
+}
+
+#ifdef MOXFILES_SSE2
+static inline __m128i
+Swap32(__m128i v)
+{
+	v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1));
+
+	return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
+#endif
+
+static void
+Swap32Row(UInt8 *out, const UInt8 *in, size_t samples)
+{
+	size_t i = 0;
+
+#ifdef MOXFILES_SSE2
+	for(; i + 4 <= samples; i += 4)
+	{
+		const __m128i v = _mm_loadu_si128((const __m128i *)(in + (4 * i)));
+
+		_mm_storeu_si128((__m128i *)(out + (4 * i)), Swap32(v));
+	}
+#endif
+
+	for(; i < samples; i++)
+	{
+		const UInt8 a = in[(4 * i) + 0];
+		const UInt8 b = in[(4 * i) + 1];
+		const UInt8 c = in[(4 * i) + 2];
+		const UInt8 d = in[(4 * i) + 3];
+
+		out[(4 * i) + 0] = d;
+		out[(4 * i) + 1] = c;
+		out[(4 * i) + 2] = b;
+		out[(4 * i) + 3] = a;
+	}
+}
+
+static void
+SwapRow(UInt8 *out, const UInt8 *in, size_t samples, int sample_size)
+{
+	if(sample_size == 1)
+		memcpy(out, in, samples);
+	else if(sample_size == 2)
+		Swap16Row(out, in, samples);
+	else if(sample_size == 4)
+		Swap32Row(out, in, samples);
+	else
+		assert(false);
+}
+
+
+#ifdef MOXFILES_SSSE3
+// Shuffle masks to go between N planar channel vectors and N vectors of
+// interleaved, big-endian pixels.  Each group is (16 / S) pixels.
+
+static __m128i
+InterleaveMask(int j, int c, int n, int s)
+{
+	char mask[16];
+
+	for(int t = 0; t < 16; t++)
+	{
+		const int k = (16 * j) + t;
+		const int p = k / (n * s);
+		const int r = k % (n * s);
+		const int b = r % s;
+
+		mask[t] = ((r / s) == c ? (p * s) + (s - 1 - b) : -1);
+	}
+
+	return _mm_loadu_si128((const __m128i *)mask);
+}
+
+static __m128i
+DeinterleaveMask(int c, int j, int n, int s)
+{
+	char mask[16];
+
+	for(int t = 0; t < 16; t++)
+	{
+		const int p = t / s;
+		const int b = t % s;
+		const int k = (p * n * s) + (c * s) + (s - 1 - b);
+
+		mask[t] = ((k / 16) == j ? (k % 16) : -1);
+	}
+
+	return _mm_loadu_si128((const __m128i *)mask);
+}
+#endif // MOXFILES_SSSE3
+
+template <int N, int S>
+static void
+InterleaveRow(UInt8 *out, const UInt8 * const in[], int width)
+{
+	int x = 0;
+
+#ifdef MOXFILES_SSSE3
+	__m128i mask[N][N];
+
+	for(int j = 0; j < N; j++)
+		for(int c = 0; c < N; c++)
+			mask[j][c] = InterleaveMask(j, c, N, S);
+
+	const int group = 16 / S;
+
+	for(; x + group <= width; x += group)
+	{
+		__m128i v[N];
+
+		for(int c = 0; c < N; c++)
+			v[c] = _mm_loadu_si128((const __m128i *)(in[c] + (x * S)));
+
+		for(int j = 0; j < N; j++)
+		{
+			__m128i o = _mm_shuffle_epi8(v[0], mask[j][0]);
+
+			for(int c = 1; c < N; c++)
+				o = _mm_or_si128(o, _mm_shuffle_epi8(v[c], mask[j][c]));
+
+			_mm_storeu_si128((__m128i *)(out + (x * N * S) + (16 * j)), o);
+		}
+	}
+#endif
+
+	for(; x < width; x++)
+		for(int c = 0; c < N; c++)
+			for(int b = 0; b < S; b++)
+				out[(((x * N) + c) * S) + b] = in[c][(x * S) + (S - 1 - b)];
+}
+
+template <int N, int S>
+static void
+DeinterleaveRow(UInt8 * const out[], const UInt8 *in, int width)
+{
+	int x = 0;
+
+#ifdef MOXFILES_SSSE3
+	__m128i mask[N][N];
+
+	for(int c = 0; c < N; c++)
+		for(int j = 0; j < N; j++)
+			mask[c][j] = DeinterleaveMask(c, j, N, S);
+
+	const int group = 16 / S;
+
+	for(; x + group <= width; x += group)
+	{
+		__m128i v[N];
+
+		for(int j = 0; j < N; j++)
+			v[j] = _mm_loadu_si128((const __m128i *)(in + (x * N * S) + (16 * j)));
+
+		for(int c = 0; c < N; c++)
+		{
+			__m128i o = _mm_shuffle_epi8(v[0], mask[c][0]);
+
+			for(int j = 1; j < N; j++)
+				o = _mm_or_si128(o, _mm_shuffle_epi8(v[j], mask[c][j]));
+
+			_mm_storeu_si128((__m128i *)(out[c] + (x * S)), o);
+		}
+	}
+#endif
+
+	for(; x < width; x++)
+		for(int c = 0; c < N; c++)
+			for(int b = 0; b < S; b++)
+				out[c][(x * S) + (S - 1 - b)] = in[(((x * N) + c) * S) + b];
+}
+
+template <int S>
+static bool
+InterleaveRow(UInt8 *out, const UInt8 * const in[], int n, int width)
+{
+	switch(n)
+	{
+		case 1:	InterleaveRow<1, S>(out, in, width);	return true;
+		case 2:	InterleaveRow<2, S>(out, in, width);	return true;
+		case 3:	InterleaveRow<3, S>(out, in, width);	return true;
+		case 4:	InterleaveRow<4, S>(out, in, width);	return true;
+	}
+
+	return false;
+}
+
+template <int S>
+static bool
+DeinterleaveRow(UInt8 * const out[], const UInt8 *in, int n, int width)
+{
+	switch(n)
+	{
+		case 1:	DeinterleaveRow<1, S>(out, in, width);	return true;
+		case 2:	DeinterleaveRow<2, S>(out, in, width);	return true;
+		case 3:	DeinterleaveRow<3, S>(out, in, width);	return true;
+		case 4:	DeinterleaveRow<4, S>(out, in, width);	return true;
+	}
+
+	return false;
+}
+
+static bool
+InterleaveRow(UInt8 *out, const UInt8 * const in[], int n, int sample_size, int width)
+{
+	switch(sample_size)
+	{
+		case 1:	return InterleaveRow<1>(out, in, n, width);
+		case 2:	return InterleaveRow<2>(out, in, n, width);
+		case 4:	return InterleaveRow<4>(out, in, n, width);
+	}
+
+	return false;
+}
+
+static bool
+DeinterleaveRow(UInt8 * const out[], const UInt8 *in, int n, int sample_size, int width)
+{
+	switch(sample_size)
+	{
+		case 1:	return DeinterleaveRow<1>(out, in, n, width);
+		case 2:	return DeinterleaveRow<2>(out, in, n, width);
+		case 4:	return DeinterleaveRow<4>(out, in, n, width);
+	}
+
+	return false;
+}
+
+
+// 10-bit RGB packed in a big-endian 32-bit word: R 31-22, G 21-12, B 11-2, fill 1-0
+
+static inline UInt32
+RGB10Word(UInt16 r, UInt16 g, UInt16 b)
+{
+	return ((UInt32)(r & 0x3ff) << 22) | ((UInt32)(g & 0x3ff) << 12) | ((UInt32)(b & 0x3ff) << 2);
+}
+
+static void
+PackRGB10Row(UInt8 *out, const Slice &r_slice, const Slice &g_slice, const Slice &b_slice, int width)
+{
+	int x = 0;
+
+#ifdef MOXFILES_SSE2
+	if(r_slice.xStride == sizeof(UInt16) && g_slice.xStride == sizeof(UInt16) && b_slice.xStride == sizeof(UInt16))
+	{
+		const __m128i mask10 = _mm_set1_epi16(0x3ff);
+		const __m128i zero = _mm_setzero_si128();
+
+		for(; x + 8 <= width; x += 8)
+		{
+			const __m128i r = _mm_and_si128(_mm_loadu_si128((const __m128i *)(r_slice.base + (2 * x))), mask10);
+			const __m128i g = _mm_and_si128(_mm_loadu_si128((const __m128i *)(g_slice.base + (2 * x))), mask10);
+			const __m128i b = _mm_and_si128(_mm_loadu_si128((const __m128i *)(b_slice.base + (2 * x))), mask10);
+
+			const __m128i lo = _mm_or_si128(_mm_slli_epi32(_mm_unpacklo_epi16(r, zero), 22),
+									_mm_or_si128(_mm_slli_epi32(_mm_unpacklo_epi16(g, zero), 12),
+													_mm_slli_epi32(_mm_unpacklo_epi16(b, zero), 2)));
+
+			const __m128i hi = _mm_or_si128(_mm_slli_epi32(_mm_unpackhi_epi16(r, zero), 22),
+									_mm_or_si128(_mm_slli_epi32(_mm_unpackhi_epi16(g, zero), 12),
+													_mm_slli_epi32(_mm_unpackhi_epi16(b, zero), 2)));
+
+			_mm_storeu_si128((__m128i *)(out + (4 * x)), Swap32(lo));
+			_mm_storeu_si128((__m128i *)(out + (4 * x) + 16), Swap32(hi));
+		}
+	}
+#endif
+
+	for(; x < width; x++)
+	{
+		const UInt32 word = RGB10Word(*(const UInt16 *)(r_slice.base + (x * r_slice.xStride)),
+										*(const UInt16 *)(g_slice.base + (x * g_slice.xStride)),
+										*(const UInt16 *)(b_slice.base + (x * b_slice.xStride)));
+
+		out[(4 * x) + 0] = (word >> 24) & 0xff;
+		out[(4 * x) + 1] = (word >> 16) & 0xff;
+		out[(4 * x) + 2] = (word >> 8) & 0xff;
+		out[(4 * x) + 3] = (word >> 0) & 0xff;
+	}
+}
+
+static void
+UnpackRGB10Row(const Slice &r_slice, const Slice &g_slice, const Slice &b_slice, const UInt8 *in, int width)
+{
+	int x = 0;
+
+#ifdef MOXFILES_SSE2
+	if(r_slice.xStride == sizeof(UInt16) && g_slice.xStride == sizeof(UInt16) && b_slice.xStride == sizeof(UInt16))
+	{
+		const __m128i mask10 = _mm_set1_epi32(0x3ff);
+
+		for(; x + 8 <= width; x += 8)
+		{
+			const __m128i lo = Swap32(_mm_loadu_si128((const __m128i *)(in + (4 * x))));
+			const __m128i hi = Swap32(_mm_loadu_si128((const __m128i *)(in + (4 * x) + 16)));
+
+			const __m128i r = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(lo, 22), mask10), _mm_and_si128(_mm_srli_epi32(hi, 22), mask10));
+			const __m128i g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(lo, 12), mask10), _mm_and_si128(_mm_srli_epi32(hi, 12), mask10));
+			const __m128i b = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(lo, 2), mask10), _mm_and_si128(_mm_srli_epi32(hi, 2), mask10));
+
+			_mm_storeu_si128((__m128i *)(r_slice.base + (2 * x)), r);
+			_mm_storeu_si128((__m128i *)(g_slice.base + (2 * x)), g);
+			_mm_storeu_si128((__m128i *)(b_slice.base + (2 * x)), b);
+		}
+	}
+#endif
+
+	for(; x < width; x++)
+	{
+		const UInt32 word = ((UInt32)in[(4 * x) + 0] << 24) | ((UInt32)in[(4 * x) + 1] << 16) | ((UInt32)in[(4 * x) + 2] << 8) | ((UInt32)in[(4 * x) + 3] << 0);
+
+		*(UInt16 *)(r_slice.base + (x * r_slice.xStride)) = (word >> 22) & 0x3ff;
+		*(UInt16 *)(g_slice.base + (x * g_slice.xStride)) = (word >> 12) & 0x3ff;
+		*(UInt16 *)(b_slice.base + (x * b_slice.xStride)) = (word >> 2) & 0x3ff;
+	}
+}
+
+
+// The general case: samples of any bit depth packed MSB first, with fill bits
+// at the end of each pixel.  Not fast, but handles any RGBALayout.
+
+static inline UInt32
+ReadSample(const char *in, PixelType type)
+{
+	switch(PixelSize(type))
+	{
+		case 1:	return *(const UInt8 *)in;
+		case 2:	return *(const UInt16 *)in;
+		case 4:	return *(const UInt32 *)in;
+	}
+
+	assert(false);
+	return 0;
+}
+
+static inline void
+WriteSample(char *out, PixelType type, UInt32 val)
+{
+	switch(PixelSize(type))
+	{
+		case 1:	*(UInt8 *)out = val;	break;
+		case 2:	*(UInt16 *)out = val;	break;
+		case 4:	*(UInt32 *)out = val;	break;
+		default:	assert(false);
+	}
+}
+
+
+// Row description handed to the tasks.  Slices have already been moved to the row.
+typedef std::vector<Slice> RowSlices;
+
+static bool
+SlicesHaveUniformSize(const RowSlices &slices, int &sample_size)
+{
+	sample_size = PixelSize(slices[0].type);
+
+	for(int i = 1; i < slices.size(); i++)
+	{
+		if(PixelSize(slices[i].type) != sample_size)
+			return false;
+	}
+
+	return true;
+}
+
+static bool
+SlicesAreInterleaved(const RowSlices &slices, int sample_size)
+{
+	// i.e. the same pixels in the same order as the essence
+	const ptrdiff_t pixel_size = sample_size * slices.size();
+
+	for(int i = 0; i < slices.size(); i++)
+	{
+		if(slices[i].xStride != pixel_size || slices[i].base != slices[0].base + (i * sample_size))
+			return false;
+	}
+
+	return true;
+}
+
+static bool
+SlicesArePlanar(const RowSlices &slices, int sample_size)
+{
+	for(int i = 0; i < slices.size(); i++)
+	{
+		if(slices[i].xStride != sample_size)
+			return false;
+	}
+
+	return true;
+}
+
+
 class CompressChannelBits : public Task
 {
   public:
-	CompressChannelBits(TaskGroup *group, char *origin, ptrdiff_t rowbytes, const std::vector<UncompressedVideoCodec::ChannelBits> &channelVec, const FrameBuffer &frame, int y);
+	CompressChannelBits(TaskGroup *group, char *origin, ptrdiff_t rowbytes, const std::vector<UncompressedVideoCodec::ChannelBits> &channelVec, unsigned char padding, UncompressedVideoCodec::PackMode packMode, const FrameBuffer &frame, int y);
 	~CompressChannelBits() {}
 	
 	virtual void execute();
@@ -284,17 +749,22 @@ class CompressChannelBits : public Task
 	char * const _origin;
 	const ptrdiff_t _rowbytes;
 	const std::vector<UncompressedVideoCodec::ChannelBits> &_channelVec;
+	const unsigned char _padding;
+	const UncompressedVideoCodec::PackMode _packMode;
 	const FrameBuffer &_frame;
 	const int _y;
 	
 	static void CompressChannel(char *dst_row, ptrdiff_t dst_stride, int bit_depth, const Slice &row_slice, int width);
+	static void CompressBits(char *dst_row, const RowSlices &row_slices, unsigned char padding, int width);
 };
 
-CompressChannelBits::CompressChannelBits(TaskGroup *group, char *origin, ptrdiff_t rowbytes, const std::vector<UncompressedVideoCodec::ChannelBits> &channelVec, const FrameBuffer &frame, int y) :
+CompressChannelBits::CompressChannelBits(TaskGroup *group, char *origin, ptrdiff_t rowbytes, const std::vector<UncompressedVideoCodec::ChannelBits> &channelVec, unsigned char padding, UncompressedVideoCodec::PackMode packMode, const FrameBuffer &frame, int y) :
 	Task(group),
 	_origin(origin),
 	_rowbytes(rowbytes),
 	_channelVec(channelVec),
+	_padding(padding),
+	_packMode(packMode),
 	_frame(frame),
 	_y(y)
 {
@@ -304,19 +774,7 @@ CompressChannelBits::CompressChannelBits(TaskGroup *group, char *origin, ptrdiff
 void
 CompressChannelBits::execute()
 {
-	size_t pixel_size = 0;
-	
-	for(int i = 0; i < _channelVec.size(); i++)
-	{
-		const UncompressedVideoCodec::ChannelBits &chanbit = _channelVec[i];
-		
-		assert(PixelBits(chanbit.type) % 8 == 0); // not handling weird bit depths yet
-		
-		pixel_size += PixelSize(chanbit.type);
-	}
-	
-	
-	char * _row = _origin + (_rowbytes * _y);
+	RowSlices row_slices;
 	
 	for(int i = 0; i < _channelVec.size(); i++)
 	{
@@ -332,12 +790,57 @@ CompressChannelBits::execute()
 			
 			row_slice.base += (row_slice.yStride * _y);
 			
-			CompressChannel(_row, pixel_size, PixelBits(chanbit.type), row_slice, _frame.width());
+			row_slices.push_back(row_slice);
 		}
 		else
-			assert(false);
+			throw MoxMxf::ArgExc("Frame buffer missing channel");
+	}
 		
-		_row += PixelSize(chanbit.type);
+
+	char * _row = _origin + (_rowbytes * _y);
+
+	const int width = _frame.width();
+
+	if(_packMode == UncompressedVideoCodec::PACK_RGB10)
+	{
+		PackRGB10Row((UInt8 *)_row, row_slices[0], row_slices[1], row_slices[2], width);
+	}
+	else if(_packMode == UncompressedVideoCodec::PACK_BYTES)
+	{
+		int sample_size = 0;
+
+		const bool uniform = SlicesHaveUniformSize(row_slices, sample_size);
+
+		if(uniform && SlicesAreInterleaved(row_slices, sample_size))
+		{
+			SwapRow((UInt8 *)_row, (const UInt8 *)row_slices[0].base, width * row_slices.size(), sample_size);
+
+			return;
+		}
+		else if(uniform && SlicesArePlanar(row_slices, sample_size) && row_slices.size() <= 4)
+		{
+			const UInt8 *in[4];
+
+			for(int i = 0; i < row_slices.size(); i++)
+				in[i] = (const UInt8 *)row_slices[i].base;
+
+			if( InterleaveRow((UInt8 *)_row, in, row_slices.size(), sample_size, width) )
+				return;
+		}
+
+		// one channel at a time, any strides
+		const size_t pixel_size = (_rowbytes / width);
+
+		for(int i = 0; i < row_slices.size(); i++)
+		{
+			CompressChannel(_row, pixel_size, PixelBits(row_slices[i].type), row_slices[i], width);
+
+			_row += PixelSize(row_slices[i].type);
+		}
+	}
+	else
+	{
+		CompressBits(_row, row_slices, _padding, width);
 	}
 }
 
@@ -406,6 +909,47 @@ CompressChannelBits::CompressChannel(char *dst_row, ptrdiff_t dst_stride, int bi
 		assert(false);
 }
 
+void
+CompressChannelBits::CompressBits(char *dst_row, const RowSlices &row_slices, unsigned char padding, int width)
+{
+	UInt8 *out = (UInt8 *)dst_row;
+
+	UInt64 bits = 0;
+	int num_bits = 0;
+
+	for(int x = 0; x < width; x++)
+	{
+		for(int i = 0; i < row_slices.size(); i++)
+		{
+			const Slice &slice = row_slices[i];
+
+			const int depth = PixelLayoutBits(slice.type);
+
+			const UInt32 val = ReadSample(slice.base + (x * slice.xStride), slice.type);
+
+			bits = (bits << depth) | (val & (UInt32)((1ULL << depth) - 1));
+			num_bits += depth;
+
+			while(num_bits >= 8)
+			{
+				*out++ = (bits >> (num_bits - 8)) & 0xff;
+				num_bits -= 8;
+			}
+		}
+
+		bits <<= padding;
+		num_bits += padding;
+
+		while(num_bits >= 8)
+		{
+			*out++ = (bits >> (num_bits - 8)) & 0xff;
+			num_bits -= 8;
+		}
+	}
+
+	assert(num_bits == 0);
+}
+
 
 void
 UncompressedVideoCodec::compress(const FrameBuffer &frame)
@@ -415,44 +959,48 @@ UncompressedVideoCodec::compress(const FrameBuffer &frame)
 
 	bool input_matches = true;
 	
-	unsigned int bits_per_pixel = 0;
+	RowSlices frame_slices;
 	
 	for(std::vector<ChannelBits>::const_iterator i = _channelVec.begin(); i != _channelVec.end(); ++i)
 	{
-		bits_per_pixel += PixelLayoutBits(i->type);
-		
-		assert(PixelLayoutBits(i->type) % 8 == 0); // not dealing with weird bits yet
-		
 		const Slice *slice = frame.findSlice(i->name);
 		
 		if(slice)
 		{
 			if(slice->type != i->type)
 				input_matches = false;
+
+			frame_slices.push_back(*slice);
 		}
 		else
 			assert(false);
 	}
 	
-	bits_per_pixel += _padding;
-	
-	assert(bits_per_pixel % 8 == 0);
-	
 	assert(input_matches);
 	
 	
-	const size_t pixel_size = (bits_per_pixel >> 3);
+	const size_t pixel_size = pixelSize();
 	const size_t rowbytes = _descriptor.getStoredWidth() * pixel_size;
 	const size_t data_size = rowbytes * _descriptor.getStoredHeight();
 	
-	DataChunkPtr data = new DataChunk(data_size);
+	DataChunkPtr data = new PooledDataChunk(data_size);
 	
+	int sample_size = 0;
+
+	if(_packMode == PACK_BYTES && frame_slices.size() == _channelVec.size() &&
+		SlicesHaveUniformSize(frame_slices, sample_size) && sample_size == 1 &&
+		SlicesAreInterleaved(frame_slices, sample_size) && frame_slices[0].yStride == rowbytes)
+	{
+		// 8-bit frame already laid out exactly like the essence
+		memcpy(data->Data, frame_slices[0].base, data_size);
+	}
+	else
 	{
 		TaskGroup taskGroup;
 		
 		for(int y = 0; y < _descriptor.getStoredHeight(); y++)
 		{
-			ThreadPool::addGlobalTask(new CompressChannelBits(&taskGroup, (char *)data->Data, rowbytes, _channelVec, frame, y));
+			ThreadPool::addGlobalTask(new CompressChannelBits(&taskGroup, (char *)data->Data, rowbytes, _channelVec, _padding, _packMode, frame, y));
 		}
 	}
 	
@@ -463,27 +1011,36 @@ UncompressedVideoCodec::compress(const FrameBuffer &frame)
 class DecompressChannelBits : public Task
 {
   public:
-	DecompressChannelBits(TaskGroup *group, const FrameBuffer &frame, const char *origin, ptrdiff_t rowbytes, const std::vector<UncompressedVideoCodec::ChannelBits> &channelVec, int y);
+	DecompressChannelBits(TaskGroup *group, const FrameBuffer &frame, const char *row, size_t pixel_size, const std::vector<UncompressedVideoCodec::ChannelBits> &channelVec, unsigned char padding, UncompressedVideoCodec::PackMode packMode, int x, int width, int y);
 	~DecompressChannelBits() {}
 	
 	virtual void execute();
 	
   private:
 	const FrameBuffer &_frame;
-	const char * const _origin;
-	const ptrdiff_t _rowbytes;
+	const char * const _row;
+	const size_t _pixel_size;
 	const std::vector<UncompressedVideoCodec::ChannelBits> &_channelVec;
+	const unsigned char _padding;
+	const UncompressedVideoCodec::PackMode _packMode;
+	const int _x;
+	const int _width;
 	const int _y;
 	
 	static void DecompressChannel(const Slice &row_slice, const char *src_row, ptrdiff_t src_stride, int bit_depth, int width);
+	static void DecompressBits(const RowSlices &row_slices, const char *src_row, unsigned char padding, int width);
 };
 
-DecompressChannelBits::DecompressChannelBits(TaskGroup *group, const FrameBuffer &frame, const char *origin, ptrdiff_t rowbytes, const std::vector<UncompressedVideoCodec::ChannelBits> &channelVec, int y) :
+DecompressChannelBits::DecompressChannelBits(TaskGroup *group, const FrameBuffer &frame, const char *row, size_t pixel_size, const std::vector<UncompressedVideoCodec::ChannelBits> &channelVec, unsigned char padding, UncompressedVideoCodec::PackMode packMode, int x, int width, int y) :
 	Task(group),
 	_frame(frame),
-	_origin(origin),
-	_rowbytes(rowbytes),
+	_row(row),
+	_pixel_size(pixel_size),
 	_channelVec(channelVec),
+	_padding(padding),
+	_packMode(packMode),
+	_x(x),
+	_width(width),
 	_y(y)
 {
 
@@ -492,19 +1049,9 @@ DecompressChannelBits::DecompressChannelBits(TaskGroup *group, const FrameBuffer
 void
 DecompressChannelBits::execute()
 {
-	size_t pixel_size = 0;
-	
-	for(int i = 0; i < _channelVec.size(); i++)
-	{
-		const UncompressedVideoCodec::ChannelBits &chanbit = _channelVec[i];
-		
-		assert(PixelBits(chanbit.type) % 8 == 0); // not handling weird bit depths yet
-		
-		pixel_size += PixelSize(chanbit.type);
-	}
-	
+	RowSlices row_slices;
 	
-	const char * _row = _origin + (_rowbytes * _y);
+	bool all_channels = true;
 	
 	for(int i = 0; i < _channelVec.size(); i++)
 	{
@@ -518,14 +1065,63 @@ DecompressChannelBits::execute()
 		
 			Slice row_slice = *frame_slice;
 			
-			row_slice.base += (row_slice.yStride * _y);
+			row_slice.base += (row_slice.yStride * _y) + (row_slice.xStride * _x);
 			
-			DecompressChannel(row_slice, _row, pixel_size, PixelBits(chanbit.type), _frame.width());
+			row_slices.push_back(row_slice);
 		}
 		else
-			assert(false);
+		{
+			// not wanted, just step over it
+			row_slices.push_back(Slice(chanbit.type, NULL));
 		
-		_row += PixelSize(chanbit.type);
+			all_channels = false;
+		}
+	}
+
+
+	const char *row = _row;
+
+	const int width = _width;
+
+	if(_packMode == UncompressedVideoCodec::PACK_RGB10 && all_channels)
+	{
+		UnpackRGB10Row(row_slices[0], row_slices[1], row_slices[2], (const UInt8 *)row, width);
+	}
+	else if(_packMode == UncompressedVideoCodec::PACK_BYTES)
+	{
+		int sample_size = 0;
+
+		const bool uniform = all_channels && SlicesHaveUniformSize(row_slices, sample_size);
+
+		if(uniform && SlicesAreInterleaved(row_slices, sample_size))
+		{
+			SwapRow((UInt8 *)row_slices[0].base, (const UInt8 *)row, width * row_slices.size(), sample_size);
+
+			return;
+		}
+		else if(uniform && SlicesArePlanar(row_slices, sample_size) && row_slices.size() <= 4)
+		{
+			UInt8 *out[4];
+
+			for(int i = 0; i < row_slices.size(); i++)
+				out[i] = (UInt8 *)row_slices[i].base;
+
+			if( DeinterleaveRow(out, (const UInt8 *)row, row_slices.size(), sample_size, width) )
+				return;
+		}
+
+		for(int i = 0; i < row_slices.size(); i++)
+		{
+			if(row_slices[i].base != NULL)
+				DecompressChannel(row_slices[i], row, _pixel_size, PixelBits(row_slices[i].type), width);
+
+			row += PixelSize(row_slices[i].type);
+		}
+	}
+	else
+	{
+		// RGB10 is the same layout, read bit by bit
+		DecompressBits(row_slices, row, _padding, width);
 	}
 }
 
@@ -590,84 +1186,228 @@ DecompressChannelBits::DecompressChannel(const Slice &row_slice, const char *src
 		assert(false);
 }
 
-
 void
-UncompressedVideoCodec::decompress(const DataChunk &data)
+DecompressChannelBits::DecompressBits(const RowSlices &row_slices, const char *src_row, unsigned char padding, int width)
 {
-	unsigned int bits_per_pixel = 0;
-	
-	for(std::vector<ChannelBits>::const_iterator i = _channelVec.begin(); i != _channelVec.end(); ++i)
+	const UInt8 *in = (const UInt8 *)src_row;
+
+	UInt64 bits = 0;
+	int num_bits = 0;
+
+	for(int x = 0; x < width; x++)
 	{
-		bits_per_pixel += PixelLayoutBits(i->type);
-		
-		assert(PixelLayoutBits(i->type) % 8 == 0); // not dealing with weird bits yet
+		for(int i = 0; i < row_slices.size(); i++)
+		{
+			const Slice &slice = row_slices[i];
+
+			const int depth = PixelLayoutBits(slice.type);
+
+			while(num_bits < depth)
+			{
+				bits = (bits << 8) | *in++;
+				num_bits += 8;
+			}
+
+			const UInt32 val = (bits >> (num_bits - depth)) & (UInt32)((1ULL << depth) - 1);
+			num_bits -= depth;
+
+			if(slice.base != NULL)
+				WriteSample(slice.base + (x * slice.xStride), slice.type, val);
+		}
+
+		while(num_bits < padding)
+		{
+			bits = (bits << 8) | *in++;
+			num_bits += 8;
+		}
+
+		num_bits -= padding;
 	}
-	
-	bits_per_pixel += _padding;
-	
-	assert(bits_per_pixel % 8 == 0);
-	
-	const size_t pixel_size = (bits_per_pixel >> 3);
+}
+
+
+void
+UncompressedVideoCodec::decompress(const DataChunk &data)
+{
+	const size_t pixel_size = pixelSize();
 	const size_t rowbytes = pixel_size * _descriptor.getStoredWidth();
 	const size_t data_size = rowbytes * _descriptor.getStoredHeight();
 	
-	assert(data_size == data.Size);
-	
-	//FrameBuffer encoded_frameBuffer(_descriptor.getWidth(), _descriptor.getHeight());
+	if(data.Size < data_size)
+		throw MoxMxf::InputExc("Stored data is too small");
 	
 	
-	FrameBufferPtr exported_frameBuffer = new FrameBuffer(this->dataWindow());
-	
-	DataChunkPtr data_to_store = new DataChunk(data_size);
-	
-	exported_frameBuffer->attachData(data_to_store);
-	
-	
-	//char *encoded_origin = (char *)data.Data;
-	
-	char *exported_origin = (char *)data_to_store->Data + _descriptor.getImageAlignmentOffset() + _descriptor.getImageStartOffset();
+	const Box2i dataW = dataWindow();
 	
+	FrameBufferPtr exported_frameBuffer = new FrameBuffer(dataW);
+
 	assert(_descriptor.getImageAlignmentOffset() == 0 && _descriptor.getImageStartOffset() == 0);
-	
-	for(int i = 0; i < _channelVec.size(); i++)
+
+	char *interleaved_data = NULL;
+
+	if(_packMode == PACK_BYTES)
 	{
-		const ChannelBits &chan = _channelVec[i];
+		// export the same interleaved layout as the essence, so rows only need a byte swap
+		DataChunkPtr data_to_store = new PooledDataChunk(data_size);
 		
-		const size_t bytes_this_subpixel = (PixelLayoutBits(chan.type) >> 3);
-	
-		if(chan.code != 'F')
+		exported_frameBuffer->attachData(data_to_store);
+		
+		interleaved_data = (char *)data_to_store->Data;
+		
+		char *exported_origin = interleaved_data - (dataW.min.x * pixel_size) - (dataW.min.y * rowbytes);
+		
+		for(int i = 0; i < _channelVec.size(); i++)
 		{
-			//encoded_frameBuffer.insert(chan.name, Slice(MoxFiles::UINT8, encoded_origin, pixel_size, rowbytes));
-			
-			//encoded_origin += bytes_this_subpixel;
+			const ChannelBits &chan = _channelVec[i];
 			
 			exported_frameBuffer->insert(chan.name, Slice(chan.type, exported_origin, pixel_size, rowbytes));
-			
-			exported_origin += bytes_this_subpixel;
+				
+			exported_origin += PixelSize(chan.type);
 		}
 	}
-	
-	
+	else
 	{
-		TaskGroup taskGroup;
-		
-		for(int y = 0; y < _descriptor.getStoredHeight(); y++)
+		// bit-packed essence goes out planar
+		const int width = _descriptor.getStoredWidth();
+		const int height = _descriptor.getStoredHeight();
+
+		for(int i = 0; i < _channelVec.size(); i++)
 		{
-			ThreadPool::addGlobalTask(new DecompressChannelBits(&taskGroup, *exported_frameBuffer, (char *)data.Data, rowbytes, _channelVec, y));
+			const ChannelBits &chan = _channelVec[i];
+
+			const size_t pix_size = PixelSize(chan.type);
+			const size_t chan_rowbytes = pix_size * width;
+
+			DataChunkPtr chan_data = new PooledDataChunk(chan_rowbytes * height);
+
+			exported_frameBuffer->attachData(chan_data);
+
+			char *chan_origin = (char *)chan_data->Data - (dataW.min.x * pix_size) - (dataW.min.y * chan_rowbytes);
+
+			exported_frameBuffer->insert(chan.name, Slice(chan.type, chan_origin, pix_size, chan_rowbytes));
 		}
 	}
-
 	
-	//exported_frameBuffer->copyFromFrame(encoded_frameBuffer);
+	
+	bool all_8bit = true;
+
+	for(int i = 0; i < _channelVec.size(); i++)
+	{
+		if(_channelVec[i].type != MoxFiles::UINT8)
+			all_8bit = false;
+	}
+
+	if(_packMode == PACK_BYTES && all_8bit)
+	{
+		// nothing to unpack
+		memcpy(interleaved_data, data.Data, data_size);
+	}
+	else
+	{
+		decompressFrame(data, *exported_frameBuffer, dataW);
+	}
 	
 	storeFrame(exported_frameBuffer);
 }
 
 
+bool
+UncompressedVideoCodec::decompressInto(const DataChunk &data, FrameBuffer &frameBuffer)
+{
+	if(frameBuffer.dataWindow() != dataWindow())
+		return VideoCodec::decompressInto(data, frameBuffer);
+
+	return decompressRegion(data, frameBuffer, dataWindow());
+}
+
+
+bool
+UncompressedVideoCodec::decompressRegion(const DataChunk &data, FrameBuffer &frameBuffer, const Box2i &region)
+{
+	ChannelList channels;
+
+	for(std::vector<ChannelBits>::const_iterator i = _channelVec.begin(); i != _channelVec.end(); ++i)
+		channels.insert(i->name, Channel(i->type));
+
+	if( subsetOfChannels(frameBuffer, channels) )
+	{
+		// the row unpackers work with whatever strides the caller has,
+		// and step over the channels that aren't there
+		decompressFrame(data, frameBuffer, region);
+	}
+	else
+	{
+		// unpack just the region and the channels we need into our own buffers, then convert
+		FrameBuffer region_frameBuffer(region);
+
+		const int width = (region.max.x - region.min.x + 1);
+		const int height = (region.max.y - region.min.y + 1);
+
+		for(int i = 0; i < _channelVec.size(); i++)
+		{
+			const ChannelBits &chan = _channelVec[i];
+
+			if( !channelWanted(frameBuffer, chan.name) )
+				continue;
+
+			const size_t pix_size = PixelSize(chan.type);
+			const size_t chan_rowbytes = pix_size * width;
+
+			DataChunkPtr chan_data = new PooledDataChunk(chan_rowbytes * height);
+
+			region_frameBuffer.attachData(chan_data);
+
+			char *chan_origin = (char *)chan_data->Data - (region.min.x * pix_size) - (region.min.y * chan_rowbytes);
+
+			region_frameBuffer.insert(chan.name, Slice(chan.type, chan_origin, pix_size, chan_rowbytes));
+		}
+
+		decompressFrame(data, region_frameBuffer, region);
+
+		FrameBuffer region_view(frameBuffer, region);
+
+		region_view.copyFromFrame(region_frameBuffer);
+	}
+
+	return true;
+}
+
+
+void
+UncompressedVideoCodec::decompressFrame(const DataChunk &data, const FrameBuffer &frameBuffer, const Box2i &region)
+{
+	const size_t pixel_size = pixelSize();
+	const size_t rowbytes = pixel_size * _descriptor.getStoredWidth();
+
+	if(data.Size < rowbytes * _descriptor.getStoredHeight())
+		throw MoxMxf::InputExc("Stored data is too small");
+
+	const Box2i dataW = dataWindow();
+
+	assert(region.min.x >= dataW.min.x && region.max.x <= dataW.max.x);
+	assert(region.min.y >= dataW.min.y && region.max.y <= dataW.max.y);
+
+	// every pixel starts on a byte, thanks to the padding, so we can start
+	// partway into a row and skip the rows we don't want entirely
+	const char *origin = (const char *)data.Data + ((region.min.x - dataW.min.x) * pixel_size);
+
+	const int width = (region.max.x - region.min.x + 1);
+
+	TaskGroup taskGroup;
+
+	for(int y = region.min.y; y <= region.max.y; y++)
+	{
+		const char *row = origin + ((y - dataW.min.y) * rowbytes);
+
+		ThreadPool::addGlobalTask(new DecompressChannelBits(&taskGroup, frameBuffer, row, pixel_size, _channelVec, _padding, _packMode, region.min.x, width, y));
+	}
+}
+
+
 bool
 UncompressedVideoCodecInfo::canCompressType(PixelType pixelType) const
 {
-	return (pixelType == UINT8 || pixelType == UINT16 || pixelType == FLOAT);
+	return (pixelType == UINT8 || pixelType == UINT10 || pixelType == UINT12 || pixelType == UINT16 || pixelType == FLOAT);
 }
 
 
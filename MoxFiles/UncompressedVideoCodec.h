@@ -25,6 +25,8 @@ namespace MoxFiles
 				
 		virtual void compress(const FrameBuffer &frame);
 		virtual void decompress(const DataChunk &data);
+		virtual bool decompressInto(const DataChunk &data, FrameBuffer &frameBuffer);
+		virtual bool decompressRegion(const DataChunk &data, FrameBuffer &frameBuffer, const Box2i &region);
 	
 	  private:
 		MoxMxf::RGBADescriptor _descriptor;
@@ -38,11 +40,24 @@ namespace MoxFiles
 			ChannelBits(std::string n, unsigned char c, PixelType t) : name(n), code(c), type(t) {}
 		} ChannelBits;
 		
+		// How the essence is laid out, picks the row packer
+		enum PackMode {
+			PACK_BYTES,		// every sample a whole number of bytes, no fill
+			PACK_RGB10,		// R10 G10 B10 F2 in 32 bits
+			PACK_GENERIC	// anything else, packed bit by bit
+		};
+		
 		friend class CompressChannelBits;
 		friend class DecompressChannelBits;
 		
 		std::vector<ChannelBits> _channelVec;
 		unsigned char _padding;
+		PackMode _packMode;
+		
+		PackMode choosePackMode() const;
+		size_t pixelSize() const;
+		
+		void decompressFrame(const DataChunk &data, const FrameBuffer &frameBuffer, const Box2i &region);
 	};
 	
 	class UncompressedVideoCodecInfo : public VideoCodecInfo
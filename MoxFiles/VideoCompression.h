@@ -24,6 +24,8 @@ namespace MoxFiles
 		OPENEXR,
 		DIRAC,
 		MPEG,
+		UNCOMPRESSED_CDCI,	// 4:2:2 Y'CbCr, UYVY or v210
+		PLANAR,				// lossless planes, zstd or LZ4
 		
 
 		NUM_VIDEO_COMPRESSION_METHODS	// number of different compression methods
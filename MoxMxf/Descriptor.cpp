@@ -367,6 +367,24 @@ VideoDescriptor::makeDescriptorObj() const
 	return descriptor;
 }
 
+UInt8
+VideoDescriptor::getCodingVariant() const
+{
+	return _picture_essence_coding.GetValue()[15];
+}
+
+void
+VideoDescriptor::setCodingVariant(UInt8 variant)
+{
+	UInt8 coding_data[16];
+	
+	memcpy(coding_data, _picture_essence_coding.GetValue(), 16);
+	
+	coding_data[15] = variant;
+	
+	_picture_essence_coding = mxflib::UL(coding_data);
+}
+
 VideoDescriptor::CaptureGamma
 VideoDescriptor::getCaptureGamma() const
 {
@@ -444,6 +462,9 @@ static const mxflib::UL GC_Dirac_FrameWrapped_UL(GC_Dirac_FrameWrapped_Data);
 static const UInt8 Uncompressed_422_YCbCr_8bit_Picture_Coding_Data[16] = { 0x06, 0x0e, 0x2b, 0x34, 0x04, 0x01, 0x01, 0x0a, 0x04, 0x01, 0x02, 0x01, 0x01, 0x02, 0x01, 0x02 };
 static const mxflib::UL Uncompressed_422_YCbCr_8bit_Picture_Coding_UL(Uncompressed_422_YCbCr_8bit_Picture_Coding_Data);
 
+static const UInt8 Uncompressed_422_YCbCr_10bit_Picture_Coding_Data[16] = { 0x06, 0x0e, 0x2b, 0x34, 0x04, 0x01, 0x01, 0x0a, 0x04, 0x01, 0x02, 0x01, 0x01, 0x02, 0x02, 0x01 };
+static const mxflib::UL Uncompressed_422_YCbCr_10bit_Picture_Coding_UL(Uncompressed_422_YCbCr_10bit_Picture_Coding_Data);
+
 static const UInt8 Dirac_YCbCr_Picture_Coding_Data[16] = { 0x06, 0x0e, 0x2b, 0x34, 0x04, 0x01, 0x01, 0x0c, 0x04, 0x01, 0x02, 0x02, 0x73, 0x01, 0x00, 0x00 };
 static const mxflib::UL Dirac_YCbCr_Picture_Coding_UL(Dirac_YCbCr_Picture_Coding_Data);
 
@@ -522,7 +543,8 @@ CDCIDescriptor::getVideoCodec() const
 	{
 		return VideoCodecDiracCDCI;
 	}
-	else if(coding.Matches(Uncompressed_422_YCbCr_8bit_Picture_Coding_Data))
+	else if(coding.Matches(Uncompressed_422_YCbCr_8bit_Picture_Coding_Data) ||
+			coding.Matches(Uncompressed_422_YCbCr_10bit_Picture_Coding_Data))
 	{
 		return VideoCodecUncompressedCDCI;
 	}
@@ -533,6 +555,22 @@ CDCIDescriptor::getVideoCodec() const
 }
 
 
+void
+CDCIDescriptor::setComponentDepth(UInt32 val)
+{
+	_component_depth = val;
+	
+	// uncompressed 8-bit and 10-bit have their own coding labels
+	if(getVideoCodec() == VideoCodecUncompressedCDCI)
+	{
+		if(val == 10)
+			setPictureEssenceCoding(Uncompressed_422_YCbCr_10bit_Picture_Coding_UL);
+		else
+			setPictureEssenceCoding(Uncompressed_422_YCbCr_8bit_Picture_Coding_UL);
+	}
+}
+
+
 RGBADescriptor::RGBADescriptor(mxflib::MDObjectPtr descriptor) :
 	VideoDescriptor(descriptor)
 {
@@ -568,6 +606,15 @@ RGBADescriptor::RGBADescriptor(mxflib::MDObjectPtr descriptor) :
 	}
 	else
 		assert(false);
+	
+	mxflib::MDObjectPtr palette = descriptor->Child(Palette_UL);
+	
+	if(palette)
+	{
+		const mxflib::DataChunk &dat = palette->GetData();
+		
+		_palette.assign(dat.Data, dat.Data + dat.Size);
+	}
 }
 
 // these are the "non-standard" ULs.  The standard ones seem to only apply to YCbCr.
@@ -605,6 +652,9 @@ static const mxflib::UL GC_JPEG_XT_FrameWrapped_UL(GC_JPEG_XT_FrameWrapped_Data)
 static const UInt8 GC_DPX_FrameWrapped_Data[16] = { 0x06, 0x0e, 0x2b, 0x34, 0x04, 0x01, 0x01, 0x0c, 0x0d, 0x01, 0x03, 0x01, 0x02, 0x19, 0x01, 0x00 };
 static const mxflib::UL GC_DPX_FrameWrapped_UL(GC_DPX_FrameWrapped_Data);
 
+static const UInt8 GC_Planar_FrameWrapped_Data[16] = { 0x06, 0x0e, 0x2b, 0x34, 0x04, 0x01, 0x01, 0x0c, 0x0d, 0x01, 0x03, 0x01, 0x02, 0x1c, 0x01, 0x00 };
+static const mxflib::UL GC_Planar_FrameWrapped_UL(GC_Planar_FrameWrapped_Data);
+
 
 static const UInt8 PNG_Picture_Coding_Data[16] = { 0x06, 0x0e, 0x2b, 0x34, 0x04, 0x01, 0x01, 0x0c, 0x04, 0x01, 0x02, 0x02, 0x03, 0x03, 0x01, 0x00 };
 static const mxflib::UL PNG_Picture_Coding_UL(PNG_Picture_Coding_Data);
@@ -624,6 +674,9 @@ static const mxflib::UL JPEG_XT_Picture_Coding_UL(JPEG_XT_Picture_Coding_Data);
 static const UInt8 DPX_Picture_Coding_Data[16] = { 0x06, 0x0e, 0x2b, 0x34, 0x04, 0x01, 0x01, 0x0c, 0x04, 0x01, 0x02, 0x02, 0x03, 0x06, 0x01, 0x00 };
 static const mxflib::UL DPX_Picture_Coding_UL(DPX_Picture_Coding_Data);
 
+static const UInt8 Planar_Picture_Coding_Data[16] = { 0x06, 0x0e, 0x2b, 0x34, 0x04, 0x01, 0x01, 0x0c, 0x04, 0x01, 0x02, 0x02, 0x03, 0x09, 0x01, 0x00 };
+static const mxflib::UL Planar_Picture_Coding_UL(Planar_Picture_Coding_Data);
+
 
 RGBADescriptor::RGBADescriptor(Rational sample_rate, UInt32 width, UInt32 height, VideoCodec codec) :
 	VideoDescriptor(sample_rate, width, height),
@@ -678,6 +731,11 @@ RGBADescriptor::RGBADescriptor(Rational sample_rate, UInt32 width, UInt32 height
 		setEssenceContainerLabel(GC_DPX_FrameWrapped_UL);
 		setPictureEssenceCoding(DPX_Picture_Coding_UL);
 	}
+	else if(codec == VideoCodecPlanar)
+	{
+		setEssenceContainerLabel(GC_Planar_FrameWrapped_UL);
+		setPictureEssenceCoding(Planar_Picture_Coding_UL);
+	}
 	else
 		throw ArgExc("Unsupported RGB codec");
 }
@@ -691,6 +749,7 @@ RGBADescriptor::RGBADescriptor(const RGBADescriptor &other) :
 	_alpha_min_ref = other._alpha_min_ref;
 	_scanning_direction = other._scanning_direction;
 	_pixel_layout = other._pixel_layout;
+	_palette = other._palette;
 }
 
 mxflib::MDObjectPtr
@@ -748,10 +807,27 @@ RGBADescriptor::makeDescriptorObj() const
 	else
 		assert(false); // pixel layout wasn't set
 	
+	if(_palette.size() > 0)
+		descriptor->AddChild(Palette_UL)->SetValue(&_palette[0], _palette.size());
+	
 	return descriptor;
 }
 
 
+// ignores the variant byte, see VideoDescriptor::setCodingVariant()
+static bool
+MatchesCodingFamily(const mxflib::UL &coding, const mxflib::UL &family)
+{
+	UInt8 coding_data[16];
+	
+	memcpy(coding_data, coding.GetValue(), 16);
+	
+	coding_data[15] = family.GetValue()[15];
+	
+	return mxflib::UL(coding_data).Matches(family);
+}
+
+
 VideoDescriptor::VideoCodec
 RGBADescriptor::getVideoCodec() const
 {
@@ -761,11 +837,11 @@ RGBADescriptor::getVideoCodec() const
 	{
 		return VideoCodecUncompressedRGB;
 	}
-	else if(coding.Matches(PNG_Picture_Coding_UL))
+	else if(MatchesCodingFamily(coding, PNG_Picture_Coding_UL))
 	{
 		return VideoCodecPNG;
 	}
-	else if(coding.Matches(OpenEXR_Picture_Coding_UL))
+	else if(MatchesCodingFamily(coding, OpenEXR_Picture_Coding_UL))
 	{
 		return VideoCodecOpenEXR;
 	}
@@ -777,7 +853,7 @@ RGBADescriptor::getVideoCodec() const
 	{
 		return VideoCodecJPEG2000;
 	}
-	else if(coding.Matches(JPEG_LS_Picture_Coding_UL))
+	else if(MatchesCodingFamily(coding, JPEG_LS_Picture_Coding_UL))
 	{
 		return VideoCodecJPEGLS;
 	}
@@ -797,6 +873,10 @@ RGBADescriptor::getVideoCodec() const
 	{
 		return VideoCodecDiracRGB;
 	}
+	else if(MatchesCodingFamily(coding, Planar_Picture_Coding_UL))
+	{
+		return VideoCodecPlanar;
+	}
 	else
 		assert(false);
 	
@@ -947,6 +1027,13 @@ static const mxflib::UL SMPTE_AIFF_Uncompressed_Sound_Coding_UL(SMPTE_AIFF_Uncom
 static const UInt8 SMPTE_Undefined_Sound_Coding_Data[16] = { 0x06, 0x0e, 0x2b, 0x34, 0x04, 0x01, 0x01, 0x0a, 0x04, 0x02, 0x02, 0x01, 0x7f, 0x00, 0x00, 0x00 };
 static const mxflib::UL SMPTE_Undefined_Sound_Coding_UL(SMPTE_Undefined_Sound_Coding_Data);
 
+// MOX ULs
+static const UInt8 GC_FLAC_FrameWrapped_Data[16] = { 0x06, 0x0e, 0x2b, 0x34, 0x04, 0x01, 0x01, 0x0c, 0x0d, 0x01, 0x03, 0x01, 0x02, 0x1d, 0x01, 0x00 };
+static const mxflib::UL GC_FLAC_FrameWrapped_UL(GC_FLAC_FrameWrapped_Data);
+
+static const UInt8 FLAC_Sound_Coding_Data[16] = { 0x06, 0x0e, 0x2b, 0x34, 0x04, 0x01, 0x01, 0x0c, 0x04, 0x02, 0x02, 0x02, 0x04, 0x01, 0x01, 0x00 };
+static const mxflib::UL FLAC_Sound_Coding_UL(FLAC_Sound_Coding_Data);
+
 // just a sample of what you might put in _channel_assignment
 static const UInt8 SMPTE_320M_8Channel_ModeA_Data[16] = { 0x06, 0x0e, 0x2b, 0x34, 0x04, 0x01, 0x01, 0x09, 0x04, 0x02, 0x02, 0x10, 0x02, 0x01, 0x00, 0x00 };
 static const mxflib::UL SMPTE_320M_8Channel_ModeA_UL(SMPTE_320M_8Channel_ModeA_Data);
@@ -963,16 +1050,28 @@ WaveAudioDescriptor::WaveAudioDescriptor(mxflib::MDObjectPtr descriptor) :
 		_channel_assignment = mxflib::UL(channel_assignment->GetData().Data);
 }
 
-WaveAudioDescriptor::WaveAudioDescriptor(Rational sample_rate, Rational audio_sample_rate, UInt32 channel_count, UInt32 quantization_bits) :
+WaveAudioDescriptor::WaveAudioDescriptor(Rational sample_rate, Rational audio_sample_rate, UInt32 channel_count, UInt32 quantization_bits, AudioCodec codec) :
 	AudioDescriptor(sample_rate, audio_sample_rate, channel_count, quantization_bits)
 {
+	// for FLAC these are what the PCM would be
 	_block_align = (quantization_bits + 7) / 8;
 	
 	_avg_bytes_per_sec = _block_align * channel_count * audio_sample_rate.Numerator / audio_sample_rate.Denominator;
 	
-	setEssenceContainerLabel(MXF_GC_BWF_FrameWrapped_UL);
-	
-	setSoundCompression(SMPTE_382M_Default_Uncompressed_Sound_Coding_UL);
+	if(codec == AudioCodecUncompressedPCM)
+	{
+		setEssenceContainerLabel(MXF_GC_BWF_FrameWrapped_UL);
+		
+		setSoundCompression(SMPTE_382M_Default_Uncompressed_Sound_Coding_UL);
+	}
+	else if(codec == AudioCodecFLAC)
+	{
+		setEssenceContainerLabel(GC_FLAC_FrameWrapped_UL);
+		
+		setSoundCompression(FLAC_Sound_Coding_UL);
+	}
+	else
+		throw ArgExc("Unsupported Wave codec");
 }
 
 WaveAudioDescriptor::WaveAudioDescriptor(const WaveAudioDescriptor &other) :
@@ -984,6 +1083,25 @@ WaveAudioDescriptor::WaveAudioDescriptor(const WaveAudioDescriptor &other) :
 }
 	
 
+UInt8
+WaveAudioDescriptor::getGCElementType() const
+{
+	// BWF frame-wrapped, but FLAC gets a number SMPTE 382M doesn't use,
+	// so a reader that only looks at the essence key can't take it for PCM
+	return (getAudioCodec() == AudioCodecFLAC ? 0x7f : 0x01);
+}
+
+
+WaveAudioDescriptor::AudioCodec
+WaveAudioDescriptor::getAudioCodec() const
+{
+	if(getSoundCompression() == FLAC_Sound_Coding_UL)
+		return AudioCodecFLAC;
+	else
+		return AudioCodecUncompressedPCM;
+}
+
+
 mxflib::MDObjectPtr
 WaveAudioDescriptor::makeDescriptorObj() const
 {
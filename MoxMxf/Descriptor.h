@@ -88,6 +88,7 @@ namespace MoxMxf
 			VideoCodecDPX,
 			VideoCodecDiracCDCI,
 			VideoCodecDiracRGB,
+			VideoCodecPlanar,
 			VideoCodecUnknown
 		};
 		
@@ -180,6 +181,14 @@ namespace MoxMxf
 		const PictureComponentSizing & getPictureComponentSizing() const { return _picture_component_sizing; }
 		void setPictureComponentSizing(const PictureComponentSizing &val) { _picture_component_sizing = val; }
 		
+		// The last byte of MOX's own picture coding labels is left for the codec
+		// to say how the frames were coded.  0 is what every file written before
+		// variants existed has, so codecs that store a setting number it from 1
+		// (value + 1) and keep 0 for "not recorded".  Readers from before then
+		// only know the label with a 0 there, so only set one when it matters.
+		UInt8 getCodingVariant() const;
+		void setCodingVariant(UInt8 variant);
+		
 	  protected:
 		const mxflib::UL & getPictureEssenceCoding() const { return _picture_essence_coding; }
 		void setPictureEssenceCoding(const mxflib::UL &ul) { _picture_essence_coding = ul; }
@@ -261,7 +270,7 @@ namespace MoxMxf
 		UInt32 getWhiteRefLevel() const { return _white_ref_level; }
 		UInt32 getColorRange() const { return _color_range; }
 		
-		void setComponentDepth(UInt32 val) { _component_depth = val; }
+		void setComponentDepth(UInt32 val);
 		void setHorizontalSubsampling(UInt32 val) { _horizontal_subsampling = val; }
 		void setVerticalSubsampling(UInt32 val) { _vertical_subsampling = val; }
 		void setColorSiting(UInt8 val) { _color_siting = val; }
@@ -320,6 +329,14 @@ namespace MoxMxf
 		void setPixelLayout(const RGBALayout &layout) { _pixel_layout = layout; }
 		const RGBALayout & getPixelLayout() const { return _pixel_layout; }
 		
+		// SMPTE 377M E.2.47, only meaningful with a 'P' in the layout.  Without
+		// one, a codec can keep its own bytes here (MOX's planar codec keeps
+		// the full channel names, which don't fit in one-byte layout codes).
+		typedef std::vector<UInt8> Palette;
+		
+		void setPalette(const Palette &palette) { _palette = palette; }
+		const Palette & getPalette() const { return _palette; }
+	
 	  protected:
 		virtual const mxflib::UL & getDescriptorUL() const { return mxflib::RGBAEssenceDescriptor_UL; }
 	
@@ -341,7 +358,7 @@ namespace MoxMxf
 		UInt32 _alpha_min_ref;
 		UInt8 _scanning_direction;
 		RGBALayout _pixel_layout;
-		// palette
+		Palette _palette;
 		// palette layout
 	};
 
@@ -405,6 +422,7 @@ namespace MoxMxf
 		{
 			AudioCodecUncompressedPCM,
 			AudioCodecAES3,
+			AudioCodecFLAC,
 			AudioCodecUnknown
 		};
 		
@@ -416,6 +434,7 @@ namespace MoxMxf
 		
 	  protected:
 		void setSoundCompression(const mxflib::UL &ul) { _sound_compression = ul; }
+		const mxflib::UL & getSoundCompression() const { return _sound_compression; }
 	  
 		virtual const mxflib::UL & getDescriptorUL() const = 0;
 		
@@ -436,16 +455,16 @@ namespace MoxMxf
 	{
 	  public:
 		WaveAudioDescriptor(mxflib::MDObjectPtr descriptor);
-		WaveAudioDescriptor(Rational sample_rate, Rational audio_sample_rate, UInt32 channel_count, UInt32 quantization_bits);
+		WaveAudioDescriptor(Rational sample_rate, Rational audio_sample_rate, UInt32 channel_count, UInt32 quantization_bits, AudioCodec codec = AudioCodecUncompressedPCM);
 		WaveAudioDescriptor(const WaveAudioDescriptor &other);
 		virtual ~WaveAudioDescriptor() {}
 		
 		virtual mxflib::MDObjectPtr makeDescriptorObj() const;
 		
 		virtual UInt8 getGCItemType() const { return 0x16; } // SMPTE 382M-2007 6.5 (i.e. "GC Sound")
-		virtual UInt8 getGCElementType() const { return 0x01; } // BWF frame-wrapped
+		virtual UInt8 getGCElementType() const;
 		
-		virtual AudioCodec getAudioCodec() const { return AudioCodecUncompressedPCM; }
+		virtual AudioCodec getAudioCodec() const;
 
 	  protected:
 		virtual const mxflib::UL & getDescriptorUL() const { return mxflib::WaveAudioDescriptor_UL; }
@@ -328,7 +328,7 @@ class SequentialReadHandler : public mxflib::GCReadHandler_Base
 
 
 FramePtr
-InputFile::getFrame(Position EditUnit, SID bodySID, SID indexSID)
+InputFile::getFrame(Position EditUnit, SID bodySID, SID indexSID, bool reorder)
 {
 	assert(EditUnit >= 0 && EditUnit < getDuration());
 
@@ -372,7 +372,7 @@ InputFile::getFrame(Position EditUnit, SID bodySID, SID indexSID)
 				
 				assert(index->BodySID == bodySID);
 			
-				mxflib::IndexPosPtr posPtr = index->Lookup(EditUnit);
+				mxflib::IndexPosPtr posPtr = index->Lookup(EditUnit, 0, reorder);
 				
 				if(posPtr)
 				{
@@ -388,7 +388,7 @@ InputFile::getFrame(Position EditUnit, SID bodySID, SID indexSID)
 				{
 					assert(false); // asked for a frame not in the index
 				
-					return getFrame(EditUnit, bodySID, 0);
+					return getFrame(EditUnit, bodySID, 0, reorder);
 				}
 			}
 			else
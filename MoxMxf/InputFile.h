@@ -77,7 +77,10 @@ namespace MoxMxf
 		Length getDuration() const;
 		Rational getEditRate() const;
 		
-		FramePtr getFrame(Position EditUnit, SID bodySID, SID indexSID);
+		// EditUnit is in display order, unless reorder is false, in which case
+		// it's the position the frame is stored at (they differ when the index
+		// has temporal offsets, as with MPEG-2 B pictures).
+		FramePtr getFrame(Position EditUnit, SID bodySID, SID indexSID, bool reorder = true);
 		
 		static mxflib::PackagePtr findPackage(mxflib::MetadataParent mdata, const mxflib::UMID &package_id);
 		static UInt32 getSID(mxflib::MetadataParent mdata, const mxflib::UMID &package_id, bool getIndexSID);
@@ -303,16 +303,26 @@ OutputFile::PushEssence(TrackNum trackNumber, mxflib::DataChunkPtr data, int Key
 		
 		if(_index_manager)
 		{
-			const FrameInfo &next_frame_info = next_frame.begin()->second;
-			
-			if(next_frame_info.KeyOffset != 0)
-				_index_manager->OfferKeyOffset(_duration, next_frame_info.KeyOffset);
-			
-			if(next_frame_info.TemporalOffset != 0)
-				_index_manager->OfferTemporalOffset(_duration, next_frame_info.TemporalOffset);
-			
-			if(next_frame_info.Flags != -1)
-				_index_manager->OfferFlags(_duration, next_frame_info.Flags);
+			// There's one index entry for the whole edit unit, so take it from
+			// whichever track has one (i.e. the video, if it's inter-frame).
+			for(OutFrame::const_iterator i = next_frame.begin(); i != next_frame.end(); ++i)
+			{
+				const FrameInfo &next_frame_info = i->second;
+				
+				if(next_frame_info.KeyOffset != 0 || next_frame_info.TemporalOffset != 0 || next_frame_info.Flags != -1)
+				{
+					if(next_frame_info.KeyOffset != 0)
+						_index_manager->OfferKeyOffset(_duration, next_frame_info.KeyOffset);
+					
+					if(next_frame_info.TemporalOffset != 0)
+						_index_manager->OfferTemporalOffset(_duration, next_frame_info.TemporalOffset);
+					
+					if(next_frame_info.Flags != -1)
+						_index_manager->OfferFlags(_duration, next_frame_info.Flags);
+					
+					break;
+				}
+			}
 		}
 		else
 			assert(false);
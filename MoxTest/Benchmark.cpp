@@ -0,0 +1,240 @@
+/*
+ *  Benchmark.cpp
+ *  MoxFiles
+ *
+ *  Created by agent on 10/18/26.
+ *  Copyright 2026 fnord. All rights reserved.
+ *
+ */
+
+#include "Benchmark.h"
+
+#include <half.h>
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
+
+using namespace MoxFiles;
+
+
+double
+Seconds()
+{
+#ifdef _WIN32
+	LARGE_INTEGER count, frequency;
+	
+	QueryPerformanceCounter(&count);
+	QueryPerformanceFrequency(&frequency);
+	
+	return ((double)count.QuadPart / (double)frequency.QuadPart);
+#else
+	struct timeval tv;
+	
+	gettimeofday(&tv, NULL);
+	
+	return (tv.tv_sec + (tv.tv_usec / 1000000.0));
+#endif
+}
+
+
+void
+BenchmarkSize(int argc, char * const argv[], int &width, int &height, int &frames)
+{
+	if(argc > 3)
+	{
+		width = atoi(argv[1]);
+		height = atoi(argv[2]);
+		frames = atoi(argv[3]);
+	}
+}
+
+
+FrameBufferPtr
+MakeFrame(int width, int height, PixelType type, int channels, const char * const names[], bool fill)
+{
+	const size_t pixelSize = channels * PixelSize(type);
+	const size_t rowBytes = width * pixelSize;
+	
+	DataChunkPtr data = new PooledDataChunk(rowBytes * height);
+	
+	char *origin = (char *)data->Data;
+	
+	memset(origin, 0, rowBytes * height);
+	
+	FrameBufferPtr frame = new FrameBuffer(width, height);
+	
+	for(int i=0; i < channels; i++)
+		frame->insert(names[i], Slice(type, origin + (i * PixelSize(type)), pixelSize, rowBytes));
+	
+	frame->attachData(data);
+	
+	if(fill)
+		FillFrame(*frame);
+	
+	return frame;
+}
+
+
+static unsigned int
+MaxValue(PixelType type)
+{
+	switch(type)
+	{
+		case UINT8:		return 255;
+		case UINT10:	return 1023;
+		case UINT12:	return 4095;
+		case UINT16:	return 65535;
+		case UINT16A:	return 32768;
+		default:		return 0xffffffff;
+	}
+}
+
+
+void
+FillFrame(FrameBuffer &frame)
+{
+	const Box2i &dataW = frame.dataWindow();
+	
+	const int width = frame.width();
+	
+	int chan = 0;
+	
+	for(FrameBuffer::Iterator i = frame.begin(); i != frame.end(); ++i, chan++)
+	{
+		const bool alpha = !strcmp(i.name(), "A");
+		
+		Slice &slice = i.slice();
+		
+		for(int y = dataW.min.y; y <= dataW.max.y; y += slice.ySampling)
+		{
+			for(int x = dataW.min.x; x <= dataW.max.x; x += slice.xSampling)
+			{
+				const int u = (x - dataW.min.x);
+				const int v = (y - dataW.min.y);
+				
+				// a gradient a little different for each channel, plus texture
+				const float texture = (float)(((u * v) >> 6) & 0x1f) / 256.0f;
+				
+				float value = fmodf(((float)u * (chan + 1) / width) + texture, 1.0f);
+				
+				if(alpha)
+					value = (u < (width * 3 / 4) ? 1.0f : 0.0f);
+				
+				char *pix = slice.base + ((x / slice.xSampling) * slice.xStride) + ((y / slice.ySampling) * slice.yStride);
+				
+				if(slice.type == HALF || slice.type == FLOAT)
+				{
+					const float linear = (alpha ? value : powf(2.0f, (8.0f * value) - 4.0f));
+					
+					if(slice.type == HALF)
+						*(half *)pix = linear;
+					else
+						*(float *)pix = linear;
+				}
+				else
+				{
+					const unsigned int sample = (unsigned int)(value * MaxValue(slice.type));
+					
+					if(slice.type == UINT8)
+						*(unsigned char *)pix = sample;
+					else if(slice.type == UINT32)
+						*(unsigned int *)pix = sample;
+					else
+						*(unsigned short *)pix = sample;
+				}
+			}
+		}
+	}
+}
+
+
+bool
+FramesMatch(const FrameBuffer &a, const FrameBuffer &b)
+{
+	const Box2i &dataW = a.dataWindow();
+	
+	for(FrameBuffer::ConstIterator i = a.begin(); i != a.end(); ++i)
+	{
+		const Slice &slice_a = i.slice();
+		const Slice *slice_b = b.findSlice(i.name());
+		
+		if(slice_b == NULL || slice_b->type != slice_a.type || slice_b->xSampling != slice_a.xSampling || slice_b->ySampling != slice_a.ySampling)
+			return false;
+		
+		const size_t sample_size = PixelSize(slice_a.type);
+		
+		for(int y = dataW.min.y; y <= dataW.max.y; y += slice_a.ySampling)
+		{
+			for(int x = dataW.min.x; x <= dataW.max.x; x += slice_a.xSampling)
+			{
+				const char *pix_a = slice_a.base + ((x / slice_a.xSampling) * slice_a.xStride) + ((y / slice_a.ySampling) * slice_a.yStride);
+				const char *pix_b = slice_b->base + ((x / slice_b->xSampling) * slice_b->xStride) + ((y / slice_b->ySampling) * slice_b->yStride);
+				
+				if(memcmp(pix_a, pix_b, sample_size) != 0)
+					return false;
+			}
+		}
+	}
+	
+	return true;
+}
+
+
+void
+TimeCodec(const Header &header, const ChannelList &channels, const FrameBuffer &frame, FrameBuffer &output, int frames, CodecTiming &timing)
+{
+	const VideoCodecInfo &info = getVideoCodecInfo(header.videoCompression());
+	
+	VideoCodec *encoder = info.createCodec(header, channels);
+	VideoCodec *decoder = NULL;
+	
+	try
+	{
+		timing.compressed.clear();
+		timing.compressedSize = 0;
+		
+		const double encode_start = Seconds();
+		
+		for(int i=0; i < frames; i++)
+		{
+			encoder->compress(frame);
+			
+			DataChunkPtr data = encoder->getNextData();
+			
+			timing.compressedSize += data->Size;
+			
+			timing.compressed.push_back(data);
+		}
+		
+		timing.encodeTime = Seconds() - encode_start;
+		
+		
+		decoder = info.createCodec(*encoder->getDescriptor(), timing.decodeHeader, timing.decodeChannels);
+		
+		const double decode_start = Seconds();
+		
+		for(int i=0; i < frames; i++)
+		{
+			decoder->decompressInto(*timing.compressed[i], output);
+		}
+		
+		timing.decodeTime = Seconds() - decode_start;
+	}
+	catch(...)
+	{
+		delete decoder;
+		delete encoder;
+		
+		throw;
+	}
+	
+	delete decoder;
+	delete encoder;
+}
@@ -0,0 +1,65 @@
+/*
+ *  Benchmark.h
+ *  MoxFiles
+ *
+ *  Created by agent on 10/18/26.
+ *  Copyright 2026 fnord. All rights reserved.
+ *
+ */
+
+#ifndef MOXTEST_BENCHMARK_H
+#define MOXTEST_BENCHMARK_H
+
+// What the *_benchmark programs have in common.  Each one is built from its
+// own .cpp plus Benchmark.cpp, linked to MoxFiles.
+
+#include <MoxFiles/Codec.h>
+
+#include <vector>
+
+
+// wall clock, in seconds
+double Seconds();
+
+
+// [width height frames] from the command line, otherwise what's passed in
+void BenchmarkSize(int argc, char * const argv[], int &width, int &height, int &frames);
+
+
+// An interleaved frame with the named channels.  Filled with gradients and
+// some texture so the codecs have something to do, or zeros to decode into.
+MoxFiles::FrameBufferPtr MakeFrame(int width, int height, MoxFiles::PixelType type,
+									int channels, const char * const names[], bool fill = true);
+
+// The same pattern for any slices, whatever their layout and sampling.
+// Integer types use their whole range.  HALF and FLOAT get linear light
+// over a few stops.  "A" gets an edge.
+void FillFrame(MoxFiles::FrameBuffer &frame);
+
+// Every sample of every slice in a is the same in b
+bool FramesMatch(const MoxFiles::FrameBuffer &a, const MoxFiles::FrameBuffer &b);
+
+
+struct CodecTiming
+{
+	double encodeTime;
+	double decodeTime;
+	size_t compressedSize;
+	
+	std::vector<MoxFiles::DataChunkPtr> compressed;
+	
+	// what the decoder made of the descriptor
+	MoxFiles::Header decodeHeader;
+	MoxFiles::ChannelList decodeChannels;
+	
+	CodecTiming() : encodeTime(0), decodeTime(0), compressedSize(0) {}
+};
+
+// Compresses frame over and over with the codec the header asks for, then
+// decompresses all of it into output through a codec made from the descriptor.
+void TimeCodec(const MoxFiles::Header &header, const MoxFiles::ChannelList &channels,
+				const MoxFiles::FrameBuffer &frame, MoxFiles::FrameBuffer &output, int frames,
+				CodecTiming &timing);
+
+
+#endif // MOXTEST_BENCHMARK_H
@@ -0,0 +1,112 @@
+/*
+ *  jpeg2000_benchmark.cpp
+ *  MoxFiles
+ *
+ *  Created by agent on 10/18/26.
+ *  Copyright 2026 fnord. All rights reserved.
+ *
+ */
+
+
+/*
+	Classic JPEG 2000 (EBCOT) against High-Throughput JPEG 2000 (Part 15),
+	encoding and decoding the same frames through JPEG2000Codec.
+	
+	usage: jpeg2000_benchmark [width height frames]
+	
+	HT needs MoxFiles built with MOXFILES_USE_OPENJPH to write and OpenJPEG 2.5 to read,
+	otherwise those lines are skipped.
+*/
+
+
+#include "Benchmark.h"
+
+#include <MoxFiles/JPEG2000Codec.h>
+
+#include <iostream>
+#include <iomanip>
+
+using namespace MoxFiles;
+
+
+static const char *RGB[3] = { "R", "G", "B" };
+
+
+static void
+RunBenchmark(const FrameBuffer &frame, int frames, bool highThroughput, bool lossless)
+{
+	const int width = frame.width();
+	const int height = frame.height();
+	
+	std::cout << std::setw(8) << (highThroughput ? "HTJ2K" : "J2K") << std::setw(10) << (lossless ? "lossless" : "lossy");
+	
+	try
+	{
+		Header header(width, height, Rational(24, 1), Rational(0, 1), JPEG2000);
+		
+		if(lossless)
+			VideoCodec::setLossless(header);
+		else
+			VideoCodec::setQuality(header, 90);
+		
+		JPEG2000Codec::setHighThroughput(header, highThroughput);
+		
+		ChannelList channels;
+		
+		for(int i=0; i < 3; i++)
+			channels.insert(RGB[i], Channel(UINT10));
+		
+		FrameBufferPtr output = MakeFrame(width, height, UINT10, 3, RGB, false);
+		
+		CodecTiming timing;
+		
+		TimeCodec(header, channels, frame, *output, frames, timing);
+		
+		
+		const double raw_size = (double)width * height * 3 * sizeof(unsigned short) * frames;
+		
+		std::cout << std::fixed << std::setprecision(2);
+		std::cout << std::setw(10) << (frames / timing.encodeTime) << " fps enc";
+		std::cout << std::setw(10) << (frames / timing.decodeTime) << " fps dec";
+		std::cout << std::setw(10) << (raw_size / timing.compressedSize) << ":1";
+		
+		if(lossless && !FramesMatch(frame, *output))
+			std::cout << "  (decoded frame doesn't match)";
+		
+		std::cout << std::endl;
+	}
+	catch(MoxMxf::NoImplExc &e)
+	{
+		std::cout << "  skipped: " << e.what() << std::endl;
+	}
+}
+
+
+int main(int argc, char * const argv[])
+{
+	int width = 3840;
+	int height = 2160;
+	int frames = 10;
+	
+	BenchmarkSize(argc, argv, width, height, frames);
+	
+	std::cout << width << "x" << height << " 10-bit RGB, " << frames << " frames" << std::endl;
+	
+	try
+	{
+		FrameBufferPtr frame = MakeFrame(width, height, UINT10, 3, RGB);
+		
+		RunBenchmark(*frame, frames, false, true);
+		RunBenchmark(*frame, frames, true, true);
+		RunBenchmark(*frame, frames, false, false);
+		RunBenchmark(*frame, frames, true, false);
+	}
+	catch(std::exception &e)
+	{
+		std::cout << "Exception thrown: " << e.what() << std::endl;
+		
+		return -1;
+	}
+	
+	return 0;
+}
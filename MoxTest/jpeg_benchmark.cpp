@@ -0,0 +1,144 @@
+/*
+ *  jpeg_benchmark.cpp
+ *  MoxFiles
+ *
+ *  Created by agent on 10/18/26.
+ *  Copyright 2026 fnord. All rights reserved.
+ *
+ */
+
+
+/*
+	JPEGCodec throughput for the different ways a frame can be handed over:
+	
+		RGB interleaved		libjpeg reads and writes the caller's rows
+		RGB planar			staged through an interleaved buffer
+		Y'CbCr interleaved	no color conversion
+		Y'CbCr 4:2:0		raw planes, no color conversion or chroma resampling
+	
+	and RGB again with a restart marker every MCU row, so frames decode in stripes.
+	
+	usage: jpeg_benchmark [width height frames]
+*/
+
+
+#include "Benchmark.h"
+
+#include <MoxFiles/JPEGCodec.h>
+
+#include <iostream>
+#include <iomanip>
+
+using namespace MoxFiles;
+
+
+enum Layout
+{
+	RGB_INTERLEAVED,
+	RGB_PLANAR,
+	YCBCR_INTERLEAVED,
+	YCBCR_420
+};
+
+
+static FrameBufferPtr
+MakeLayoutFrame(int width, int height, Layout layout, bool fill = true)
+{
+	const bool ycbcr = (layout == YCBCR_INTERLEAVED || layout == YCBCR_420);
+	
+	const char *names[3] = { (ycbcr ? "Y" : "R"), (ycbcr ? "Cb" : "G"), (ycbcr ? "Cr" : "B") };
+	
+	if(layout == RGB_INTERLEAVED || layout == YCBCR_INTERLEAVED)
+	{
+		FrameBufferPtr frame = MakeFrame(width, height, UINT8, 3, names, fill);
+		
+		if(ycbcr)
+			frame->coefficients() = FrameBuffer::Rec601_FullRange;
+		
+		return frame;
+	}
+	
+	FrameBufferPtr frame = new FrameBuffer(width, height);
+	
+	if(ycbcr)
+		frame->coefficients() = FrameBuffer::Rec601_FullRange;
+	
+	for(int i=0; i < 3; i++)
+	{
+		const int sampling = (layout == YCBCR_420 && i > 0 ? 2 : 1);
+		
+		const size_t rowBytes = ((width + sampling - 1) / sampling);
+		
+		DataChunkPtr data = new PooledDataChunk(rowBytes * ((height + sampling - 1) / sampling));
+		
+		frame->insert(names[i], Slice(UINT8, (char *)data->Data, 1, rowBytes, sampling, sampling));
+		
+		frame->attachData(data);
+	}
+	
+	if(fill)
+		FillFrame(*frame);
+	
+	return frame;
+}
+
+
+static void
+RunBenchmark(int width, int height, int frames, Layout layout, const char *label, int restartRows = 0)
+{
+	std::cout << std::setw(20) << label;
+	
+	try
+	{
+		FrameBufferPtr frame = MakeLayoutFrame(width, height, layout);
+		
+		Header header(width, height, Rational(24, 1), Rational(0, 1), JPEG);
+		
+		VideoCodec::setQuality(header, 90);
+		
+		JPEGCodec::setRestartInterval(header, restartRows);
+		
+		ChannelList channels;
+		
+		channels.insert("R", Channel(UINT8));
+		channels.insert("G", Channel(UINT8));
+		channels.insert("B", Channel(UINT8));
+		
+		FrameBufferPtr output = MakeLayoutFrame(width, height, layout, false);
+		
+		CodecTiming timing;
+		
+		TimeCodec(header, channels, *frame, *output, frames, timing);
+		
+		
+		const double megapixels = ((double)width * height * frames) / (1024.0 * 1024.0);
+		
+		std::cout << std::fixed << std::setprecision(2);
+		std::cout << std::setw(10) << (frames / timing.encodeTime) << " fps enc" << std::setw(10) << (megapixels / timing.encodeTime) << " MP/s";
+		std::cout << std::setw(10) << (frames / timing.decodeTime) << " fps dec" << std::setw(10) << (megapixels / timing.decodeTime) << " MP/s" << std::endl;
+	}
+	catch(std::exception &e)
+	{
+		std::cout << "  failed: " << e.what() << std::endl;
+	}
+}
+
+
+int main(int argc, char * const argv[])
+{
+	int width = 3840;
+	int height = 2160;
+	int frames = 20;
+	
+	BenchmarkSize(argc, argv, width, height, frames);
+	
+	std::cout << width << "x" << height << " 8-bit, quality 90, " << frames << " frames" << std::endl;
+	
+	RunBenchmark(width, height, frames, RGB_INTERLEAVED, "RGB interleaved");
+	RunBenchmark(width, height, frames, RGB_PLANAR, "RGB planar");
+	RunBenchmark(width, height, frames, YCBCR_INTERLEAVED, "Y'CbCr interleaved");
+	RunBenchmark(width, height, frames, YCBCR_420, "Y'CbCr 4:2:0 planar");
+	RunBenchmark(width, height, frames, RGB_INTERLEAVED, "RGB restarts", 1);
+	
+	return 0;
+}
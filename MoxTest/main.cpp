@@ -8,11 +8,27 @@
  */
 
 #include <MoxFiles/FrameBuffer.h>
+#include <MoxFiles/Codec.h>
+#include <MoxFiles/PNGCodec.h>
+#include <MoxFiles/OpenEXRCodec.h>
+#include <MoxFiles/JPEGLSCodec.h>
+#include <MoxFiles/PlanarCodec.h>
+#include <MoxFiles/FLACCodec.h>
+
+#include "Benchmark.h"
+
+#include <half.h>
+
+#include "png.h"
 
 #include <iostream>
 #include <fstream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
 
 #include <math.h>
+#include <string.h>
 
 using namespace MoxFiles;
 
@@ -476,16 +492,1818 @@ MakeCubes()
 }
 
 
-int main(int argc, char * const argv[])
+// Codec tests.  Each one writes frames, reads them back, and where the codec
+// has a vector path, checks it against a simple scalar version of the same
+// thing.  Widths are picked to leave tails after the vector loops.
+
+static unsigned int
+TestRandom(unsigned int max)
+{
+	// same numbers every run
+	static unsigned int seed = 0x5eed;
+	
+	unsigned int value = 0;
+	
+	for(int i=0; i < 3; i++)
+	{
+		seed = (seed * 1103515245) + 12345;
+		
+		value = (value << 11) | ((seed >> 16) & 0x7ff);
+	}
+	
+	return (max == 0xffffffff ? value : value % (max + 1));
+}
+
+
+static unsigned int
+MaxSample(PixelType type)
+{
+	if(type == UINT16A)
+		return 32768;
+	else if(PixelBits(type) >= 32)
+		return 0xffffffff;
+	else
+		return (1 << PixelBits(type)) - 1;
+}
+
+
+static char *
+SamplePtr(const Slice &slice, int x, int y)
+{
+	return slice.base + ((x / slice.xSampling) * slice.xStride) + ((y / slice.ySampling) * slice.yStride);
+}
+
+static unsigned int
+GetSample(const Slice &slice, int x, int y)
+{
+	const char *pix = SamplePtr(slice, x, y);
+	
+	if(slice.type == UINT8)
+		return *(const unsigned char *)pix;
+	else if(slice.type == UINT32)
+		return *(const unsigned int *)pix;
+	else
+		return *(const unsigned short *)pix;
+}
+
+static void
+SetSample(const Slice &slice, int x, int y, unsigned int value)
+{
+	char *pix = SamplePtr(slice, x, y);
+	
+	if(slice.type == UINT8)
+		*(unsigned char *)pix = value;
+	else if(slice.type == UINT32)
+		*(unsigned int *)pix = value;
+	else
+		*(unsigned short *)pix = value;
+}
+
+
+static std::vector<unsigned int>
+RowSamples(const Slice &slice, int width, int y)
+{
+	std::vector<unsigned int> row(width);
+	
+	for(int x=0; x < width; x++)
+		row[x] = GetSample(slice, x, y);
+	
+	return row;
+}
+
+
+static void
+FillRandom(FrameBuffer &frame)
+{
+	const Box2i &dataW = frame.dataWindow();
+	
+	for(FrameBuffer::Iterator i = frame.begin(); i != frame.end(); ++i)
+	{
+		const Slice &slice = i.slice();
+		
+		for(int y = dataW.min.y; y <= dataW.max.y; y += slice.ySampling)
+		{
+			for(int x = dataW.min.x; x <= dataW.max.x; x += slice.xSampling)
+			{
+				if(slice.type == HALF)
+					*(half *)SamplePtr(slice, x, y) = (float)TestRandom(0xffff) / 4096.0f;
+				else if(slice.type == FLOAT)
+					*(float *)SamplePtr(slice, x, y) = ((float)TestRandom(0xffffff) / 65536.0f) - 128.0f;
+				else
+					SetSample(slice, x, y, TestRandom(MaxSample(slice.type)));
+			}
+		}
+	}
+}
+
+
+// The layouts the codecs take different paths for
+enum TestLayout
+{
+	LayoutInterleaved,
+	LayoutPlanar,
+	LayoutPadded	// interleaved with a gap after each pixel and each row
+};
+
+static FrameBufferPtr
+MakeTestFrame(int width, int height, PixelType type, int channels, const char * const names[], TestLayout layout, bool fill = true)
+{
+	const size_t sample_size = PixelSize(type);
+	
+	const size_t pixel_size = (layout == LayoutPlanar ? sample_size :
+								layout == LayoutPadded ? (channels + 1) * sample_size :
+								channels * sample_size);
+	
+	const size_t rowbytes = (width * pixel_size) + (layout == LayoutPadded ? 16 : 0);
+	const size_t plane_size = rowbytes * height;
+	const size_t data_size = (layout == LayoutPlanar ? channels * plane_size : plane_size);
+	
+	DataChunkPtr data = new DataChunk(data_size);
+	
+	memset(data->Data, 0, data_size);
+	
+	FrameBufferPtr frame = new FrameBuffer(width, height);
+	
+	frame->attachData(data);
+	
+	char *origin = (char *)data->Data;
+	
+	for(int i=0; i < channels; i++)
+	{
+		char *base = origin + (layout == LayoutPlanar ? (i * plane_size) : (i * sample_size));
+		
+		frame->insert(names[i], Slice(type, base, pixel_size, rowbytes));
+	}
+	
+	if(fill)
+		FillRandom(*frame);
+	
+	return frame;
+}
+
+
+static void
+CopySamples(FrameBuffer &dest, const FrameBuffer &source)
+{
+	const Box2i &dataW = source.dataWindow();
+	
+	for(FrameBuffer::ConstIterator i = source.begin(); i != source.end(); ++i)
+	{
+		const Slice &in = i.slice();
+		const Slice &out = dest[i.name()];
+		
+		for(int y = dataW.min.y; y <= dataW.max.y; y++)
+		{
+			for(int x = dataW.min.x; x <= dataW.max.x; x++)
+				memcpy(SamplePtr(out, x, y), SamplePtr(in, x, y), PixelSize(in.type));
+		}
+	}
+}
+
+
+// Inside the region output matches source, outside it's untouched zeros
+static bool
+RegionMatches(const FrameBuffer &source, const FrameBuffer &output, const Box2i &region)
+{
+	const Box2i &dataW = output.dataWindow();
+	
+	const char zeros[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+	
+	for(FrameBuffer::ConstIterator i = output.begin(); i != output.end(); ++i)
+	{
+		const Slice &out = i.slice();
+		const Slice &in = source[i.name()];
+		
+		for(int y = dataW.min.y; y <= dataW.max.y; y++)
+		{
+			for(int x = dataW.min.x; x <= dataW.max.x; x++)
+			{
+				const bool inside = (x >= region.min.x && x <= region.max.x && y >= region.min.y && y <= region.max.y);
+				
+				if(memcmp(SamplePtr(out, x, y), (inside ? SamplePtr(in, x, y) : zeros), PixelSize(out.type)) != 0)
+					return false;
+			}
+		}
+	}
+	
+	return true;
+}
+
+
+// An encoder for the header and, made from its descriptor, a decoder
+class TestCodecs
+{
+  public:
+	TestCodecs(const Header &header, const ChannelList &channels);
+	~TestCodecs();
+	
+	DataChunkPtr compress(const FrameBuffer &frame);
+	
+	VideoCodec & encoder() { return *_encoder; }
+	VideoCodec & decoder(); // once something has been compressed
+	
+	const ChannelList & decodeChannels() { decoder(); return _decodeChannels; }
+
+  private:
+	const VideoCodecInfo &_info;
+	
+	VideoCodec *_encoder;
+	VideoCodec *_decoder;
+	
+	Header _decodeHeader;
+	ChannelList _decodeChannels;
+	
+	TestCodecs(const TestCodecs &other);
+	TestCodecs & operator = (const TestCodecs &other);
+};
+
+TestCodecs::TestCodecs(const Header &header, const ChannelList &channels) :
+	_info(getVideoCodecInfo(header.videoCompression())),
+	_encoder(NULL),
+	_decoder(NULL)
+{
+	_encoder = _info.createCodec(header, channels);
+}
+
+TestCodecs::~TestCodecs()
+{
+	delete _decoder;
+	delete _encoder;
+}
+
+DataChunkPtr
+TestCodecs::compress(const FrameBuffer &frame)
+{
+	_encoder->compress(frame);
+	
+	return _encoder->getNextData();
+}
+
+VideoCodec &
+TestCodecs::decoder()
+{
+	if(_decoder == NULL)
+		_decoder = _info.createCodec(*_encoder->getDescriptor(), _decodeHeader, _decodeChannels);
+	
+	return *_decoder;
+}
+
+
+// UncompressedCDCICodec, done the slow way
+
+static std::vector<unsigned int>
+DownsampleReference(const std::vector<unsigned int> &full)
+{
+	const int width = full.size();
+	const int n = (width + 1) / 2;
+	
+	std::vector<unsigned int> sub(n);
+	
+	for(int i=0; i < n; i++)
+	{
+		const int x = 2 * i;
+		
+		const unsigned int left = full[x > 0 ? x - 1 : x];
+		const unsigned int right = full[x + 1 < width ? x + 1 : x];
+		
+		sub[i] = (left + (2 * full[x]) + right + 2) >> 2;
+	}
+	
+	return sub;
+}
+
+static std::vector<unsigned int>
+UpsampleReference(const std::vector<unsigned int> &sub, int width)
+{
+	const int n = sub.size();
+	
+	std::vector<unsigned int> full(width);
+	
+	for(int x=0; x < width; x++)
+	{
+		const int i = x / 2;
+		
+		full[x] = ((x & 1) ? (sub[i] + sub[i + 1 < n ? i + 1 : i] + 1) >> 1 : sub[i]);
+	}
+	
+	return full;
+}
+
+static void
+PackCDCIReference(UInt8 *out, size_t rowbytes, const std::vector<unsigned int> &y,
+					const std::vector<unsigned int> &cb, const std::vector<unsigned int> &cr, bool ten_bit)
+{
+	const int width = y.size();
+	const int n = cb.size();
+	
+	memset(out, 0, rowbytes);
+	
+	if(ten_bit)
+	{
+		// v210, the partial block repeating the last samples
+		const int blocks = (width + 5) / 6;
+		
+		for(int b=0; b < blocks; b++)
+		{
+			unsigned int ys[6], cbs[3], crs[3];
+			
+			for(int i=0; i < 6; i++)
+				ys[i] = y[(6 * b) + i < width ? (6 * b) + i : width - 1];
+			
+			for(int i=0; i < 3; i++)
+			{
+				cbs[i] = cb[(3 * b) + i < n ? (3 * b) + i : n - 1];
+				crs[i] = cr[(3 * b) + i < n ? (3 * b) + i : n - 1];
+			}
+			
+			const unsigned int words[4] = { cbs[0] | (ys[0] << 10) | (crs[0] << 20),
+											ys[1] | (cbs[1] << 10) | (ys[2] << 20),
+											crs[1] | (ys[3] << 10) | (cbs[2] << 20),
+											ys[4] | (crs[2] << 10) | (ys[5] << 20) };
+			
+			for(int w=0; w < 4; w++)
+			{
+				for(int i=0; i < 4; i++)
+					out[(16 * b) + (4 * w) + i] = (words[w] >> (8 * i)) & 0xff;
+			}
+		}
+	}
+	else
+	{
+		// UYVY
+		for(int p=0; p < n; p++)
+		{
+			out[(4 * p) + 0] = cb[p];
+			out[(4 * p) + 1] = y[2 * p];
+			out[(4 * p) + 2] = cr[p];
+			out[(4 * p) + 3] = y[(2 * p) + 1 < width ? (2 * p) + 1 : width - 1];
+		}
+	}
+}
+
+
+static bool
+CDCITest()
 {
 	bool success = true;
 	
-	try
+	// around the 16-pixel vector chunks and the 48-pixel v210 row padding
+	const int widths[] = { 1, 2, 5, 6, 7, 15, 16, 17, 33, 47, 48, 49, 101 };
+	const int num_widths = sizeof(widths) / sizeof(widths[0]);
+	const int height = 3;
+	
+	const char * const names[3] = { "Y", "Cb", "Cr" };
+	
+	for(int d=0; d < 2; d++)
 	{
-		std::cout << "FrameBufferYUVTest...";
-		const bool yuv_test = FrameBufferYUVTest();
-		std::cout << (yuv_test ? "success" : "failed") << std::endl;
-		if(!yuv_test)
+		const bool ten_bit = (d == 1);
+		const PixelType type = (ten_bit ? UINT10 : UINT8);
+		
+		for(int w=0; w < num_widths; w++)
+		{
+			const int width = widths[w];
+			
+			const size_t rowbytes = (ten_bit ? ((width + 47) / 48) * 128 : ((width + 1) / 2) * 4);
+			
+			Header header(width, height, Rational(24, 1), Rational(0, 1), UNCOMPRESSED_CDCI);
+			
+			ChannelList channels;
+			
+			for(int i=0; i < 3; i++)
+				channels.insert(names[i], Channel(type));
+			
+			// planar rows get copied in, interleaved ones go through the strided load
+			for(int l=0; l < 2; l++)
+			{
+				FrameBufferPtr frame = MakeTestFrame(width, height, type, 3, names, (l == 0 ? LayoutInterleaved : LayoutPlanar));
+				
+				frame->coefficients() = FrameBuffer::Rec601; // what the codec uses at this size, so no conversion
+				
+				TestCodecs codecs(header, channels);
+				
+				DataChunkPtr data = codecs.compress(*frame);
+				
+				if(data->Size != rowbytes * height)
+				{
+					success = false;
+					
+					continue;
+				}
+				
+				FrameBufferPtr output = MakeTestFrame(width, height, type, 3, names, LayoutPlanar, false);
+				
+				output->coefficients() = FrameBuffer::Rec601;
+				
+				codecs.decoder().decompressInto(*data, *output);
+				
+				std::vector<UInt8> row(rowbytes);
+				
+				for(int y=0; y < height; y++)
+				{
+					const std::vector<unsigned int> Y = RowSamples((*frame)["Y"], width, y);
+					const std::vector<unsigned int> Cb = DownsampleReference(RowSamples((*frame)["Cb"], width, y));
+					const std::vector<unsigned int> Cr = DownsampleReference(RowSamples((*frame)["Cr"], width, y));
+					
+					PackCDCIReference(&row[0], rowbytes, Y, Cb, Cr, ten_bit);
+					
+					if(memcmp(&row[0], data->Data + (y * rowbytes), rowbytes) != 0)
+						success = false;
+					
+					if(RowSamples((*output)["Y"], width, y) != Y ||
+						RowSamples((*output)["Cb"], width, y) != UpsampleReference(Cb, width) ||
+						RowSamples((*output)["Cr"], width, y) != UpsampleReference(Cr, width))
+					{
+						success = false;
+					}
+				}
+			}
+		}
+	}
+	
+	return success;
+}
+
+
+// UncompressedVideoCodec stores every sample MSB first, in R G B A order,
+// then fill bits to finish the pixel on a byte
+static void
+PackRGBAReference(UInt8 *out, const FrameBuffer &frame, const char * const names[], int channels, int width, int y)
+{
+	UInt64 bits = 0;
+	int num_bits = 0;
+	
+	for(int x=0; x < width; x++)
+	{
+		for(int c=0; c < channels; c++)
+		{
+			const Slice &slice = frame[names[c]];
+			
+			const int depth = (slice.type == FLOAT ? 32 : PixelBits(slice.type));
+			
+			UInt32 val = 0;
+			
+			if(slice.type == FLOAT)
+				memcpy(&val, SamplePtr(slice, x, y), sizeof(val));
+			else
+				val = GetSample(slice, x, y);
+			
+			bits = (bits << depth) | val;
+			num_bits += depth;
+			
+			while(num_bits >= 8)
+			{
+				*out++ = (bits >> (num_bits - 8)) & 0xff;
+				num_bits -= 8;
+			}
+		}
+		
+		if(num_bits > 0)
+		{
+			*out++ = (bits << (8 - num_bits)) & 0xff;
+			num_bits = 0;
+		}
+	}
+}
+
+
+static bool
+UncompressedVideoTest()
+{
+	bool success = true;
+	
+	const char * const names[4] = { "R", "G", "B", "A" };
+	
+	// 8, 16 and float get byte swapped, RGB 10 has its own packer, the rest go bit by bit
+	const PixelType types[] = { UINT8, UINT16, FLOAT, UINT10, UINT12 };
+	const int num_types = sizeof(types) / sizeof(types[0]);
+	
+	const int widths[] = { 1, 5, 8, 17, 31, 64, 67 };
+	const int num_widths = sizeof(widths) / sizeof(widths[0]);
+	const int height = 4;
+	
+	// interleaved gets swapped in place, planar shuffled together, padded done one channel at a time
+	const TestLayout layouts[3] = { LayoutInterleaved, LayoutPlanar, LayoutPadded };
+	
+	for(int t=0; t < num_types; t++)
+	{
+		const PixelType type = types[t];
+		
+		for(int channel_count = 3; channel_count <= 4; channel_count++)
+		{
+			for(int w=0; w < num_widths; w++)
+			{
+				const int width = widths[w];
+				
+				Header header(width, height, Rational(24, 1), Rational(0, 1), UNCOMPRESSED);
+				
+				ChannelList channels;
+				
+				for(int c=0; c < channel_count; c++)
+					channels.insert(names[c], Channel(type));
+				
+				FrameBufferPtr source = MakeTestFrame(width, height, type, channel_count, names, LayoutInterleaved);
+				
+				const int pixel_bits = channel_count * (type == FLOAT ? 32 : PixelBits(type));
+				const size_t rowbytes = width * ((pixel_bits + 7) / 8);
+				
+				std::vector<UInt8> reference(rowbytes * height);
+				
+				for(int y=0; y < height; y++)
+					PackRGBAReference(&reference[y * rowbytes], *source, names, channel_count, width, y);
+				
+				TestCodecs codecs(header, channels);
+				
+				DataChunkPtr data = NULL;
+				
+				for(int l=0; l < 3; l++)
+				{
+					FrameBufferPtr frame = source;
+					
+					if(layouts[l] != LayoutInterleaved)
+					{
+						frame = MakeTestFrame(width, height, type, channel_count, names, layouts[l], false);
+						
+						CopySamples(*frame, *source);
+					}
+					
+					data = codecs.compress(*frame);
+					
+					if(data->Size != reference.size() || memcmp(data->Data, &reference[0], reference.size()) != 0)
+						success = false;
+				}
+				
+				for(int l=0; l < 3; l++)
+				{
+					FrameBufferPtr output = MakeTestFrame(width, height, type, channel_count, names, layouts[l], false);
+					
+					codecs.decoder().decompressInto(*data, *output);
+					
+					if( !FramesMatch(*source, *output) )
+						success = false;
+				}
+				
+				codecs.decoder().decompress(*data);
+				
+				FrameBufferPtr exported = codecs.decoder().getNextFrame();
+				
+				if(!exported || !FramesMatch(*source, *exported))
+					success = false;
+				
+				if(width > 2)
+				{
+					// starting on an odd pixel
+					const Box2i region(V2i(1, 1), V2i(width - 2, height - 2));
+					
+					FrameBufferPtr output = MakeTestFrame(width, height, type, channel_count, names, LayoutPlanar, false);
+					
+					codecs.decoder().decompressRegion(*data, *output, region);
+					
+					if( !RegionMatches(*source, *output, region) )
+						success = false;
+				}
+			}
+		}
+	}
+	
+	return success;
+}
+
+
+struct PNGReadSource
+{
+	const DataChunk *chunk;
+	size_t pos;
+};
+
+
+static void png_test_read_callback(png_structp png_ptr, png_bytep data, png_size_t length)
+{
+	PNGReadSource *source = (PNGReadSource *)png_get_io_ptr(png_ptr);
+	
+	if(length > source->chunk->Size - source->pos)
+		png_error(png_ptr, "Read past end");
+	
+	memcpy(data, source->chunk->Data + source->pos, length);
+	
+	source->pos += length;
+}
+
+
+// libpng and its scalar unfilter, into the rows of an interleaved frame
+static void
+ReadWithLibPNG(const DataChunk &data, const Slice &first, int height)
+{
+	PNGReadSource source = { &data, 0 };
+	
+	png_structp png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	
+	png_infop info_ptr = png_create_info_struct(png_ptr);
+	
+	png_set_read_fn(png_ptr, &source, png_test_read_callback);
+	
+	if(setjmp(png_jmpbuf(png_ptr)))
+	{
+		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+		
+		throw MoxMxf::IoExc("Problem reading PNG file");
+	}
+	
+	png_read_info(png_ptr, info_ptr);
+	
+	if(png_get_bit_depth(png_ptr, info_ptr) == 16)
+		png_set_swap(png_ptr);
+	
+	std::vector<png_bytep> row_pointers(height);
+	
+	for(int y=0; y < height; y++)
+		row_pointers[y] = (png_bytep)(first.base + (y * first.yStride));
+	
+	png_read_image(png_ptr, &row_pointers[0]);
+	
+	png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+}
+
+
+static bool
+PNGTest()
+{
+	bool success = true;
+	
+	const char * const rgba[4] = { "R", "G", "B", "A" };
+	const char * const ya[2] = { "Y", "A" };
+	
+	const PNGCodec::Filter filters[] = { PNGCodec::FilterNone, PNGCodec::FilterSub, PNGCodec::FilterUp,
+											PNGCodec::FilterAverage, PNGCodec::FilterPaeth, PNGCodec::FilterAdaptive };
+	const int num_filters = sizeof(filters) / sizeof(filters[0]);
+	
+	const int widths[] = { 1, 2, 5, 17, 33, 100 };
+	const int num_widths = sizeof(widths) / sizeof(widths[0]);
+	const int height = 5;
+	
+	for(int f=0; f < num_filters; f++)
+	{
+		// libpng does the filtering, or we do it in stripes
+		for(int p=0; p < 2; p++)
+		{
+			for(int d=0; d < 2; d++)
+			{
+				const PixelType type = (d == 0 ? UINT8 : UINT16);
+				
+				// Y, YA, RGB, RGBA: 1 to 8 bytes per pixel, the SSE2 unfilter taking 3, 4, 6 and 8
+				for(int channel_count = 1; channel_count <= 4; channel_count++)
+				{
+					const char * const *names = (channel_count <= 2 ? ya : rgba);
+					
+					for(int w=0; w < num_widths; w++)
+					{
+						const int width = widths[w];
+						
+						Header header(width, height, Rational(24, 1), Rational(0, 1), PNG);
+						
+						PNGCodec::setFilter(header, filters[f]);
+						PNGCodec::setParallelDeflate(header, (p == 1));
+						
+						ChannelList channels;
+						
+						for(int c=0; c < channel_count; c++)
+							channels.insert(names[c], Channel(type));
+						
+						FrameBufferPtr frame = MakeTestFrame(width, height, type, channel_count, names, LayoutInterleaved);
+						
+						TestCodecs codecs(header, channels);
+						
+						DataChunkPtr data = codecs.compress(*frame);
+						
+						FrameBufferPtr output = MakeTestFrame(width, height, type, channel_count, names, LayoutInterleaved, false);
+						
+						codecs.decoder().decompressInto(*data, *output);
+						
+						if( !FramesMatch(*frame, *output) )
+							success = false;
+						
+						FrameBufferPtr libpng_output = MakeTestFrame(width, height, type, channel_count, names, LayoutInterleaved, false);
+						
+						ReadWithLibPNG(*data, (*libpng_output)[names[0]], height);
+						
+						if( !FramesMatch(*frame, *libpng_output) )
+							success = false;
+					}
+				}
+			}
+		}
+	}
+	
+	return success;
+}
+
+
+// DPX filled method A, the slow way: 10-bit samples three to a native 32-bit
+// word from the top, 12-bit ones in the top of a native 16-bit word
+static void
+PackDPXReference(UInt8 *out, const std::vector<unsigned int> &samples, int bit_depth)
+{
+	if(bit_depth == 10)
+	{
+		for(size_t i=0; i < samples.size(); i += 3)
+		{
+			UInt32 word = 0;
+			
+			for(size_t j=0; j < 3 && i + j < samples.size(); j++)
+				word |= samples[i + j] << (22 - (10 * j));
+			
+			memcpy(out + (4 * (i / 3)), &word, 4);
+		}
+	}
+	else
+	{
+		for(size_t i=0; i < samples.size(); i++)
+		{
+			const UInt16 word = (samples[i] << 4);
+			
+			memcpy(out + (2 * i), &word, 2);
+		}
+	}
+}
+
+
+static bool
+DPXTest()
+{
+	bool success = true;
+	
+	const char * const names[4] = { "R", "G", "B", "A" };
+	
+	// 10-bit is unpacked 12 samples at a time, 12-bit 8 at a time
+	const int widths[] = { 1, 2, 3, 5, 7, 16, 17, 33 };
+	const int num_widths = sizeof(widths) / sizeof(widths[0]);
+	const int height = 3;
+	
+	for(int bit_depth = 10; bit_depth <= 12; bit_depth += 2)
+	{
+		const PixelType type = (bit_depth == 10 ? UINT10 : UINT12);
+		
+		for(int channel_count = 3; channel_count <= 4; channel_count++)
+		{
+			for(int w=0; w < num_widths; w++)
+			{
+				const int width = widths[w];
+				
+				const size_t samples = width * channel_count;
+				const size_t rowbytes = (bit_depth == 10 ? 4 * ((samples + 2) / 3) : 2 * samples);
+				
+				// 12-bit rows that don't end on a word go through libdpx instead
+				if(rowbytes % 4 != 0)
+					continue;
+				
+				Header header(width, height, Rational(24, 1), Rational(0, 1), DPX);
+				
+				ChannelList channels;
+				
+				for(int c=0; c < channel_count; c++)
+					channels.insert(names[c], Channel(type));
+				
+				FrameBufferPtr source = MakeTestFrame(width, height, type, channel_count, names, LayoutInterleaved);
+				
+				FrameBufferPtr planar_source = MakeTestFrame(width, height, type, channel_count, names, LayoutPlanar, false);
+				
+				CopySamples(*planar_source, *source);
+				
+				// full range, reduced on the way in
+				FrameBufferPtr source16 = MakeTestFrame(width, height, UINT16, channel_count, names, LayoutInterleaved);
+				
+				TestCodecs codecs(header, channels);
+				
+				DataChunkPtr data = NULL;
+				
+				const FrameBufferPtr inputs[3] = { source16, planar_source, source };
+				
+				for(int i=0; i < 3; i++)
+				{
+					const FrameBuffer &input = *inputs[i];
+					
+					data = codecs.compress(input);
+					
+					UInt32 offset = 0;
+					
+					memcpy(&offset, data->Data + 4, 4);
+					
+					if(data->Size < offset + (rowbytes * height))
+					{
+						success = false;
+						
+						continue;
+					}
+					
+					std::vector<UInt8> reference(rowbytes);
+					
+					for(int y=0; y < height; y++)
+					{
+						std::vector<unsigned int> row(samples);
+						
+						for(int x=0; x < width; x++)
+						{
+							for(int c=0; c < channel_count; c++)
+							{
+								const unsigned int v = GetSample(input[names[c]], x, y);
+								
+								row[(x * channel_count) + c] = (i == 0 ? v >> (16 - bit_depth) : v);
+							}
+						}
+						
+						PackDPXReference(&reference[0], row, bit_depth);
+						
+						if(memcmp(&reference[0], data->Data + offset + (y * rowbytes), rowbytes) != 0)
+							success = false;
+					}
+				}
+				
+				// data is from source now
+				
+				for(int l=0; l < 2; l++)
+				{
+					FrameBufferPtr output = MakeTestFrame(width, height, type, channel_count, names, (l == 0 ? LayoutInterleaved : LayoutPlanar), false);
+					
+					codecs.decoder().decompressInto(*data, *output);
+					
+					if( !FramesMatch(*source, *output) )
+						success = false;
+				}
+				
+				FrameBufferPtr output16 = MakeTestFrame(width, height, UINT16, channel_count, names, LayoutInterleaved, false);
+				
+				codecs.decoder().decompressInto(*data, *output16);
+				
+				for(int y=0; y < height; y++)
+				{
+					for(int x=0; x < width; x++)
+					{
+						for(int c=0; c < channel_count; c++)
+						{
+							const unsigned int v = GetSample((*source)[names[c]], x, y);
+							
+							const unsigned int expanded = (bit_depth == 10 ? ((v << 6) | (v >> 4)) : ((v << 4) | (v >> 8)));
+							
+							if(GetSample((*output16)[names[c]], x, y) != expanded)
+								success = false;
+						}
+					}
+				}
+				
+				if(width > 2)
+				{
+					// starting partway into a 10-bit word for RGBA
+					const Box2i region(V2i(1, 1), V2i(width - 2, height - 2));
+					
+					FrameBufferPtr output = MakeTestFrame(width, height, type, channel_count, names, LayoutPlanar, false);
+					
+					codecs.decoder().decompressRegion(*data, *output, region);
+					
+					if( !RegionMatches(*source, *output, region) )
+						success = false;
+				}
+			}
+		}
+	}
+	
+	return success;
+}
+
+
+static bool
+PlanarTest()
+{
+	bool success = true;
+	
+	// any channel name goes
+	const char * const names[4] = { "R", "G", "B", "depth.Z" };
+	
+	const PixelType types[] = { UINT8, UINT10, UINT12, UINT16, UINT32, HALF, FLOAT };
+	const int num_types = sizeof(types) / sizeof(types[0]);
+	
+	// rows go 16 samples at a time
+	const int widths[] = { 1, 15, 16, 17, 33, 100 };
+	const int num_widths = sizeof(widths) / sizeof(widths[0]);
+	const int height = 5;
+
+#ifdef MOXFILES_USE_LZ4
+	const int num_compressors = 2;
+#else
+	const int num_compressors = 1;
+#endif
+
+	for(int k=0; k < num_compressors; k++)
+	{
+		for(int t=0; t < num_types; t++)
+		{
+			const PixelType type = types[t];
+			
+			for(int w=0; w < num_widths; w++)
+			{
+				const int width = widths[w];
+				
+				Header header(width, height, Rational(24, 1), Rational(0, 1), PLANAR);
+				
+				PlanarCodec::setCompressor(header, (PlanarCodec::Compressor)k);
+				
+				ChannelList channels;
+				
+				for(int c=0; c < 4; c++)
+					channels.insert(names[c], Channel(type));
+				
+				// contiguous rows take the SSE2 path, interleaved ones the plain loop
+				FrameBufferPtr source = MakeTestFrame(width, height, type, 4, names, LayoutPlanar);
+				
+				FrameBufferPtr interleaved = MakeTestFrame(width, height, type, 4, names, LayoutInterleaved, false);
+				
+				CopySamples(*interleaved, *source);
+				
+				TestCodecs codecs(header, channels);
+				
+				DataChunkPtr data = codecs.compress(*source);
+				
+				if(data->Size < 4 || memcmp(data->Data, "MXPL", 4) != 0)
+					success = false;
+				
+				DataChunkPtr interleaved_data = codecs.compress(*interleaved);
+				
+				if(interleaved_data->Size != data->Size || memcmp(interleaved_data->Data, data->Data, data->Size) != 0)
+					success = false;
+				
+				// stripes on the calling thread come out the same
+				PlanarCodec::setThreadCount(0);
+				
+				DataChunkPtr unthreaded_data = codecs.compress(*source);
+				
+				PlanarCodec::setThreadCount(-1);
+				
+				if(unthreaded_data->Size != data->Size || memcmp(unthreaded_data->Data, data->Data, data->Size) != 0)
+					success = false;
+				
+				const Channel *z_channel = codecs.decodeChannels().findChannel("depth.Z");
+				
+				if(z_channel == NULL || z_channel->type != type)
+					success = false;
+				
+				for(int l=0; l < 2; l++)
+				{
+					FrameBufferPtr output = MakeTestFrame(width, height, type, 4, names, (l == 0 ? LayoutPlanar : LayoutInterleaved), false);
+					
+					codecs.decoder().decompressInto(*data, *output);
+					
+					if( !FramesMatch(*source, *output) )
+						success = false;
+				}
+				
+				// whole rows go straight in, anything narrower through a band of rows
+				for(int r=0; r < 2 && width > 2; r++)
+				{
+					const Box2i region(V2i(r, 1), V2i(width - 1 - r, height - 2));
+					
+					FrameBufferPtr output = MakeTestFrame(width, height, type, 4, names, LayoutPlanar, false);
+					
+					codecs.decoder().decompressRegion(*data, *output, region);
+					
+					if( !RegionMatches(*source, *output, region) )
+						success = false;
+				}
+			}
+		}
+	}
+	
+	return success;
+}
+
+
+static bool
+JPEGLSTest()
+{
+	bool success = true;
+	
+	const char * const names[4] = { "R", "G", "B", "A" };
+	
+	const PixelType types[] = { UINT8, UINT10, UINT12 };
+	const int num_types = sizeof(types) / sizeof(types[0]);
+	
+	// the last is wide enough for several stripes, and tall enough that the
+	// last one comes up short
+	const int widths[] = { 1, 5, 17, 33, 4099 };
+	const int heights[] = { 5, 5, 5, 5, 300 };
+	const int num_sizes = sizeof(widths) / sizeof(widths[0]);
+	
+	for(int t=0; t < num_types; t++)
+	{
+		const PixelType type = types[t];
+		
+		for(int num_channels = 3; num_channels <= 4; num_channels++)
+		{
+			for(int s=0; s < num_sizes; s++)
+			{
+				const int width = widths[s];
+				const int height = heights[s];
+				
+				ChannelList channels;
+				
+				for(int c=0; c < num_channels; c++)
+					channels.insert(names[c], Channel(type));
+				
+				FrameBufferPtr source = MakeTestFrame(width, height, type, num_channels, names, LayoutInterleaved);
+				
+				for(int striped=0; striped < 2; striped++)
+				{
+					Header header(width, height, Rational(24, 1), Rational(0, 1), JPEGLS);
+					
+					JPEGLSCodec::setStriped(header, striped);
+					
+					TestCodecs codecs(header, channels);
+					
+					DataChunkPtr data = codecs.compress(*source);
+					
+					const bool has_magic = (data->Size >= 12 && memcmp(data->Data, "MXLS", 4) == 0);
+					
+					if(has_magic != (striped != 0))
+						success = false;
+					
+					if(has_magic)
+					{
+						const unsigned char *p = data->Data;
+						
+						const unsigned int rows_per_stripe = (p[4] | (p[5] << 8) | (p[6] << 16) | (p[7] << 24));
+						const unsigned int stripe_count = (p[8] | (p[9] << 8) | (p[10] << 16) | (p[11] << 24));
+						
+						if(rows_per_stripe == 0 || stripe_count != (height + rows_per_stripe - 1) / rows_per_stripe)
+							success = false;
+						
+						if(width > 1000 && (stripe_count < 2 || height % rows_per_stripe == 0))
+							success = false;
+						
+						// stripes on the calling thread come out the same
+						JPEGLSCodec::setThreadCount(0);
+						
+						DataChunkPtr unthreaded_data = codecs.compress(*source);
+						
+						FrameBufferPtr output = MakeTestFrame(width, height, type, num_channels, names, LayoutInterleaved, false);
+						
+						codecs.decoder().decompressInto(*data, *output);
+						
+						JPEGLSCodec::setThreadCount(-1);
+						
+						if(unthreaded_data->Size != data->Size || memcmp(unthreaded_data->Data, data->Data, data->Size) != 0)
+							success = false;
+						
+						if( !FramesMatch(*source, *output) )
+							success = false;
+					}
+					
+					// always lossless
+					for(int l=0; l < 2; l++)
+					{
+						FrameBufferPtr output = MakeTestFrame(width, height, type, num_channels, names, (l == 0 ? LayoutInterleaved : LayoutPlanar), false);
+						
+						codecs.decoder().decompressInto(*data, *output);
+						
+						if( !FramesMatch(*source, *output) )
+							success = false;
+					}
+				}
+			}
+		}
+	}
+	
+	return success;
+}
+
+
+// Audio in the StandardAudioChannelList() order, interleaved or one channel
+// after the other.  Random samples, with the ends of the range up front.
+static AudioBufferPtr
+MakeTestAudio(UInt64 length, SampleType type, int channels, bool interleaved, bool fill = true)
+{
+	const size_t sample_size = SampleSize(type);
+	const size_t data_size = std::max<size_t>(length * channels * sample_size, 1);
+	
+	DataChunkPtr data = new DataChunk(data_size);
+	
+	memset(data->Data, 0, data_size);
+	
+	AudioBufferPtr audio = new AudioBuffer(length);
+	
+	audio->attachData(data);
+	
+	char *origin = (char *)data->Data;
+	
+	const std::vector<Name> names = StandardAudioChannelList(channels);
+	
+	for(int i=0; i < channels; i++)
+	{
+		char *base = origin + (interleaved ? (i * sample_size) : (i * length * sample_size));
+		
+		audio->insert(names[i].text(), AudioSlice(type, base, (interleaved ? channels * sample_size : sample_size)));
+	}
+	
+	if(fill)
+	{
+		for(AudioBuffer::Iterator i = audio->begin(); i != audio->end(); ++i)
+		{
+			const AudioSlice &slice = i.slice();
+			
+			for(UInt64 s=0; s < length; s++)
+			{
+				char *sample = slice.base + (s * slice.stride);
+				
+				const int end = (s == 0 ? -1 : s == 1 ? 1 : 0);
+				
+				switch(type)
+				{
+					case UNSIGNED8:
+						*(unsigned char *)sample = (end < 0 ? 0 : end > 0 ? 255 : TestRandom(0xff));
+					break;
+					
+					case SIGNED16:
+						*(short *)sample = (end < 0 ? -32768 : end > 0 ? 32767 : (int)TestRandom(0xffff) - 32768);
+					break;
+					
+					case SIGNED24:
+						*(int *)sample = (end < 0 ? -8388608 : end > 0 ? 8388607 : (int)TestRandom(0xffffff) - 8388608);
+					break;
+					
+					case SIGNED32:
+						*(unsigned int *)sample = (end < 0 ? 0x80000000 : end > 0 ? 0x7fffffff : TestRandom(0xffffffff));
+					break;
+					
+					case AFLOAT:
+						*(float *)sample = (end != 0 ? (float)end : ((float)TestRandom(0xffffff) / 8388608.0f) - 1.0f);
+					break;
+				}
+			}
+		}
+	}
+	
+	return audio;
+}
+
+
+// samples a_start to a_start + length of every channel in a are the same as
+// b_start on in b
+static bool
+AudioMatches(const AudioBuffer &a, UInt64 a_start, const AudioBuffer &b, UInt64 b_start, UInt64 length)
+{
+	for(AudioBuffer::ConstIterator i = a.begin(); i != a.end(); ++i)
+	{
+		const AudioSlice &slice_a = i.slice();
+		const AudioSlice *slice_b = b.findSlice(i.name());
+		
+		if(slice_b == NULL || slice_b->type != slice_a.type)
+			return false;
+		
+		const size_t sample_size = SampleSize(slice_a.type);
+		
+		for(UInt64 s=0; s < length; s++)
+		{
+			const char *sample_a = slice_a.base + ((a_start + s) * slice_a.stride);
+			const char *sample_b = slice_b->base + ((b_start + s) * slice_b->stride);
+			
+			if(memcmp(sample_a, sample_b, sample_size) != 0)
+				return false;
+		}
+	}
+	
+	return true;
+}
+
+
+// TestCodecs for audio
+class TestAudioCodecs
+{
+  public:
+	TestAudioCodecs(const Header &header, const AudioChannelList &channels);
+	~TestAudioCodecs();
+	
+	DataChunkPtr compress(const AudioBuffer &audio);
+	
+	AudioCodec & encoder() { return *_encoder; }
+	AudioCodec & decoder(); // once something has been compressed
+	
+	const AudioChannelList & decodeChannels() { decoder(); return _decodeChannels; }
+
+  private:
+	const AudioCodecInfo &_info;
+	
+	AudioCodec *_encoder;
+	AudioCodec *_decoder;
+	
+	Header _decodeHeader;
+	AudioChannelList _decodeChannels;
+	
+	TestAudioCodecs(const TestAudioCodecs &other);
+	TestAudioCodecs & operator = (const TestAudioCodecs &other);
+};
+
+// the decoder gets the sample rate from the file's header, like InputFile does
+TestAudioCodecs::TestAudioCodecs(const Header &header, const AudioChannelList &channels) :
+	_info(getAudioCodecInfo(header.audioCompression())),
+	_encoder(NULL),
+	_decoder(NULL),
+	_decodeHeader(header)
+{
+	_encoder = _info.createCodec(header, channels);
+}
+
+TestAudioCodecs::~TestAudioCodecs()
+{
+	delete _decoder;
+	delete _encoder;
+}
+
+DataChunkPtr
+TestAudioCodecs::compress(const AudioBuffer &audio)
+{
+	_encoder->compress(audio);
+	
+	return _encoder->getNextData();
+}
+
+AudioCodec &
+TestAudioCodecs::decoder()
+{
+	if(_decoder == NULL)
+		_decoder = _info.createCodec(*_encoder->getDescriptor(), _decodeHeader, _decodeChannels);
+	
+	return *_decoder;
+}
+
+
+static bool
+FLACTest()
+{
+	bool success = true;
+	
+	const SampleType types[] = { UNSIGNED8, SIGNED16, SIGNED24 };
+	const int num_types = sizeof(types) / sizeof(types[0]);
+	
+	const int channel_counts[] = { 1, 2, 6 };
+	const int num_channel_counts = sizeof(channel_counts) / sizeof(channel_counts[0]);
+	
+	// 2002 is a 29.97 frame at 48k, rounded up
+	const UInt64 lengths[] = { 1, 7, 2002, 4099 };
+	const int num_lengths = sizeof(lengths) / sizeof(lengths[0]);
+	
+	for(int t=0; t < num_types; t++)
+	{
+		const SampleType type = types[t];
+		
+		for(int c=0; c < num_channel_counts; c++)
+		{
+			const int num_channels = channel_counts[c];
+			
+			const std::vector<Name> names = StandardAudioChannelList(num_channels);
+			
+			AudioChannelList channels;
+			
+			for(int i=0; i < num_channels; i++)
+				channels.insert(names[i].text(), AudioChannel(type));
+			
+			for(int l=0; l < num_lengths; l++)
+			{
+				const UInt64 length = lengths[l];
+				
+				AudioBufferPtr source = MakeTestAudio(length, type, num_channels, true);
+				
+				// planar audio comes out the same
+				AudioBufferPtr planar = MakeTestAudio(length, type, num_channels, false, false);
+				
+				planar->copyFromBuffer(*source);
+				planar->rewind();
+				
+				for(int level=0; level <= 8; level += 4)
+				{
+					Header header(64, 64, Rational(30000, 1001), Rational(48000, 1), UNCOMPRESSED, FLAC);
+					
+					FLACCodec::setCompressionLevel(header, level);
+					
+					TestAudioCodecs codecs(header, channels);
+					
+					DataChunkPtr data = codecs.compress(*source);
+					
+					if(data->Size < 12 || memcmp(data->Data, "MXFL", 4) != 0)
+					{
+						success = false;
+						
+						continue;
+					}
+					
+					const unsigned char *p = data->Data;
+					
+					if((p[4] | (p[5] << 8) | (p[6] << 16) | ((UInt32)p[7] << 24)) != length || p[8] != num_channels)
+						success = false;
+					
+					DataChunkPtr planar_data = codecs.compress(*planar);
+					
+					// channels on the calling thread come out the same
+					FLACCodec::setThreadCount(0);
+					
+					DataChunkPtr unthreaded_data = codecs.compress(*source);
+					
+					FLACCodec::setThreadCount(-1);
+					
+					if(planar_data->Size != data->Size || memcmp(planar_data->Data, data->Data, data->Size) != 0 ||
+						unthreaded_data->Size != data->Size || memcmp(unthreaded_data->Data, data->Data, data->Size) != 0)
+					{
+						success = false;
+					}
+					
+					AudioCodec &decoder = codecs.decoder();
+					
+					const AudioChannel *channel = codecs.decodeChannels().findChannel(names[0].text());
+					
+					if(codecs.decodeChannels().size() != num_channels || channel == NULL || channel->type != type)
+						success = false;
+					
+					for(UInt64 f=0; f < 5; f++)
+					{
+						if(decoder.samplesInFrame(f, data->Size) != AudioSamplesInFrame(header.frameRate(), header.sampleRate(), f))
+							success = false;
+					}
+					
+					// always lossless
+					decoder.decompress(*data);
+					
+					AudioBufferPtr output = decoder.getNextBuffer();
+					
+					if(!output || output->length() != length || !AudioMatches(*source, 0, *output, 0, length))
+						success = false;
+					
+					// the tail of the frame, into planar audio
+					const UInt64 start = (length / 3);
+					
+					AudioBufferPtr tail = MakeTestAudio(length - start, type, num_channels, false, false);
+					
+					if( !decoder.decompressInto(*data, *tail, start, length - start) || !AudioMatches(*source, start, *tail, 0, length - start) )
+						success = false;
+				}
+			}
+		}
+	}
+	
+	return success;
+}
+
+
+// UncompressedPCMCodec, done the slow way
+
+static int
+GetAudioSample(const AudioSlice &slice, UInt64 s)
+{
+	const char *sample = slice.base + (s * slice.stride);
+	
+	switch(slice.type)
+	{
+		case UNSIGNED8:	return *(const unsigned char *)sample;
+		case SIGNED16:	return *(const short *)sample;
+		default:		return *(const int *)sample;
+	}
+}
+
+
+// little-endian, SampleBits / 8 bytes a sample, the channels interleaved
+static std::vector<unsigned char>
+PackPCMReference(const AudioBuffer &audio, int channels, SampleType type)
+{
+	const std::vector<Name> names = StandardAudioChannelList(channels);
+	
+	const int bytes = SampleBits(type) / 8;
+	
+	std::vector<unsigned char> packed;
+	
+	for(UInt64 s=0; s < audio.length(); s++)
+	{
+		for(int i=0; i < channels; i++)
+		{
+			const unsigned int val = GetAudioSample(audio[names[i].text()], s);
+			
+			for(int b=0; b < bytes; b++)
+				packed.push_back((val >> (8 * b)) & 0xff);
+		}
+	}
+	
+	return packed;
+}
+
+
+static float
+PCMFloatReference(int val, SampleType type)
+{
+	if(type == UNSIGNED8)
+		return ((double)val - 128.0) / 127.0;
+	else
+		return (double)val / (double)((1U << (SampleBits(type) - 1)) - 1);
+}
+
+
+static bool
+PCMTest()
+{
+	bool success = true;
+	
+	const SampleType types[] = { UNSIGNED8, SIGNED16, SIGNED24, SIGNED32 };
+	const int num_types = sizeof(types) / sizeof(types[0]);
+	
+	const int channel_counts[] = { 1, 2, 6 };
+	const int num_channel_counts = sizeof(channel_counts) / sizeof(channel_counts[0]);
+	
+	// the SSE loops go 4 or 8 samples at a time and stop a few short of the end
+	const UInt64 lengths[] = { 1, 2, 3, 5, 7, 9, 17, 2002 };
+	const int num_lengths = sizeof(lengths) / sizeof(lengths[0]);
+	
+	for(int t=0; t < num_types; t++)
+	{
+		const SampleType type = types[t];
+		
+		for(int c=0; c < num_channel_counts; c++)
+		{
+			const int num_channels = channel_counts[c];
+			
+			const std::vector<Name> names = StandardAudioChannelList(num_channels);
+			
+			AudioChannelList channels;
+			
+			for(int i=0; i < num_channels; i++)
+				channels.insert(names[i].text(), AudioChannel(type));
+			
+			for(int l=0; l < num_lengths; l++)
+			{
+				const UInt64 length = lengths[l];
+				
+				Header header(64, 64, Rational(24, 1), Rational(48000, 1), UNCOMPRESSED, PCM);
+				
+				TestAudioCodecs codecs(header, channels);
+				
+				// interleaved audio is packed in one go, planar one channel at a time
+				AudioBufferPtr source = MakeTestAudio(length, type, num_channels, true);
+				
+				AudioBufferPtr planar = MakeTestAudio(length, type, num_channels, false, false);
+				
+				planar->copyFromBuffer(*source);
+				planar->rewind();
+				
+				const std::vector<unsigned char> reference = PackPCMReference(*source, num_channels, type);
+				
+				DataChunkPtr data = codecs.compress(*source);
+				DataChunkPtr planar_data = codecs.compress(*planar);
+				
+				if(data->Size != reference.size() || memcmp(data->Data, &reference[0], data->Size) != 0 ||
+					planar_data->Size != data->Size || memcmp(planar_data->Data, data->Data, data->Size) != 0)
+				{
+					success = false;
+					
+					continue;
+				}
+				
+				AudioCodec &decoder = codecs.decoder();
+				
+				if(decoder.samplesInFrame(0, data->Size) != length)
+					success = false;
+				
+				decoder.decompress(*data);
+				
+				AudioBufferPtr output = decoder.getNextBuffer();
+				
+				if(!output || output->length() != length || !AudioMatches(*source, 0, *output, 0, length))
+					success = false;
+				
+				// Straight into the caller's buffer, part way into the frame.
+				// Interleaved buffers take the SSE path, planar ones the plain
+				// loop, and the floats have to come out the same from both.
+				const UInt64 starts[] = { 0, 1, length / 2 };
+				
+				for(int st=0; st < 3; st++)
+				{
+					const UInt64 start = starts[st];
+					
+					if(start >= length)
+						continue;
+					
+					const UInt64 count = (length - start);
+					
+					for(int interleaved=0; interleaved < 2; interleaved++)
+					{
+						AudioBufferPtr own = MakeTestAudio(count, type, num_channels, interleaved, false);
+						
+						if( !decoder.decompressInto(*data, *own, start, count) || own->remaining() != 0 ||
+							!AudioMatches(*source, start, *own, 0, count) )
+						{
+							success = false;
+						}
+						
+						AudioBufferPtr floats = MakeTestAudio(count, AFLOAT, num_channels, interleaved, false);
+						
+						if( !decoder.decompressInto(*data, *floats, start, count) || floats->remaining() != 0 )
+							success = false;
+						
+						for(int i=0; i < num_channels; i++)
+						{
+							const AudioSlice &source_slice = (*source)[names[i].text()];
+							const AudioSlice &float_slice = (*floats)[names[i].text()];
+							
+							for(UInt64 s=0; s < count; s++)
+							{
+								const float value = *(const float *)(float_slice.base + (s * float_slice.stride));
+								
+								if(value != PCMFloatReference(GetAudioSample(source_slice, start + s), type))
+									success = false;
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+	
+	return success;
+}
+
+
+// Planar, each channel sampled xSampling[i] by ySampling[i] like 4:2:0
+// Y'CbCr or an OpenEXR file.  The data window is at 0, 0, so the samples
+// line up with the pixels.
+static FrameBufferPtr
+MakeSubsampledFrame(int width, int height, PixelType type, int channels, const char * const names[], const int xSampling[], const int ySampling[])
+{
+	const size_t sample_size = PixelSize(type);
+	
+	FrameBufferPtr frame = new FrameBuffer(width, height);
+	
+	for(int i=0; i < channels; i++)
+	{
+		const int plane_width = (width + xSampling[i] - 1) / xSampling[i];
+		const int plane_height = (height + ySampling[i] - 1) / ySampling[i];
+		
+		const size_t rowbytes = plane_width * sample_size;
+		const size_t data_size = rowbytes * plane_height;
+		
+		DataChunkPtr data = new DataChunk(data_size);
+		
+		memset(data->Data, 0, data_size);
+		
+		frame->attachData(data);
+		
+		frame->insert(names[i], Slice(type, (char *)data->Data, sample_size, rowbytes, xSampling[i], ySampling[i]));
+	}
+	
+	FillRandom(*frame);
+	
+	return frame;
+}
+
+
+static bool
+SubsampledReduceTest()
+{
+	bool success = true;
+	
+	const char * const rgb_names[3] = { "R", "G", "B" };
+	const char * const ycbcr_names[3] = { "Y", "Cb", "Cr" };
+	
+	// 4:2:0 and 4:2:2 like MPEG-2, then a mix like an OpenEXR file can have
+	const int x_samplings[3][3] = { { 1, 2, 2 }, { 1, 2, 2 }, { 1, 2, 1 } };
+	const int y_samplings[3][3] = { { 1, 2, 2 }, { 1, 1, 1 }, { 1, 2, 2 } };
+	
+	const int widths[] = { 2, 7, 16, 33 };
+	const int heights[] = { 2, 5, 4, 9 };
+	const int num_sizes = sizeof(widths) / sizeof(widths[0]);
+	
+	for(int s=0; s < 3; s++)
+	{
+		const bool ycbcr = (s < 2);
+		
+		const PixelType type = (ycbcr ? UINT8 : HALF);
+		
+		const char * const *names = (ycbcr ? ycbcr_names : rgb_names);
+		
+		for(int z=0; z < num_sizes; z++)
+		{
+			const int width = widths[z];
+			const int height = heights[z];
+			
+			FrameBufferPtr source = MakeSubsampledFrame(width, height, type, 3, names, x_samplings[s], y_samplings[s]);
+			
+			if(ycbcr)
+				source->coefficients() = FrameBuffer::Rec601;
+			
+			// each sample filling its block, which is what the source should act like
+			FrameBufferPtr full = MakeTestFrame(width, height, type, 3, names, LayoutInterleaved, false);
+			
+			full->coefficients() = source->coefficients();
+			
+			CopySamples(*full, *source);
+			
+			for(int factor=1; factor <= 3; factor++)
+			{
+				const Box2i reducedW = ReducedWindow(source->dataWindow(), factor);
+				
+				const int reduced_width = (reducedW.max.x - reducedW.min.x + 1);
+				const int reduced_height = (reducedW.max.y - reducedW.min.y + 1);
+				
+				// the same channels are filtered straight in, RGB or another
+				// type through a frame like the source
+				for(int d=0; d < 2; d++)
+				{
+					const PixelType out_type = (d == 0 ? type : ycbcr ? UINT8 : FLOAT);
+					
+					const char * const *out_names = (d == 0 ? names : rgb_names);
+					
+					FrameBufferPtr expected = MakeTestFrame(reduced_width, reduced_height, out_type, 3, out_names, LayoutPlanar, false);
+					FrameBufferPtr output = MakeTestFrame(reduced_width, reduced_height, out_type, 3, out_names, LayoutPlanar, false);
+					
+					expected->coefficients() = source->coefficients();
+					output->coefficients() = source->coefficients();
+					
+					expected->reduceFromFrame(*full, factor);
+					
+					output->reduceFromFrame(*source, factor);
+					
+					if( !FramesMatch(*expected, *output) )
+						success = false;
+				}
+			}
+		}
+	}
+	
+	return success;
+}
+
+
+static bool
+OpenEXRTest()
+{
+	bool success = true;
+	
+	const char * const names[3] = { "R", "G", "B" };
+	
+	// full resolution, then G and B subsampled
+	const int x_samplings[2][3] = { { 1, 1, 1 }, { 1, 2, 2 } };
+	const int y_samplings[2][3] = { { 1, 1, 1 }, { 1, 1, 2 } };
+	
+	// OpenEXR wants the data window to divide by the sampling
+	const int widths[] = { 2, 16, 34 };
+	const int heights[] = { 2, 6, 10 };
+	const int num_sizes = sizeof(widths) / sizeof(widths[0]);
+	
+	for(int s=0; s < 2; s++)
+	{
+		for(int z=0; z < num_sizes; z++)
+		{
+			const int width = widths[z];
+			const int height = heights[z];
+			
+			Header header(width, height, Rational(24, 1), Rational(0, 1), OPENEXR);
+			
+			OpenEXRCodec::setCompression(header, Imf::ZIP_COMPRESSION);
+			
+			ChannelList channels;
+			
+			for(int c=0; c < 3; c++)
+				channels.insert(names[c], Channel(HALF, x_samplings[s][c], y_samplings[s][c]));
+			
+			FrameBufferPtr source = MakeSubsampledFrame(width, height, HALF, 3, names, x_samplings[s], y_samplings[s]);
+			
+			// what every read should come back with
+			FrameBufferPtr full = MakeTestFrame(width, height, HALF, 3, names, LayoutPlanar, false);
+			
+			CopySamples(*full, *source);
+			
+			TestCodecs codecs(header, channels);
+			
+			DataChunkPtr data = codecs.compress(*source);
+			
+			// OpenEXR converts HALF to FLOAT by itself, other frames are staged
+			for(int t=0; t < 2; t++)
+			{
+				const PixelType type = (t == 0 ? HALF : FLOAT);
+				
+				FrameBufferPtr expected = MakeTestFrame(width, height, type, 3, names, LayoutInterleaved, false);
+				FrameBufferPtr output = MakeTestFrame(width, height, type, 3, names, LayoutInterleaved, false);
+				
+				expected->copyFromFrame(*full);
+				
+				codecs.decoder().decompressInto(*data, *output);
+				
+				if( !FramesMatch(*expected, *output) )
+					success = false;
+			}
+			
+			// only the last channel, subsampled or not
+			FrameBufferPtr subset = MakeTestFrame(width, height, HALF, 1, &names[2], LayoutPlanar, false);
+			
+			codecs.decoder().decompressInto(*data, *subset);
+			
+			if( !FramesMatch(*subset, *full) )
+				success = false;
+			
+			// whole scanlines straight in, anything narrower through a band
+			for(int r=0; r < 2 && width > 2 && height > 2; r++)
+			{
+				const Box2i region(V2i(r, 1), V2i(width - 1 - r, height - 2));
+				
+				FrameBufferPtr output = MakeTestFrame(width, height, HALF, 3, names, LayoutPlanar, false);
+				
+				codecs.decoder().decompressRegion(*data, *output, region);
+				
+				if( !RegionMatches(*full, *output, region) )
+					success = false;
+			}
+			
+			// scanline files have no levels, so these are box filtered
+			const Box2i reducedW = ReducedWindow(full->dataWindow(), 2);
+			
+			const int reduced_width = (reducedW.max.x - reducedW.min.x + 1);
+			const int reduced_height = (reducedW.max.y - reducedW.min.y + 1);
+			
+			FrameBufferPtr expected = MakeTestFrame(reduced_width, reduced_height, HALF, 3, names, LayoutPlanar, false);
+			FrameBufferPtr output = MakeTestFrame(reduced_width, reduced_height, HALF, 3, names, LayoutPlanar, false);
+			
+			expected->reduceFromFrame(*full, 2);
+			
+			codecs.decoder().decompressReduced(*data, *output, 2);
+			
+			if( !FramesMatch(*expected, *output) )
+				success = false;
+		}
+	}
+	
+	return success;
+}
+
+
+int main(int argc, char * const argv[])
+{
+	bool success = true;
+	
+	try
+	{
+		std::cout << "FrameBufferYUVTest...";
+		const bool yuv_test = FrameBufferYUVTest();
+		std::cout << (yuv_test ? "success" : "failed") << std::endl;
+		if(!yuv_test)
+			success = false;
+		
+		std::cout << "CDCITest...";
+		const bool cdci_test = CDCITest();
+		std::cout << (cdci_test ? "success" : "failed") << std::endl;
+		if(!cdci_test)
+			success = false;
+		
+		std::cout << "UncompressedVideoTest...";
+		const bool uncompressed_test = UncompressedVideoTest();
+		std::cout << (uncompressed_test ? "success" : "failed") << std::endl;
+		if(!uncompressed_test)
+			success = false;
+		
+		std::cout << "PNGTest...";
+		const bool png_test = PNGTest();
+		std::cout << (png_test ? "success" : "failed") << std::endl;
+		if(!png_test)
+			success = false;
+		
+		std::cout << "DPXTest...";
+		const bool dpx_test = DPXTest();
+		std::cout << (dpx_test ? "success" : "failed") << std::endl;
+		if(!dpx_test)
+			success = false;
+		
+		std::cout << "PlanarTest...";
+		const bool planar_test = PlanarTest();
+		std::cout << (planar_test ? "success" : "failed") << std::endl;
+		if(!planar_test)
+			success = false;
+		
+		std::cout << "JPEGLSTest...";
+		const bool jpegls_test = JPEGLSTest();
+		std::cout << (jpegls_test ? "success" : "failed") << std::endl;
+		if(!jpegls_test)
+			success = false;
+		
+		std::cout << "FLACTest...";
+		const bool flac_test = FLACTest();
+		std::cout << (flac_test ? "success" : "failed") << std::endl;
+		if(!flac_test)
+			success = false;
+		
+		std::cout << "PCMTest...";
+		const bool pcm_test = PCMTest();
+		std::cout << (pcm_test ? "success" : "failed") << std::endl;
+		if(!pcm_test)
+			success = false;
+		
+		std::cout << "SubsampledReduceTest...";
+		const bool subsampled_reduce_test = SubsampledReduceTest();
+		std::cout << (subsampled_reduce_test ? "success" : "failed") << std::endl;
+		if(!subsampled_reduce_test)
+			success = false;
+		
+		std::cout << "OpenEXRTest...";
+		const bool openexr_test = OpenEXRTest();
+		std::cout << (openexr_test ? "success" : "failed") << std::endl;
+		if(!openexr_test)
 			success = false;
 		
 		//std::cout << "YCgCoTest...";
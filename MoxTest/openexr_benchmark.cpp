@@ -0,0 +1,114 @@
+/*
+ *  openexr_benchmark.cpp
+ *  MoxFiles
+ *
+ *  Created by agent on 10/18/26.
+ *  Copyright 2026 fnord. All rights reserved.
+ *
+ */
+
+
+/*
+	OpenEXRCodec encode and decode speed and compression ratio for each of
+	OpenEXR's compression methods, on half-float RGBA frames.
+	
+	usage: openexr_benchmark [width height frames]
+*/
+
+
+#include "Benchmark.h"
+
+#include <MoxFiles/OpenEXRCodec.h>
+
+#include <half.h>
+
+#include <iostream>
+#include <iomanip>
+
+using namespace MoxFiles;
+
+
+static const char * const RGBA[4] = { "R", "G", "B", "A" };
+
+
+static void
+RunBenchmark(const FrameBuffer &frame, int frames, Imf::Compression compression, const char *label)
+{
+	const int width = frame.width();
+	const int height = frame.height();
+	
+	std::cout << std::setw(8) << label;
+	
+	try
+	{
+		Header header(width, height, Rational(24, 1), Rational(0, 1), OPENEXR);
+		
+		VideoCodec::setQuality(header, 90);
+		
+		OpenEXRCodec::setCompression(header, compression);
+		
+		ChannelList channels;
+		
+		for(int i=0; i < 4; i++)
+			channels.insert(RGBA[i], Channel(MoxFiles::HALF));
+		
+		FrameBufferPtr output = MakeFrame(width, height, MoxFiles::HALF, 4, RGBA, false);
+		
+		CodecTiming timing;
+		
+		TimeCodec(header, channels, frame, *output, frames, timing);
+		
+		
+		const double raw_size = (double)width * height * 4 * sizeof(half) * frames;
+		
+		std::cout << std::fixed << std::setprecision(2);
+		std::cout << std::setw(10) << (frames / timing.encodeTime) << " fps enc";
+		std::cout << std::setw(10) << (frames / timing.decodeTime) << " fps dec";
+		std::cout << std::setw(10) << (raw_size / timing.compressedSize) << ":1";
+		
+		if(OpenEXRCodec::getCompression(timing.decodeHeader) != compression)
+			std::cout << "  (compression not in descriptor)";
+		
+		std::cout << std::endl;
+	}
+	catch(std::exception &e)
+	{
+		std::cout << "  failed: " << e.what() << std::endl;
+	}
+}
+
+
+int main(int argc, char * const argv[])
+{
+	int width = 3840;
+	int height = 2160;
+	int frames = 10;
+	
+	BenchmarkSize(argc, argv, width, height, frames);
+	
+	std::cout << width << "x" << height << " half RGBA, " << frames << " frames" << std::endl;
+	
+	try
+	{
+		FrameBufferPtr frame = MakeFrame(width, height, MoxFiles::HALF, 4, RGBA);
+		
+		RunBenchmark(*frame, frames, Imf::NO_COMPRESSION, "none");
+		RunBenchmark(*frame, frames, Imf::RLE_COMPRESSION, "RLE");
+		RunBenchmark(*frame, frames, Imf::ZIPS_COMPRESSION, "ZIPS");
+		RunBenchmark(*frame, frames, Imf::ZIP_COMPRESSION, "ZIP");
+		RunBenchmark(*frame, frames, Imf::PIZ_COMPRESSION, "PIZ");
+		RunBenchmark(*frame, frames, Imf::PXR24_COMPRESSION, "PXR24");
+		RunBenchmark(*frame, frames, Imf::B44_COMPRESSION, "B44");
+		RunBenchmark(*frame, frames, Imf::B44A_COMPRESSION, "B44A");
+		RunBenchmark(*frame, frames, Imf::DWAA_COMPRESSION, "DWAA");
+		RunBenchmark(*frame, frames, Imf::DWAB_COMPRESSION, "DWAB");
+	}
+	catch(std::exception &e)
+	{
+		std::cout << "Exception thrown: " << e.what() << std::endl;
+		
+		return -1;
+	}
+	
+	return 0;
+}
@@ -0,0 +1,125 @@
+/*
+ *  planar_benchmark.cpp
+ *  MoxFiles
+ *
+ *  Created by agent on 10/18/26.
+ *  Copyright 2026 fnord. All rights reserved.
+ *
+ */
+
+
+/*
+	PlanarCodec encode and decode speed and compression ratio with zstd at a
+	few levels and LZ4, against OpenEXR's PIZ, on half-float frames with an
+	extra channel that isn't R, G, B or A.
+	
+	usage: planar_benchmark [width height frames]
+*/
+
+
+#include "Benchmark.h"
+
+#include <MoxFiles/PlanarCodec.h>
+#include <MoxFiles/OpenEXRCodec.h>
+
+#include <half.h>
+
+#include <iostream>
+#include <iomanip>
+
+using namespace MoxFiles;
+
+
+static const char * const ChannelNames[5] = { "R", "G", "B", "A", "depth.Z" };
+
+
+static void
+RunBenchmark(const FrameBuffer &frame, int frames, VideoCompression compression, int setting, const char *label)
+{
+	const int width = frame.width();
+	const int height = frame.height();
+	
+	std::cout << std::setw(8) << label;
+	
+	try
+	{
+		Header header(width, height, Rational(24, 1), Rational(0, 1), compression);
+		
+		if(compression == PLANAR)
+		{
+			if(setting > 0)
+			{
+				PlanarCodec::setCompressor(header, PlanarCodec::CompressorZstd);
+				PlanarCodec::setCompressionLevel(header, setting);
+			}
+			else
+				PlanarCodec::setCompressor(header, PlanarCodec::CompressorLZ4);
+		}
+		else
+			OpenEXRCodec::setCompression(header, Imf::PIZ_COMPRESSION);
+		
+		// OpenEXRCodec only does one-letter channels
+		const int num_channels = (compression == PLANAR ? 5 : 4);
+		
+		ChannelList channels;
+		
+		for(int i=0; i < num_channels; i++)
+			channels.insert(ChannelNames[i], Channel(MoxFiles::HALF));
+		
+		FrameBufferPtr output = MakeFrame(width, height, MoxFiles::HALF, 5, ChannelNames, false);
+		
+		CodecTiming timing;
+		
+		TimeCodec(header, channels, frame, *output, frames, timing);
+		
+		
+		if(timing.decodeChannels.size() != num_channels)
+			std::cout << "  (channels not in descriptor)";
+		
+		if(compression == PLANAR && !FramesMatch(frame, *output))
+			std::cout << "  (decoded frame doesn't match)";
+		
+		const double raw_size = (double)width * height * num_channels * sizeof(half) * frames;
+		
+		std::cout << std::fixed << std::setprecision(2);
+		std::cout << std::setw(10) << (frames / timing.encodeTime) << " fps enc";
+		std::cout << std::setw(10) << (frames / timing.decodeTime) << " fps dec";
+		std::cout << std::setw(10) << (raw_size / timing.decodeTime) / (1024 * 1024 * 1024) << " GB/s dec";
+		std::cout << std::setw(10) << (raw_size / timing.compressedSize) << ":1" << std::endl;
+	}
+	catch(std::exception &e)
+	{
+		std::cout << "  failed: " << e.what() << std::endl;
+	}
+}
+
+
+int main(int argc, char * const argv[])
+{
+	int width = 3840;
+	int height = 2160;
+	int frames = 10;
+	
+	BenchmarkSize(argc, argv, width, height, frames);
+	
+	std::cout << width << "x" << height << " half RGBA + depth, " << frames << " frames" << std::endl;
+	
+	try
+	{
+		FrameBufferPtr frame = MakeFrame(width, height, MoxFiles::HALF, 5, ChannelNames);
+		
+		RunBenchmark(*frame, frames, PLANAR, 1, "zstd 1");
+		RunBenchmark(*frame, frames, PLANAR, 3, "zstd 3");
+		RunBenchmark(*frame, frames, PLANAR, 9, "zstd 9");
+		RunBenchmark(*frame, frames, PLANAR, 0, "LZ4");
+		RunBenchmark(*frame, frames, OPENEXR, 0, "PIZ");
+	}
+	catch(std::exception &e)
+	{
+		std::cout << "Exception thrown: " << e.what() << std::endl;
+		
+		return -1;
+	}
+	
+	return 0;
+}
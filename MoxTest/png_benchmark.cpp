@@ -0,0 +1,163 @@
+/*
+ *  png_benchmark.cpp
+ *  MoxFiles
+ *
+ *  Created by agent on 10/18/26.
+ *  Copyright 2026 fnord. All rights reserved.
+ *
+ */
+
+
+/*
+	PNGCodec decode speed, against reading the same frames the way it used to:
+	new libpng read structs for every frame, fed through a read callback, with
+	libpng swapping 16-bit samples and writing into a fresh buffer.
+	
+	usage: png_benchmark [width height frames]
+*/
+
+
+#include "Benchmark.h"
+
+#include <MoxFiles/PNGCodec.h>
+
+#include "png.h"
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+
+#include <string.h>
+
+using namespace MoxFiles;
+
+
+static const char * const RGBA[4] = { "R", "G", "B", "A" };
+
+
+struct ReadSource
+{
+	const DataChunk *chunk;
+	size_t pos;
+};
+
+
+static void png_read_callback(png_structp png_ptr, png_bytep data, png_size_t length)
+{
+	ReadSource *source = (ReadSource *)png_get_io_ptr(png_ptr);
+	
+	if(length > source->chunk->Size - source->pos)
+		png_error(png_ptr, "Read past end");
+	
+	memcpy(data, source->chunk->Data + source->pos, length);
+	
+	source->pos += length;
+}
+
+
+static void
+ReadWithLibPNG(const DataChunk &data, int width, int height, int channels, int bit_depth)
+{
+	const size_t rowbytes = width * channels * (bit_depth / 8);
+	
+	DataChunkPtr frame_data = new PooledDataChunk(rowbytes * height);
+	
+	ReadSource source = { &data, 0 };
+	
+	png_structp png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	
+	png_infop info_ptr = png_create_info_struct(png_ptr);
+	
+	png_set_read_fn(png_ptr, &source, png_read_callback);
+	
+	if(setjmp(png_jmpbuf(png_ptr)))
+	{
+		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+		
+		throw MoxMxf::IoExc("Problem reading PNG file");
+	}
+	
+	png_read_info(png_ptr, info_ptr);
+	
+	if(bit_depth == 16)
+		png_set_swap(png_ptr);
+	
+	std::vector<png_bytep> row_pointers(height);
+	
+	for(int y=0; y < height; y++)
+		row_pointers[y] = (png_bytep)(frame_data->Data + (y * rowbytes));
+	
+	png_read_image(png_ptr, &row_pointers[0]);
+	
+	png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+}
+
+
+static void
+RunBenchmark(int width, int height, int frames, int channels, PixelType type, const char *label)
+{
+	std::cout << std::setw(8) << label;
+	
+	try
+	{
+		FrameBufferPtr frame = MakeFrame(width, height, type, channels, RGBA);
+		
+		Header header(width, height, Rational(24, 1), Rational(0, 1), PNG);
+		
+		PNGCodec::setParallelDeflate(header, true);
+		
+		ChannelList channel_list;
+		
+		for(int i=0; i < channels; i++)
+			channel_list.insert(RGBA[i], Channel(type));
+		
+		FrameBufferPtr output = MakeFrame(width, height, type, channels, RGBA, false);
+		
+		CodecTiming timing;
+		
+		TimeCodec(header, channel_list, *frame, *output, frames, timing);
+		
+		
+		const int bit_depth = (type == UINT16 ? 16 : 8);
+		
+		const double libpng_start = Seconds();
+		
+		for(int i=0; i < frames; i++)
+		{
+			ReadWithLibPNG(*timing.compressed[i], width, height, channels, bit_depth);
+		}
+		
+		const double libpng_time = Seconds() - libpng_start;
+		
+		
+		if( !FramesMatch(*frame, *output) )
+			std::cout << "  (decoded frame doesn't match)";
+		
+		std::cout << std::fixed << std::setprecision(2);
+		std::cout << std::setw(10) << (frames / libpng_time) << " fps libpng";
+		std::cout << std::setw(10) << (frames / timing.decodeTime) << " fps direct" << std::endl;
+	}
+	catch(std::exception &e)
+	{
+		std::cout << "  failed: " << e.what() << std::endl;
+	}
+}
+
+
+int main(int argc, char * const argv[])
+{
+	int width = 3840;
+	int height = 2160;
+	int frames = 10;
+	
+	BenchmarkSize(argc, argv, width, height, frames);
+	
+	std::cout << width << "x" << height << ", " << frames << " frames" << std::endl;
+	
+	RunBenchmark(width, height, frames, 3, UINT8, "RGB8");
+	RunBenchmark(width, height, frames, 4, UINT8, "RGBA8");
+	RunBenchmark(width, height, frames, 3, UINT16, "RGB16");
+	RunBenchmark(width, height, frames, 4, UINT16, "RGBA16");
+	
+	return 0;
+}